@@ -0,0 +1,154 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include <functional>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+
+namespace gep
+{
+    struct IoPriority
+    {
+        enum Enum
+        {
+            Background,
+            Normal,
+            High,
+            /// e.g. data the current frame is waiting for
+            Critical,
+            Count
+        };
+    };
+
+    struct IoStatus
+    {
+        enum Enum
+        {
+            /// all requested bytes were read
+            Completed,
+            /// the file could not be opened or read, or it ended before all bytes were read
+            Failed,
+            /// the request was cancelled before it was started
+            Cancelled
+        };
+    };
+
+    struct IoBackend
+    {
+        enum Enum
+        {
+            /// io_uring where the kernel supports it, the thread pool otherwise
+            Default,
+            /// blocking positional reads on a pool of threads
+            ThreadPool,
+            /// linux io_uring, falls back to the thread pool if the kernel refuses
+            IoUring
+        };
+    };
+
+    typedef uint32 IoRequestId;
+    /// \brief never returned for a valid request
+    static const IoRequestId INVALID_IO_REQUEST = 0;
+
+    /// \brief a read of a part of a file into a buffer owned by the caller
+    struct IoReadRequest
+    {
+        std::string filename;
+        uint64 offset;
+        size_t size;
+        /// has to stay valid until the callback was called
+        void* pDestination;
+        IoPriority::Enum priority;
+        /// called exactly once, on an io thread (or in cancel for cancelled requests)
+        std::function<void(IoStatus::Enum status, size_t bytesRead)> onComplete;
+
+        IoReadRequest() : offset(0), size(0), pDestination(nullptr), priority(IoPriority::Normal) {}
+    };
+
+    class AsyncIoBackend;
+    struct AsyncIoBatch;
+
+    /// \brief asynchronous file reads, serviced in priority order by a background io backend
+    ///
+    /// Pending reads of the same file which directly follow each other are coalesced into a single
+    /// vectored read. Callbacks run on the io threads, anything expensive should be handed on to a
+    /// JobQueue so that the disk keeps being busy.
+    class GEP_API AsyncIo
+    {
+        friend class AsyncIoBackend;
+        friend struct AsyncIoBatch;
+    private:
+        struct Request
+        {
+            IoRequestId id;
+            IoReadRequest desc;
+            bool cancelled;
+        };
+
+        /// one fifo per priority, cancelled requests are removed lazily
+        std::deque<Request*> m_pending[IoPriority::Count];
+        std::unordered_map<IoRequestId, Request*> m_pendingById;
+        std::mutex m_mutex;
+        std::condition_variable m_requestAvailable;
+        std::condition_variable m_idle;
+        uint32 m_numOutstanding;
+        IoRequestId m_nextId;
+        bool m_stopping;
+        size_t m_maxCoalescedSize;
+
+        std::atomic<uint32> m_numReadsIssued;
+        std::atomic<uint32> m_numRequestsCompleted;
+
+        AsyncIoBackend* m_pBackend;
+
+        Request* popHighestPriority();
+        Request* removePendingAdjacent(const std::string& filename, uint64 offset, bool before);
+
+        /// \brief takes the most important pending request and everything it can be coalesced with
+        /// \return false if the service is stopping and there is nothing left to do
+        bool takeBatch(AsyncIoBatch& batch, bool wait);
+        /// \brief distributes the result of a batch read to the requests and calls their callbacks
+        void completeBatch(AsyncIoBatch& batch, bool success, size_t bytesRead);
+
+        //non-copyable
+        AsyncIo(const AsyncIo& rh);
+        void operator = (const AsyncIo& rh);
+
+    public:
+        /// \brief starts the io service
+        /// \param numThreads
+        ///   number of threads for the thread pool backend, 0 picks a default
+        AsyncIo(uint32 numThreads = 0, IoBackend::Enum backend = IoBackend::Default);
+
+        /// \brief finishes all pending requests and stops the io threads
+        ~AsyncIo();
+
+        /// \brief queues a read
+        /// \return id which can be used to cancel the request
+        IoRequestId read(IoReadRequest request);
+
+        /// \brief cancels a request which has not been started yet, its callback is called with IoStatus::Cancelled
+        /// \return true if the request was cancelled, false if it already started or finished
+        bool cancel(IoRequestId id);
+
+        /// \brief blocks until all requests have been completed and their callbacks returned
+        void waitUntilIdle();
+
+        /// \brief reads which directly follow each other are only coalesced up to this size
+        void setMaxCoalescedSize(size_t size);
+
+        /// \brief name of the backend in use, for logging
+        const char* getBackendName() const;
+
+        /// \brief number of reads handed to the operating system, lower than the number of requests if reads were coalesced
+        inline uint32 getNumReadsIssued() const { return m_numReadsIssued.load(); }
+        inline uint32 getNumRequestsCompleted() const { return m_numRequestsCompleted.load(); }
+    };
+}
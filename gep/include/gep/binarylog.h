@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include <cstdarg>
+
+namespace gep
+{
+    /// \brief layout of the files written by ILogging in binary mode
+    ///
+    /// A file starts with the 8 byte magic, the version and a reserved uint32. It is followed by
+    /// records which all start with a uint8 RecordType:
+    ///   formatString: uint64 formatId, uint16 length, characters (not null terminated)
+    ///   message:      int64 timestamp, uint8 channel, uint64 formatId, uint16 argsSize, packed arguments
+    ///   text:         int64 timestamp, uint8 channel, uint16 length, characters (not null terminated)
+    /// The formatId of a message refers to the last formatString record with the same id that came
+    /// before it. Timestamps are microseconds since the epoch. All values are little endian.
+    namespace BinaryLog
+    {
+        static const char MAGIC[8] = { 'G', 'E', 'P', 'B', 'L', 'O', 'G', '\0' };
+        static const uint32 VERSION = 1;
+
+        enum class RecordType : uint8
+        {
+            formatString = 1,
+            message = 2,
+            text = 3
+        };
+    }
+
+    /// \brief stores the arguments belonging to a printf style format string without formatting them
+    ///
+    /// Integers, characters and pointers are stored as 8 byte integers, floating point values as double,
+    /// strings are copied with a uint16 length prefix (cut to the precision if one is given). Arguments
+    /// which do not fit into the buffer anymore are left out.
+    /// \return the number of bytes written into pBuffer
+    GEP_API size_t packLogArguments(const char* fmt, va_list args, char* pBuffer, size_t bufferSize);
+
+    /// \brief formats arguments stored by packLogArguments with the same format string
+    ///
+    /// Arguments missing in the packed data are replaced with "<truncated>".
+    /// \return the length of the result, which is always null terminated
+    GEP_API size_t formatPackedLogArguments(const char* fmt, const char* pArgs, size_t argsSize, char* pOut, size_t outSize);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+
+namespace gep
+{
+    /// \brief CRC32C (Castagnoli), with the SSE4.2 crc32 instruction if the CPU has it
+    /// \param previous
+    ///   the checksum of the data in front, so that data can be checked in pieces:
+    ///   crc32c(b, sizeB, crc32c(a, sizeA)) is the checksum of a followed by b
+    GEP_API uint32 crc32c(const void* data, size_t size, uint32 previous = 0);
+
+    /// \brief if crc32c uses the crc32 instruction
+    GEP_API bool hasHardwareCrc32c();
+}
@@ -2,11 +2,28 @@
 
 #include "gep/memory/allocator.h"
 #include "gep/file.h"
+#include "gep/vfs.h"
 #include "gep/container/DynamicArray.h"
 #include "gep/traits.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace gep
 {
+    class JobQueue;
+
+    struct ChunkCompression
+    {
+        enum Enum
+        {
+            None,
+            /// \brief the LZ4 block format, see Lz4
+            Lz4
+        };
+    };
+
     class GEP_API Chunkfile
     {
     public:
@@ -14,41 +31,209 @@ namespace gep
         {
             read,
             write,
-            modify
+            modify,
+            /// \brief reads from a memory mapping of the file, arrays can be read without a copy
+            mapped
+        };
+
+        /// \brief where a chunk is, as recorded in the chunk index at the end of the file
+        struct ChunkIndexEntry
+        {
+            /// the names of the parent chunks and the chunk separated by '/', e.g. "thModel/bones"
+            std::string path;
+            /// position of the chunk header in the file
+            uint64 offset;
+            /// bytes of chunk data following the header, the compressed size for compressed chunks
+            uint32 length;
+            /// CRC32C of the chunk data as it is stored, without the nested chunks which have their own checksum
+            uint32 checksum;
+
+            ChunkIndexEntry() : offset(0), length(0), checksum(0) {}
         };
 
     private:
         Operation m_operation;
-        ArrayPtr<uint8> m_oldData;
+        /// the mapped file contents when mapped or read from a pak archive
+        ArrayPtr<uint8> m_mappedData;
         uint8* m_readLocation;
+        /// the file which is read, the original file when modifying, not open for files in pak archives
         RawFile m_file;
+        /// the file which is written, a temporary file which replaces the original when modifying
+        RawFile m_outputFile;
+        /// the file in mapped operation or when reading from a pak archive
+        VfsFile m_vfsFile;
         std::string m_filename;
+        std::string m_temporaryFilename;
         uint32 m_version;
 
         static const uint32 MAX_CHUNK_NAME_LENGTH = 27;
+        /// \brief set in the name length of compressed chunks, so that readers which do not know compression fail
+        static const uint8 COMPRESSED_CHUNK_FLAG = 0x80;
+        /// \brief written data is collected up to this size before it goes to the file
+        static const size_t WRITE_BLOCK_SIZE = 4 * 1024 * 1024;
+
+        /// the written data which is not in the file yet, only allocated when writing
+        std::unique_ptr<uint8[]> m_pWriteBuffer;
+        size_t m_writeBufferSize;
+        size_t m_writeBufferUsed;
+        /// bytes of the file in front of the write buffer
+        uint64 m_flushedBytes;
+        /// something could not be written, the file is incomplete
+        bool m_writeFailed;
+
+        inline uint64 writePosition() const
+        {
+            return m_flushedBytes + m_writeBufferUsed;
+        }
+
+        /// while a compressed chunk is open the write buffer counts as full, so that all its data goes through writeBlock
+        inline void bufferWrite(const void* data, size_t size)
+        {
+            if(size <= m_writeBufferSize - m_writeBufferUsed)
+            {
+                memcpy(m_pWriteBuffer.get() + m_writeBufferUsed, data, size);
+                m_writeBufferUsed += size;
+            }
+            else
+                writeBlock(data, size);
+        }
+
+        /// \brief writes what does not fit into the write buffer anymore, or collects the data of a compressed chunk
+        void writeBlock(const void* data, size_t size);
+        void flushWriteBuffer();
+
+        /// \brief advances the read location in memory
+        /// \return the data which was skipped or nullptr if there is not enough data left
+        inline uint8* consumeData(size_t bytes)
+        {
+            size_t bytesRemaining = static_cast<size_t>((m_mappedData.getPtr() + m_mappedData.length()) - m_readLocation);
+            // a truncated file is a data error, not a programming error
+            if(bytes > bytesRemaining)
+                return nullptr;
+            uint8* pData = m_readLocation;
+            m_readLocation += bytes;
+            return pData;
+        }
 
         struct ChunkReadInfo
         {
             char name[MAX_CHUNK_NAME_LENGTH];
             uint8 nameLength;
+            /// decompressed bytes for compressed chunks
             uint32 bytesLeft;
+            bool compressed;
+            uint64 headerOffset;
 
-            ChunkReadInfo() : nameLength(0), bytesLeft(0) {}
+            ChunkReadInfo() : nameLength(0), bytesLeft(0), compressed(false), headerOffset(0) {}
         };
 
         struct ChunkWriteInfo
         {
             size_t lengthPosition;
             size_t length;
+            size_t indexEntry;
+            uint32 checksum;
+            ChunkCompression::Enum compression;
+            uint8 shuffleElementSize;
+
+            ChunkWriteInfo() : lengthPosition(0), length(0), indexEntry(0), checksum(0),
+                compression(ChunkCompression::None), shuffleElementSize(0) {}
+        };
+
+        /// \brief the compressed chunk which is being read, compressed chunks can not be nested
+        struct CompressedReadInfo
+        {
+            /// the length of the chunk in the file
+            uint32 storedLength;
+            /// the stored data after the compression header, in memory or in storedCopy
+            const uint8* pStored;
+            size_t storedSize;
+            std::vector<uint8> storedCopy;
+            uint8 shuffleElementSize;
+            uint32 uncompressedSize;
+            /// the whole decompressed chunk, only decompressed when the chunk is not read in one piece
+            std::vector<uint8> decompressed;
+            bool isDecompressed;
+            /// views into decompressed were handed out, so it has to be kept
+            bool hasViews;
 
-            ChunkWriteInfo() : lengthPosition(0), length(0) {}
+            CompressedReadInfo() : storedLength(0), pStored(nullptr), storedSize(0), shuffleElementSize(0), uncompressedSize(0),
+                isDecompressed(false), hasViews(false) {}
         };
 
         DynamicArray<ChunkReadInfo> m_readInfo;
         DynamicArray<ChunkWriteInfo> m_writeInfo;
 
+        /// the chunks written so far, for the chunk index
+        std::vector<ChunkIndexEntry> m_writtenChunks;
+        /// the chunk index of the file, loaded on first use
+        std::vector<ChunkIndexEntry> m_index;
+        /// the index entries of every path in the loaded index
+        std::unordered_map<std::string, std::vector<uint32>> m_indexPaths;
+        /// the index entries by the offset of their chunk header
+        std::unordered_map<uint64, uint32> m_indexOffsets;
+        bool m_writeIndex;
+        bool m_indexLoaded;
+        bool m_verifyChecksums;
+        /// chunk headers count for the length of the parent chunk but not for its checksum
+        bool m_writingHeader;
+        /// the data written from here on is not in the checksum of the current chunk yet
+        uint64 m_checksumStart;
+
+        /// the data of the compressed chunk which is being written
+        std::vector<uint8> m_uncompressedChunk;
+        CompressedReadInfo m_compressedRead;
+        /// chunks decompressed by decompressChunksInParallel by the offset of their header
+        std::unordered_map<uint64, std::vector<uint8>> m_predecompressed;
+        /// decompressed chunks which views were read from in mapped operation
+        std::vector<std::vector<uint8>> m_keptDecompressed;
+
+        /// \brief accounts written bytes to the length of the current chunk
+        inline void addWritten(size_t size)
+        {
+            if(m_writeInfo.length() > 0)
+                m_writeInfo.lastElement().length += size;
+        }
+        /// \brief adds the data written since m_checksumStart to the checksum of the current chunk
+        ///
+        /// The checksums are updated in whole ranges of the write buffer instead of for every write.
+        void updateWriteChecksum();
+        /// \brief reads at the given position without moving the read location
+        size_t readAt(uint64 offset, void* pDestination, size_t size);
+        Result writeChunkIndex();
+        Result loadChunkIndex();
+
+        /// \brief computes the checksum of a chunk of the index from the file
+        /// \param pFile
+        ///   read from instead of m_file in read operation if not null, so that chunks can be checked on other threads
+        Result computeChecksum(size_t entryIndex, RawFile* pFile, uint32& checksum);
+        Result verifyIndexEntry(size_t entryIndex, RawFile* pFile);
+
+        void endWriteCompressedChunk(ChunkWriteInfo& info);
+        Result startReadCompressedChunk(uint64 headerOffset, ChunkReadInfo& info);
+        Result decompressCurrentChunk();
+        size_t readDecompressed(void* pDestination, size_t size);
+        uint8* readDecompressedView(size_t size);
+
+        /// \brief if reads go through m_file instead of memory
+        inline bool readsFromFile() const
+        {
+            return m_file.isOpen();
+        }
+
+        inline bool readingCompressedChunk() const
+        {
+            return m_readInfo.length() > 0 && m_readInfo.lastElement().compressed;
+        }
+
+        //non-copyable
+        Chunkfile(const Chunkfile& rh);
+        void operator = (const Chunkfile& rh);
+
     public:
         /// \brief creates or opens a chunkfile
+        ///
+        /// Files are read through the VirtualFileSystem, files in pak archives are read from the mapping of the archive.
         Chunkfile(const char* filename, Operation operation);
         ~Chunkfile();
 
@@ -57,6 +242,15 @@ namespace gep
             return m_operation;
         }
 
+        inline bool isOpen() const
+        {
+            if(m_operation == Operation::write)
+                return m_outputFile.isOpen();
+            if(m_operation == Operation::modify)
+                return m_file.isOpen() && m_outputFile.isOpen();
+            return m_file.isOpen() || m_vfsFile.isOpen();
+        }
+
         void skipRead(size_t bytes);
 
         template <typename T>
@@ -65,17 +259,21 @@ namespace gep
             static_assert(isArrayPtr<T>::value == false, "for reading arrays use readArray");
             GEP_ASSERT(m_operation != Operation::write, "can not read in write operation");
             GEP_ASSERT(m_readInfo.length() == 0 || m_readInfo.lastElement().bytesLeft >= sizeof(T), "reading over chunk boundary");
+            if(readingCompressedChunk())
+                return readDecompressed(&val, sizeof(T));
             size_t size = 0;
-            if(m_operation == Operation::read)
+            if(readsFromFile())
             {
                 size = m_file.read(val);
             }
             else
             {
-                GEP_ASSERT(m_readLocation + sizeof(T) <= m_oldData.getPtr() + m_oldData.length(), "out of bounds");
-                val = *(T*)(m_readLocation);
+                // the data in memory is not aligned
+                const uint8* pData = consumeData(sizeof(T));
+                if(pData == nullptr)
+                    return 0;
+                memcpy(&val, pData, sizeof(T));
                 size = sizeof(T);
-                m_readLocation += sizeof(T);
             }
             if(m_readInfo.length() > 0)
                 m_readInfo.lastElement().bytesLeft -= (uint32)size;
@@ -87,33 +285,51 @@ namespace gep
         {
             GEP_ASSERT(m_operation != Operation::write, "can not read in write operation");
             GEP_ASSERT(m_readInfo.length() == 0 || m_readInfo.lastElement().bytesLeft >= sizeof(T) * val.length(), "reading over chunk boundary");
+            if(readingCompressedChunk())
+                return readDecompressed(val.getPtr(), sizeof(T) * val.length());
 
             size_t size;
-            if(m_operation == Operation::read)
+            if(readsFromFile())
             {
                 size = m_file.readArray(val.getPtr(), val.length());
             }
             else
             {
-                if(m_readLocation + sizeof(T) * val.length() <= m_oldData.getPtr() + m_oldData.length())
-                {
-                    GEP_ASSERT(false, "out of bounds");
+                const uint8* pData = consumeData(sizeof(T) * val.length());
+                if(pData == nullptr)
                     return 0;
-                }
-                val.copyFrom(ArrayPtr<T>((T*)m_readLocation, val.length()));
                 size = sizeof(T) * val.length();
-                m_readLocation += size;
+                if(size > 0)
+                    memcpy(val.getPtr(), pData, size);
             }
             if(m_readInfo.length() > 0)
                 m_readInfo.lastElement().bytesLeft -= (uint32)size;
             return size;
         }
 
+        /// \brief reads an array without copying it, only possible in mapped operation
+        ///
+        /// \return a view into the mapping which stays valid as long as the chunkfile, or an empty array on error.
+        ///   The data is only aligned to what the file layout gives it.
+        ///   Views into compressed chunks point to the decompressed chunk, which is kept as long as the chunkfile.
+        template <typename T>
+        ArrayPtr<T> readArrayView(size_t length)
+        {
+            GEP_ASSERT(m_operation == Operation::mapped, "views can only be read in mapped operation");
+            GEP_ASSERT(m_readInfo.length() == 0 || m_readInfo.lastElement().bytesLeft >= sizeof(T) * length, "reading over chunk boundary");
+            uint8* pData = readingCompressedChunk() ? readDecompressedView(sizeof(T) * length) : consumeData(sizeof(T) * length);
+            if(pData == nullptr)
+                return ArrayPtr<T>();
+            if(m_readInfo.length() > 0)
+                m_readInfo.lastElement().bytesLeft -= (uint32)(sizeof(T) * length);
+            return ArrayPtr<T>(reinterpret_cast<T*>(pData), length);
+        }
+
         /// \brief Allocates and reads a array of a given type from the chunk file
         /// \param pAllocator
-        ///   the allocator to use
+        ///   the allocator to use, the array is copied in mapped operation as well, so that it can outlive the chunkfile
         ///
-        /// \return the correctly initialized array or an empty array on error
+        /// \return the correctly initialized array or an empty array on error.
         template <typename T, typename SizeType>
         ArrayPtr<T> readAndAllocateArray(IAllocator* pAllocator)
         {
@@ -143,25 +359,26 @@ namespace gep
         size_t write(const T& val)
         {
             static_assert(isArrayPtr<T>::value == false, "for writing arrays use writeArray");
-            GEP_ASSERT(m_operation != Operation::read, "can not write in read operation");
-            size_t size = m_file.write(val);
-            GEP_ASSERT(size == sizeof(T), "writing failed");
-            if(m_writeInfo.length() > 0)
-                m_writeInfo.lastElement().length += size;
-            return size;
+            GEP_ASSERT(m_operation != Operation::read && m_operation != Operation::mapped, "can not write in read operation");
+            bufferWrite(&val, sizeof(T));
+            addWritten(sizeof(T));
+            return sizeof(T);
         }
 
         template <class T>
         size_t writeArray(ArrayPtr<T> val)
         {
-            GEP_ASSERT(m_operation != Operation::read, "can not write in read operation");
-            size_t size = m_file.writeArray(val.getPtr(), val.length());
-            GEP_ASSERT(size == sizeof(T) * val.length(), "writing failed");
-            if(m_writeInfo.length() > 0)
-                m_writeInfo.lastElement().length += size;
+            GEP_ASSERT(m_operation != Operation::read && m_operation != Operation::mapped, "can not write in read operation");
+            size_t size = sizeof(T) * val.length();
+            bufferWrite(val.getPtr(), size);
+            addWritten(size);
             return size;
         }
 
+        /// \brief stops modifying, the original file is kept as it is
+        ///
+        /// Without discarding the modified file replaces the original when the chunkfile is destroyed,
+        /// unless something could not be written to it.
         void discardChanges();
         Result startReadChunk();
 
@@ -185,25 +402,80 @@ namespace gep
 
         void endReadChunk();
 
-        void startWriteChunk(const char* name);
-        size_t endWriteChunk();
+        /// \param compression
+        ///   how the data of the chunk is compressed, compressed chunks can not contain other chunks.
+        ///   Data which does not get smaller is stored uncompressed. Reading decompresses transparently.
+        /// \param shuffleElementSize
+        ///   if not 0 the data is shuffled with shuffleBytes before it is compressed, e.g. 4 for arrays of floats
+        void startWriteChunk(const char* name, ChunkCompression::Enum compression = ChunkCompression::None, uint8 shuffleElementSize = 0);
+
+        /// \return FAILURE if anything written so far could not be written to the file, e.g. because the disk is full
+        Result endWriteChunk();
 
         /**
-        * keeps the rest of the current chunk and ends the chunk
+        * copies the rest of the chunk which is read into the chunk which is written and ends both chunks
         */
         void keepRestOfCurrentChunk();
 
+        /// \brief copies the chunk which was just started for reading unchanged into the file which is written and ends it
+        ///
+        /// Only possible in modify operation before anything was read from the chunk. The chunk and the chunks
+        /// nested in it keep their entries in the chunk index and are copied without going through memory where possible.
+        void keepCurrentChunk();
+
         /**
         * skips the rest of the current chunk and ends it
         */
         void skipCurrentChunk();
 
-        void startWriting(const char* filetype, uint32 ver);
+        /// \param writeIndex
+        ///   if endWriting appends a chunk index, which allows to open chunks directly with findChunk and openChunkAt
+        void startWriting(const char* filetype, uint32 ver, bool writeIndex = true);
 
-        void endWriting();
+        /// \return FAILURE if anything could not be written to the file, the file is incomplete then
+        Result endWriting();
 
         Result startReading(const char* filetype);
 
         void endReading();
+
+        /// \brief looks a chunk up in the chunk index, without reading through the chunks before it
+        /// \param path
+        ///   the names of the chunk and its parents separated by '/', starting with the file type
+        /// \param occurrence
+        ///   which of the chunks with the same path, in the order they were written
+        /// \return nullptr if the file has no index or no such chunk
+        const ChunkIndexEntry* findChunk(const char* path, size_t occurrence = 0);
+
+        /// \brief the entries of the chunk index in the order the chunks were started, nullptr if the file has no index
+        const std::vector<ChunkIndexEntry>* getChunkIndex();
+
+        /// \brief starts reading the chunk of the given index entry, no other chunk may be open
+        ///
+        /// Reading continues after the chunk once it is ended.
+        Result openChunkAt(const ChunkIndexEntry& entry);
+
+        /// \brief checks every chunk against its checksum in the chunk index when it is started,
+        /// startReadChunk and openChunkAt fail for corrupted chunks and chunks which are not in the index
+        ///
+        /// Chunks which are skipped are still read for the check. In read operation the data is read twice.
+        inline void setVerifyChecksums(bool verify)
+        {
+            m_verifyChecksums = verify;
+        }
+
+        /// \brief checks a chunk against its checksum, the entry has to be from getChunkIndex or findChunk
+        Result verifyChunk(const ChunkIndexEntry& entry);
+
+        /// \brief checks all chunks against their checksums and stops at the first corrupted one
+        /// \param pJobQueue
+        ///   if not null the chunks are checked on the job queue, this blocks until they are done
+        /// \return FAILURE if a chunk is corrupted or the file has no chunk index, e.g. because it was cut off
+        Result verifyChecksums(JobQueue* pJobQueue = nullptr);
+
+        /// \brief decompresses all compressed chunks of the chunk index on the job queue, blocks until they are done
+        ///
+        /// Reading the chunks afterwards only copies the decompressed data. Does nothing if the file has no index.
+        Result decompressChunksInParallel(JobQueue& jobQueue);
     };
 }
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+
+namespace gep
+{
+    /// \brief compression in the LZ4 block format, fast enough to decompress while loading
+    struct GEP_API Lz4
+    {
+        /// \brief the size the compressed data can have at most
+        static size_t getMaxCompressedSize(size_t size);
+
+        /// \brief compresses a block
+        /// \param destinationSize
+        ///   has to be at least getMaxCompressedSize(sourceSize)
+        /// \return the size of the compressed data
+        static size_t compress(const uint8* pSource, size_t sourceSize, uint8* pDestination, size_t destinationSize);
+
+        /// \brief decompresses a block, malformed data is detected and never read or written out of bounds
+        /// \return the size of the decompressed data, which is not destinationSize if the data was malformed
+        static size_t decompress(const uint8* pSource, size_t sourceSize, uint8* pDestination, size_t destinationSize);
+    };
+
+    /// \brief groups the bytes of an array by their position in the element, first all first bytes, then
+    /// all second bytes and so on. Arrays of floats or small integers compress much better like this.
+    ///
+    /// Bytes after the last whole element are copied unchanged.
+    GEP_API void shuffleBytes(const uint8* pSource, uint8* pDestination, size_t size, size_t elementSize);
+
+    /// \brief reverses shuffleBytes
+    GEP_API void unshuffleBytes(const uint8* pSource, uint8* pDestination, size_t size, size_t elementSize);
+}
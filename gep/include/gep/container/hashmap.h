@@ -79,11 +79,7 @@ namespace gep
         {
             // We can savely devide the pointer by the architectures default alignment because almost all pointers will be aligned
             // Pointers that are not aligned will cause a hash collision
-            #ifdef _M_X64 //x64
-            return (reinterpret_cast<unsigned int>(ptr) / 8) % 0xFFFFFFFF;
-            #else //X86
-            return reinterpret_cast<unsigned int>(ptr) / 4;
-            #endif
+            return static_cast<unsigned int>(reinterpret_cast<uintptr_t>(ptr) / sizeof(void*));
         }
 
         static bool equals(const void* lhs, const void* rhs)
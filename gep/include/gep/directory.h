@@ -1,11 +1,29 @@
 #pragma once
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <gep/types.h>
 #include <functional>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#ifndef _WIN32
+#include <thread>
+#endif
 
 namespace gep
 {
+    /// \brief reports changes to the files in a directory
+    ///
+    /// Modifications are delivered once the file is ready to be loaded: repeated modifications of the same file
+    /// are merged into one, which is only reported after no more changes came in for the debounce time.
+    /// On Linux a thread waits for inotify events and only counts a file as written once it was closed
+    /// (or moved into place). If events were lost because the inotify queue overflowed, the directories are
+    /// watched anew and every file in them is reported as modified. On Windows the changes are collected whenever enumerateChanges is called
+    /// and a modification is held back as long as the file can not be opened for reading.
     class DirectoryWatcher
     {
     public:
@@ -33,23 +51,84 @@ namespace gep
         {
             enum Enum
             {
+#ifdef _WIN32
               added = FILE_ACTION_ADDED,
               removed = FILE_ACTION_REMOVED,
               modified = FILE_ACTION_MODIFIED,
               renamedOldName = FILE_ACTION_RENAMED_OLD_NAME,
               renamedNewName = FILE_ACTION_RENAMED_NEW_NAME
+#else
+              added = 1,
+              removed = 2,
+              modified = 3,
+              renamedOldName = 4,
+              renamedNewName = 5
+#endif
             };
         };
 
     private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Change
+        {
+            std::string filename;
+            Action::Enum action;
+        };
+
+        struct PendingModification
+        {
+            /// the file is still open for writing, it is not reported before it was closed
+            bool writing;
+            Clock::time_point readyTime;
+        };
+
+        std::string m_path;
+        WatchSubdirs::Enum m_watchSubdirs;
+        Clock::duration m_debounceTime;
+        /// how long a file which is open for writing may stay unchanged before it is reported anyway
+        Clock::duration m_writeTimeout;
+        /// modifications waiting for the debounce time to pass, by filename relative to the watched path
+        std::unordered_map<std::string, PendingModification> m_pendingModifications;
+        /// changes ready to be enumerated
+        std::deque<Change> m_changes;
+        std::mutex m_changesMutex;
+
+        void addChange(const std::string& filename, Action::Enum action);
+        void modified(const std::string& filename, bool writing, Clock::time_point now);
+        /// \brief moves the modifications which are ready to m_changes
+        /// \return the time at which the next pending modification will be ready, or Clock::time_point::max()
+        Clock::time_point releaseModifications(Clock::time_point now);
+
+#ifdef _WIN32
         HANDLE m_directoryHandle;
         HANDLE m_completionPort;
-        WatchSubdirs::Enum m_watchSubdirs;
         DWORD m_filter;
         OVERLAPPED m_overlapped;
         char m_buffer[4096];
 
         void doRead();
+        void readChanges();
+#else
+        int m_inotify;
+        /// wakes the thread up to stop it
+        int m_wakeEvent;
+        uint32 m_watch;
+        uint32 m_mask;
+        /// the watched directories by their inotify watch descriptor, relative to the watched path with a trailing '/'
+        std::unordered_map<int, std::string> m_directories;
+        std::thread m_thread;
+
+        void addWatch(const std::string& directory);
+        /// \brief watches the directories anew and reports every file in them, after events were lost
+        void rescan(Clock::time_point now);
+        void watchLoop();
+        void handleEvents(const char* pBuffer, size_t size);
+#endif
+
+        //non-copyable
+        DirectoryWatcher(const DirectoryWatcher& rh);
+        void operator = (const DirectoryWatcher& rh);
 
     public:
         /// \brief constructor
@@ -59,13 +138,19 @@ namespace gep
         ///   if the subdirectoriers should be watched or not
         /// \param watch
         ///   a combination of Watch::Enum flags or 0
-        DirectoryWatcher(const char* path, WatchSubdirs::Enum watchSubdirs, uint32 watch);
+        /// \param debounceMilliseconds
+        ///   how long a file has to stay unchanged before its modification is reported
+        /// \param writeTimeoutMilliseconds
+        ///   how long a file which is still open for writing has to stay unchanged before it is reported anyway,
+        ///   in case the notification that it was closed got lost
+        DirectoryWatcher(const char* path, WatchSubdirs::Enum watchSubdirs, uint32 watch, uint32 debounceMilliseconds = 50,
+            uint32 writeTimeoutMilliseconds = 10000);
 
         ~DirectoryWatcher();
 
-        /// \brief interates over all changes that occured since the last iteration
+        /// \brief interates over all changes that occured since the last iteration, does not wait for files which are still being written
         /// \param func
-        ///    the callback function to call for each change
+        ///    the callback function to call for each change, the filename is relative to the watched path
         void enumerateChanges(std::function<void(const char* filename, Action::Enum action)> func);
     };
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "gep/gepmodule.h"
+#include "gep/types.h"
+#include "gep/arrayptr.h"
 #include <stdio.h>
 
 namespace gep
@@ -8,10 +10,31 @@ namespace gep
 
     /**
     * wrapper around C FILE for raw file handling
+    * opens the path on the disk as it is, VirtualFileSystem::openLoose opens files through the mounts
     */
     struct RawFile {
         FILE* m_pHandle;
 
+        /// \brief ftell with 64 bit offsets
+        static inline int64 tell(FILE* pHandle)
+        {
+#ifdef _WIN32
+            return _ftelli64(pHandle);
+#else
+            return ftello(pHandle);
+#endif
+        }
+
+        /// \brief fseek with 64 bit offsets
+        static inline int seekTo(FILE* pHandle, int64 offset, int origin)
+        {
+#ifdef _WIN32
+            return _fseeki64(pHandle, offset, origin);
+#else
+            return fseeko(pHandle, offset, origin);
+#endif
+        }
+
         /**
         * opens a file
         * Params:
@@ -124,11 +147,11 @@ namespace gep
         {
             if( m_pHandle != nullptr)
             {
-                auto cur = ftell(m_pHandle);
-                fseek(m_pHandle, 0, SEEK_END);
-                auto len = ftell(m_pHandle);
-                fseek(m_pHandle, cur, SEEK_SET);
-                return len;
+                auto cur = tell(m_pHandle);
+                seekTo(m_pHandle, 0, SEEK_END);
+                auto len = tell(m_pHandle);
+                seekTo(m_pHandle, cur, SEEK_SET);
+                return static_cast<size_t>(len);
             }
             return 0;
         }
@@ -140,7 +163,7 @@ namespace gep
         {
             if(m_pHandle != nullptr)
             {
-                return ftell(m_pHandle);
+                return static_cast<size_t>(tell(m_pHandle));
             }
             return 0;
         }
@@ -152,7 +175,7 @@ namespace gep
         {
             if( m_pHandle != nullptr)
             {
-                fseek(m_pHandle, static_cast<int>(position), SEEK_SET);
+                seekTo(m_pHandle, static_cast<int64>(position), SEEK_SET);
             }
         }
 
@@ -163,7 +186,7 @@ namespace gep
         {
             if(m_pHandle != nullptr)
             {
-                fseek(m_pHandle, 0, SEEK_END);
+                seekTo(m_pHandle, 0, SEEK_END);
             }
         }
 
@@ -174,7 +197,7 @@ namespace gep
         {
             if(m_pHandle != nullptr)
             {
-                fseek(m_pHandle, static_cast<int>(bytes), SEEK_CUR);
+                seekTo(m_pHandle, static_cast<int64>(bytes), SEEK_CUR);
             }
         }
 
@@ -186,6 +209,61 @@ namespace gep
         }
     };
 
+    /// \brief a whole file mapped read only into memory
+    ///
+    /// Reading the data only causes page faults instead of a system call and a copy per read.
+    class GEP_API MappedFile
+    {
+    public:
+        struct AccessPattern
+        {
+            enum Enum
+            {
+                Normal,
+                /// read once from the start to the end, the pages are read ahead and dropped early
+                Sequential,
+                Random
+            };
+        };
+
+    private:
+        uint8* m_pData;
+        uint64 m_size;
+        bool m_isOpen;
+#ifdef _WIN32
+        void* m_fileHandle;
+        void* m_mappingHandle;
+#endif
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator = (const MappedFile&);
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /// \brief maps the given file, an already mapped file is unmapped first
+        Result open(const char* filename, AccessPattern::Enum accessPattern = AccessPattern::Sequential);
+        void close();
+
+        inline bool isOpen() const { return m_isOpen; }
+        inline uint64 getSize() const { return m_size; }
+        /// \brief the contents of the file, stays valid until the file is closed
+        inline ArrayPtr<uint8> getData() const { return ArrayPtr<uint8>(m_pData, static_cast<size_t>(m_size)); }
+    };
+
+    /// \brief appends a range of one file to another, done by the operating system without a copy through memory where it can
+    /// \param sourceOffset
+    ///   where the range starts in source, the position of source does not change
+    /// \return the number of bytes copied, less than size if source ends before
+    GEP_API uint64 copyFileRange(RawFile& source, uint64 sourceOffset, uint64 size, RawFile& destination);
+
+    /// \brief makes sure that everything written to the file is on the disk
+    GEP_API Result flushToDisk(RawFile& file);
+
+    /// \brief replaces destination with source in one step, destination is either the old or the new file even after a crash
+    GEP_API Result replaceFile(const char* source, const char* destination);
+
     /// \brief checks if the given file exists
     GEP_API bool fileExists(const char* pathToFile);
 
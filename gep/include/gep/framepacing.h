@@ -0,0 +1,79 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+
+namespace gep
+{
+    /// \brief accumulates frame time and hands it out in steps of a fixed length
+    ///
+    /// If the frames take too long for the simulation to keep up, at most maxStepsPerFrame steps are
+    /// run per frame and the remaining time is dropped, the simulation then runs slower than real time
+    /// instead of spiraling into ever longer frames.
+    class GEP_API FixedTimestep
+    {
+    private:
+        double m_stepTime;
+        double m_accumulator;
+        uint32 m_maxStepsPerFrame;
+        uint64 m_numDroppedSteps;
+
+    public:
+        FixedTimestep(float tickRate = 60.0f, uint32 maxStepsPerFrame = 5);
+
+        /// \param tickRate steps per second
+        void setTickRate(float tickRate);
+        void setMaxStepsPerFrame(uint32 maxStepsPerFrame);
+        inline float getStepTime() const { return static_cast<float>(m_stepTime); }
+        inline uint32 getMaxStepsPerFrame() const { return m_maxStepsPerFrame; }
+
+        /// \brief adds the time of a frame
+        /// \return the number of steps to simulate in this frame
+        uint32 advance(float frameTime);
+
+        /// \brief how far the time has moved on from the last step towards the next one, between 0 and 1
+        ///
+        /// Rendering should interpolate between the last two simulated states with this.
+        inline float getInterpolationAlpha() const { return static_cast<float>(m_accumulator / m_stepTime); }
+
+        /// \brief number of steps which were skipped because a frame needed more than maxStepsPerFrame
+        inline uint64 getNumDroppedSteps() const { return m_numDroppedSteps; }
+
+        void reset();
+    };
+
+    /// \brief keeps frames from being shorter than a target frame time
+    ///
+    /// Sleeps most of the remaining time and spin-waits only the last part, the length of that part is
+    /// adapted to how late the operating system wakes the thread up. Deadlines are spaced by the target
+    /// time from the previous deadline rather than from the end of the wait, so the frame rate does not drift.
+    class GEP_API FrameLimiter
+    {
+    private:
+        uint64 m_targetTicks;
+        uint64 m_nextDeadline;
+        /// the sleep aims this many ticks before the deadline
+        uint64 m_spinTicks;
+        /// average of how late sleeps wake up, in ticks
+        double m_averageOversleep;
+        bool m_timerResolutionRaised;
+
+        //non-copyable
+        FrameLimiter(const FrameLimiter& rh);
+        void operator = (const FrameLimiter& rh);
+
+    public:
+        FrameLimiter();
+        ~FrameLimiter();
+
+        /// \param seconds 0 disables the limiter
+        void setTargetFrameTime(float seconds);
+        float getTargetFrameTime() const;
+
+        /// \brief waits until the target frame time has passed since the previous call
+        void waitForNextFrame();
+
+        /// \brief blocks until Timer::getCurrentTicks reaches the given value, sleeping as long as it is safe
+        void waitUntil(uint64 deadline);
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include <vector>
+#include <deque>
+#include <utility>
+
+namespace gep
+{
+    /// \brief the parts a frame of the update framework is made of
+    struct FramePhase
+    {
+        enum Enum
+        {
+            UpdateCallbacks,
+            ResourceUpdate,
+            Render,
+            Count
+        };
+    };
+
+    /// \brief rolling statistics over the last frames
+    ///
+    /// Mean, variance, min, max and averages over the newest frames are O(1). Percentiles come from a
+    /// histogram with logarithmic buckets (about 5.5% wide), so they are approximations that cost a
+    /// walk over the buckets. All times are in seconds.
+    class GEP_API FrameTimeStats
+    {
+    public:
+        static const uint32 NUM_HISTOGRAM_BUCKETS = 256;
+
+    private:
+        struct Frame
+        {
+            float total;
+            float phases[FramePhase::Count];
+        };
+
+        /// ring buffer of the last frames
+        std::vector<Frame> m_history;
+        /// m_cumulative[i] is the sum of all frame times up to and including ring slot i, for O(1) averages
+        std::vector<double> m_cumulative;
+        size_t m_newest;
+        size_t m_numFrames;
+        uint64 m_frameNumber;
+
+        double m_sum;
+        double m_sumOfSquares;
+        double m_phaseSums[FramePhase::Count];
+        uint32 m_histogram[NUM_HISTOGRAM_BUCKETS];
+
+        /// monotonic queues of (frame number, time) for the sliding min and max
+        std::deque<std::pair<uint64, float>> m_minQueue;
+        std::deque<std::pair<uint64, float>> m_maxQueue;
+
+        static uint32 getBucket(float frameTime);
+        static float getBucketLowerBound(uint32 bucket);
+        void recomputeSums();
+
+    public:
+        /// \param historyLength number of frames the statistics are taken over
+        FrameTimeStats(size_t historyLength = 600);
+
+        /// \brief clears the history and changes its length
+        void setHistoryLength(size_t historyLength);
+        inline size_t getHistoryLength() const { return m_history.size(); }
+
+        /// \brief adds a frame, the oldest one drops out if the history is full
+        /// \param phaseTimes time of each FramePhase, may be null
+        void addFrame(float frameTime, const float* phaseTimes = nullptr);
+        void clear();
+
+        /// \brief number of frames currently in the history
+        inline size_t getNumFrames() const { return m_numFrames; }
+
+        float getNewest() const;
+        float getMean() const;
+        float getVariance() const;
+        float getStandardDeviation() const;
+        float getMin() const;
+        float getMax() const;
+        /// \param percentile between 0 and 100
+        float getPercentile(float percentile) const;
+        /// \brief mean time of a phase over the history
+        float getPhaseMean(FramePhase::Enum phase) const;
+        /// \brief average over the newest numFrames frames (or all frames if there are fewer)
+        float calcAverage(size_t numFrames) const;
+
+        /// \brief writes the history, oldest frame first, with all times in milliseconds
+        Result writeCsv(const char* filename) const;
+    };
+}
@@ -73,6 +73,6 @@ namespace gep
 }
 
 #define g_globalManager gep::GlobalManager::instance()
-#define g_logMessage(msg) gep::GlobalManager::instance().getLogging()->logMessage(msg)
-#define g_logWarning(msg) gep::GlobalManager::instance().getLogging()->logWarning(msg)
-#define g_logError(msg) gep::GlobalManager::instance().getLogging()->logError(msg)
+#define g_logMessage(...) gep::GlobalManager::instance().getLogging()->logMessage(__VA_ARGS__)
+#define g_logWarning(...) gep::GlobalManager::instance().getLogging()->logWarning(__VA_ARGS__)
+#define g_logError(...) gep::GlobalManager::instance().getLogging()->logError(__VA_ARGS__)
@@ -1,6 +1,5 @@
 #pragma once
 #include "gep/interfaces/subsystem.h"
-#include <map>
 
 
 namespace gep
@@ -16,18 +15,22 @@ namespace gep
     {
     public:
         virtual ~ILogSink() {}
+        /// \brief receives one complete line (timestamp, channel and message) without line break
+        ///
+        /// Only ever called from the logging writer thread.
         virtual void take(LogChannel channel, const char* msg) = 0;
+        /// \brief writes out everything the sink buffered so far
+        virtual void flush() {}
 
 		static inline const char* logChannelChar(LogChannel channel)
 		{
-			const std::map<LogChannel, const char*> enumStrings{
-				{LogChannel::message, "Message"},
-				{LogChannel::warning, "Warning"},
-				{LogChannel::error, "Error"}
-			};
-
-			auto found = enumStrings.find(channel);
-			return found == enumStrings.end() ? "Out of range" : found->second;
+			switch (channel)
+			{
+			case LogChannel::message: return "Message";
+			case LogChannel::warning: return "Warning";
+			case LogChannel::error: return "Error";
+			}
+			return "Out of range";
 		}
     };
 
@@ -44,6 +47,15 @@ namespace gep
 
         virtual void registerSink(ILogSink* pSink) = 0;
         virtual void deregisterSink(ILogSink* pSink) = 0;
+		/// \brief blocks until everything logged so far reached the sinks and they are flushed
+        virtual void flush() = 0;
+
+		/// \brief switches to deferred formatting, messages are written in binary form to the given file
+		///
+		/// The log functions then only copy the arguments, gep_logdecode turns the file into text later on.
+		/// Warnings and errors still reach the sinks. Format strings have to be string literals in this mode
+		/// because only their address is stored. Passing nullptr switches back to formatting right away.
+		virtual Result setBinaryLogFile(const char* pFilename) = 0;
 
     };
 }
@@ -75,6 +75,17 @@ namespace gep
     {
     public:
         virtual ~IRendererExtractor(){}
+
+        /// \brief starts a named region, it shows up as a zone in the profiler
+        /// \param name has to stay valid until the profiling data was collected, a string literal usually
+        virtual void beginDebugMarker(const char* name) = 0;
+        /// \brief ends the region started last by beginDebugMarker
+        virtual void endDebugMarker() = 0;
+
+        /// \brief set by the update framework each frame, objects extract their state interpolated by it
+        virtual void setInterpolationAlpha(float alpha) = 0;
+        /// \brief 0 means the state of the previous fixed step, 1 the state of the last one
+        virtual float getInterpolationAlpha() const = 0;
     };
 
 
@@ -1,22 +1,167 @@
 #pragma once
 
 #include "gep/interfaces/subsystem.h"
+#include "gep/weakptr.h"
+#include <string>
+#include <atomic>
+#include <functional>
+#include <type_traits>
 
 namespace gep
 {
     //forward reference
     class IResource;
     class IResourceLoader;
+    class AsyncIo;
     template <class T>
     struct ResourcePtr;
+}
+
+// the weak table of all resources lives in the gep dll
+DeclareWeakRefStaticMembers(gep::IResource, GEP_API)
+
+namespace gep
+{
+    struct ResourceFinalize
+    {
+        enum Enum
+        {
+            NotRequired  = 0,
+            NotYet       = 0x00000001,
+            FromRenderer = 0x00000002,
+            FromTest     = 0x00000004
+        };
+    };
 
 
     class IResource
+        : public WeakReferenced<IResource>
     {
         friend class IResourceManager;
     public:
+        /// \brief returns the loader which created this resource
+        virtual IResourceLoader* getLoader() = 0;
+        /// \brief stes the loader which created this resource
+        virtual void setLoader(IResourceLoader* loader) = 0;
+        /// \brief unloads the resource
+        virtual void unload() = 0;
+        /// \brief finalizes the resource (e.g. upload a texture to vram)
+        virtual void finalize() = 0;
+        /// \brief returns the finalize options \see ResourceFinalize
+        virtual uint32 getFinalizeOptions() = 0;
+        /// \brief checks if this resource is loaded or not
+        virtual bool isLoaded() = 0;
+        /// \brief returns the resource this subresource is part of
+        virtual IResource* getSuperResource() = 0;
+        /// \brief creates a resource pointer from this resource
+        template <class T>
+        ResourcePtr<T> makeResourcePtrFromThis()
+        {
+            #ifdef _DEBUG
+            auto ptr = dynamic_cast<T*>(this);
+            #else
+            auto ptr = static_cast<T*>(this);
+            #endif
+            return ResourcePtr<T>(ptr, false);
+        }
+    };
+
+    struct GEP_API ResourcePtrBase
+    {
+    protected:
+        WeakPtr<IResource> m_ptr;
+
+    public:
+        uint32 getWeakRefIndex()
+        {
+            return m_ptr.getWeakRefIndex();
+        }
     };
 
+    /// \brief points to a resource
+    template <class T>
+    struct ResourcePtr : public ResourcePtrBase
+    {
+        friend class IResourceManager;
+        friend class IResource;
+
+        template <class U>
+        friend struct ResourcePtr;
+    protected:
+        ResourcePtr(T* ptr, bool isDummy)
+        {
+            GEP_ASSERT(ptr != nullptr, "can not create resource pointer from null");
+            if(isDummy)
+                m_ptr.setWithNewIndex(ptr);
+            else
+                m_ptr = ptr;
+        }
+
+        ResourcePtr(WeakPtr<IResource> ptr)
+        {
+            m_ptr = ptr;
+        }
+
+        void invalidateAndReplace(T* ptr)
+        {
+            m_ptr.invalidateAndReplace(ptr);
+        }
+
+        void releaseDummyIndex()
+        {
+            m_ptr.releaseNewIndex();
+        }
+
+    public:
+        ResourcePtr() {}
+
+        template <class U>
+        ResourcePtr(ResourcePtr<U>& other)
+        {
+            static_assert(std::is_base_of<T, U>::value, "U is not a base of T");
+            m_ptr = other.m_ptr;
+        }
+
+        inline operator T*()
+        {
+            GEP_ASSERT(m_ptr.get() != nullptr, "accessing invalid resource pointer");
+            return static_cast<T*>(m_ptr.get());
+        }
+
+        inline T* operator ->()
+        {
+            GEP_ASSERT(m_ptr.get() != nullptr, "accessing invalid resource pointer");
+            return static_cast<T*>(m_ptr.get());
+        }
+
+        inline bool isValid() const
+        {
+            return m_ptr.get() != nullptr;
+        }
+
+        inline T* get()
+        {
+            return static_cast<T*>(m_ptr.get());
+        }
+
+        template <class U>
+        ResourcePtr<T>& operator = (ResourcePtr<U>& other)
+        {
+            static_assert(std::is_base_of<T, U>::value, "U is not a base of T");
+            m_ptr = other.m_ptr;
+            return *this;
+        }
+
+        template <class TO>
+        ResourcePtr<TO> castTo()
+        {
+            #ifdef _DEBUG
+            auto* ptr = dynamic_cast<TO*>(m_ptr.get());
+            GEP_ASSERT(ptr != nullptr, "casting to wrong type");
+            #endif
+            return ResourcePtr<TO>(m_ptr);
+        }
+    };
 
     /// \brief class which is responsible for loading resources
     class IResourceLoader
@@ -24,16 +169,139 @@ namespace gep
 		friend class ResourceManager;
     public:
         virtual ~IResourceLoader() {}
+		IResourceLoader(const char* resourceId) : m_resourceId(resourceId) { }
+        /// \brief loads a resource
+        /// \param pInPlace, if the resource should be loaded in place (may be null)
+        ///
+        /// When loaded with loadResourceAsync this runs on a job thread, it must not use the
+        /// immediate device context or anything else that belongs to the main thread.
+        virtual IResource* loadResource(IResource* pInPlace) = 0;
+        /// \brief called before an asynchronous loadResource, which is started once onDone was called
+        ///
+        /// Loaders can issue the reads of their files on io here so that the job thread does not wait for the disk.
+        /// onDone may be called on any thread, the default calls it right away.
+        virtual void prefetch(AsyncIo& io, std::function<void()> onDone) { onDone(); }
+        /// \brief returns the type of resources this loader loads
+        virtual const char* getResourceType() = 0;
+        /// \brief returns the id of the resource. Resources with the same id are only loaded once
+        const char* getResourceId() const { return m_resourceId.c_str(); }
+        /// \brief deletes a resource
+        virtual void deleteResource(IResource* pResource) = 0;
+        /// \brief creates a duplicate of this resource loader
+        virtual IResourceLoader* moveToHeap() = 0;
+        /// \brief deletes this resource loader (previoulsy created with moveToHeap)
+        virtual void release() = 0;
+        /// \brief gets called after each load operation
+        virtual void postLoad(ResourcePtr<IResource> pResource) = 0;
+	protected:
+		std::string m_resourceId;
     };
 
+	/// \brief can be used to simplify concrete resource loaders
+	#define GEP_RESOURCELOADER_DEFAULT_FUNCTIONS(classType, resourceType) \
+		virtual const char* getResourceType() override { return resourceType; } \
+		virtual classType* moveToHeap() override { return new classType(*static_cast<classType*>(this)); } \
+		virtual void release() override { delete this; }
+
+    /// \brief tracks a group of asynchronous loads, e.g. everything a level needs for a loading screen
+    ///
+    /// Has to stay alive until all loads of the batch are done.
+    class ResourceLoadBatch
+    {
+        friend class ResourceManager;
+    private:
+        std::atomic<uint32> m_numQueued;
+        std::atomic<uint32> m_numFinished;
+        std::atomic<uint32> m_numFailed;
+
+        //non-copyable
+        ResourceLoadBatch(const ResourceLoadBatch& rh);
+        void operator = (const ResourceLoadBatch& rh);
+
+    public:
+        ResourceLoadBatch() : m_numQueued(0), m_numFinished(0), m_numFailed(0) {}
+
+        ~ResourceLoadBatch()
+        {
+            GEP_ASSERT(isDone(), "load batch destroyed while some of its loads are still running");
+        }
+
+        /// \brief number of loads added to the batch
+        inline uint32 getNumQueued() const { return m_numQueued.load(); }
+        /// \brief number of loads which completed (successful or not) and were swapped in
+        inline uint32 getNumFinished() const { return m_numFinished.load(); }
+        /// \brief number of loads which failed, their resource pointers keep pointing at the dummy
+        inline uint32 getNumFailed() const { return m_numFailed.load(); }
+
+        inline bool isDone() const { return getNumFinished() == getNumQueued(); }
+
+        /// \brief progress between 0 and 1
+        inline float getProgress() const
+        {
+            uint32 numQueued = getNumQueued();
+            return (numQueued == 0) ? 1.0f : static_cast<float>(getNumFinished()) / static_cast<float>(numQueued);
+        }
+    };
 
     /// \brief interface for the resource manager
     class IResourceManager : public ISubsystem
     {
+    protected:
+        virtual ResourcePtr<IResource> doLoadResource(IResourceLoader& loader) = 0;
+        virtual ResourcePtr<IResource> doLoadResourceAsync(IResourceLoader& loader, ResourceLoadBatch* pBatch) = 0;
+
+        inline static void invalidateAndReplace(ResourcePtr<IResource>& ptr, IResource* replaceWith)
+        {
+            ptr.invalidateAndReplace(replaceWith);
+        }
+
+        /// \brief releases the own weak reference slot of a handle which still points to its dummy
+        inline static void releaseDummyReference(ResourcePtr<IResource>& ptr)
+        {
+            ptr.releaseDummyIndex();
+        }
+
+        inline static ResourcePtr<IResource> makeResourcePtr(IResource* pResource, bool isDummy)
+        {
+            GEP_ASSERT(pResource != nullptr);
+            return ResourcePtr<IResource>(pResource, isDummy);
+        }
     public:
         virtual ~IResourceManager() {}
 
 
+        /// \brief reloads a resource with the loader which created it
+        ///
+        /// A resource whose load failed is loaded again and replaces the dummy. Loads which are still in flight are not touched.
+        virtual void reloadResource(ResourcePtr<IResource> pResource) = 0;
+
+        /// \brief loads a resource
+        template <class T>
+        inline ResourcePtr<T> loadResource(IResourceLoader& loader)
+        {
+            return doLoadResource(loader).castTo<T>();
+        }
+
+        /// \brief starts loading a resource on the io and job threads
+        ///
+        /// Returns right away with a pointer to the dummy resource of the type. Once the load finished,
+        /// update or waitForBatch swap the real resource in and the returned pointer refers to it.
+        /// If the load fails the pointer keeps pointing at the dummy.
+        /// \param pBatch
+        ///   optional batch the load is added to
+        template <class T>
+        inline ResourcePtr<T> loadResourceAsync(IResourceLoader& loader, ResourceLoadBatch* pBatch = nullptr)
+        {
+            return doLoadResourceAsync(loader, pBatch).castTo<T>();
+        }
+
+        /// \brief swaps in finished asynchronous loads until every load of the batch is done
+        ///
+        /// Has to be called from the thread that calls update.
+        /// \param timeoutMs
+        ///   0 only swaps in what is finished already, 0xFFFFFFFF waits as long as it takes
+        /// \return SUCCESS if the batch is done, FAILURE if the timeout elapsed before
+        virtual Result waitForBatch(ResourceLoadBatch& batch, uint32 timeoutMs = 0xFFFFFFFF) = 0;
 
         /// \brief deletes a resource
         virtual void deleteResource(IResource* pResource) = 0;
@@ -51,5 +319,11 @@ namespace gep
         /// \brief finalizes resources with a given set of flags
         virtual void finalizeResourcesWithFlags(uint32 flags) = 0;
 
+        /// \brief registers a resource loader for a file changed event so that the assoicated resource will be
+        ///  be reloaded as soon as the file changes
+        virtual void registerLoaderForReload(const std::string& filename, IResourceLoader* pLoader, ResourcePtr<IResource> pResource) = 0;
+
+        /// \brief deregisters a previously registered resource loader
+        virtual void deregisterLoaderForReload(const std::string& filename, IResourceLoader* pLoader) = 0;
     };
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <functional>
+#include "gep/types.h"
+#include "gep/frametimestats.h"
 
 namespace gep
 {
@@ -25,6 +27,28 @@ namespace gep
         virtual void run() = 0;
         virtual float getElapsedTime() const = 0;
         virtual float calcElapsedTimeAverage(size_t numFrames) const = 0;
+        /// \brief statistics over the last frames, including the time spent in each FramePhase
+        virtual const FrameTimeStats& getFrameTimeStats() const = 0;
+        /// \brief sets the number of frames the statistics are taken over, clears the history
+        virtual void setFrameTimeHistoryLength(size_t numFrames) = 0;
+
+        /// \brief switches the update callbacks to a fixed timestep
+        ///
+        /// The callbacks then get called zero or more times per frame, always with 1 / tickRate as elapsed
+        /// time. Rendering should interpolate between the last two states with getInterpolationAlpha.
+        /// \param tickRate steps per second, 0 goes back to one update per frame with the variable frame time
+        /// \param maxStepsPerFrame more steps are dropped, so slow frames do not snowball
+        virtual void setFixedTimestep(float tickRate, uint32 maxStepsPerFrame = 5) = 0;
+        /// \brief how far the time is between the last fixed step and the next one (0..1), 1 without a fixed timestep
+        virtual float getInterpolationAlpha() const = 0;
+        /// \brief limits the frame rate, sleeping instead of spinning through frames
+        /// \param seconds 0 lets the frames run as fast as they can
+        virtual void setTargetFrameTime(float seconds) = 0;
+        /// \brief records what the StdAllocator allocates in the next frames into a file for -allocreplay of the unittests
+        ///
+        /// This covers the loads the resource manager finishes and the extraction of the renderer as they happen in the game.
+        /// The file is written after numFrames frames, or when the update framework stops before.
+        virtual void recordAllocationTrace(const char* filename, uint32 numFrames) = 0;
         virtual CallbackId registerUpdateCallback(std::function<void(float elapsedTime)> callback) = 0;
         virtual void deregisterUpdateCallback(CallbackId id) = 0;
 
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include "gep/memory/allocator.h"
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace gep
+{
+    /// \brief a recorded sequence of allocations and frees
+    ///
+    /// Only the order and the sizes are kept, the recorded addresses are replaced by ids, so the
+    /// same trace can be replayed against any allocator. Recording is thread safe.
+    class GEP_API AllocationTrace
+    {
+    public:
+        /// \brief the size of a free event
+        static const uint32 FREE = 0xFFFFFFFF;
+
+        struct Event
+        {
+            uint32 id;
+            /// the requested size or FREE
+            uint32 size;
+        };
+
+    private:
+        std::vector<Event> m_events;
+        std::unordered_map<void*, uint32> m_liveIds;
+        uint32 m_numIds;
+        mutable std::mutex m_mutex;
+
+    public:
+        AllocationTrace();
+
+        void recordAllocation(void* mem, size_t size);
+        /// \brief frees of memory which was allocated before recording started are ignored
+        void recordFree(void* mem);
+        void clear();
+
+        inline const std::vector<Event>& getEvents() const { return m_events; }
+        /// \brief the ids of the events are smaller than this
+        inline uint32 getNumIds() const { return m_numIds; }
+
+        /// \brief the highest number of bytes alive at the same time
+        /// \param pEventIndex receives the index of the event after which the peak was reached
+        size_t getPeakBytes(size_t* pEventIndex = nullptr) const;
+        /// \brief the highest number of allocations alive at the same time
+        size_t getPeakCount() const;
+        uint32 getLargestAllocation() const;
+
+        Result saveToFile(const char* filename) const;
+        /// \brief replaces the recorded events with the ones of the file
+        Result loadFromFile(const char* filename);
+    };
+
+    /// \brief forwards to a parent allocator and records everything into a trace
+    class GEP_API TracingAllocator : public IAllocator
+    {
+    private:
+        IAllocator* m_pParent;
+        AllocationTrace* m_pTrace;
+
+    public:
+        TracingAllocator(IAllocator* pParent, AllocationTrace* pTrace) : m_pParent(pParent), m_pTrace(pTrace) {}
+
+        virtual void* allocateMemory(size_t size) override;
+        virtual void freeMemory(void* mem) override;
+    };
+
+    /// \brief what a replay of a trace measured, the latencies are seconds per operation
+    struct GEP_API AllocationReplayResult
+    {
+        uint32 numThreads;
+        /// operations of all threads together
+        uint64 numOperations;
+        /// allocations which returned nullptr, their frees are skipped
+        uint64 numFailedAllocations;
+        double seconds;
+        double operationsPerSecond;
+        double latencyMedian;
+        double latency99;
+        double latency999;
+        double latencyMax;
+        /// the peak of the trace times the number of threads
+        size_t peakBytesUsed;
+        /// what the allocators reported as reserved at the peak of the trace, the growth of the
+        /// resident memory of the process for allocators which take their memory from the system
+        size_t peakBytesReserved;
+        /// the part of the reserved memory that is not used at the peak
+        double fragmentation;
+        /// the growth of the resident memory of the process until the peak of the trace
+        size_t peakResidentGrowth;
+    };
+
+    /// \brief replays a trace against allocators to compare them on real allocation patterns
+    class GEP_API AllocationReplay
+    {
+    public:
+        /// \brief returns the allocator for the given thread, allocators which are not thread safe
+        /// have to return a separate instance for every thread
+        typedef std::function<IAllocator*(uint32 threadIndex)> AllocatorFactory;
+
+        /// \brief every thread replays the whole trace at the same time, every operation is timed
+        static AllocationReplayResult replay(const AllocationTrace& trace, uint32 numThreads, const AllocatorFactory& getAllocator);
+
+        /// \brief the resident memory of the process in bytes, 0 if unknown
+        static size_t getResidentMemory();
+
+        /// \brief replays the trace against system malloc and every engine allocator at 1 up to maxThreads threads
+        /// and prints a table of the results
+        static void compareAllocators(const AllocationTrace& trace, uint32 maxThreads);
+    };
+}
@@ -5,6 +5,8 @@
 
 namespace gep
 {
+    class AllocationTrace;
+
     /// \brief generic allocator interface
     class IAllocator
     {
@@ -49,8 +51,9 @@ namespace gep
         size_t m_peakBytesAllocated;
 
         Mutex m_allocationLock;
+        AllocationTrace* m_pTrace;
 
-        StdAllocator(){}
+        StdAllocator() : m_pTrace(nullptr) {}
         ~StdAllocator(){}
     public:
         // IAllocator interface
@@ -64,6 +67,12 @@ namespace gep
         virtual size_t getNumBytesUsed() const override;
         virtual IAllocator* getParentAllocator() const override;
 
+        /// \brief records all following allocations and frees into the given trace, nullptr stops recording
+        ///
+        /// Most engine allocations, e.g. when loading models or in the containers, go through here,
+        /// so this records the allocation patterns of real workloads for the AllocationReplay.
+        void setTrace(AllocationTrace* pTrace);
+
         /// \brief returns the only instance of this class
         static StdAllocator& globalInstance(); //not using DoubleLockingSingelton because of cyclic dependency
         static void destroyInstance();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "gep/gepmodule.h"
 #include "gep/types.h"
 #include "gep/math3d/vec2.h"
 #include "gep/math3d/vec3.h"
@@ -61,7 +62,7 @@ namespace gep
         unsigned int hash;
     };
 
-    class ModelLoader
+    class GEP_API ModelLoader
     {
     public:
         struct Load
@@ -235,10 +236,15 @@ namespace gep
             MemoryPool boneDataArray;
         };
 
-        void loadThModel(const char* pFileName, uint32 loadWhat);
+        /// \param verifyChecksums
+        ///   if the chunks are checked against the checksums in the chunk index, a corrupted file throws a LoadingError
+        void loadThModel(const char* pFileName, uint32 loadWhat, bool verifyChecksums = false);
         void loadAssimpCompatibleModel(const char* pFileName, uint32 loadWhat);
 
-        void writeThModel( const char* file );
+        Result writeThModel( const char* file );
+
+        /// \brief frees what was loaded, so that the model can be loaded again
+        void discardModelData();
 
     public:
 
@@ -266,5 +272,11 @@ namespace gep
         /// \param loadWhat
         ///   which data should be loaded. Combination of Load::Enum values
         void loadFile(const char* pFilename, uint32 loadWhat);
+
+        /// \brief the thModel file loadFile caches a model in, if it is not a thModel itself
+        static std::string getCachePath(const char* pFilename);
+
+        /// \brief if the file is loaded without going through the cache
+        static bool isThModel(const char* pFilename);
     };
 }
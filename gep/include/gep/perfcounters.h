@@ -0,0 +1,58 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include "gep/common.h"
+
+namespace gep
+{
+    struct PerfCounter
+    {
+        enum Enum
+        {
+            Instructions,
+            Cycles,
+            /// level 1 data cache read misses
+            L1DataMisses,
+            /// last level cache misses
+            CacheMisses,
+            BranchMisses,
+            Count
+        };
+
+        static const char* getName(Enum counter);
+    };
+
+    /// \brief the hardware performance counters of the thread which opened the group
+    ///
+    /// Uses perf_event_open on Linux and only counts user mode, which is allowed up to
+    /// perf_event_paranoid 2. All counters are read with a single system call. Counters the cpu or
+    /// the virtual machine does not support are left out, opening only fails if none is available.
+    /// There is no comparable interface on Windows, open always fails there.
+    class GEP_API PerfCounterGroup
+    {
+    private:
+        int m_fds[PerfCounter::Count];
+        /// position of each counter in the group read, -1 if the counter is not available
+        int32 m_readIndex[PerfCounter::Count];
+        int m_numOpen;
+
+        //non-copyable
+        PerfCounterGroup(const PerfCounterGroup& rh);
+        void operator = (const PerfCounterGroup& rh);
+
+    public:
+        PerfCounterGroup();
+        ~PerfCounterGroup();
+
+        /// \brief starts counting on the calling thread
+        Result open();
+        void close();
+
+        inline bool isOpen() const { return m_numOpen > 0; }
+        inline bool isAvailable(PerfCounter::Enum counter) const { return m_readIndex[counter] >= 0; }
+
+        /// \brief reads the current values, counters which are not available read as 0
+        bool read(uint64 (&values)[PerfCounter::Count]) const;
+    };
+}
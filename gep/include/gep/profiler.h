@@ -0,0 +1,143 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include "gep/common.h"
+#include "gep/perfcounters.h"
+#include <string>
+#include <vector>
+
+namespace gep
+{
+    struct ProfileEventType
+    {
+        enum Enum : uint8
+        {
+            ZoneBegin,
+            ZoneEnd,
+            /// a frame boundary, marked by the update framework
+            Frame
+        };
+    };
+
+    /// \brief one recorded event, as handed out by Profiler::collect
+    struct ProfileEvent
+    {
+        uint64 ticks;
+        /// index into ProfileCapture::names for ZoneBegin, the frame number for Frame, unused for ZoneEnd
+        uint32 data;
+        ProfileEventType::Enum type;
+    };
+
+    struct ProfileThread
+    {
+        uint32 threadId;
+        std::string name;
+        std::vector<ProfileEvent> events;
+    };
+
+    /// \brief profiling data taken out of the profiler, can be written to disk in two formats
+    ///
+    /// The binary format starts with the 8 byte magic "GEPPROF", the uint32 version and the uint64
+    /// ticks per second. Then the number of names follows (uint32) and each name as uint16 length and
+    /// characters, then the number of threads (uint32). Every thread is stored as uint32 id, uint16 name
+    /// length, name, uint32 number of events, and the events as a uint8 type, the tick delta to the
+    /// previous event of the thread and the data (both LEB128 encoded varints). Little endian.
+    struct GEP_API ProfileCapture
+    {
+        static const char MAGIC[8];
+        static const uint32 VERSION = 1;
+
+        uint64 ticksPerSecond;
+        std::vector<std::string> names;
+        std::vector<ProfileThread> threads;
+
+        ProfileCapture() : ticksPerSecond(0) {}
+
+        /// \brief writes a Chrome Trace Event json file (load it in chrome://tracing or perfetto)
+        Result writeChromeTrace(const char* filename) const;
+        /// \brief writes the compact binary format
+        Result writeBinary(const char* filename) const;
+        /// \brief reads a file written by writeBinary, replacing the current contents
+        Result readBinary(const char* filename);
+    };
+
+    /// \brief hardware performance counter totals of all calls of one zone, see Profiler::setCountersEnabled
+    struct GEP_API ProfileZoneCounters
+    {
+        std::string name;
+        uint64 calls;
+        /// including nested zones, a call nested in a zone of the same name (recursion) is not counted again
+        uint64 inclusive[PerfCounter::Count];
+        /// excluding nested zones
+        uint64 self[PerfCounter::Count];
+
+        ProfileZoneCounters();
+
+        /// \brief instructions per cycle of the inclusive counts, 0 if either counter is not available
+        float getIpc() const;
+        /// \brief inclusive count per call
+        float getPerCall(PerfCounter::Enum counter) const;
+
+        /// \brief writes a text table of the zones sorted by inclusive cycles, columns of counters which
+        /// are not available are marked with '-'
+        static Result writeReport(const std::vector<ProfileZoneCounters>& zones, const char* filename);
+    };
+
+    /// \brief a hierarchical cpu profiler
+    ///
+    /// Every thread records into its own buffer, recording does not take any locks. Zones nest like
+    /// scopes, a zone has to be ended on the thread it was begun on. Zone names are only stored as
+    /// pointers, so they have to stay valid until the data was collected (string literals usually).
+    class GEP_API Profiler
+    {
+    public:
+        /// \brief starts or stops recording, disabled by default
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+
+        static void beginZone(const char* name);
+        static void endZone();
+        /// \brief marks the end of a frame, called by the update framework
+        static void markFrame();
+        /// \brief names the calling thread in the exported data, the string is copied
+        static void setThreadName(const char* name);
+
+        /// \brief moves everything recorded so far out of the thread buffers into capture
+        ///
+        /// Can be called while other threads keep recording, their events show up in the next collect.
+        static void collect(ProfileCapture& capture);
+
+        /// \brief opt-in: reads the hardware performance counters of the thread at the begin and end of every zone
+        ///
+        /// Works independently of setEnabled. Reading the counters costs a system call at every zone begin
+        /// and end, so this is meant for looking into specific zones rather than for running all the time.
+        /// Enabling fails and the counters stay off if they can not be opened on the calling thread, which
+        /// is the case on Windows, in virtual machines without a virtual pmu and when perf_event_paranoid
+        /// is above 2. Only change this between frames, zones open at that moment are not attributed.
+        static Result setCountersEnabled(bool enabled);
+        static bool areCountersEnabled();
+        /// \brief whether the counter could be opened on the thread which enabled the counters
+        static bool isCounterAvailable(PerfCounter::Enum counter);
+
+        /// \brief adds the counter totals gathered since the previous call to zones, merged by name
+        static void collectCounters(std::vector<ProfileZoneCounters>& zones);
+    };
+
+    /// \brief begins a zone on construction and ends it when leaving the scope
+    struct ProfileScope
+    {
+        inline ProfileScope(const char* name) { Profiler::beginZone(name); }
+        inline ~ProfileScope() { Profiler::endZone(); }
+    };
+}
+
+#ifndef GEP_NO_PROFILER
+    /// \brief profiles the rest of the current scope under the given name
+    #define GEP_PROFILE_SCOPE(name) gep::ProfileScope GEP_CONCAT(profileScope_, __LINE__)(name)
+    /// \brief marks a frame boundary
+    #define GEP_PROFILE_FRAME() gep::Profiler::markFrame()
+#else
+    #define GEP_PROFILE_SCOPE(name)
+    #define GEP_PROFILE_FRAME()
+#endif
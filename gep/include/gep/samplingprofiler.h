@@ -0,0 +1,46 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+
+namespace gep
+{
+    /// \brief a statistical profiler which needs no instrumentation
+    ///
+    /// A process cpu time timer (timer_create) sends SIGPROF at the given rate, the thread which
+    /// receives it captures its callstack into a preallocated buffer without locks or allocations.
+    /// The callstack is found by following the frame pointers, code built without them (-fomit-frame-pointer)
+    /// only shows up with the function which was interrupted.
+    /// Symbolization only happens when the result is written, with the StackWalker.
+    /// Only available on Linux, start fails on other platforms.
+    class GEP_API SamplingProfiler
+    {
+    public:
+        /// \brief the deepest stack captured, deeper stacks lose their outermost frames
+        static const uint32 MAX_FRAMES = 64;
+
+        /// \brief starts sampling, all samples taken by an earlier run are discarded
+        ///
+        /// \param samplesPerSecond
+        ///   samples per second of cpu time used by the whole process, a prime rate avoids
+        ///   sampling in lockstep with periodic work
+        ///
+        /// \param bufferSize
+        ///   room for this many return addresses, once it is full further samples are dropped
+        static Result start(uint32 samplesPerSecond = 997, size_t bufferSize = 4 * 1024 * 1024);
+        static void stop();
+        static bool isRunning();
+
+        static size_t getNumSamples();
+        static size_t getNumDroppedSamples();
+
+        /// \brief writes the samples as folded stacks for flame graph tools
+        ///
+        /// One line per distinct stack, the function names from the outermost to the innermost frame
+        /// separated by ';' followed by a space and the number of samples. Stops sampling first.
+        static Result writeFoldedStacks(const char* filename);
+
+        /// \brief starts sampling and writes the folded stacks to filename on gep::destroy
+        static Result startUntilExit(const char* filename, uint32 samplesPerSecond = 997);
+    };
+}
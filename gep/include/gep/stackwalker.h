@@ -0,0 +1,65 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/arrayptr.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <string>
+
+namespace gep
+{
+    class GEP_API StackWalker
+    {
+    public:
+      typedef size_t address_t; ///< type for a instruction address
+
+#ifdef _WIN32
+      typedef CONTEXT context_t;
+#else
+      typedef void context_t; ///< a ucontext_t, as handed to a signal handler
+#endif
+
+      /// \brief
+      ///  Get a given number of addresses from the callstack
+      ///
+      /// \param functionAddresses
+      ///   where to save the results to (The array needs to be preallocated)
+      ///
+      /// \param pContext
+      ///   the context to be used for capturing the stack frames. If null the current context is used.
+      ///   On Linux this has to be the context of a signal handler running on the current thread, the
+      ///   frames of the handler are left out then and framesToSkip counts from the interrupted function.
+      ///   The frames are found by following the frame pointers then, which is safe inside a signal handler.
+      ///
+      /// On Linux all addresses are return addresses, the interrupted instruction of a signal context is stored as the address after it.
+      ///
+      /// \return the number of addresses written
+      static size_t getCallstack(size_t framesToSkip, ArrayPtr<address_t> functionAddresses, context_t* pContext = nullptr);
+
+      /// \brief
+      ///  resolves a number of given addresses to function names + file & line number
+      ///
+      /// \param functionAddresses
+      ///  array of function addresses previously collected with GetCallstack
+      ///
+      /// \param pFunctionNames
+      ///   array of function names which is uiMaxFuncNameLength * uiNumAddresses * sizeof(char) in length
+      ///
+      /// \param uiMaxFuncNameLength
+      ///   maximum length of a function name string
+      static void resolveCallstack(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength);
+
+      /// \brief
+      ///  like resolveCallstack, but only writes the function names without file, line or parameters
+      static void resolveFunctionNames(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength);
+
+    private:
+      static bool s_isInitialized;
+
+      static void resolve(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength, bool withLines);
+      static std::string generateSearchPath();
+    };
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gep
+{
+    /// \brief caches the existence, type and size of files, so that repeated checks do not go to the disk
+    ///
+    /// Only paths below the directories added with addDirectory are cached, all others are passed through to the
+    /// file system. The first time a path is asked for, the directory it is in is listed as a whole, which answers
+    /// the checks for all files in it, including the ones which do not exist.
+    /// The cache does not notice changes by itself, they have to be reported with invalidate. The ResourceManager
+    /// does this for everything its DirectoryWatcher sees.
+    class GEP_API StatCache
+    {
+    public:
+        struct Type
+        {
+            enum Enum
+            {
+                None,
+                File,
+                Directory
+            };
+        };
+
+    private:
+        struct Entry
+        {
+            /// normalized
+            std::string path;
+            Type::Enum type;
+            /// all files in the directory are in the cache
+            bool listed;
+            bool sizeKnown;
+            uint64 size;
+        };
+
+        /// by the hash of the normalized path
+        std::unordered_map<uint64, Entry> m_entries;
+        /// normalized, without a trailing slash
+        std::vector<std::string> m_directories;
+        std::mutex m_mutex;
+
+        bool isCached(const std::string& path) const;
+        /// \brief finds the entry of the path, listing its directory if necessary
+        /// \return nullptr if the path can not be cached because another one has the same hash
+        Entry* lookup(const std::string& path, uint64 hash);
+        void listDirectory(Entry& directory);
+
+        //non-copyable
+        StatCache(const StatCache& rh);
+        void operator = (const StatCache& rh);
+
+    public:
+        StatCache();
+
+        /// \brief the cache used by the engine
+        static StatCache& instance();
+
+        /// \brief caches the paths below the directory, changes in it have to be reported with invalidate from now on
+        void addDirectory(const char* directory);
+
+        /// \brief forgets what is known about the path, everything below it and the files next to it
+        void invalidate(const char* path);
+
+        /// \brief forgets everything, the directories stay cached
+        void clear();
+
+        Type::Enum getType(const char* path);
+
+        /// \return 0 if the file does not exist
+        uint64 getFileSize(const char* path);
+
+        inline bool fileExists(const char* path) { return getType(path) == Type::File; }
+        inline bool directoryExists(const char* path) { return getType(path) == Type::Directory; }
+    };
+}
+
+#define g_statCache gep::StatCache::instance()
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+namespace gep
+{
+    /// \brief a fixed number of worker threads executing jobs in the order they were submitted
+    class GEP_API JobQueue
+    {
+    private:
+        std::vector<std::thread> m_threads;
+        std::deque<std::function<void()>> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_jobAvailable;
+        std::condition_variable m_idle;
+        uint32 m_numRunningJobs;
+        bool m_stopping;
+
+        void workerLoop();
+
+        //non-copyable
+        JobQueue(const JobQueue& rh);
+        void operator = (const JobQueue& rh);
+
+    public:
+        /// \brief starts the worker threads, 0 uses one thread per hardware thread
+        JobQueue(uint32 numThreads);
+
+        /// \brief finishes all jobs which are still queued and joins the threads
+        ~JobQueue();
+
+        /// \brief queues a job, it will be executed on one of the worker threads
+        void submit(std::function<void()> job);
+
+        /// \brief blocks until the queue is empty and no job is running anymore
+        void waitUntilIdle();
+
+        inline uint32 getNumThreads() const { return static_cast<uint32>(m_threads.size()); }
+    };
+}
@@ -2,51 +2,74 @@
 
 namespace gep
 {
+    class PointInTime;
+
     /// \brief for measuring time
+    ///
+    /// Time is counted in ticks of the fastest reliable clock of the machine. That is the invariant
+    /// time stamp counter of the cpu if it has one, calibrated once against the operating system's
+    /// monotonic clock, and the monotonic clock itself otherwise. All timers share the same tick length.
     class GEP_API Timer
     {
-		LARGE_INTEGER frequency;
+        friend class PointInTime;
+    private:
+        /// raw tick at which this timer's time was 0, moved forward by the length of every pause
+        uint64 m_startTicks;
+        /// time of the timer when it was paused
+        uint64 m_pausedTime;
+        bool m_isPaused;
 
     public:
-		Timer();
-
-		float getTimeAsFloat() const;
-
-		double getTimeAsDouble() const;
-
-		gep::uint64 getTime() const;
-
-		void pause();
-
-		void unpause();
-
-
-		
+        /// \brief the timer starts running on construction
+        Timer();
+
+        /// \brief returns the time elapsed since the start of the timer as a float (in seconds)
+        float getTimeAsFloat() const;
+        /// \brief returns the time elapsed since the start of the timer as a double (in seconds)
+        double getTimeAsDouble() const;
+        /// \brief returns the time elapsed since the start of the timer in ticks, pauses not included
+        uint64 getTime() const;
+        /// \brief stops the time of this timer until unpause is called
+        void pause();
+        /// \brief continues the timer after pausing
+        void unpause();
+        inline bool isPaused() const { return m_isPaused; }
+
+        /// \brief reads the raw tick counter, not related to any timer. For timestamps which have to be cheap.
+        static uint64 getCurrentTicks();
+        /// \brief length of a tick
+        static double getSecondsPerTick();
+        static uint64 getTicksPerSecond();
+        /// \brief name of the clock the ticks come from, for logging
+        static const char* getClockName();
     };
 
-    /// \brief stores a point in time with maximum percision
+    /// \brief stores a point in time of a timer with maximum percision
+    ///
+    /// Only holds the tick count, so taking and comparing points in time is as cheap as it gets.
+    /// Points in time of different timers can not be compared.
     class GEP_API PointInTime
     {
-		Timer timer;
-
-	public:
-		PointInTime(Timer t);
-
-		PointInTime(Timer& timer);
-
-		float operator - (const PointInTime& rh) const;
-
-		bool operator < (const PointInTime& rh) const;
-
-		bool operator > (const PointInTime& rh) const;
-
-		bool operator <= (const PointInTime& rh) const;
-
-		bool operator >= (const PointInTime& rh) const;
-
-		bool operator == (const PointInTime& rh) const;
-
-		bool operator != (const PointInTime& rh) const;
+    private:
+        uint64 m_ticks;
 
+    public:
+        /// \brief the start of every timer
+        PointInTime() : m_ticks(0) {}
+        /// \param timer the timer to use for measuring time
+        PointInTime(const Timer& timer) : m_ticks(timer.getTime()) {}
+
+        /// \brief computes the time difference between two points in time in seconds
+        float operator - (const PointInTime& rh) const;
+
+        inline uint64 getTicks() const { return m_ticks; }
+
+        // comparison operators
+        inline bool operator > (const PointInTime& rh) const { return m_ticks > rh.m_ticks; }
+        inline bool operator < (const PointInTime& rh) const { return m_ticks < rh.m_ticks; }
+        inline bool operator >= (const PointInTime& rh) const { return m_ticks >= rh.m_ticks; }
+        inline bool operator <= (const PointInTime& rh) const { return m_ticks <= rh.m_ticks; }
+        inline bool operator == (const PointInTime& rh) const { return m_ticks == rh.m_ticks; }
+        inline bool operator != (const PointInTime& rh) const { return m_ticks != rh.m_ticks; }
     };
 }
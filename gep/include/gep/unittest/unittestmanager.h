@@ -1,7 +1,12 @@
 #pragma once
 #include <vector>
+#include <string>
 #include <exception>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace gep
 {
 	/// \brief class for allocating memory for the unittest framework
@@ -72,29 +77,167 @@ namespace gep
         virtual const char* getName() const = 0;
     };
 
+    /// \brief handed to a benchmark, the benchmark runs the code to measure as long as keepRunning returns true
+    ///
+    /// setup();
+    /// while(state.keepRunning())
+    /// {
+    ///     doNotOptimize(codeToMeasure());
+    /// }
+    ///
+    /// Only the time from the first call to keepRunning until it returns false is measured,
+    /// without the time between pauseTiming and resumeTiming.
+    class GEP_API BenchmarkState
+    {
+    private:
+        uint64 m_iterations;
+        uint64 m_remaining;
+        uint64 m_startTicks;
+        uint64 m_stopTicks;
+        uint64 m_pauseTicks;
+        uint64 m_pausedTicks;
+        std::vector<std::pair<std::string, double>> m_counters;
+
+        void startTiming();
+        void stopTiming();
+
+    public:
+        BenchmarkState(uint64 iterations) : m_iterations(iterations), m_remaining(iterations),
+            m_startTicks(0), m_stopTicks(0), m_pauseTicks(0), m_pausedTicks(0) {}
+
+        inline bool keepRunning()
+        {
+            if(m_remaining == 0)
+            {
+                stopTiming();
+                return false;
+            }
+            if(m_remaining-- == m_iterations)
+                startTiming();
+            return true;
+        }
+        inline uint64 getIterations() const { return m_iterations; }
+
+        /// \brief excludes e.g. resetting a container between iterations from the measurement
+        void pauseTiming();
+        void resumeTiming();
+
+        /// \brief the measured time of the whole loop in seconds, a negative value if the loop did not run
+        double getElapsedSeconds() const;
+
+        /// \brief reports a value besides the time with the result, e.g. a measured quality
+        /// setting a counter again replaces its value
+        void setCounter(const char* name, double value);
+        inline const std::vector<std::pair<std::string, double>>& getCounters() const { return m_counters; }
+    };
+
+    /// \brief interface for a single benchmark
+    class GEP_API IBenchmark
+    {
+    public:
+        virtual void Run(BenchmarkState& state) = 0;
+        virtual const char* getName() const = 0;
+    };
+
+    /// \brief timings of one benchmark, all times are seconds per iteration
+    struct GEP_API BenchmarkResult
+    {
+        std::string group;
+        std::string name;
+        uint64 iterations; ///< iterations per sample
+        uint32 numSamples;
+        double median;
+        /// median absolute deviation of the samples from the median
+        double mad;
+        double min;
+        double mean;
+        /// the counters set by the last sample
+        std::vector<std::pair<std::string, double>> counters;
+
+        BenchmarkResult() : iterations(0), numSamples(0), median(0.0), mad(0.0), min(0.0), mean(0.0) {}
+    };
+
+    struct GEP_API BenchmarkSettings
+    {
+        /// only benchmarks whose "Group.Name" contains this string are run, all if null
+        const char* filter;
+        /// results are written to this json file if not null
+        const char* jsonOutput;
+        /// json file written by an earlier run to compare against, if not null
+        const char* baseline;
+        /// a median more than this fraction slower than the baseline counts as regression
+        float regressionThreshold;
+        /// the iterations per sample are increased until a sample takes at least this long
+        float minSampleTime;
+        /// or until there are this many, a benchmark which does not call keepRunning always has one
+        uint64 maxIterations;
+        uint32 numWarmupSamples;
+        uint32 numSamples;
+
+        BenchmarkSettings() :
+            filter(nullptr),
+            jsonOutput(nullptr),
+            baseline(nullptr),
+            regressionThreshold(0.1f),
+            minSampleTime(0.01f),
+            maxIterations(1000000000),
+            numWarmupSamples(2),
+            numSamples(15)
+        {
+        }
+    };
+
+    /// \brief wall time of a single test
+    struct GEP_API UnittestTiming
+    {
+        std::string group;
+        std::string name;
+        double seconds;
+        bool passed;
+    };
+
     /// \brief a named group of unittests
     class GEP_API UnittestGroup
     {
     private:
         const char* m_name;
-        std::vector<IUnittest*, UnittestAllocator<IUnittest>> m_tests;
+        std::vector<IUnittest*, UnittestAllocator<IUnittest*>> m_tests;
+        std::vector<IBenchmark*, UnittestAllocator<IBenchmark*>> m_benchmarks;
 
     public:
         UnittestGroup(const char* name);
 
+        inline const char* getName() const { return m_name; }
+
+        inline size_t getNumSubtests() const { return m_tests.size(); }
+        inline const char* getSubtestName(size_t index) const { return m_tests[index]->getName(); }
+
         /// \brief runs all tests in this testgroup
+        /// \param pTimings if not null the wall time of every test is appended
         /// \return the number of tests that failed
-        int runAllSubtests(UnittestLog& log);
+        int runAllSubtests(UnittestLog& log, std::vector<UnittestTiming>* pTimings = nullptr);
+
+        /// \brief runs a single test of this group
+        /// \param seconds receives the wall time of the test
+        /// \return true if the test passed
+        bool runSubtest(size_t index, UnittestLog& log, double& seconds);
+
+        /// \brief runs the benchmarks of this group which pass the filter and appends their results
+        /// \return the number of benchmarks that failed
+        int runAllBenchmarks(UnittestLog& log, const BenchmarkSettings& settings, std::vector<BenchmarkResult>& results);
 
         /// \brief registers a new subtest
         void registerTest(IUnittest* test);
+
+        /// \brief registers a new benchmark
+        void registerBenchmark(IBenchmark* benchmark);
     };
 
     /// \brief singelton that manages all unittest
     class GEP_API UnittestManager : public IFailedAssertCallback
     {
     private:
-		std::vector<UnittestGroup*, UnittestAllocator<UnittestGroup>> m_groups;
+		std::vector<UnittestGroup*, UnittestAllocator<UnittestGroup*>> m_groups;
         static UnittestManager* s_globalInstance;
         bool m_doDebugBreaks;
 
@@ -114,6 +257,25 @@ namespace gep
         /// \brief runs all registered tests
         /// \return the number of tests that failed
         int runAllTests();
+
+        /// \brief runs the test groups in up to numWorkers child processes at the same time
+        ///
+        /// The tests of a group still run one after another in the same process. A test which crashes
+        /// or runs longer than timeoutSeconds fails, its process is killed and the rest of the group
+        /// continues in a new process. Only available where fork exists, otherwise all tests run serially.
+        /// \return the number of tests that failed
+        int runAllTestsParallel(uint32 numWorkers, float timeoutSeconds);
+
+        /// \brief runs all registered benchmarks instead of the tests
+        /// \return the number of benchmarks that failed or regressed compared to the baseline
+        int runAllBenchmarks(const BenchmarkSettings& settings);
+
+        /// \brief calibrates the number of iterations, warms up and measures a single benchmark
+        static BenchmarkResult runBenchmark(IBenchmark& benchmark, const BenchmarkSettings& settings);
+
+        static Result writeBenchmarkJson(const std::vector<BenchmarkResult>& results, const char* filename);
+        /// \brief reads a file written by writeBenchmarkJson, only the fields written by it are understood
+        static Result readBenchmarkJson(const char* filename, std::vector<BenchmarkResult>& results);
     };
 
     /// \brief exception that is thrown whenever a testing condition fails
@@ -126,7 +288,7 @@ namespace gep
 
     public:
       UnittestFailedException(const char* file, unsigned int line, std::string&& message);
-      virtual const char* what() const override;
+      virtual const char* what() const throw() override;
       inline const char* getFile() const { return m_file; }
       inline unsigned int getLine() const { return m_line; }
     };
@@ -142,6 +304,52 @@ namespace gep
         virtual Result Deinitialize(UnittestLog& log) override;
         virtual const char* getName() const override { return m_name; }
     };
+
+    /// \brief a simple benchmark implementation
+    class GEP_API SimpleBenchmark : public IBenchmark
+    {
+    private:
+        const char* m_name;
+    public:
+        SimpleBenchmark(const char* name, UnittestGroup& group);
+        virtual const char* getName() const override { return m_name; }
+    };
+
+    GEP_API void doNotOptimizeAddress(const void* pValue);
+
+    /// \brief keeps the compiler from optimizing away the computation of value
+    template <class T>
+    inline void doNotOptimize(const T& value)
+    {
+#ifdef _MSC_VER
+        // no inline assembly on x64, a call into the dll which the optimizer can not look into does the same
+        doNotOptimizeAddress(&value);
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    /// \brief like above, additionally the compiler has to assume that value changed, so calculations
+    /// with it can not be moved out of the benchmark loop
+    template <class T>
+    inline void doNotOptimize(T& value)
+    {
+#ifdef _MSC_VER
+        doNotOptimizeAddress(&value);
+#else
+        asm volatile("" : "+r,m"(value) : : "memory");
+#endif
+    }
+
+    /// \brief forces all pending writes to memory, so that writes are not optimized away
+    inline void clobber()
+    {
+#ifdef _MSC_VER
+        _ReadWriteBarrier();
+#else
+        asm volatile("" : : : "memory");
+#endif
+    }
 };
 
 #define GEP_EXTERN_UNITTEST_GROUP(groupId) extern gep::UnittestGroup g_unittest_##groupId;
@@ -157,3 +365,11 @@ public: \
 }; \
 Unittest_##groupId##testId g_unittest_##groupId##testId(GEP_STRINGIZE(testId),unittestGroup_##groupId()); \
 void Unittest_##groupId##testId::Run(gep::UnittestLog& log)
+#define GEP_BENCHMARK(groupId, benchmarkId) \
+class Benchmark_##groupId##benchmarkId : public gep::SimpleBenchmark { \
+public: \
+    Benchmark_##groupId##benchmarkId(const char* name, gep::UnittestGroup& group) : gep::SimpleBenchmark(name,group) {} \
+    virtual void Run(gep::BenchmarkState& state) override; \
+}; \
+Benchmark_##groupId##benchmarkId g_benchmark_##groupId##benchmarkId(GEP_STRINGIZE(benchmarkId),unittestGroup_##groupId()); \
+void Benchmark_##groupId##benchmarkId::Run(gep::BenchmarkState& state)
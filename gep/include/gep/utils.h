@@ -83,6 +83,7 @@ namespace gep
     ///   * Remove leading ./ or .\ constructs.
     ///   * Resolve Hello/../World/file.ext => World/file.ext
     ///   * Resolve Hello/./World/file.ext => Hello/World/file.ext
+    ///   * Keep leading ../ constructs, ../../file.ext stays as it is
     /// \note The \a path is not checked against the file system,
     ///       i.e. this function can be called on any string,
     ///       even if the given \a path does not exist on the file system.
@@ -98,7 +99,33 @@ namespace gep
     {
         auto memory = const_cast<char*>(path.c_str());
         auto newLen = normalizePath(memory, path.size(), options);
-        path.assign(memory, newLen);
+        path.resize(newLen);
+    }
+
+    /// \brief The hash paths are looked up by, FNV-1a over the normalized path.
+    GEP_API uint64 hashPath(const char* normalizedPath, size_t length);
+
+    struct NormalizedPath
+    {
+        size_t length;
+        /// Same as \a hashPath over the normalized path.
+        uint64 hash;
+    };
+
+    /// \brief Normalizes the path like \a normalizePath and hashes it in the same pass.
+    ///
+    /// Nothing is allocated, which makes it cheap enough for every lookup of a path.
+    /// \param destination
+    ///        Receives the normalized path, at least \a length chars. May be the same as \a path.
+    ///        It is not zero-terminated.
+    GEP_API NormalizedPath normalizeAndHashPath(const char* path, size_t length, char* destination, uint32 options = NormalizationOptions::None);
+
+    /// \brief Convenience overload to normalize and hash a \c std::string in place.
+    inline uint64 normalizeAndHashPath(std::string& path, uint32 options = NormalizationOptions::None)
+    {
+        auto normalized = normalizeAndHashPath(path.c_str(), path.size(), &path[0], options);
+        path.resize(normalized.length);
+        return normalized.hash;
     }
 
     GEP_API bool areEqual(const char* lhs, const char* rhs, size_t count = -1);
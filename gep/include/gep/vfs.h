@@ -0,0 +1,286 @@
+#pragma once
+
+#include "gep/gepmodule.h"
+#include "gep/types.h"
+#include "gep/file.h"
+#include "gep/utils.h"
+#include "gep/asyncio.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gep
+{
+    /// \brief a normalized path together with its hash
+    ///
+    /// Paths which are opened repeatedly can be kept as VfsPath, so that they are only normalized and hashed once.
+    struct GEP_API VfsPath
+    {
+        std::string path;
+        uint64 hash;
+        /// the path as it was given, files which are in no mount are opened with it
+        std::string original;
+
+        /// \brief normalizes the path and hashes it with normalizeAndHashPath
+        VfsPath(const char* path);
+        VfsPath(const std::string& path);
+    };
+
+    /// \brief a pak archive, many files in one file which is mapped into memory as a whole
+    ///
+    /// The archive starts with a header and a table of the files sorted by the hash of their path,
+    /// followed by the paths and the data of the files, which starts at multiples of DATA_ALIGNMENT.
+    class GEP_API PakArchive
+    {
+    public:
+        static const uint32 MAGIC = 0x4B415047; // "GPAK"
+        static const uint32 VERSION = 1;
+        static const size_t DATA_ALIGNMENT = 16;
+
+        struct Header
+        {
+            uint32 magic;
+            uint32 version;
+            uint32 numEntries;
+            uint32 pathsSize;
+        };
+
+        struct Entry
+        {
+            uint64 hash;
+            uint64 offset;
+            uint64 size;
+            /// position of the path in the paths behind the table
+            uint32 pathOffset;
+            uint32 pathLength;
+        };
+
+    private:
+        MappedFile m_file;
+        ArrayPtr<const Entry> m_entries;
+        const char* m_pPaths;
+        std::string m_filename;
+
+        PakArchive(const PakArchive&);
+        PakArchive& operator = (const PakArchive&);
+
+    public:
+        PakArchive();
+
+        /// \brief maps the archive and checks that the table is intact, an open archive is closed first
+        Result open(const char* filename);
+        void close();
+
+        inline bool isOpen() const { return m_file.isOpen(); }
+        inline const std::string& getFilename() const { return m_filename; }
+
+        /// \brief the files in the order of their hashes
+        inline ArrayPtr<const Entry> getEntries() const { return m_entries; }
+        inline std::string getPath(const Entry& entry) const { return std::string(m_pPaths + entry.pathOffset, entry.pathLength); }
+        /// \brief the data of a file, stays valid as long as the archive is open
+        inline ArrayPtr<uint8> getData(const Entry& entry) const
+        {
+            return ArrayPtr<uint8>(m_file.getData().getPtr() + entry.offset, static_cast<size_t>(entry.size));
+        }
+
+        /// \brief looks a file up with a binary search over the hashes
+        /// \return nullptr if the archive does not contain the file
+        const Entry* find(const VfsPath& path) const;
+    };
+
+    /// \brief writes pak archives
+    class GEP_API PakWriter
+    {
+        struct File
+        {
+            std::string path;
+            /// read from the disk if not empty, data is used otherwise
+            std::string sourceFilename;
+            std::vector<uint8> data;
+        };
+        std::vector<File> m_files;
+
+    public:
+        /// \brief adds a file from memory
+        /// \param path
+        ///   the path it is found under in the archive, normalized with normalizePath
+        void addFile(const char* path, ArrayPtr<const uint8> data);
+
+        /// \brief adds a file from the disk, it is only read when the archive is written
+        void addFileFromDisk(const char* path, const char* sourceFilename);
+
+        /// \brief writes the archive, fails if a source file can not be read or a path was added twice
+        Result write(const char* filename);
+    };
+
+    /// \brief a file opened through the VirtualFileSystem, read from memory like a RawFile is read from the disk
+    ///
+    /// Files in archives point into the mapping of the archive, which is kept alive by the file.
+    /// Loose files are mapped on their own, prefetched files point into the memory they were read into.
+    class GEP_API VfsFile
+    {
+        friend class VirtualFileSystem;
+
+        std::shared_ptr<PakArchive> m_pArchive;
+        std::shared_ptr<std::vector<uint8>> m_pPrefetched;
+        MappedFile m_mappedFile;
+        ArrayPtr<uint8> m_data;
+        size_t m_position;
+        bool m_isOpen;
+
+        VfsFile(const VfsFile&);
+        VfsFile& operator = (const VfsFile&);
+
+    public:
+        VfsFile();
+
+        void close();
+
+        inline bool isOpen() const { return m_isOpen; }
+        inline bool isInArchive() const { return m_pArchive != nullptr; }
+        /// \brief the whole file, valid until the file is closed
+        inline ArrayPtr<uint8> getData() const { return m_data; }
+        inline size_t getSize() const { return m_data.length(); }
+        inline size_t position() const { return m_position; }
+
+        inline void seek(size_t position)
+        {
+            m_position = (position < m_data.length()) ? position : m_data.length();
+        }
+
+        inline void skip(size_t bytes)
+        {
+            seek(m_position + bytes);
+        }
+
+        /// \brief reads a value as raw data
+        /// \return number of bytes read
+        template <typename T>
+        inline size_t read(T& value)
+        {
+            return readArray(&value, 1);
+        }
+
+        /// \brief reads a value array as raw data, only whole values are read
+        /// \return number of bytes read
+        template <typename T>
+        inline size_t readArray(T* values, size_t length)
+        {
+            size_t count = (m_data.length() - m_position) / sizeof(T);
+            if(length < count)
+                count = length;
+            size_t size = count * sizeof(T);
+            if(size > 0)
+                memcpy(values, m_data.getPtr() + m_position, size);
+            m_position += size;
+            return size;
+        }
+    };
+
+    /// \brief looks files up in mounted pak archives and directories
+    ///
+    /// Later mounts take precedence over earlier ones, so that a directory mounted after an archive overrides
+    /// the files in it during development. Files in archives are found with one hash lookup, without
+    /// touching the file system. Files which are in no mount are opened by their path as it is,
+    /// so that nothing changes as long as nothing is mounted.
+    ///
+    /// Mounting and unmounting must not happen while files are looked up on other threads.
+    class GEP_API VirtualFileSystem
+    {
+        struct Mount
+        {
+            std::shared_ptr<PakArchive> pArchive;
+            /// with a trailing slash, empty for archives
+            std::string directory;
+        };
+
+        struct ArchiveFile
+        {
+            uint32 mountIndex;
+            const PakArchive::Entry* pEntry;
+        };
+
+        struct PrefetchedFile
+        {
+            std::string path;
+            std::shared_ptr<std::vector<uint8>> pData;
+            uint32 refCount;
+        };
+
+        struct Location
+        {
+            enum Enum
+            {
+                None,
+                Archive,
+                Loose
+            };
+        };
+
+        std::vector<Mount> m_mounts;
+        /// the files of all archives by the hash of their path, the latest mount wins
+        std::unordered_map<uint64, ArchiveFile> m_archiveFiles;
+        uint32 m_numDirectories;
+        /// files read into memory ahead of being opened, by the hash of their path
+        std::unordered_map<uint64, PrefetchedFile> m_prefetched;
+        mutable std::mutex m_prefetchedMutex;
+
+        std::shared_ptr<std::vector<uint8>> findPrefetched(const VfsPath& path) const;
+        /// \brief keeps the data of a file which was read, or takes another reference if the file is prefetched already
+        /// \return false if a different file with the same hash is prefetched
+        bool addPrefetched(const VfsPath& path, std::shared_ptr<std::vector<uint8>> pData);
+        /// \brief takes another reference of an already prefetched file
+        bool addPrefetchedReference(const VfsPath& path);
+        bool findArchiveFile(const VfsPath& path, ArchiveFile& file) const;
+        /// \brief finds the file in the mount which takes precedence
+        Location::Enum locate(const VfsPath& path, ArchiveFile& archiveFile, std::string& diskPath) const;
+
+        VirtualFileSystem(const VirtualFileSystem&);
+        VirtualFileSystem& operator = (const VirtualFileSystem&);
+
+    public:
+        VirtualFileSystem();
+
+        /// \brief the file system the engine loads its files through
+        static VirtualFileSystem& instance();
+
+        Result mountArchive(const char* filename);
+        Result mountDirectory(const char* directory);
+        void unmountAll();
+
+        bool exists(const VfsPath& path) const;
+
+        /// \param accessPattern
+        ///   how loose files are mapped, archives are always mapped for random access
+        Result open(const VfsPath& path, VfsFile& file, MappedFile::AccessPattern::Enum accessPattern = MappedFile::AccessPattern::Sequential) const;
+
+        /// \brief where the file is on the disk, for code which has to read through a RawFile
+        /// \return false if the file is in an archive, was prefetched or does not exist
+        bool findLooseFile(const VfsPath& path, std::string& diskPath) const;
+
+        /// \brief opens a loose file with the C runtime, e.g. to stream it or to modify it in place
+        ///
+        /// Unlike findLooseFile prefetched files are opened on the disk as well. Files in archives can only be read
+        /// through open, new files are created with RawFile directly.
+        /// \param diskPath
+        ///   receives where the file is on the disk
+        Result openLoose(const VfsPath& path, RawFile& file, const char* pMode, std::string& diskPath) const;
+
+        /// \brief reads files into memory through io, so that opening them does not wait for the disk anymore
+        ///
+        /// Files in archives are read from the archive file as well, instead of faulting in the pages of its mapping.
+        /// onDone is called on an io thread once all reads finished, or right away if nothing had to be read. It gets
+        /// the files which were prefetched, each of them has to be released with releasePrefetched.
+        /// Unlike mounting this may happen on any thread.
+        void prefetch(AsyncIo& io, const std::vector<std::string>& paths, IoPriority::Enum priority,
+            std::function<void(const std::vector<std::string>& prefetched)> onDone);
+
+        /// \brief frees the memory of a prefetched file once every prefetch of it was released
+        void releasePrefetched(const VfsPath& path);
+    };
+}
+
+#define g_vfs gep::VirtualFileSystem::instance()
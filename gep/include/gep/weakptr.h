@@ -4,11 +4,18 @@
 #include "gep/memory/allocator.h"
 #include "gep/exit.h"
 #include <limits>
-#include "gep/threading/mutex.h"
+#include <atomic>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 namespace gep
 {
 #define INITIAL_WEAK_TABLE_LENGTH 8
+// segment k holds INITIAL_WEAK_TABLE_LENGTH << k slots, 21 segments cover the whole 24 bit index range
+#define WEAK_TABLE_MAX_SEGMENTS 21
 
 	/// \brief union for referencing objects in weak pointers
 	union WeakRefIndex {
@@ -17,48 +24,186 @@ namespace gep
 			unsigned int hash : 8;
 		};
 		unsigned int both;
-		bool Compare(WeakRefIndex& other) { return both == other.both ? true : false; }
+		bool Compare(const WeakRefIndex& other) const { return both == other.both ? true : false; }
 		static WeakRefIndex invalidRef() { return WeakRefIndex{ 0xFFFFFF,0xFF }; }
 	};
+	static_assert(sizeof(WeakRefIndex) == 4, "WeakRefIndex should be 4 bytes big");
+
+	/// \brief maps a weak table index to the segment it lives in and the offset inside that segment
+	inline void weakTableLocation(uint32 index, uint32& segment, uint32& offset)
+	{
+		// biasing the index makes segment k start at INITIAL_WEAK_TABLE_LENGTH << k
+		uint32 biased = index + INITIAL_WEAK_TABLE_LENGTH;
+#ifdef _MSC_VER
+		unsigned long msb;
+		_BitScanReverse(&msb, biased);
+#else
+		uint32 msb = 31 - __builtin_clz(biased);
+#endif
+		segment = msb - 3; // log2(INITIAL_WEAK_TABLE_LENGTH)
+		offset = biased - (INITIAL_WEAK_TABLE_LENGTH << segment);
+	}
+	static_assert(INITIAL_WEAK_TABLE_LENGTH == 8, "weakTableLocation assumes an initial table length of 8");
 
     /// \brief base class for all weak referenced objects
+    ///
+    /// All objects of type T share one handle table. The table is made of segments which are
+    /// never moved or freed while the program runs, so growing it does not invalidate slots other
+    /// threads are looking at. Free slots are kept in a lock-free list, creating and resolving
+    /// handles is O(1) and does not take a lock.
     template <class T>
     class WeakReferenced
 	{
-		template <class U> friend struct WeakPtr; //TODO Why class U?
+		template <class U> friend struct WeakPtr;
 	private:
-		static T** m_pGlobalHandleTable;
-		static unsigned int m_weakTableLength;
-		static unsigned int m_numWeakTableEntries;
+		struct Slot
+		{
+			std::atomic<T*> pObject;
+			/// generation of the slot, bumped every time the slot is released
+			std::atomic<uint8> hash;
+			/// next entry in the free list, stored as index + 1 so that 0 means end of list
+			std::atomic<uint32> nextFree;
+		};
+
+		static std::atomic<Slot*> s_segments[WEAK_TABLE_MAX_SEGMENTS];
+		/// free list head, upper 32 bits are an ABA tag, lower 32 bits are index + 1
+		static std::atomic<uint64> s_freeListHead;
+		/// first index that has never been handed out
+		static std::atomic<uint32> s_nextUnusedIndex;
+		static std::atomic<uint32> s_numWeakTableEntries;
 
 		WeakRefIndex m_ptrData;
-	public:
 
-		WeakReferenced()
+		static Slot& getSlot(uint32 index)
 		{
-			if (m_weakTableLength == 0) initTable();
-			if (m_weakTableLength == m_numWeakTableEntries) enlargeTable();
+			uint32 segment, offset;
+			weakTableLocation(index, segment, offset);
+			Slot* pSegment = s_segments[segment].load(std::memory_order_acquire);
+			GEP_ASSERT(pSegment != nullptr, "weak table segment was never allocated", index);
+			return pSegment[offset];
+		}
 
-			//adding reference
-			int newIndex = 0;
-			m_numWeakTableEntries++;
-			for (; newIndex < m_weakTableLength; newIndex++)
+		/// \brief makes sure the segment holding the given index exists
+		static void enlargeTable(uint32 index)
+		{
+			uint32 segment, offset;
+			weakTableLocation(index, segment, offset);
+			if (s_segments[segment].load(std::memory_order_acquire) != nullptr)
+				return;
+
+			Slot* pNewSegment = new Slot[INITIAL_WEAK_TABLE_LENGTH << segment]();
+			Slot* pExpected = nullptr;
+			if (s_segments[segment].compare_exchange_strong(pExpected, pNewSegment, std::memory_order_acq_rel))
+			{
+				if (segment == 0)
+					gep::atexit(&freeTable);
+			}
+			else
 			{
-				if (m_pGlobalHandleTable[newIndex] == nullptr)
+				// another thread was faster
+				delete[] pNewSegment;
+			}
+		}
+
+		static void freeTable()
+		{
+			for (auto& segment : s_segments)
+			{
+				delete[] segment.exchange(nullptr);
+			}
+			s_freeListHead = 0;
+			s_nextUnusedIndex = 0;
+			s_numWeakTableEntries = 0;
+		}
+
+		/// \brief takes a slot from the free list or from the unused part of the table
+		///   and makes it point to the given object
+		static WeakRefIndex acquireSlot(T* pObject)
+		{
+			uint32 index;
+			uint64 head = s_freeListHead.load(std::memory_order_acquire);
+			for (;;)
+			{
+				uint32 encodedIndex = static_cast<uint32>(head);
+				if (encodedIndex == 0)
+				{
+					index = s_nextUnusedIndex.fetch_add(1, std::memory_order_relaxed);
+					GEP_ASSERT(index < 0xFFFFFF, "index does not fit into 24 bits", index);
+					enlargeTable(index);
+					break;
+				}
+				uint32 next = getSlot(encodedIndex - 1).nextFree.load(std::memory_order_relaxed);
+				uint64 newHead = (((head >> 32) + 1) << 32) | next;
+				if (s_freeListHead.compare_exchange_weak(head, newHead, std::memory_order_acquire))
 				{
-					m_pGlobalHandleTable[newIndex] = static_cast<T*>(this);
-					m_ptrData.index = newIndex;
+					index = encodedIndex - 1;
 					break;
 				}
-					
 			}
-			
+
+			Slot& slot = getSlot(index);
+			WeakRefIndex result;
+			result.index = index;
+			result.hash = slot.hash.load(std::memory_order_relaxed);
+			slot.pObject.store(pObject, std::memory_order_release);
+			s_numWeakTableEntries.fetch_add(1, std::memory_order_relaxed);
+			return result;
+		}
+
+		/// \brief invalidates all weak references to the slot and puts it back on the free list
+		static void releaseSlot(uint32 index)
+		{
+			Slot& slot = getSlot(index);
+			slot.pObject.store(nullptr, std::memory_order_relaxed);
+			slot.hash.fetch_add(1, std::memory_order_release);
+
+			uint64 head = s_freeListHead.load(std::memory_order_relaxed);
+			uint64 newHead;
+			do
+			{
+				slot.nextFree.store(static_cast<uint32>(head), std::memory_order_relaxed);
+				newHead = (((head >> 32) + 1) << 32) | (index + 1);
+			}
+			while (!s_freeListHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+			s_numWeakTableEntries.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		/// \brief resolves a weak reference, returns nullptr if the slot has been released since
+		static T* resolve(WeakRefIndex ref)
+		{
+			if (ref.Compare(WeakRefIndex::invalidRef()))
+				return nullptr;
+			Slot& slot = getSlot(ref.index);
+			T* pObject = slot.pObject.load(std::memory_order_acquire);
+			if (pObject == nullptr || slot.hash.load(std::memory_order_acquire) != ref.hash)
+				return nullptr;
+			return pObject;
+		}
+
+	public:
+
+		WeakReferenced()
+		{
+			m_ptrData = acquireSlot(static_cast<T*>(this));
+		}
+
+		/// \brief a copy is a different object and gets its own slot
+		WeakReferenced(const WeakReferenced<T>& other)
+		{
+			m_ptrData = acquireSlot(static_cast<T*>(this));
+		}
+
+		/// \brief keeps the own slot, weak references are not transferred
+		WeakReferenced<T>& operator = (const WeakReferenced<T>& rh)
+		{
+			return *this;
 		}
 
         virtual ~WeakReferenced()
         {
-			m_numWeakTableEntries--;
-			m_pGlobalHandleTable[m_ptrData.index] = nullptr;
+			// after swapPlaces or invalidateAndReplace the slot might belong to someone else already
+			if (getSlot(m_ptrData.index).pObject.load(std::memory_order_relaxed) == static_cast<T*>(this))
+				releaseSlot(m_ptrData.index);
         }
 
         /// \brief gets the weak ref index for debugging purposes
@@ -70,27 +215,34 @@ namespace gep
         /// \brief all weak references of this and another weak referenced object
         void swapPlaces(WeakReferenced<T>& other)
         {
+			GEP_ASSERT(&other != this, "can not swap places with itself");
+			getSlot(m_ptrData.index).pObject.store(static_cast<T*>(&other), std::memory_order_release);
+			getSlot(other.m_ptrData.index).pObject.store(static_cast<T*>(this), std::memory_order_release);
+			std::swap(m_ptrData, other.m_ptrData);
         }
 
-		static void enlargeTable()
+		/// \brief returns the number of alive slots in the table of T
+		static uint32 getNumWeakTableEntries()
 		{
-			//TODO important yo
-		}
-
-		static void initTable()
-		{
-			m_pGlobalHandleTable = new T* [INITIAL_WEAK_TABLE_LENGTH];
-			memset(m_pGlobalHandleTable, 0, INITIAL_WEAK_TABLE_LENGTH * sizeof(T));
-			m_weakTableLength = INITIAL_WEAK_TABLE_LENGTH;
+			return s_numWeakTableEntries.load(std::memory_order_relaxed);
 		}
     };
 
     // this macro should define all static members neccessary for WeakReferenced
 	// other static member initialization
     #define DefineWeakRefStaticMembers(T) \
-	T** gep::WeakReferenced<T>::m_pGlobalHandleTable = nullptr; \
-	unsigned int gep::WeakReferenced<T>::m_weakTableLength = 0; \
-	unsigned int gep::WeakReferenced<T>::m_numWeakTableEntries = 0;
+	template<> std::atomic<gep::WeakReferenced<T>::Slot*> gep::WeakReferenced<T>::s_segments[WEAK_TABLE_MAX_SEGMENTS] = {}; \
+	template<> std::atomic<gep::uint64> gep::WeakReferenced<T>::s_freeListHead(0); \
+	template<> std::atomic<gep::uint32> gep::WeakReferenced<T>::s_nextUnusedIndex(0); \
+	template<> std::atomic<gep::uint32> gep::WeakReferenced<T>::s_numWeakTableEntries(0);
+
+	// declares the static members defined by DefineWeakRefStaticMembers, needed when the table of T
+	// lives in a dll and is used from other modules (pass GEP_API as API then)
+	#define DeclareWeakRefStaticMembers(T, API) \
+	template<> API std::atomic<gep::WeakReferenced<T>::Slot*> gep::WeakReferenced<T>::s_segments[WEAK_TABLE_MAX_SEGMENTS]; \
+	template<> API std::atomic<gep::uint64> gep::WeakReferenced<T>::s_freeListHead; \
+	template<> API std::atomic<gep::uint32> gep::WeakReferenced<T>::s_nextUnusedIndex; \
+	template<> API std::atomic<gep::uint32> gep::WeakReferenced<T>::s_numWeakTableEntries;
 
     template <class T>
     struct WeakPtr
@@ -107,34 +259,19 @@ namespace gep
         /// \brief constructor from an object
         inline WeakPtr(T* ptr)
         {
-			m_ptrData = ptr->m_ptrData;
+			m_ptrData = (ptr != nullptr) ? ptr->m_ptrData : WeakRefIndex::invalidRef();
         }
 
         /// \brief returns the pointer to the object, might be null
         inline T* get()
         {
-			//if (m_ptrData.both == WeakRefIndex::invalidRef().both)
-				//return nullptr;
-
-			WeakReferenced<T>* temp = WeakReferenced<T>::m_pGlobalHandleTable[m_ptrData.index];
-			if (temp == nullptr)
-				return nullptr;
-			if (m_ptrData.Compare(temp->m_ptrData))
-				return WeakReferenced<T>::m_pGlobalHandleTable[m_ptrData.index];
-
-			return nullptr;
+			return WeakReferenced<T>::resolve(m_ptrData);
         }
 
         /// \brief returns the pointer to the object, might be null
         inline const T* get() const
 		{
-			unsigned int index = m_ptrData.index;
-
-			//WeakReferenced<T>* temp = WeakReferenced<T>::m_pGlobalHandleTable[m_ptrData.index];
-			//if (m_ptrData.Compare(temp->m_ptrData))
-				return WeakReferenced<T>::m_pGlobalHandleTable[index];
-
-			//return nullptr;
+			return WeakReferenced<T>::resolve(m_ptrData);
         }
 
         WeakPtr<T>& operator = (T* ptr)
@@ -151,13 +288,37 @@ namespace gep
         /// creates a new weak reference
         void setWithNewIndex(T* ptr)
         {
-			//m_ptrData = ptr.m_ptrData;
+			GEP_ASSERT(ptr != nullptr);
+			m_ptrData = WeakReferenced<T>::acquireSlot(ptr);
         }
 
         /// \brief invalidates a weak reference which was previously created with setWithNewIndex
         ///   and replaces it with the given object
         void invalidateAndReplace(T* ptr)
         {
+			GEP_ASSERT(ptr != nullptr);
+			T* pStored = get();
+			GEP_ASSERT(pStored != nullptr, "reference is already invalid");
+			GEP_ASSERT(!pStored->m_ptrData.Compare(m_ptrData), "reference was not created with setWithNewIndex");
+			GEP_UNUSED(pStored);
+
+			// the object moves into this slot, all references to its old slot become invalid
+			WeakRefIndex oldIndex = ptr->m_ptrData;
+			ptr->m_ptrData = m_ptrData;
+			WeakReferenced<T>::getSlot(m_ptrData.index).pObject.store(ptr, std::memory_order_release);
+			WeakReferenced<T>::releaseSlot(oldIndex.index);
+        }
+
+        /// \brief gives back the slot of a weak reference created with setWithNewIndex which was never replaced
+        ///   all copies of this reference become invalid, the stand-in object keeps its own slot
+        void releaseNewIndex()
+        {
+			T* pStored = get();
+			GEP_ASSERT(pStored != nullptr, "reference is already invalid");
+			GEP_ASSERT(!pStored->m_ptrData.Compare(m_ptrData), "reference was not created with setWithNewIndex");
+			GEP_UNUSED(pStored);
+			WeakReferenced<T>::releaseSlot(m_ptrData.index);
+			m_ptrData = WeakRefIndex::invalidRef();
         }
 
         /// \brief gets the weak ref index for debugging purposes
@@ -168,10 +329,9 @@ namespace gep
 
 		inline ~WeakPtr()
 		{
-			//delete WeakReferenced<T>::m_pGlobalHandleTable[m_ptrData.index];
 			m_ptrData = WeakRefIndex::invalidRef();
 		}
-		
+
     };
 
 
@@ -1,17 +1,103 @@
 #pragma once
 //#include "gep/common.h"
 #include "gep/interfaces/logging.h"
+#include "gep/threading/mutex.h"
+#include "gep/threading/semaphore.h"
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdarg>
+#include <unordered_set>
 
 //class GlobalManager;
 
 namespace gep
 {
 	#define MAX_SINK_OBJECTS 2
+	/// longer messages are truncated
+	#define LOG_MAX_MESSAGE_LENGTH 512
+	/// number of records in each per thread ring buffer, has to be a power of two
+	#define LOG_RING_CAPACITY 128
+	/// default thresholds after which the writer thread flushes the sinks
+	#define LOG_DEFAULT_FLUSH_INTERVAL_MS 200
+	#define LOG_DEFAULT_FLUSH_SIZE (64 * 1024)
 
-    class Logging : public ILogging
+	static_assert((LOG_RING_CAPACITY & (LOG_RING_CAPACITY - 1)) == 0, "LOG_RING_CAPACITY has to be a power of two");
+
+	/// \brief a single formatted message waiting for the writer thread
+	struct LogRecord
+	{
+		/// microseconds since the epoch
+		int64 timestamp;
+		LogChannel channel;
+		/// format string of a binary record, nullptr if text holds the formatted message
+		const char* pFormat;
+		/// length of the message or of the packed arguments
+		uint32 length;
+		char text[LOG_MAX_MESSAGE_LENGTH];
+	};
+
+	/// \brief single producer single consumer ring of log records
+	///
+	/// Every thread that logs owns exactly one ring per Logging instance, the writer thread is the only consumer.
+	/// Rings of exited threads are handed to the next new thread instead of being freed.
+	struct LogRingBuffer
+	{
+		std::atomic<uint32> writeIndex;
+		std::atomic<uint32> readIndex;
+		/// true while a thread produces into this ring
+		std::atomic<bool> inUse;
+		LogRingBuffer* pNext;
+		LogRecord records[LOG_RING_CAPACITY];
+
+		LogRingBuffer() : writeIndex(0), readIndex(0), inUse(false), pNext(nullptr) {}
+	};
+
+    /// \brief logging with a background writer thread
+    ///
+    /// The log functions only format into the ring buffer of the calling thread and never
+    /// allocate or lock. The writer thread collects the records of all threads in timestamp
+    /// order, hands them to the sinks and flushes the sinks once enough data was written, the
+    /// flush interval passed or an error was logged.
+    /// In binary mode the log functions do not format at all, they only store the arguments next
+    /// to the address of the format string and the writer thread appends them to the binary file.
+    class GEP_API Logging : public ILogging
     {
 	private:
 		ILogSink* m_pSinkObjects[MAX_SINK_OBJECTS];
+		/// guards the sinks and the reading end of all ring buffers
+		Mutex m_sinkMutex;
+
+		std::atomic<LogRingBuffer*> m_pFirstRing;
+		uint32 m_instanceId;
+
+		std::thread m_writerThread;
+		std::atomic<bool> m_running;
+		Semaphore m_wakeup;
+		std::atomic<bool> m_wakeupPending;
+		std::atomic<uint32> m_flushIntervalMs;
+		std::atomic<size_t> m_flushSize;
+		std::atomic<uint32> m_numDroppedMessages;
+		std::atomic<bool> m_binaryMode;
+
+		// only accessed while holding m_sinkMutex
+		size_t m_bytesSinceFlush;
+		bool m_errorSinceFlush;
+		int64 m_cachedSecond;
+		char m_cachedTimePrefix[32];
+		FILE* m_pBinaryFile;
+		/// format strings already written to the current binary file
+		std::unordered_set<const char*> m_knownFormats;
+
+		LogRingBuffer* getThreadRing();
+		void wakeWriter();
+		void writerLoop();
+		/// \brief passes everything that is in the rings right now to the sinks
+		void drainRings();
+		void writeRecord(const LogRecord& record);
+		void writeBinaryRecord(const LogRecord& record);
+		void flushSinks();
+
 	public:
 
 		/// Inherited via ILogging
@@ -20,9 +106,17 @@ namespace gep
 		virtual void logError(GEP_PRINTF_FORMAT_STRING const char * fmt, ...) override;
 		virtual void registerSink(ILogSink * pSink) override;
 		virtual void deregisterSink(ILogSink * pSink) override;
+		virtual void flush() override;
+		virtual Result setBinaryLogFile(const char* pFilename) override;
+
+		///\brief queues the message for all registered sinks with the given logchannel
+		void printMessage(LogChannel channel, const char * fmt, va_list args);
 
-		///\brief prints the message in all registered sinks with the given logchannel
-		void printMessage(LogChannel channel, const char * fmt, ...);
+		/// \brief sets after how many milliseconds or written bytes the sinks get flushed
+		void setFlushThresholds(uint32 intervalMs, size_t numBytes);
+
+		/// \brief number of ring buffers this instance allocated so far
+		size_t getNumRingBuffers();
 
 		Logging();
 		~Logging();
@@ -32,12 +126,21 @@ namespace gep
     {
 		// Inherited via ILogSink
 		virtual void take(LogChannel channel, const char * msg) override;
+		virtual void flush() override;
 	};
 
 	class FileLogSink : public ILogSink
     {
 		const char* filename = "SystemLogFile.log";
+		FILE* m_pFile;
+		char m_buffer[LOG_DEFAULT_FLUSH_SIZE];
+
 		//Inherited via ILogSink
 		virtual void take(LogChannel channel, const char * msg) override;
+		virtual void flush() override;
+
+	public:
+		FileLogSink();
+		~FileLogSink();
 	};
-}
\ No newline at end of file
+}
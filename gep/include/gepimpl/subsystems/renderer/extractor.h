@@ -5,8 +5,19 @@ namespace gep
 {
 	class RendererExtractor : public IRendererExtractor
 	{
+		float m_interpolationAlpha;
+
+	public:
+		RendererExtractor() : m_interpolationAlpha(1.0f) {}
+
 		virtual const mat4 getViewMatrix() const;
 		virtual const mat4 getProjectionMatrix() const;
+
+		virtual void beginDebugMarker(const char* name) override;
+		virtual void endDebugMarker() override;
+
+		virtual void setInterpolationAlpha(float alpha) override { m_interpolationAlpha = alpha; }
+		virtual float getInterpolationAlpha() const override { return m_interpolationAlpha; }
 	};
 }
 
@@ -44,9 +44,12 @@ namespace gep
     {
     private:
         Renderer* m_pRenderer;
+        /// read into memory by prefetch, released once the model was loaded from them
+        std::vector<std::string> m_prefetchedFiles;
 
     public:
         ModelFileLoader(const char* filename);
+        virtual void prefetch(AsyncIo& io, std::function<void()> onDone) override;
         virtual Model* loadResource(Model* pInPlace) override;
         virtual void postLoad(ResourcePtr<IResource> pResource) override;
 
@@ -36,10 +36,13 @@ namespace gep
     private:
         Renderer* m_pRenderer;
         bool m_isRegistered;
+        /// the file was read into memory by prefetch
+        bool m_isPrefetched;
 
     public:
         Texture2DFileLoader(const char* filename);
         ~Texture2DFileLoader();
+        virtual void prefetch(AsyncIo& io, std::function<void()> onDone) override;
         virtual Texture2D* loadResource(Texture2D* pInPlace) override;
         virtual void postLoad(ResourcePtr<IResource> pResource) override;
 
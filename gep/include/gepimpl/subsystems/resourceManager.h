@@ -1,18 +1,102 @@
 #pragma once
 #include "gep/interfaces/resourcemanager.h"
+#include "gep/container/dynamicarray.h"
+#include "gep/directory.h"
+#include "gep/threading/mutex.h"
+#include "gep/threading/jobqueue.h"
+#include "gep/asyncio.h"
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
 namespace gep
 {
+	/// number of threads which only wait for the disk, if AsyncIo can not use io_uring
+	#define RESOURCE_IO_THREADS 2
 
-    class ResourceManager : public IResourceManager
+    class GEP_API ResourceManager : public IResourceManager
     {
-		// Inherited via IResourceManager
+	private:
+		struct ReloadInfo
+		{
+			/// the normalized filename, tells files with the same hash apart
+			std::string path;
+			ResourcePtr<IResource> pResource;
+			IResourceLoader* pLoader;
+			uint32 updateNum;
+		};
+
+		struct LoadedResource
+		{
+			/// the normalized resource id, tells resources with the same hash apart
+			std::string path;
+			ResourcePtr<IResource> pResource;
+		};
+
+		/// \brief an asynchronous load on its way through the io service and the job threads
+		struct PendingLoad
+		{
+			IResourceLoader* pLoader;
+			/// handle created on the dummy, the loaded resource gets swapped into it
+			ResourcePtr<IResource> pResource;
+			ResourceLoadBatch* pBatch;
+			IResource* pResult;
+			std::string error;
+		};
+
+		std::unordered_map<std::string, IResource*> m_resourceDummies;
+		/// by the hash normalizeAndHashPath computes for the filename
+		std::unordered_multimap<uint64, ReloadInfo> m_fileChangedListener;
+		std::unordered_map<IResourceLoader*, bool> m_failedInitialLoad;
+		/// by the hash normalizeAndHashPath computes for the resource id
+		std::unordered_multimap<uint64, LoadedResource> m_loadedResources;
+		Mutex m_fileChangedLock;
+		DynamicArray<IResource*> m_newResources;
+		DirectoryWatcher m_dataDirWatcher;
+		float m_timeSinceLastCheck;
+		uint32 m_updateNum;
+
+		AsyncIo* m_pAsyncIo;
+		JobQueue* m_pJobQueue;
+		/// loads finished on the job threads, waiting to be swapped in on the main thread
+		std::vector<PendingLoad*> m_completedLoads;
+		std::mutex m_completedLoadsMutex;
+		std::condition_variable m_loadCompleted;
+		uint32 m_numPendingLoads;
+
+		void removeFromNewList(IResource* pResource);
+		void addLoadedResource(uint64 hash, const std::string& resourceId, ResourcePtr<IResource> pResource);
+		void checkForChangedFiles();
+		/// \brief loads the resource again with its loader and swaps it in, in place of the dummy if the initial load failed
+		Result reloadWithLoader(ResourcePtr<IResource>& pResource, IResourceLoader* pLoader);
+		/// \brief runs on a job thread
+		void executeLoad(PendingLoad* pLoad);
+		/// \brief swaps in all finished loads, has to run on the main thread
+		void applyCompletedLoads();
+		void applyCompletedLoad(PendingLoad* pLoad);
+
+	protected:
+		virtual ResourcePtr<IResource> doLoadResource(IResourceLoader& loader) override;
+		virtual ResourcePtr<IResource> doLoadResourceAsync(IResourceLoader& loader, ResourceLoadBatch* pBatch) override;
+
+	public:
+		ResourceManager();
+
+		// ISubsystem interface
 		virtual void initialize() override;
 		virtual void destroy() override;
+		virtual void update(float elapsedTime) override;
+
+		// IResourceManager interface
 		virtual void deleteResource(IResource * pResource) override;
 		virtual void registerResourceType(IResource * pDummy) override;
 		virtual void registerResourceType(const char * resourceType) override;
 		virtual void finalizeResourcesWithFlags(uint32 flags) override;
+		virtual void registerLoaderForReload(const std::string& filename, IResourceLoader* pLoader, ResourcePtr<IResource> pResource) override;
+		virtual void deregisterLoaderForReload(const std::string& filename, IResourceLoader* pLoader) override;
+		virtual void reloadResource(ResourcePtr<IResource> pResource) override;
+		virtual Result waitForBatch(ResourceLoadBatch& batch, uint32 timeoutMs = 0xFFFFFFFF) override;
 	};
 
 #define g_resourceManager (*static_cast<ResourceManager*>(g_globalManager.getResourceManager()))
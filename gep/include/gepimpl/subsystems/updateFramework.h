@@ -1,18 +1,59 @@
 #pragma once
 #include "gep/interfaces/updateframework.h"
+#include "gep/timer.h"
+#include "gep/framepacing.h"
+#include <string>
+#include <vector>
 
 
 
 namespace gep
 {
+    class AllocationTrace;
 
     class UpdateFramework : public IUpdateFramework
     {
+    private:
+        struct Callback
+        {
+            size_t id;
+            std::function<void(float elapsedTime)> function;
+        };
+
+        Timer m_gameTimer;
+        float m_elapsedTime;
+        FrameTimeStats m_frameTimeStats;
+        bool m_running;
+        bool m_useFixedTimestep;
+        FixedTimestep m_fixedTimestep;
+        FrameLimiter m_frameLimiter;
+        size_t m_nextCallbackId;
+        std::vector<Callback> m_callbacks;
+
+        AllocationTrace* m_pAllocationTrace;
+        std::string m_allocationTraceFile;
+        uint32 m_numTraceFramesLeft;
+        bool m_isTracingAllocations;
+
+        void runCallbacks(float elapsedTime);
+        /// \brief called between two frames, starts a requested allocation trace or writes it once enough frames were recorded
+        void advanceAllocationTrace(bool isStopping);
+
+    public:
+        UpdateFramework();
+        ~UpdateFramework();
+
 		// Inherited via IUpdateFramework
 		virtual void stop() override;
 		virtual void run() override;
 		virtual float getElapsedTime() const override;
 		virtual float calcElapsedTimeAverage(size_t numFrames) const override;
+		virtual const FrameTimeStats& getFrameTimeStats() const override;
+		virtual void setFrameTimeHistoryLength(size_t numFrames) override;
+		virtual void setFixedTimestep(float tickRate, uint32 maxStepsPerFrame) override;
+		virtual float getInterpolationAlpha() const override;
+		virtual void setTargetFrameTime(float seconds) override;
+		virtual void recordAllocationTrace(const char* filename, uint32 numFrames) override;
 		virtual CallbackId registerUpdateCallback(std::function<void(float elapsedTime)> callback) override;
 		virtual void deregisterUpdateCallback(CallbackId id) override;
 	};
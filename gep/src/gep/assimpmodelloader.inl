@@ -3,11 +3,14 @@
 
 #include <gep/container/DynamicArray.h>
 #include <gep/interfaces/logging.h>
+#include <gep/vfs.h>
 
 #include <assimp/Logger.hpp>
 #include <assimp/DefaultLogger.hpp>
 #include <assimp/LogStream.hpp>
 
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -116,6 +119,92 @@ namespace
             }
         }
     };
+
+    /// \brief a file opened by Assimp, read from the mapping of the VfsFile
+    class VfsIOStream : public Assimp::IOStream
+    {
+        gep::VfsFile m_file;
+
+    public:
+        inline gep::VfsFile& getFile() { return m_file; }
+
+        virtual size_t Read(void* pBuffer, size_t size, size_t count) override
+        {
+            if (size == 0)
+                return 0;
+            size_t available = (m_file.getSize() - m_file.position()) / size;
+            if (count > available)
+                count = available;
+            m_file.readArray(static_cast<gep::uint8*>(pBuffer), size * count);
+            return count;
+        }
+
+        virtual size_t Write(const void*, size_t, size_t) override
+        {
+            return 0;
+        }
+
+        virtual aiReturn Seek(size_t offset, aiOrigin origin) override
+        {
+            size_t base = 0;
+            if (origin == aiOrigin_CUR)
+                base = m_file.position();
+            else if (origin == aiOrigin_END)
+                base = m_file.getSize();
+            if (offset > m_file.getSize() - base)
+                return aiReturn_FAILURE;
+            m_file.seek(base + offset);
+            return aiReturn_SUCCESS;
+        }
+
+        virtual size_t Tell() const override
+        {
+            return m_file.position();
+        }
+
+        virtual size_t FileSize() const override
+        {
+            return m_file.getSize();
+        }
+
+        virtual void Flush() override
+        {
+        }
+    };
+
+    /// \brief lets Assimp open the model and the files it references, like materials, through the VirtualFileSystem
+    class VfsIOSystem : public Assimp::IOSystem
+    {
+    public:
+        virtual bool Exists(const char* pFile) const override
+        {
+            return g_vfs.exists(pFile);
+        }
+
+        virtual char getOsSeparator() const override
+        {
+            return '/';
+        }
+
+        virtual Assimp::IOStream* Open(const char* pFile, const char* pMode) override
+        {
+            // the files in archives can only be read
+            if (strpbrk(pMode, "wa+") != nullptr)
+                return nullptr;
+            auto pStream = new VfsIOStream();
+            if (g_vfs.open(pFile, pStream->getFile()) != gep::SUCCESS)
+            {
+                delete pStream;
+                return nullptr;
+            }
+            return pStream;
+        }
+
+        virtual void Close(Assimp::IOStream* pFile) override
+        {
+            delete pFile;
+        }
+    };
 }
 
 const char* const AssimpLogger::s_messagePrefix = "[Assimp]";
@@ -137,6 +226,8 @@ inline void gep::ModelLoader::loadAssimpCompatibleModel(const char* pFilename, u
     // Note: All resources allocated by the importer
     //       are destroyed when this scope is left.
     Assimp::Importer importer;
+    // the model may be in a pak archive, the importer takes ownership of the io system
+    importer.SetIOHandler(new VfsIOSystem());
 
     importer.SetPropertyBool( AI_CONFIG_IMPORT_FBX_READ_ANIMATIONS, false );
     importer.SetPropertyBool( AI_CONFIG_IMPORT_FBX_OPTIMIZE_EMPTY_ANIMATION_CURVES, false );
@@ -0,0 +1,751 @@
+#include "stdafx.h"
+#include "gep/asyncio.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace gep
+{
+    /// \brief a single read covering one or more adjacent requests
+    struct AsyncIoBatch
+    {
+        std::vector<AsyncIo::Request*> requests;
+        uint64 offset;
+        size_t size;
+    };
+}
+
+namespace
+{
+    /// more destinations than this are not coalesced, keeps us below IOV_MAX everywhere
+    const size_t maxRequestsPerBatch = 64;
+
+#ifdef _WIN32
+    typedef HANDLE NativeFile;
+    const NativeFile invalidFile = INVALID_HANDLE_VALUE;
+
+    NativeFile openForReading(const char* filename)
+    {
+        return CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    }
+
+    void closeFile(NativeFile file)
+    {
+        CloseHandle(file);
+    }
+
+    /// \return number of bytes read, stops early at the end of the file or on error
+    size_t readAt(NativeFile file, gep::uint64 offset, void* pDestination, size_t size)
+    {
+        size_t totalRead = 0;
+        while (totalRead < size)
+        {
+            OVERLAPPED overlapped = {};
+            gep::uint64 position = offset + totalRead;
+            overlapped.Offset = static_cast<DWORD>(position);
+            overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+            DWORD toRead = static_cast<DWORD>(std::min<size_t>(size - totalRead, 0x40000000));
+            DWORD bytesRead = 0;
+            if (!ReadFile(file, static_cast<char*>(pDestination) + totalRead, toRead, &bytesRead, &overlapped) || bytesRead == 0)
+                break;
+            totalRead += bytesRead;
+        }
+        return totalRead;
+    }
+#else
+    typedef int NativeFile;
+    const NativeFile invalidFile = -1;
+
+    NativeFile openForReading(const char* filename)
+    {
+        return open(filename, O_RDONLY | O_CLOEXEC);
+    }
+
+    void closeFile(NativeFile file)
+    {
+        close(file);
+    }
+#endif
+}
+
+namespace gep
+{
+    /// \brief services the batches of an AsyncIo
+    class AsyncIoBackend
+    {
+    protected:
+        AsyncIo& m_io;
+
+        AsyncIoBackend(AsyncIo& io) : m_io(io) {}
+
+        bool takeBatch(AsyncIoBatch& batch, bool wait) { return m_io.takeBatch(batch, wait); }
+        void completeBatch(AsyncIoBatch& batch, bool success, size_t bytesRead) { m_io.completeBatch(batch, success, bytesRead); }
+        void countRead() { m_io.m_numReadsIssued++; }
+        static const std::string& getFilename(AsyncIoBatch& batch) { return batch.requests[0]->desc.filename; }
+        static void* getDestination(AsyncIoBatch& batch, size_t i) { return batch.requests[i]->desc.pDestination; }
+        static size_t getSize(AsyncIoBatch& batch, size_t i) { return batch.requests[i]->desc.size; }
+
+    public:
+        virtual ~AsyncIoBackend() {}
+        virtual const char* getName() const = 0;
+        /// \brief called after a request was queued or the service started stopping, for backends which do not wait in takeBatch
+        virtual void wake() {}
+        /// \brief stops the backend, has to complete every batch it can still take
+        virtual void shutdown() = 0;
+    };
+}
+
+namespace
+{
+    /// \brief blocking positional reads on a number of threads
+    class ThreadPoolBackend : public gep::AsyncIoBackend
+    {
+    private:
+        std::vector<std::thread> m_threads;
+
+        void threadLoop()
+        {
+            gep::AsyncIoBatch batch;
+#ifdef _WIN32
+            // coalesced reads go through here, there is no vectored positional read for buffered handles
+            std::vector<char> scratch;
+#endif
+            while (takeBatch(batch, true))
+            {
+                countRead();
+                NativeFile file = openForReading(getFilename(batch).c_str());
+                if (file == invalidFile)
+                {
+                    completeBatch(batch, false, 0);
+                    continue;
+                }
+
+                size_t bytesRead = 0;
+#ifdef _WIN32
+                if (batch.requests.size() == 1)
+                {
+                    bytesRead = readAt(file, batch.offset, getDestination(batch, 0), batch.size);
+                }
+                else
+                {
+                    scratch.resize(batch.size);
+                    bytesRead = readAt(file, batch.offset, scratch.data(), batch.size);
+                    size_t copied = 0;
+                    for (size_t i = 0; i < batch.requests.size() && copied < bytesRead; i++)
+                    {
+                        size_t toCopy = std::min(getSize(batch, i), bytesRead - copied);
+                        memcpy(getDestination(batch, i), scratch.data() + copied, toCopy);
+                        copied += toCopy;
+                    }
+                }
+#else
+                iovec iov[maxRequestsPerBatch];
+                for (size_t i = 0; i < batch.requests.size(); i++)
+                {
+                    iov[i].iov_base = getDestination(batch, i);
+                    iov[i].iov_len = getSize(batch, i);
+                }
+                // preadv may return early, continue where it stopped
+                size_t firstIov = 0;
+                while (bytesRead < batch.size)
+                {
+                    ssize_t result = preadv(file, iov + firstIov, static_cast<int>(batch.requests.size() - firstIov), batch.offset + bytesRead);
+                    if (result < 0 && errno == EINTR)
+                        continue;
+                    if (result <= 0)
+                        break;
+                    bytesRead += result;
+                    size_t remaining = result;
+                    while (firstIov < batch.requests.size() && remaining >= iov[firstIov].iov_len)
+                    {
+                        remaining -= iov[firstIov].iov_len;
+                        firstIov++;
+                    }
+                    if (firstIov < batch.requests.size())
+                    {
+                        iov[firstIov].iov_base = static_cast<char*>(iov[firstIov].iov_base) + remaining;
+                        iov[firstIov].iov_len -= remaining;
+                    }
+                }
+#endif
+                closeFile(file);
+                completeBatch(batch, true, bytesRead);
+            }
+        }
+
+    public:
+        ThreadPoolBackend(gep::AsyncIo& io, gep::uint32 numThreads) : AsyncIoBackend(io)
+        {
+            for (gep::uint32 i = 0; i < numThreads; i++)
+            {
+                m_threads.emplace_back([this]() { threadLoop(); });
+            }
+        }
+
+        virtual const char* getName() const override { return "thread pool"; }
+
+        virtual void shutdown() override
+        {
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+            m_threads.clear();
+        }
+    };
+
+#ifdef __linux__
+    /// \brief linux io_uring, talks to the kernel through the raw system calls so that there is no dependency on liburing
+    ///
+    /// A single thread fills the submission queue and reaps the completions, the kernel does the rest.
+    class IoUringBackend : public gep::AsyncIoBackend
+    {
+    private:
+        struct InFlight
+        {
+            gep::AsyncIoBatch batch;
+            NativeFile file;
+            iovec iov[maxRequestsPerBatch];
+            /// the first destination which is not full yet, after a short read
+            size_t firstIov;
+            size_t bytesRead;
+        };
+
+        static const unsigned s_queueDepth = 32;
+        /// user data of the poll on m_wakeFd, never the address of an InFlight
+        static const gep::uint64 s_wakeUserData = 0;
+
+        int m_ringFd;
+        /// written to for every new request, a poll on it ends the wait for completions
+        int m_wakeFd;
+        bool m_isWakePollArmed;
+        void* m_pSqRing;
+        size_t m_sqRingSize;
+        void* m_pCqRing;
+        size_t m_cqRingSize;
+        io_uring_sqe* m_pSqes;
+        size_t m_sqesSize;
+
+        unsigned* m_pSqTail;
+        unsigned* m_pSqMask;
+        unsigned* m_pSqArray;
+        unsigned* m_pCqHead;
+        unsigned* m_pCqTail;
+        unsigned* m_pCqMask;
+        io_uring_cqe* m_pCqes;
+
+        std::thread m_thread;
+
+        static int ioUringSetup(unsigned entries, io_uring_params* pParams)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, pParams));
+        }
+
+        static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+        {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+        }
+
+        io_uring_sqe& nextSubmission()
+        {
+            unsigned index = *m_pSqTail & *m_pSqMask;
+            io_uring_sqe& sqe = m_pSqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            m_pSqArray[index] = index;
+            return sqe;
+        }
+
+        void commitSubmission()
+        {
+            // the kernel must see the filled entry before the new tail
+            __atomic_store_n(m_pSqTail, *m_pSqTail + 1, __ATOMIC_RELEASE);
+        }
+
+        /// \brief reads whatever the destinations of the batch are still missing
+        void pushSubmission(InFlight* pInFlight)
+        {
+            io_uring_sqe& sqe = nextSubmission();
+            sqe.opcode = IORING_OP_READV;
+            sqe.fd = pInFlight->file;
+            sqe.off = pInFlight->batch.offset + pInFlight->bytesRead;
+            sqe.addr = reinterpret_cast<gep::uint64>(pInFlight->iov + pInFlight->firstIov);
+            sqe.len = static_cast<unsigned>(pInFlight->batch.requests.size() - pInFlight->firstIov);
+            sqe.user_data = reinterpret_cast<gep::uint64>(pInFlight);
+            commitSubmission();
+        }
+
+        void pushWakePoll()
+        {
+            io_uring_sqe& sqe = nextSubmission();
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = m_wakeFd;
+            sqe.poll_events = POLLIN;
+            sqe.user_data = s_wakeUserData;
+            commitSubmission();
+            m_isWakePollArmed = true;
+        }
+
+        /// \brief completes the finished reads and submits the rest of short reads again
+        /// \return number of reads which left the kernel, including the ones submitted again
+        unsigned reapCompletions(unsigned& numUnsubmitted)
+        {
+            unsigned head = *m_pCqHead;
+            unsigned tail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+            unsigned numReaped = 0;
+            for (; head != tail; head++)
+            {
+                const io_uring_cqe& cqe = m_pCqes[head & *m_pCqMask];
+                if (cqe.user_data == s_wakeUserData)
+                {
+                    // reset the counter, the poll is armed again before the next wait
+                    gep::uint64 value;
+                    ssize_t numRead = ::read(m_wakeFd, &value, sizeof(value));
+                    GEP_UNUSED(numRead);
+                    m_isWakePollArmed = false;
+                    continue;
+                }
+
+                numReaped++;
+                InFlight* pInFlight = reinterpret_cast<InFlight*>(cqe.user_data);
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+                {
+                    pushSubmission(pInFlight);
+                    numUnsubmitted++;
+                    continue;
+                }
+                if (cqe.res > 0)
+                {
+                    // reads may end early anywhere, only a read which returns nothing is at the end of the file
+                    pInFlight->bytesRead += static_cast<size_t>(cqe.res);
+                    size_t remaining = static_cast<size_t>(cqe.res);
+                    size_t numIov = pInFlight->batch.requests.size();
+                    while (pInFlight->firstIov < numIov && remaining >= pInFlight->iov[pInFlight->firstIov].iov_len)
+                    {
+                        remaining -= pInFlight->iov[pInFlight->firstIov].iov_len;
+                        pInFlight->firstIov++;
+                    }
+                    if (pInFlight->firstIov < numIov)
+                    {
+                        iovec& iov = pInFlight->iov[pInFlight->firstIov];
+                        iov.iov_base = static_cast<char*>(iov.iov_base) + remaining;
+                        iov.iov_len -= remaining;
+                        pushSubmission(pInFlight);
+                        numUnsubmitted++;
+                        continue;
+                    }
+                }
+                closeFile(pInFlight->file);
+                completeBatch(pInFlight->batch, cqe.res >= 0, pInFlight->bytesRead);
+                delete pInFlight;
+            }
+            __atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+            return numReaped;
+        }
+
+        void threadLoop()
+        {
+            unsigned numInFlight = 0;
+            // reads in the submission queue the kernel has not consumed yet
+            unsigned numUnsubmitted = 0;
+            // the poll on m_wakeFd is in the submission queue behind this many reads
+            bool isWakePollQueued = false;
+            unsigned numBeforeWakePoll = 0;
+            for (;;)
+            {
+                // one entry is kept free for the poll on m_wakeFd
+                while (numInFlight + numUnsubmitted < s_queueDepth - 1)
+                {
+                    // only block for new requests if there is nothing the kernel could complete meanwhile
+                    bool wait = (numInFlight + numUnsubmitted == 0);
+                    InFlight* pInFlight = new InFlight;
+                    if (!takeBatch(pInFlight->batch, wait))
+                    {
+                        delete pInFlight;
+                        if (wait)
+                            return; // stopping and everything is done
+                        break;
+                    }
+                    countRead();
+                    pInFlight->file = openForReading(getFilename(pInFlight->batch).c_str());
+                    if (pInFlight->file == invalidFile)
+                    {
+                        completeBatch(pInFlight->batch, false, 0);
+                        delete pInFlight;
+                        continue;
+                    }
+                    for (size_t i = 0; i < pInFlight->batch.requests.size(); i++)
+                    {
+                        pInFlight->iov[i].iov_base = getDestination(pInFlight->batch, i);
+                        pInFlight->iov[i].iov_len = getSize(pInFlight->batch, i);
+                    }
+                    pInFlight->firstIov = 0;
+                    pInFlight->bytesRead = 0;
+                    pushSubmission(pInFlight);
+                    numUnsubmitted++;
+                }
+
+                if (numInFlight + numUnsubmitted == 0)
+                    continue;
+
+                // the new reads are submitted before waiting, a new request completes the poll and ends the wait
+                if (!m_isWakePollArmed)
+                {
+                    pushWakePoll();
+                    isWakePollQueued = true;
+                    numBeforeWakePoll = numUnsubmitted;
+                }
+                unsigned numSubmissions = numUnsubmitted + (isWakePollQueued ? 1 : 0);
+                int result = ioUringEnter(m_ringFd, numSubmissions, 1, IORING_ENTER_GETEVENTS);
+                if (result >= 0)
+                {
+                    // the kernel consumes the queue in order, the poll might be anywhere in it
+                    unsigned numReads = static_cast<unsigned>(result);
+                    if (isWakePollQueued)
+                    {
+                        if (numReads > numBeforeWakePoll)
+                        {
+                            isWakePollQueued = false;
+                            numReads--;
+                        }
+                        else
+                        {
+                            numBeforeWakePoll -= numReads;
+                        }
+                    }
+                    numInFlight += numReads;
+                    numUnsubmitted -= numReads;
+                }
+                else
+                {
+                    // interrupted or out of kernel resources, whatever was not consumed is submitted again next round
+                    GEP_ASSERT(errno == EINTR || errno == EAGAIN || errno == EBUSY, "io_uring_enter failed", errno);
+                }
+                unsigned numResubmitted = 0;
+                numInFlight -= reapCompletions(numResubmitted);
+                numUnsubmitted += numResubmitted;
+            }
+        }
+
+    public:
+        IoUringBackend(gep::AsyncIo& io) : AsyncIoBackend(io),
+            m_ringFd(-1),
+            m_wakeFd(-1),
+            m_isWakePollArmed(false),
+            m_pSqRing(MAP_FAILED),
+            m_pCqRing(MAP_FAILED),
+            m_pSqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+        {
+        }
+
+        ~IoUringBackend()
+        {
+            if (m_pSqes != MAP_FAILED)
+                munmap(m_pSqes, m_sqesSize);
+            if (m_pCqRing != MAP_FAILED && m_pCqRing != m_pSqRing)
+                munmap(m_pCqRing, m_cqRingSize);
+            if (m_pSqRing != MAP_FAILED)
+                munmap(m_pSqRing, m_sqRingSize);
+            if (m_ringFd >= 0)
+                close(m_ringFd);
+            if (m_wakeFd >= 0)
+                close(m_wakeFd);
+        }
+
+        /// \brief sets up the ring, fails on old kernels or when io_uring is disabled (e.g. by seccomp)
+        gep::Result initialize()
+        {
+            m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (m_wakeFd < 0)
+                return gep::FAILURE;
+            io_uring_params params = {};
+            m_ringFd = ioUringSetup(s_queueDepth, &params);
+            if (m_ringFd < 0)
+                return gep::FAILURE;
+
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMmap)
+                m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+            m_pSqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+            if (m_pSqRing == MAP_FAILED)
+                return gep::FAILURE;
+            if (singleMmap)
+                m_pCqRing = m_pSqRing;
+            else
+            {
+                m_pCqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+                if (m_pCqRing == MAP_FAILED)
+                    return gep::FAILURE;
+            }
+            m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            m_pSqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES));
+            if (m_pSqes == MAP_FAILED)
+                return gep::FAILURE;
+
+            char* pSq = static_cast<char*>(m_pSqRing);
+            char* pCq = static_cast<char*>(m_pCqRing);
+            m_pSqTail = reinterpret_cast<unsigned*>(pSq + params.sq_off.tail);
+            m_pSqMask = reinterpret_cast<unsigned*>(pSq + params.sq_off.ring_mask);
+            m_pSqArray = reinterpret_cast<unsigned*>(pSq + params.sq_off.array);
+            m_pCqHead = reinterpret_cast<unsigned*>(pCq + params.cq_off.head);
+            m_pCqTail = reinterpret_cast<unsigned*>(pCq + params.cq_off.tail);
+            m_pCqMask = reinterpret_cast<unsigned*>(pCq + params.cq_off.ring_mask);
+            m_pCqes = reinterpret_cast<io_uring_cqe*>(pCq + params.cq_off.cqes);
+
+            m_thread = std::thread([this]() { threadLoop(); });
+            return gep::SUCCESS;
+        }
+
+        virtual const char* getName() const override { return "io_uring"; }
+
+        virtual void wake() override
+        {
+            gep::uint64 one = 1;
+            ssize_t numWritten = ::write(m_wakeFd, &one, sizeof(one));
+            GEP_UNUSED(numWritten);
+        }
+
+        virtual void shutdown() override
+        {
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+    };
+#endif
+}
+
+gep::AsyncIo::AsyncIo(uint32 numThreads, IoBackend::Enum backend) :
+    m_numOutstanding(0),
+    m_nextId(INVALID_IO_REQUEST + 1),
+    m_stopping(false),
+    m_maxCoalescedSize(1024 * 1024),
+    m_numReadsIssued(0),
+    m_numRequestsCompleted(0),
+    m_pBackend(nullptr)
+{
+#ifdef __linux__
+    if (backend != IoBackend::ThreadPool)
+    {
+        auto pIoUring = new IoUringBackend(*this);
+        if (pIoUring->initialize() == SUCCESS)
+            m_pBackend = pIoUring;
+        else
+            delete pIoUring;
+    }
+#endif
+    if (m_pBackend == nullptr)
+    {
+        // a couple of threads keep the disk queue filled without fighting over the disk head
+        if (numThreads == 0)
+            numThreads = 2;
+        m_pBackend = new ThreadPoolBackend(*this, numThreads);
+    }
+}
+
+gep::AsyncIo::~AsyncIo()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_requestAvailable.notify_all();
+    m_pBackend->wake();
+    m_pBackend->shutdown();
+    delete m_pBackend;
+    GEP_ASSERT(m_pendingById.empty(), "io requests left over after shutdown");
+}
+
+gep::IoRequestId gep::AsyncIo::read(IoReadRequest request)
+{
+    GEP_ASSERT(request.pDestination != nullptr || request.size == 0);
+    Request* pRequest = new Request;
+    pRequest->desc = std::move(request);
+    pRequest->cancelled = false;
+    IoRequestId id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        GEP_ASSERT(!m_stopping, "reading from an io service which is shutting down");
+        id = m_nextId++;
+        if (m_nextId == INVALID_IO_REQUEST)
+            m_nextId++;
+        pRequest->id = id;
+        m_pending[pRequest->desc.priority].push_back(pRequest);
+        m_pendingById[id] = pRequest;
+        m_numOutstanding++;
+    }
+    m_requestAvailable.notify_one();
+    m_pBackend->wake();
+    return id;
+}
+
+bool gep::AsyncIo::cancel(IoRequestId id)
+{
+    std::function<void(IoStatus::Enum, size_t)> onComplete;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_pendingById.find(id);
+        if (it == m_pendingById.end())
+            return false;
+        // stays in its fifo until it is popped
+        it->second->cancelled = true;
+        onComplete = std::move(it->second->desc.onComplete);
+        m_pendingById.erase(it);
+    }
+
+    if (onComplete)
+        onComplete(IoStatus::Cancelled, 0);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_numOutstanding--;
+    if (m_numOutstanding == 0)
+        m_idle.notify_all();
+    return true;
+}
+
+void gep::AsyncIo::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return m_numOutstanding == 0; });
+}
+
+void gep::AsyncIo::setMaxCoalescedSize(size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maxCoalescedSize = size;
+}
+
+const char* gep::AsyncIo::getBackendName() const
+{
+    return m_pBackend->getName();
+}
+
+gep::AsyncIo::Request* gep::AsyncIo::popHighestPriority()
+{
+    for (int priority = IoPriority::Count - 1; priority >= 0; priority--)
+    {
+        auto& fifo = m_pending[priority];
+        while (!fifo.empty())
+        {
+            Request* pRequest = fifo.front();
+            fifo.pop_front();
+            if (!pRequest->cancelled)
+                return pRequest;
+            delete pRequest;
+        }
+    }
+    return nullptr;
+}
+
+gep::AsyncIo::Request* gep::AsyncIo::removePendingAdjacent(const std::string& filename, uint64 offset, bool before)
+{
+    for (auto& fifo : m_pending)
+    {
+        for (auto it = fifo.begin(); it != fifo.end(); ++it)
+        {
+            Request* pRequest = *it;
+            if (pRequest->cancelled || pRequest->desc.filename != filename)
+                continue;
+            bool adjacent = before ? (pRequest->desc.offset + pRequest->desc.size == offset) : (pRequest->desc.offset == offset);
+            if (adjacent)
+            {
+                fifo.erase(it);
+                return pRequest;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool gep::AsyncIo::takeBatch(AsyncIoBatch& batch, bool wait)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Request* pFirst = nullptr;
+    for (;;)
+    {
+        pFirst = popHighestPriority();
+        if (pFirst != nullptr || !wait || m_stopping)
+            break;
+        m_requestAvailable.wait(lock);
+    }
+    if (pFirst == nullptr)
+        return false;
+
+    batch.requests.clear();
+    batch.requests.push_back(pFirst);
+    batch.offset = pFirst->desc.offset;
+    batch.size = pFirst->desc.size;
+    m_pendingById.erase(pFirst->id);
+
+    // grow the read in both directions as long as other requests continue it seamlessly
+    bool grewBack = true, grewFront = true;
+    while ((grewBack || grewFront) && batch.requests.size() < maxRequestsPerBatch)
+    {
+        grewBack = grewFront = false;
+        Request* pNext = removePendingAdjacent(pFirst->desc.filename, batch.offset + batch.size, false);
+        if (pNext != nullptr)
+        {
+            if (batch.size + pNext->desc.size > m_maxCoalescedSize)
+            {
+                // put it back where it was most likely to have come from, order within a priority is best effort
+                m_pending[pNext->desc.priority].push_front(pNext);
+            }
+            else
+            {
+                batch.requests.push_back(pNext);
+                batch.size += pNext->desc.size;
+                m_pendingById.erase(pNext->id);
+                grewBack = true;
+            }
+        }
+        if (batch.requests.size() >= maxRequestsPerBatch)
+            break;
+        Request* pPrev = removePendingAdjacent(pFirst->desc.filename, batch.offset, true);
+        if (pPrev != nullptr)
+        {
+            if (batch.size + pPrev->desc.size > m_maxCoalescedSize)
+            {
+                m_pending[pPrev->desc.priority].push_front(pPrev);
+            }
+            else
+            {
+                batch.requests.insert(batch.requests.begin(), pPrev);
+                batch.offset = pPrev->desc.offset;
+                batch.size += pPrev->desc.size;
+                m_pendingById.erase(pPrev->id);
+                grewFront = true;
+            }
+        }
+    }
+    return true;
+}
+
+void gep::AsyncIo::completeBatch(AsyncIoBatch& batch, bool success, size_t bytesRead)
+{
+    size_t position = 0;
+    for (Request* pRequest : batch.requests)
+    {
+        size_t requestRead = (bytesRead > position) ? std::min(pRequest->desc.size, bytesRead - position) : 0;
+        position += pRequest->desc.size;
+        IoStatus::Enum status = (success && requestRead == pRequest->desc.size) ? IoStatus::Completed : IoStatus::Failed;
+        if (pRequest->desc.onComplete)
+            pRequest->desc.onComplete(status, requestRead);
+        delete pRequest;
+        m_numRequestsCompleted++;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_numOutstanding -= static_cast<uint32>(batch.requests.size());
+    if (m_numOutstanding == 0)
+        m_idle.notify_all();
+}
@@ -0,0 +1,471 @@
+#include "stdafx.h"
+#include "gep/binarylog.h"
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+namespace
+{
+    /// upper bound for a single formatted argument
+    const size_t formatBufferSize = 1024;
+
+    enum class LengthModifier
+    {
+        none, hh, h, l, ll, j, z, t, L, I32, I64, I
+    };
+
+    /// \brief a single % conversion of a printf format string
+    struct Conversion
+    {
+        /// points at the '%'
+        const char* pBegin;
+        /// points at the first character of the length modifier (or the conversion if there is none)
+        const char* pLengthBegin;
+        bool widthStar;
+        bool precisionStar;
+        bool hasPrecision;
+        int precision;
+        LengthModifier length;
+        char type;
+    };
+
+    /// \brief parses the conversion starting at p, which has to point at a '%'
+    /// \return the first character after the conversion
+    const char* parseConversion(const char* p, Conversion& conv)
+    {
+        conv.pBegin = p;
+        conv.widthStar = false;
+        conv.precisionStar = false;
+        conv.hasPrecision = false;
+        conv.precision = 0;
+        conv.length = LengthModifier::none;
+        p++;
+
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+            p++;
+
+        if (*p == '*')
+        {
+            conv.widthStar = true;
+            p++;
+        }
+        else
+        {
+            while (*p >= '0' && *p <= '9')
+                p++;
+        }
+
+        if (*p == '.')
+        {
+            conv.hasPrecision = true;
+            p++;
+            if (*p == '*')
+            {
+                conv.precisionStar = true;
+                p++;
+            }
+            else
+            {
+                while (*p >= '0' && *p <= '9')
+                {
+                    conv.precision = conv.precision * 10 + (*p - '0');
+                    p++;
+                }
+            }
+        }
+
+        conv.pLengthBegin = p;
+        switch (*p)
+        {
+        case 'h':
+            p++;
+            if (*p == 'h') { conv.length = LengthModifier::hh; p++; }
+            else conv.length = LengthModifier::h;
+            break;
+        case 'l':
+            p++;
+            if (*p == 'l') { conv.length = LengthModifier::ll; p++; }
+            else conv.length = LengthModifier::l;
+            break;
+        case 'j': conv.length = LengthModifier::j; p++; break;
+        case 'z': conv.length = LengthModifier::z; p++; break;
+        case 't': conv.length = LengthModifier::t; p++; break;
+        case 'L': conv.length = LengthModifier::L; p++; break;
+        case 'I':
+            // microsoft specific sizes
+            p++;
+            if (p[0] == '6' && p[1] == '4') { conv.length = LengthModifier::I64; p += 2; }
+            else if (p[0] == '3' && p[1] == '2') { conv.length = LengthModifier::I32; p += 2; }
+            else conv.length = LengthModifier::I;
+            break;
+        }
+
+        conv.type = *p;
+        return (*p != '\0') ? p + 1 : p;
+    }
+
+    inline bool isWideString(const Conversion& conv)
+    {
+        return conv.type == 'S' || (conv.type == 's' && conv.length == LengthModifier::l);
+    }
+
+    struct ArgumentWriter
+    {
+        char* pCur;
+        char* pEnd;
+
+        bool put(const void* pData, size_t size)
+        {
+            if (static_cast<size_t>(pEnd - pCur) < size)
+                return false;
+            memcpy(pCur, pData, size);
+            pCur += size;
+            return true;
+        }
+
+        bool putInt(gep::int64 value) { return put(&value, sizeof(value)); }
+        bool putDouble(double value) { return put(&value, sizeof(value)); }
+    };
+
+    struct ArgumentReader
+    {
+        const char* pCur;
+        const char* pEnd;
+
+        bool get(void* pData, size_t size)
+        {
+            if (static_cast<size_t>(pEnd - pCur) < size)
+                return false;
+            memcpy(pData, pCur, size);
+            pCur += size;
+            return true;
+        }
+    };
+
+    gep::int64 readSignedArgument(LengthModifier length, va_list& args)
+    {
+        switch (length)
+        {
+        case LengthModifier::l: return va_arg(args, long);
+        case LengthModifier::ll: return va_arg(args, long long);
+        case LengthModifier::I64: return va_arg(args, gep::int64);
+        case LengthModifier::I32: return va_arg(args, gep::int32);
+        case LengthModifier::j: return va_arg(args, intmax_t);
+        case LengthModifier::z:
+        case LengthModifier::t:
+        case LengthModifier::I: return va_arg(args, ptrdiff_t);
+        default: return va_arg(args, int);
+        }
+    }
+
+    gep::int64 readUnsignedArgument(LengthModifier length, va_list& args)
+    {
+        switch (length)
+        {
+        case LengthModifier::l: return va_arg(args, unsigned long);
+        case LengthModifier::ll: return va_arg(args, unsigned long long);
+        case LengthModifier::I64: return va_arg(args, gep::uint64);
+        case LengthModifier::I32: return va_arg(args, gep::uint32);
+        case LengthModifier::j: return va_arg(args, uintmax_t);
+        case LengthModifier::z:
+        case LengthModifier::t:
+        case LengthModifier::I: return va_arg(args, size_t);
+        default: return va_arg(args, unsigned int);
+        }
+    }
+
+    /// \brief converts a stored integer to the type printf converts it to for the length modifier
+    gep::int64 narrowToLength(gep::int64 value, LengthModifier length, bool isSigned)
+    {
+        switch (length)
+        {
+        case LengthModifier::hh: return isSigned ? static_cast<gep::int64>(static_cast<signed char>(value)) : static_cast<gep::int64>(static_cast<unsigned char>(value));
+        case LengthModifier::h: return isSigned ? static_cast<gep::int64>(static_cast<short>(value)) : static_cast<gep::int64>(static_cast<unsigned short>(value));
+        default: return value;
+        }
+    }
+
+    /// \brief calls snprintf with the optional * arguments in front of the value
+    template <class T>
+    int formatSingle(char* pOut, size_t outSize, const char* fmt, const Conversion& conv, int width, int precision, T value)
+    {
+        if (conv.widthStar && conv.precisionStar)
+            return snprintf(pOut, outSize, fmt, width, precision, value);
+        if (conv.widthStar)
+            return snprintf(pOut, outSize, fmt, width, value);
+        if (conv.precisionStar)
+            return snprintf(pOut, outSize, fmt, precision, value);
+        return snprintf(pOut, outSize, fmt, value);
+    }
+}
+
+size_t gep::packLogArguments(const char* fmt, va_list args, char* pBuffer, size_t bufferSize)
+{
+    // va_arg needs an lvalue which survives the helper functions
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    ArgumentWriter writer = { pBuffer, pBuffer + bufferSize };
+    bool full = false;
+    const char* p = fmt;
+    while (!full && *p != '\0')
+    {
+        if (*p != '%')
+        {
+            p++;
+            continue;
+        }
+
+        Conversion conv;
+        p = parseConversion(p, conv);
+        if (conv.type == '%')
+            continue;
+
+        int width = 0;
+        int precision = conv.precision;
+        if (conv.widthStar)
+        {
+            width = va_arg(argsCopy, int);
+            full = !writer.putInt(width);
+        }
+        if (conv.precisionStar)
+        {
+            precision = va_arg(argsCopy, int);
+            full = full || !writer.putInt(precision);
+        }
+
+        switch (conv.type)
+        {
+        case 'd':
+        case 'i':
+            full = full || !writer.putInt(readSignedArgument(conv.length, argsCopy));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            full = full || !writer.putInt(readUnsignedArgument(conv.length, argsCopy));
+            break;
+        case 'c':
+        case 'C':
+            // wide characters are promoted to int as well
+            full = full || !writer.putInt(va_arg(argsCopy, int));
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (conv.length == LengthModifier::L)
+                full = full || !writer.putDouble(static_cast<double>(va_arg(argsCopy, long double)));
+            else
+                full = full || !writer.putDouble(va_arg(argsCopy, double));
+            break;
+        case 'p':
+            full = full || !writer.putInt(static_cast<int64>(reinterpret_cast<uintptr_t>(va_arg(argsCopy, void*))));
+            break;
+        case 's':
+        case 'S':
+            {
+                // a negative precision counts as no precision
+                bool limited = conv.hasPrecision && precision >= 0;
+                size_t maxLength = limited ? static_cast<size_t>(precision) : static_cast<size_t>(-1);
+                if (isWideString(conv))
+                {
+                    const wchar_t* pStr = va_arg(argsCopy, const wchar_t*);
+                    if (pStr == nullptr)
+                        pStr = L"(null)";
+                    size_t length = 0;
+                    while (length < maxLength && pStr[length] != L'\0')
+                        length++;
+                    size_t available = static_cast<size_t>(writer.pEnd - writer.pCur);
+                    if (available < sizeof(uint16))
+                    {
+                        full = true;
+                        break;
+                    }
+                    available -= sizeof(uint16);
+                    uint16 storedLength = static_cast<uint16>(std::min<size_t>(std::min<size_t>(length, available), 0xFFFF));
+                    writer.put(&storedLength, sizeof(storedLength));
+                    // only ascii survives, everything else becomes '?'
+                    for (uint16 i = 0; i < storedLength; i++)
+                        *writer.pCur++ = (pStr[i] < 128) ? static_cast<char>(pStr[i]) : '?';
+                    full = storedLength < length;
+                }
+                else
+                {
+                    const char* pStr = va_arg(argsCopy, const char*);
+                    if (pStr == nullptr)
+                        pStr = "(null)";
+                    size_t length = 0;
+                    while (length < maxLength && pStr[length] != '\0')
+                        length++;
+                    size_t available = static_cast<size_t>(writer.pEnd - writer.pCur);
+                    if (available < sizeof(uint16))
+                    {
+                        full = true;
+                        break;
+                    }
+                    available -= sizeof(uint16);
+                    uint16 storedLength = static_cast<uint16>(std::min<size_t>(std::min<size_t>(length, available), 0xFFFF));
+                    writer.put(&storedLength, sizeof(storedLength));
+                    writer.put(pStr, storedLength);
+                    full = storedLength < length;
+                }
+            }
+            break;
+        case 'n':
+            // writing back into the caller is not possible anymore when formatting happens later
+            va_arg(argsCopy, void*);
+            break;
+        default:
+            // unknown conversion, the type of the argument is unknown as well so nothing after it can be read
+            full = true;
+            break;
+        }
+    }
+
+    va_end(argsCopy);
+    return writer.pCur - pBuffer;
+}
+
+size_t gep::formatPackedLogArguments(const char* fmt, const char* pArgs, size_t argsSize, char* pOut, size_t outSize)
+{
+    GEP_ASSERT(outSize > 0);
+    ArgumentReader reader = { pArgs, pArgs + argsSize };
+    size_t outPos = 0;
+
+    auto append = [&](const char* pStr, size_t length)
+    {
+        size_t toCopy = std::min(length, outSize - 1 - outPos);
+        memcpy(pOut + outPos, pStr, toCopy);
+        outPos += toCopy;
+    };
+
+    const char* p = fmt;
+    while (*p != '\0' && outPos < outSize - 1)
+    {
+        const char* pLiteral = p;
+        while (*p != '\0' && *p != '%')
+            p++;
+        append(pLiteral, p - pLiteral);
+        if (*p == '\0')
+            break;
+
+        Conversion conv;
+        p = parseConversion(p, conv);
+        if (conv.type == '%')
+        {
+            append("%", 1);
+            continue;
+        }
+        if (conv.type == 'n')
+            continue;
+
+        int64 width = 0;
+        int64 precision = 0;
+        bool ok = (!conv.widthStar || reader.get(&width, sizeof(width))) &&
+                  (!conv.precisionStar || reader.get(&precision, sizeof(precision)));
+
+        // the conversion without its length modifier, the stored values have a fixed size
+        char subFormat[64];
+        size_t prefixLength = conv.pLengthBegin - conv.pBegin;
+        if (!ok || prefixLength + 4 > sizeof(subFormat))
+        {
+            append("<truncated>", 11);
+            break;
+        }
+        memcpy(subFormat, conv.pBegin, prefixLength);
+        char* pSubEnd = subFormat + prefixLength;
+
+        char formatted[formatBufferSize];
+        int length = -1;
+        switch (conv.type)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            {
+                int64 value;
+                if (!reader.get(&value, sizeof(value)))
+                    break;
+                // %hhd and %hd print the value after converting it to char or short
+                bool isSigned = conv.type == 'd' || conv.type == 'i';
+                value = narrowToLength(value, conv.length, isSigned);
+                pSubEnd[0] = 'l'; pSubEnd[1] = 'l'; pSubEnd[2] = conv.type; pSubEnd[3] = '\0';
+                length = formatSingle(formatted, sizeof(formatted), subFormat, conv, (int)width, (int)precision, static_cast<long long>(value));
+            }
+            break;
+        case 'c':
+        case 'C':
+            {
+                int64 value;
+                if (!reader.get(&value, sizeof(value)))
+                    break;
+                pSubEnd[0] = 'c'; pSubEnd[1] = '\0';
+                int c = (value >= 0 && value < 128) ? static_cast<int>(value) : '?';
+                length = formatSingle(formatted, sizeof(formatted), subFormat, conv, (int)width, (int)precision, c);
+            }
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            {
+                double value;
+                if (!reader.get(&value, sizeof(value)))
+                    break;
+                pSubEnd[0] = conv.type; pSubEnd[1] = '\0';
+                length = formatSingle(formatted, sizeof(formatted), subFormat, conv, (int)width, (int)precision, value);
+            }
+            break;
+        case 'p':
+            {
+                // the pointer size of the machine that wrote the log might be a different one
+                uint64 value;
+                if (!reader.get(&value, sizeof(value)))
+                    break;
+                length = snprintf(formatted, sizeof(formatted), "0x%016llx", static_cast<unsigned long long>(value));
+            }
+            break;
+        case 's':
+        case 'S':
+            {
+                uint16 stringLength;
+                if (!reader.get(&stringLength, sizeof(stringLength)) || static_cast<size_t>(reader.pEnd - reader.pCur) < stringLength)
+                    break;
+                char str[formatBufferSize];
+                size_t copyLength = std::min<size_t>(stringLength, sizeof(str) - 1);
+                memcpy(str, reader.pCur, copyLength);
+                str[copyLength] = '\0';
+                reader.pCur += stringLength;
+                pSubEnd[0] = 's'; pSubEnd[1] = '\0';
+                length = formatSingle(formatted, sizeof(formatted), subFormat, conv, (int)width, (int)precision, static_cast<const char*>(str));
+            }
+            break;
+        }
+
+        if (length < 0)
+        {
+            append("<truncated>", 11);
+            break;
+        }
+        append(formatted, std::min<size_t>(length, sizeof(formatted) - 1));
+    }
+
+    pOut[outPos] = '\0';
+    return outPos;
+}
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "gep/checksum.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GEP_HARDWARE_CRC32C
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define GEP_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define GEP_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace
+{
+    const gep::uint32 castagnoliPolynomial = 0x82F63B78;
+
+    struct Crc32cTable
+    {
+        gep::uint32 entries[256];
+
+        Crc32cTable()
+        {
+            for(gep::uint32 i = 0; i < 256; i++)
+            {
+                gep::uint32 crc = i;
+                for(int bit = 0; bit < 8; bit++)
+                    crc = (crc >> 1) ^ ((crc & 1) ? castagnoliPolynomial : 0);
+                entries[i] = crc;
+            }
+        }
+    };
+
+    gep::uint32 crc32cSoftware(gep::uint32 crc, const gep::uint8* pData, size_t size)
+    {
+        static const Crc32cTable table;
+        for(size_t i = 0; i < size; i++)
+            crc = table.entries[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+#ifdef GEP_HARDWARE_CRC32C
+    bool cpuHasSse42()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+    }
+
+    GEP_TARGET_SSE42 gep::uint32 crc32cHardware(gep::uint32 crc, const gep::uint8* pData, size_t size)
+    {
+        // the bulk is done in words, which have to be aligned to be fast
+        for(; size > 0 && (reinterpret_cast<uintptr_t>(pData) & 7) != 0; size--)
+            crc = _mm_crc32_u8(crc, *pData++);
+#if defined(_M_X64) || defined(__x86_64__)
+        gep::uint64 crc64 = crc;
+        for(; size >= 8; size -= 8, pData += 8)
+        {
+            gep::uint64 word;
+            memcpy(&word, pData, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<gep::uint32>(crc64);
+#else
+        for(; size >= 4; size -= 4, pData += 4)
+        {
+            gep::uint32 word;
+            memcpy(&word, pData, sizeof(word));
+            crc = _mm_crc32_u32(crc, word);
+        }
+#endif
+        for(; size > 0; size--)
+            crc = _mm_crc32_u8(crc, *pData++);
+        return crc;
+    }
+#endif
+}
+
+bool gep::hasHardwareCrc32c()
+{
+#ifdef GEP_HARDWARE_CRC32C
+    static const bool hasSse42 = cpuHasSse42();
+    return hasSse42;
+#else
+    return false;
+#endif
+}
+
+gep::uint32 gep::crc32c(const void* data, size_t size, uint32 previous)
+{
+    auto pData = static_cast<const uint8*>(data);
+    uint32 crc = ~previous;
+#ifdef GEP_HARDWARE_CRC32C
+    if(hasHardwareCrc32c())
+        return ~crc32cHardware(crc, pData, size);
+#endif
+    return ~crc32cSoftware(crc, pData, size);
+}
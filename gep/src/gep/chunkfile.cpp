@@ -1,44 +1,185 @@
 #include "stdafx.h"
 #include "gep/chunkfile.h"
+#include "gep/compression.h"
+#include "gep/checksum.h"
+#include "gep/threading/jobqueue.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace
+{
+    /// the chunk index follows the file type chunk
+    const char* chunkIndexName = "ChunkIndex";
+    /// ends the chunk index and the file, "GCIX"
+    const gep::uint32 chunkIndexMagic = 0x58494347;
+    /// the position of the chunk index followed by the magic
+    const size_t chunkIndexFooterSize = sizeof(gep::uint64) + sizeof(gep::uint32);
+
+    /// \brief the size of the header of the chunk with the given path
+    size_t chunkHeaderSize(const std::string& path)
+    {
+        size_t nameStart = path.rfind('/') + 1;
+        return 1 + (path.length() - nameStart) + sizeof(gep::uint32);
+    }
+
+    /// \brief runs numJobs jobs on the job queue and waits for them
+    ///
+    /// Waits for its own jobs only, the queue may be busy with other work.
+    void runJobsAndWait(gep::JobQueue& jobQueue, size_t numJobs, const std::function<void(size_t)>& job)
+    {
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t numJobsLeft = numJobs;
+        for(size_t i = 0; i < numJobs; i++)
+        {
+            jobQueue.submit([i, &job, &mutex, &finished, &numJobsLeft]()
+            {
+                job(i);
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--numJobsLeft == 0)
+                    finished.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&numJobsLeft]() { return numJobsLeft == 0; });
+    }
+
+    /// the codec, the shuffle element size and the decompressed size in front of the data of compressed chunks
+    const size_t compressionHeaderSize = 2 + sizeof(gep::uint32);
+
+    /// \brief reads the compression header and advances past it
+    bool readCompressionHeader(const gep::uint8*& pData, size_t& size, gep::uint8& shuffleElementSize, gep::uint32& uncompressedSize)
+    {
+        if(size < compressionHeaderSize)
+            return false;
+        if(pData[0] != gep::ChunkCompression::Lz4)
+            return false;
+        shuffleElementSize = pData[1];
+        memcpy(&uncompressedSize, pData + 2, sizeof(uncompressedSize));
+        pData += compressionHeaderSize;
+        size -= compressionHeaderSize;
+        return true;
+    }
+
+    bool decompressData(const gep::uint8* pData, size_t size, gep::uint8 shuffleElementSize, gep::uint8* pDestination, size_t destinationSize)
+    {
+        if(shuffleElementSize <= 1)
+            return gep::Lz4::decompress(pData, size, pDestination, destinationSize) == destinationSize;
+        std::vector<gep::uint8> shuffled(destinationSize);
+        if(gep::Lz4::decompress(pData, size, shuffled.data(), destinationSize) != destinationSize)
+            return false;
+        gep::unshuffleBytes(shuffled.data(), pDestination, destinationSize, shuffleElementSize);
+        return true;
+    }
+}
 
 gep::Chunkfile::Chunkfile(const char* filename, Operation operation)
 {
       m_filename = filename;
       m_operation = operation;
       m_readLocation = nullptr;
+      m_version = 0;
+      m_writeIndex = false;
+      m_indexLoaded = false;
+      m_writingHeader = false;
+      m_verifyChecksums = false;
+      m_checksumStart = 0;
+      m_writeBufferSize = 0;
+      m_writeBufferUsed = 0;
+      m_flushedBytes = 0;
+      m_writeFailed = false;
+      if(m_operation == Operation::write || m_operation == Operation::modify)
+      {
+          // not initialized, only the pages which are written to are touched
+          m_pWriteBuffer.reset(new uint8[WRITE_BLOCK_SIZE]);
+          m_writeBufferSize = WRITE_BLOCK_SIZE;
+      }
       switch(m_operation)
       {
       case Operation::read:
-          m_file.open(filename, "rb");
+      {
+          // loose files are streamed, files in archives are already in memory
+          VfsPath path(filename);
+          std::string diskPath;
+          if(g_vfs.findLooseFile(path, diskPath))
+          {
+              // verifyChecksums opens the file again
+              m_filename = diskPath;
+              m_file.open(m_filename.c_str(), "rb");
+          }
+          else if(g_vfs.open(path, m_vfsFile) == SUCCESS)
+          {
+              m_mappedData = m_vfsFile.getData();
+              m_readLocation = m_mappedData.getPtr();
+          }
           break;
+      }
       case Operation::write:
-          m_file.open(filename, "wb");
+          m_outputFile.open(filename, "wb");
           break;
       case Operation::modify:
-          m_file.open(filename, "rb");
-          m_oldData = GEP_NEW_ARRAY(g_stdAllocator, uint8, m_file.getSize());
-          m_readLocation = m_oldData.getPtr();
-          m_file.readArray(m_oldData.getPtr(), m_oldData.length());
-          m_file.close();
-          m_file.open(filename, "wb");
+      {
+          // the original is read while the changes are streamed to a temporary file, which replaces it at the end,
+          // so that neither has to be kept in memory and the original stays intact until then.
+          // It may be in a mounted directory, it is replaced where it was found.
+          std::string diskPath;
+          if(g_vfs.openLoose(filename, m_file, "rb", diskPath) == SUCCESS)
+              m_filename = diskPath;
+          m_temporaryFilename = m_filename + ".tmp";
+          if(m_file.isOpen())
+              m_outputFile.open(m_temporaryFilename.c_str(), "wb");
+          break;
+      }
+      case Operation::mapped:
+          if(g_vfs.open(filename, m_vfsFile, MappedFile::AccessPattern::Sequential) == SUCCESS)
+          {
+              m_mappedData = m_vfsFile.getData();
+              m_readLocation = m_mappedData.getPtr();
+          }
           break;
       }
 }
 
 gep::Chunkfile::~Chunkfile()
 {
-    GEP_ASSERT(m_readInfo.length() == 0, "there are still chunks open for reading");
-    GEP_ASSERT(m_writeInfo.length() == 0, "there are still chunks open for writing");
-    GEP_DELETE_ARRAY(g_stdAllocator, m_oldData);
+    // loaders throw when they find an error in the middle of a chunk
+    GEP_ASSERT(m_readInfo.length() == 0 || std::uncaught_exception(), "there are still chunks open for reading");
+    GEP_ASSERT(m_writeInfo.length() == 0 || std::uncaught_exception(), "there are still chunks open for writing");
+    flushWriteBuffer();
+    // an incomplete temporary file must not replace the original
+    if(m_operation == Operation::modify && m_writeFailed)
+        discardChanges();
+    if(m_operation == Operation::modify && m_outputFile.isOpen())
+    {
+        // the original can only be replaced once it is closed
+        m_file.close();
+        Result result = flushToDisk(m_outputFile);
+        m_outputFile.close();
+        if(result == SUCCESS)
+            result = replaceFile(m_temporaryFilename.c_str(), m_filename.c_str());
+        GEP_ASSERT(result == SUCCESS, "the modified file could not replace the original", m_filename.c_str());
+        if(result != SUCCESS)
+            remove(m_temporaryFilename.c_str());
+    }
 }
 
 void gep::Chunkfile::discardChanges()
 {
     GEP_ASSERT(m_operation == Operation::modify, "discarding only possible when modifying");
-    m_file.close();
-    m_file.open(m_filename.c_str(), "wb");
-    m_file.writeArray(m_oldData.getPtr(), m_oldData.length());
-    m_file.close();
+    m_writeBufferUsed = 0;
+    m_flushedBytes = 0;
+    m_checksumStart = 0;
+    // the original was never written to
+    if(m_outputFile.isOpen())
+    {
+        m_outputFile.close();
+        remove(m_temporaryFilename.c_str());
+    }
 }
 
 gep::Result gep::Chunkfile::startReadChunk()
@@ -50,10 +191,28 @@ gep::Result gep::Chunkfile::startReadChunk()
             discardChanges();
     });
     GEP_ASSERT(m_operation != Operation::write, "opening a existing chunk is not possible in write mode");
+    if(readingCompressedChunk())
+    {
+        GEP_ASSERT(0, "compressed chunks can not contain other chunks");
+        return FAILURE;
+    }
     ChunkReadInfo info;
+    uint64 headerOffset = readsFromFile() ? m_file.position() : m_readLocation - m_mappedData.getPtr();
+    if(m_verifyChecksums)
+    {
+        if(loadChunkIndex() != SUCCESS)
+            return FAILURE;
+        auto entry = m_indexOffsets.find(headerOffset);
+        if(entry == m_indexOffsets.end() || verifyIndexEntry(entry->second, nullptr) != SUCCESS)
+            return FAILURE;
+    }
 
     //read the chunk name
-    if(read(info.nameLength) != 1 || info.nameLength > MAX_CHUNK_NAME_LENGTH)
+    if(read(info.nameLength) != 1)
+        return FAILURE;
+    info.compressed = (info.nameLength & COMPRESSED_CHUNK_FLAG) != 0;
+    info.nameLength &= ~COMPRESSED_CHUNK_FLAG;
+    if(info.nameLength > MAX_CHUNK_NAME_LENGTH)
     {
         return FAILURE;
     }
@@ -74,6 +233,10 @@ gep::Result gep::Chunkfile::startReadChunk()
         m_readInfo.lastElement().bytesLeft -= info.bytesLeft;
     }
 
+    info.headerOffset = headerOffset;
+    if(info.compressed && startReadCompressedChunk(headerOffset, info) != SUCCESS)
+        return FAILURE;
+
     m_readInfo.append(info);
 
     result = SUCCESS;
@@ -84,56 +247,352 @@ void gep::Chunkfile::endReadChunk()
 {
     GEP_ASSERT(m_readInfo.length() > 0, "no chunk to end");
     GEP_ASSERT(m_readInfo.lastElement().bytesLeft == 0, "there is still data left in the chunk");
+    if(m_readInfo.lastElement().compressed)
+    {
+        if(m_compressedRead.hasViews)
+            m_keptDecompressed.push_back(std::move(m_compressedRead.decompressed));
+        m_compressedRead = CompressedReadInfo();
+    }
     m_readInfo.removeLastElement();
 }
 
-void gep::Chunkfile::startWriteChunk(const char* name)
+gep::Result gep::Chunkfile::startReadCompressedChunk(uint64 headerOffset, ChunkReadInfo& info)
+{
+    m_compressedRead = CompressedReadInfo();
+    auto& compressed = m_compressedRead;
+    compressed.storedLength = info.bytesLeft;
+    size_t storedSize = info.bytesLeft;
+
+    // the stored data is read here at once, reads from the chunk only see the decompressed data
+    auto predecompressed = m_predecompressed.find(headerOffset);
+    if(predecompressed != m_predecompressed.end())
+    {
+        if(readsFromFile())
+            m_file.skip(storedSize);
+        else if(consumeData(storedSize) == nullptr)
+            return FAILURE;
+        compressed.decompressed = std::move(predecompressed->second);
+        m_predecompressed.erase(predecompressed);
+        compressed.isDecompressed = true;
+        compressed.uncompressedSize = static_cast<uint32>(compressed.decompressed.size());
+        info.bytesLeft = compressed.uncompressedSize;
+        return SUCCESS;
+    }
+
+    const uint8* pStored;
+    if(readsFromFile())
+    {
+        compressed.storedCopy.resize(storedSize);
+        if(m_file.readArray(compressed.storedCopy.data(), storedSize) != storedSize)
+            return FAILURE;
+        pStored = compressed.storedCopy.data();
+    }
+    else
+    {
+        pStored = consumeData(storedSize);
+        if(pStored == nullptr)
+            return FAILURE;
+    }
+    if(!readCompressionHeader(pStored, storedSize, compressed.shuffleElementSize, compressed.uncompressedSize))
+        return FAILURE;
+    compressed.pStored = pStored;
+    compressed.storedSize = storedSize;
+    info.bytesLeft = compressed.uncompressedSize;
+    return SUCCESS;
+}
+
+gep::Result gep::Chunkfile::decompressCurrentChunk()
+{
+    auto& compressed = m_compressedRead;
+    if(compressed.isDecompressed)
+        return SUCCESS;
+    compressed.decompressed.resize(compressed.uncompressedSize);
+    if(!decompressData(compressed.pStored, compressed.storedSize, compressed.shuffleElementSize,
+        compressed.decompressed.data(), compressed.decompressed.size()))
+    {
+        compressed.decompressed.clear();
+        return FAILURE;
+    }
+    compressed.isDecompressed = true;
+    compressed.storedCopy = std::vector<uint8>();
+    return SUCCESS;
+}
+
+size_t gep::Chunkfile::readDecompressed(void* pDestination, size_t size)
+{
+    auto& info = m_readInfo.lastElement();
+    auto& compressed = m_compressedRead;
+    if(size > info.bytesLeft)
+        return 0;
+    size_t position = compressed.uncompressedSize - info.bytesLeft;
+    if(!compressed.isDecompressed && position == 0 && size == compressed.uncompressedSize)
+    {
+        // the whole chunk is read at once, so it is decompressed straight into the destination
+        if(!decompressData(compressed.pStored, compressed.storedSize, compressed.shuffleElementSize, static_cast<uint8*>(pDestination), size))
+            return 0;
+    }
+    else
+    {
+        if(decompressCurrentChunk() != SUCCESS)
+            return 0;
+        if(size > 0)
+            memcpy(pDestination, compressed.decompressed.data() + position, size);
+    }
+    info.bytesLeft -= static_cast<uint32>(size);
+    return size;
+}
+
+gep::uint8* gep::Chunkfile::readDecompressedView(size_t size)
+{
+    auto& info = m_readInfo.lastElement();
+    auto& compressed = m_compressedRead;
+    if(size > info.bytesLeft || decompressCurrentChunk() != SUCCESS)
+        return nullptr;
+    compressed.hasViews = true;
+    return compressed.decompressed.data() + (compressed.uncompressedSize - info.bytesLeft);
+}
+
+void gep::Chunkfile::startWriteChunk(const char* name, ChunkCompression::Enum compression, uint8 shuffleElementSize)
 {
     GEP_ASSERT(strlen(name) <= MAX_CHUNK_NAME_LENGTH, "chunk name is to long");
-    writeArrayWithLength<char, uint8>(ArrayPtr<char>((char*)name, strlen(name)));
+    GEP_ASSERT(m_writeInfo.length() == 0 || m_writeInfo.lastElement().compression == ChunkCompression::None,
+        "compressed chunks can not contain other chunks", name);
+    updateWriteChecksum();
+    ChunkIndexEntry entry;
+    if(m_writeInfo.length() > 0)
+        entry.path = m_writtenChunks[m_writeInfo.lastElement().indexEntry].path + "/";
+    entry.path += name;
+    entry.offset = writePosition();
+
     ChunkWriteInfo info;
-    info.lengthPosition = m_file.position();
-    write<uint32>(0);
+    info.compression = compression;
+    info.shuffleElementSize = shuffleElementSize;
+    if(compression == ChunkCompression::None)
+    {
+        m_writingHeader = true;
+        writeArrayWithLength<char, uint8>(ArrayPtr<char>((char*)name, strlen(name)));
+        info.lengthPosition = static_cast<size_t>(writePosition());
+        write<uint32>(0);
+        m_writingHeader = false;
+        m_checksumStart = writePosition();
+    }
+    else
+    {
+        // the header is written by endWriteChunk once the stored size is known,
+        // nothing else can be written in between because the chunk can not have children
+        if(m_writeInfo.length() > 0)
+            m_writeInfo.lastElement().length += 1 + strlen(name) + sizeof(uint32);
+        m_uncompressedChunk.clear();
+        m_writeBufferSize = m_writeBufferUsed;
+    }
+
+    info.indexEntry = m_writtenChunks.size();
+    info.checksum = 0;
+    m_writtenChunks.push_back(entry);
     m_writeInfo.append(info);
 }
 
-size_t gep::Chunkfile::endWriteChunk()
+void gep::Chunkfile::updateWriteChecksum()
+{
+    uint64 position = writePosition();
+    // the checksums are only needed for the index
+    if(m_writeIndex && !m_writingHeader && m_writeInfo.length() > 0 && position > m_checksumStart)
+    {
+        GEP_ASSERT(m_checksumStart >= m_flushedBytes, "data was flushed before it was checksummed");
+        auto& info = m_writeInfo.lastElement();
+        info.checksum = crc32c(m_pWriteBuffer.get() + (m_checksumStart - m_flushedBytes), static_cast<size_t>(position - m_checksumStart), info.checksum);
+    }
+    m_checksumStart = position;
+}
+
+gep::Result gep::Chunkfile::endWriteChunk()
 {
     GEP_ASSERT(m_writeInfo.length() > 0, "there is no chunk to end");
-    auto length = m_writeInfo.lastElement().length;
-    m_file.seek(m_writeInfo.lastElement().lengthPosition);
-    m_file.write<uint32>(static_cast<uint32>(length));
-    m_file.seekEnd();
+    auto& info = m_writeInfo.lastElement();
+    if(info.compression != ChunkCompression::None)
+    {
+        endWriteCompressedChunk(info);
+    }
+    else
+    {
+        updateWriteChecksum();
+        uint32 length32 = static_cast<uint32>(info.length);
+        if(info.lengthPosition >= m_flushedBytes)
+        {
+            memcpy(m_pWriteBuffer.get() + (info.lengthPosition - m_flushedBytes), &length32, sizeof(length32));
+        }
+        else
+        {
+            // the buffer was flushed since the chunk started, because it filled up or a large kept chunk was copied behind it
+            m_outputFile.seek(info.lengthPosition);
+            if(m_outputFile.write(length32) != sizeof(length32))
+                m_writeFailed = true;
+            m_outputFile.seekEnd();
+        }
+    }
+    auto length = info.length;
+    auto& entry = m_writtenChunks[info.indexEntry];
+    entry.length = static_cast<uint32>(length);
+    entry.checksum = info.checksum;
     m_writeInfo.removeLastElement();
     if(m_writeInfo.length() > 0)
         m_writeInfo.lastElement().length += length;
-    return length;
+    // the checksum of the parent continues after the chunk
+    m_checksumStart = writePosition();
+    return m_writeFailed ? FAILURE : SUCCESS;
+}
+
+void gep::Chunkfile::endWriteCompressedChunk(ChunkWriteInfo& info)
+{
+    GEP_ASSERT(m_uncompressedChunk.size() <= std::numeric_limits<uint32>::max(), "compressed chunks have to be smaller than 4 GB");
+    // writes go to the file again
+    ChunkCompression::Enum compression = info.compression;
+    info.compression = ChunkCompression::None;
+    m_writeBufferSize = WRITE_BLOCK_SIZE;
+
+    const uint8* pData = m_uncompressedChunk.data();
+    size_t size = m_uncompressedChunk.size();
+    std::vector<uint8> shuffled;
+    if(info.shuffleElementSize > 1)
+    {
+        shuffled.resize(size);
+        shuffleBytes(pData, shuffled.data(), size, info.shuffleElementSize);
+        pData = shuffled.data();
+    }
+    std::vector<uint8> stored(compressionHeaderSize + Lz4::getMaxCompressedSize(size));
+    stored[0] = static_cast<uint8>(compression);
+    stored[1] = info.shuffleElementSize;
+    uint32 size32 = static_cast<uint32>(size);
+    memcpy(&stored[2], &size32, sizeof(size32));
+    size_t storedSize = compressionHeaderSize + Lz4::compress(pData, size, stored.data() + compressionHeaderSize, stored.size() - compressionHeaderSize);
+
+    // data which does not get smaller is stored as it is
+    bool compressed = storedSize < size;
+    const uint8* pStored = compressed ? stored.data() : m_uncompressedChunk.data();
+    if(!compressed)
+        storedSize = size;
+
+    auto& path = m_writtenChunks[info.indexEntry].path;
+    size_t nameStart = path.rfind('/') + 1;
+    uint8 nameLength = static_cast<uint8>(path.length() - nameStart);
+    uint8 storedNameLength = compressed ? (nameLength | COMPRESSED_CHUNK_FLAG) : nameLength;
+    uint32 length32 = static_cast<uint32>(storedSize);
+    bufferWrite(&storedNameLength, sizeof(storedNameLength));
+    bufferWrite(path.c_str() + nameStart, nameLength);
+    bufferWrite(&length32, sizeof(length32));
+    bufferWrite(pStored, storedSize);
+
+    info.length = storedSize;
+    info.checksum = m_writeIndex ? crc32c(pStored, storedSize) : 0;
+    m_uncompressedChunk.clear();
 }
 
 void gep::Chunkfile::keepRestOfCurrentChunk()
 {
     GEP_ASSERT(m_operation == Operation::modify, "can only keep chunks in modifiy operation");
-    ptrdiff_t bytesRemaining = (m_oldData.getPtr() + m_oldData.length()) - m_readLocation;
-    GEP_ASSERT(bytesRemaining >= 0, "privous read did go out of bounds");
-    if(bytesRemaining > 0)
+    GEP_ASSERT(m_readInfo.length() > 0, "no chunk is open");
+    // through memory in blocks, so that the length and the checksum of the written chunk include the data
+    std::vector<uint8> buffer(std::min<size_t>(m_readInfo.lastElement().bytesLeft, 64 * 1024));
+    while(m_readInfo.lastElement().bytesLeft > 0)
     {
-        m_file.writeArray(m_readLocation, bytesRemaining);
+        size_t size = std::min<size_t>(m_readInfo.lastElement().bytesLeft, buffer.size());
+        if(readArray(ArrayPtr<uint8>(buffer.data(), size)) != size)
+        {
+            GEP_ASSERT(0, "the rest of the chunk could not be read", m_filename.c_str());
+            m_readInfo.lastElement().bytesLeft = 0;
+            break;
+        }
+        writeArray(ArrayPtr<uint8>(buffer.data(), size));
     }
+    endReadChunk();
     endWriteChunk();
 }
 
+void gep::Chunkfile::keepCurrentChunk()
+{
+    GEP_ASSERT(m_operation == Operation::modify, "can only keep chunks in modifiy operation");
+    GEP_ASSERT(m_readInfo.length() > 0, "no chunk is open");
+    GEP_ASSERT(m_writeInfo.length() == 0 || m_writeInfo.lastElement().compression == ChunkCompression::None,
+        "compressed chunks can not contain other chunks");
+    const auto& info = m_readInfo.lastElement();
+    uint64 dataOffset = info.headerOffset + 1 + info.nameLength + sizeof(uint32);
+    GEP_ASSERT(info.compressed ? info.bytesLeft == m_compressedRead.uncompressedSize : m_file.position() == dataOffset,
+        "data was already read from the chunk");
+    uint32 storedLength = info.compressed ? m_compressedRead.storedLength : info.bytesLeft;
+
+    size_t entryIndex = 0;
+    if(m_writeIndex)
+    {
+        auto entry = (loadChunkIndex() == SUCCESS) ? m_indexOffsets.find(info.headerOffset) : m_indexOffsets.end();
+        if(entry == m_indexOffsets.end())
+        {
+            // the checksums are not known without the index of the original, so they are computed while copying
+            startWriteChunk(getCurrentChunkName().c_str(), info.compressed ? ChunkCompression::Lz4 : ChunkCompression::None,
+                m_compressedRead.shuffleElementSize);
+            keepRestOfCurrentChunk();
+            return;
+        }
+        entryIndex = entry->second;
+    }
+
+    // the chunk does not count for the checksum of its parent
+    updateWriteChecksum();
+    uint64 offset = writePosition();
+    uint64 size = (dataOffset - info.headerOffset) + storedLength;
+    if(size <= m_writeBufferSize - m_writeBufferUsed)
+    {
+        // small chunks go through the write buffer, so that a file of many kept chunks is still written in blocks
+        size_t readPosition = m_file.position();
+        m_file.seek(static_cast<size_t>(info.headerOffset));
+        if(m_file.readArray(m_pWriteBuffer.get() + m_writeBufferUsed, static_cast<size_t>(size)) != size)
+            m_writeFailed = true;
+        m_file.seek(readPosition);
+        m_writeBufferUsed += static_cast<size_t>(size);
+    }
+    else
+    {
+        // larger ones are copied by the operating system, behind what was buffered so far
+        flushWriteBuffer();
+        if(copyFileRange(m_file, info.headerOffset, size, m_outputFile) != size)
+            m_writeFailed = true;
+        m_flushedBytes += size;
+    }
+    addWritten(static_cast<size_t>(size));
+    m_checksumStart = writePosition();
+
+    if(m_writeIndex)
+    {
+        // the chunk and the chunks nested in it follow each other in the index, they move with the chunk
+        std::string parentPath = (m_writeInfo.length() > 0) ? m_writtenChunks[m_writeInfo.lastElement().indexEntry].path + "/" : "";
+        size_t nameStart = m_index[entryIndex].path.rfind('/') + 1;
+        uint64 end = info.headerOffset + size;
+        for(size_t i = entryIndex; i < m_index.size() && m_index[i].offset < end; i++)
+        {
+            ChunkIndexEntry entry = m_index[i];
+            entry.path = parentPath + entry.path.substr(nameStart);
+            entry.offset = entry.offset - info.headerOffset + offset;
+            m_writtenChunks.push_back(entry);
+        }
+    }
+    skipCurrentChunk();
+}
+
 void gep::Chunkfile::skipRead(size_t bytes)
 {
     GEP_ASSERT(m_operation != Operation::write, "can not read in write operation");
     GEP_ASSERT(m_readInfo.length() == 0 || m_readInfo.lastElement().bytesLeft >= bytes, "reading over chunk boundary");
-    if(m_operation == Operation::read)
+    if(readingCompressedChunk())
+    {
+        // the stored data was already read when the chunk was started
+    }
+    else if(readsFromFile())
     {
         m_file.skip(bytes);
     }
     else
     {
-        GEP_ASSERT(m_readLocation + bytes <= m_oldData.getPtr() + m_oldData.length(), "out of bounds");
-        m_readLocation += bytes;
+        if(consumeData(bytes) == nullptr)
+            return;
     }
     if(m_readInfo.length() > 0)
         m_readInfo.lastElement().bytesLeft -= (uint32)bytes;
@@ -142,7 +601,12 @@ void gep::Chunkfile::skipRead(size_t bytes)
 void gep::Chunkfile::skipCurrentChunk()
 {
     GEP_ASSERT(m_operation != Operation::write, "can not skip chunks in write operation");
-    if(m_operation == Operation::read)
+    if(readingCompressedChunk())
+    {
+        m_readInfo.lastElement().bytesLeft = 0;
+        endReadChunk();
+    }
+    else if(readsFromFile())
     {
         m_file.skip(m_readInfo.lastElement().bytesLeft);
         m_readInfo.lastElement().bytesLeft = 0;
@@ -156,20 +620,89 @@ void gep::Chunkfile::skipCurrentChunk()
     }
 }
 
-void gep::Chunkfile::startWriting(const char* filetype, uint32 ver)
+void gep::Chunkfile::startWriting(const char* filetype, uint32 ver, bool writeIndex)
 {
-    GEP_ASSERT(m_operation != Operation::read, "can't write in reading operation");
+    GEP_ASSERT(m_operation != Operation::read && m_operation != Operation::mapped, "can't write in reading operation");
     GEP_ASSERT(ver > 0, "version has to be greater then 0");
+    m_writeIndex = writeIndex;
+    m_writtenChunks.clear();
     startWriteChunk(filetype);
     write(ver);
     write<uint32>(1); // DebugMode = off
 }
 
-void gep::Chunkfile::endWriting()
+gep::Result gep::Chunkfile::endWriting()
 {
-    GEP_ASSERT(m_operation != Operation::read, "can't write in reading operation");
+    GEP_ASSERT(m_operation != Operation::read && m_operation != Operation::mapped, "can't write in reading operation");
     GEP_ASSERT(m_writeInfo.length() == 1, "there is still more then 1 chunk open");
     endWriteChunk();
+    if(m_writeIndex)
+        writeChunkIndex();
+    flushWriteBuffer();
+    // writes which the C runtime buffered only fail once they leave its buffer
+    if(m_outputFile.isOpen() && fflush(m_outputFile.m_pHandle) != 0)
+        m_writeFailed = true;
+    return m_writeFailed ? FAILURE : SUCCESS;
+}
+
+void gep::Chunkfile::flushWriteBuffer()
+{
+    if(m_writeBufferUsed == 0)
+        return;
+    updateWriteChecksum();
+    // e.g. a full disk, the data is dropped and the failure is reported by endWriteChunk and endWriting
+    size_t size = m_outputFile.isOpen() ? m_outputFile.writeArray(m_pWriteBuffer.get(), m_writeBufferUsed) : 0;
+    if(size != m_writeBufferUsed)
+        m_writeFailed = true;
+    m_flushedBytes += m_writeBufferUsed;
+    m_writeBufferUsed = 0;
+}
+
+void gep::Chunkfile::writeBlock(const void* data, size_t size)
+{
+    GEP_ASSERT(m_pWriteBuffer != nullptr, "can not write in read operation");
+    if(m_writeInfo.length() > 0 && m_writeInfo.lastElement().compression != ChunkCompression::None)
+    {
+        auto bytes = static_cast<const uint8*>(data);
+        m_uncompressedChunk.insert(m_uncompressedChunk.end(), bytes, bytes + size);
+        return;
+    }
+    flushWriteBuffer();
+    if(size < m_writeBufferSize)
+    {
+        memcpy(m_pWriteBuffer.get(), data, size);
+        m_writeBufferUsed = size;
+        return;
+    }
+    // large arrays go to the file directly instead of through the buffer
+    size_t written = m_outputFile.isOpen() ? m_outputFile.writeArray(static_cast<const uint8*>(data), size) : 0;
+    if(written != size)
+        m_writeFailed = true;
+    if(m_writeIndex && !m_writingHeader && m_writeInfo.length() > 0)
+        m_writeInfo.lastElement().checksum = crc32c(data, size, m_writeInfo.lastElement().checksum);
+    m_flushedBytes += size;
+    m_checksumStart = writePosition();
+}
+
+gep::Result gep::Chunkfile::writeChunkIndex()
+{
+    size_t numEntries = m_writtenChunks.size();
+    uint64 indexOffset = writePosition();
+    startWriteChunk(chunkIndexName);
+    write(static_cast<uint32>(numEntries));
+    for(size_t i = 0; i < numEntries; i++)
+    {
+        auto& entry = m_writtenChunks[i];
+        GEP_ASSERT(entry.path.length() <= 255, "chunk path is too long for the chunk index", entry.path.c_str());
+        writeArrayWithLength<char, uint8>(ArrayPtr<char>(const_cast<char*>(entry.path.c_str()), entry.path.length()));
+        write(entry.offset);
+        write(entry.length);
+        write(entry.checksum);
+    }
+    // the footer is the end of the file, so that the index can be found from there
+    write(indexOffset);
+    write(chunkIndexMagic);
+    return endWriteChunk();
 }
 
 gep::Result gep::Chunkfile::startReading(const char* filetype)
@@ -214,3 +747,324 @@ void gep::Chunkfile::endReading()
 {
     endReadChunk();
 }
+
+size_t gep::Chunkfile::readAt(uint64 offset, void* pDestination, size_t size)
+{
+    if(readsFromFile())
+    {
+        if(!m_file.isOpen())
+            return 0;
+        size_t position = m_file.position();
+        m_file.seek(static_cast<size_t>(offset));
+        size_t bytesRead = m_file.readArray(static_cast<uint8*>(pDestination), size);
+        m_file.seek(position);
+        return bytesRead;
+    }
+    if(offset > m_mappedData.length() || size > m_mappedData.length() - offset)
+        return 0;
+    memcpy(pDestination, m_mappedData.getPtr() + offset, size);
+    return size;
+}
+
+gep::Result gep::Chunkfile::loadChunkIndex()
+{
+    GEP_ASSERT(m_operation != Operation::write, "the chunk index can not be read in write operation");
+    if(m_indexLoaded)
+        return m_index.empty() ? FAILURE : SUCCESS;
+    m_indexLoaded = true;
+
+    Result result = FAILURE;
+    SCOPE_EXIT
+    {
+        if(result != SUCCESS)
+        {
+            m_index.clear();
+            m_indexPaths.clear();
+            m_indexOffsets.clear();
+        }
+    });
+
+    uint64 fileSize = readsFromFile() ? m_file.getSize() : m_mappedData.length();
+    uint8 footer[chunkIndexFooterSize];
+    if(fileSize < chunkIndexFooterSize || readAt(fileSize - chunkIndexFooterSize, footer, chunkIndexFooterSize) != chunkIndexFooterSize)
+        return FAILURE;
+    uint64 indexOffset;
+    uint32 magic;
+    memcpy(&indexOffset, footer, sizeof(indexOffset));
+    memcpy(&magic, footer + sizeof(indexOffset), sizeof(magic));
+    if(magic != chunkIndexMagic)
+        return FAILURE;
+
+    // the header of the index chunk
+    const size_t nameLength = strlen(chunkIndexName);
+    const size_t headerSize = 1 + nameLength + sizeof(uint32);
+    uint8 header[1 + MAX_CHUNK_NAME_LENGTH + sizeof(uint32)];
+    if(indexOffset > fileSize || readAt(indexOffset, header, headerSize) != headerSize)
+        return FAILURE;
+    if(header[0] != nameLength || memcmp(header + 1, chunkIndexName, nameLength) != 0)
+        return FAILURE;
+    uint32 length;
+    memcpy(&length, header + 1 + nameLength, sizeof(length));
+    if(indexOffset + headerSize + length != fileSize || length < sizeof(uint32) + chunkIndexFooterSize)
+        return FAILURE;
+
+    std::vector<uint8> data(length);
+    if(readAt(indexOffset + headerSize, data.data(), length) != length)
+        return FAILURE;
+    const uint8* pPosition = data.data();
+    const uint8* pEnd = data.data() + length - chunkIndexFooterSize;
+    auto take = [&](void* pDestination, size_t size) -> bool
+    {
+        if(size > static_cast<size_t>(pEnd - pPosition))
+            return false;
+        memcpy(pDestination, pPosition, size);
+        pPosition += size;
+        return true;
+    };
+
+    uint32 numEntries;
+    if(!take(&numEntries, sizeof(numEntries)))
+        return FAILURE;
+    for(uint32 i = 0; i < numEntries; i++)
+    {
+        ChunkIndexEntry entry;
+        uint8 pathLength;
+        if(!take(&pathLength, sizeof(pathLength)) || pathLength > pEnd - pPosition)
+            return FAILURE;
+        entry.path.assign(reinterpret_cast<const char*>(pPosition), pathLength);
+        pPosition += pathLength;
+        if(!take(&entry.offset, sizeof(entry.offset)) || !take(&entry.length, sizeof(entry.length)) || !take(&entry.checksum, sizeof(entry.checksum)))
+            return FAILURE;
+        m_indexPaths[entry.path].push_back(i);
+        m_indexOffsets[entry.offset] = i;
+        m_index.push_back(entry);
+    }
+    if(m_index.empty())
+        return FAILURE;
+
+    result = SUCCESS;
+    return SUCCESS;
+}
+
+const gep::Chunkfile::ChunkIndexEntry* gep::Chunkfile::findChunk(const char* path, size_t occurrence)
+{
+    if(loadChunkIndex() != SUCCESS)
+        return nullptr;
+    auto it = m_indexPaths.find(path);
+    if(it == m_indexPaths.end() || occurrence >= it->second.size())
+        return nullptr;
+    return &m_index[it->second[occurrence]];
+}
+
+const std::vector<gep::Chunkfile::ChunkIndexEntry>* gep::Chunkfile::getChunkIndex()
+{
+    if(loadChunkIndex() != SUCCESS)
+        return nullptr;
+    return &m_index;
+}
+
+gep::Result gep::Chunkfile::openChunkAt(const ChunkIndexEntry& entry)
+{
+    GEP_ASSERT(m_operation == Operation::read || m_operation == Operation::mapped, "chunks can only be opened directly when reading");
+    GEP_ASSERT(m_readInfo.length() == 0, "there are still chunks open");
+    if(readsFromFile())
+    {
+        if(!m_file.isOpen() || entry.offset >= m_file.getSize())
+            return FAILURE;
+        m_file.seek(static_cast<size_t>(entry.offset));
+    }
+    else
+    {
+        if(entry.offset >= m_mappedData.length())
+            return FAILURE;
+        m_readLocation = m_mappedData.getPtr() + entry.offset;
+    }
+    if(startReadChunk() != SUCCESS)
+        return FAILURE;
+    uint32 length = readingCompressedChunk() ? m_compressedRead.storedLength : m_readInfo.lastElement().bytesLeft;
+    if(length != entry.length)
+    {
+        // the index does not belong to this file
+        m_compressedRead = CompressedReadInfo();
+        m_readInfo.removeLastElement();
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+gep::Result gep::Chunkfile::decompressChunksInParallel(JobQueue& jobQueue)
+{
+    GEP_ASSERT(m_operation == Operation::read || m_operation == Operation::mapped, "chunks can only be decompressed when reading");
+    if(loadChunkIndex() != SUCCESS)
+        return SUCCESS;
+
+    struct Job
+    {
+        uint64 headerOffset;
+        std::vector<uint8> storedCopy;
+        const uint8* pData;
+        size_t size;
+        uint8 shuffleElementSize;
+        uint32 uncompressedSize;
+        std::vector<uint8> decompressed;
+        bool succeeded;
+    };
+    std::vector<Job> jobs;
+    for(auto& entry : m_index)
+    {
+        if(m_predecompressed.find(entry.offset) != m_predecompressed.end())
+            continue;
+        uint8 nameLength;
+        if(readAt(entry.offset, &nameLength, sizeof(nameLength)) != sizeof(nameLength))
+            return FAILURE;
+        if((nameLength & COMPRESSED_CHUNK_FLAG) == 0)
+            continue;
+        uint64 lengthOffset = entry.offset + 1 + (nameLength & ~COMPRESSED_CHUNK_FLAG);
+        uint32 length;
+        if(readAt(lengthOffset, &length, sizeof(length)) != sizeof(length) || length != entry.length)
+            return FAILURE;
+
+        Job job;
+        job.headerOffset = entry.offset;
+        job.size = length;
+        job.succeeded = false;
+        uint64 dataOffset = lengthOffset + sizeof(length);
+        if(readsFromFile())
+        {
+            // reading the file stays on this thread
+            job.storedCopy.resize(length);
+            if(readAt(dataOffset, job.storedCopy.data(), length) != length)
+                return FAILURE;
+            job.pData = job.storedCopy.data();
+        }
+        else
+        {
+            if(dataOffset > m_mappedData.length() || length > m_mappedData.length() - dataOffset)
+                return FAILURE;
+            job.pData = m_mappedData.getPtr() + dataOffset;
+        }
+        if(!readCompressionHeader(job.pData, job.size, job.shuffleElementSize, job.uncompressedSize))
+            return FAILURE;
+        jobs.push_back(std::move(job));
+    }
+
+    runJobsAndWait(jobQueue, jobs.size(), [&jobs](size_t i)
+    {
+        auto& job = jobs[i];
+        job.decompressed.resize(job.uncompressedSize);
+        job.succeeded = decompressData(job.pData, job.size, job.shuffleElementSize, job.decompressed.data(), job.decompressed.size());
+    });
+
+    Result result = SUCCESS;
+    for(auto& job : jobs)
+    {
+        if(job.succeeded)
+            m_predecompressed[job.headerOffset] = std::move(job.decompressed);
+        else
+            result = FAILURE;
+    }
+    return result;
+}
+
+gep::Result gep::Chunkfile::computeChecksum(size_t entryIndex, RawFile* pFile, uint32& checksum)
+{
+    std::vector<uint8> buffer;
+    auto addRange = [&](uint64 offset, uint64 size) -> bool
+    {
+        if(!readsFromFile())
+        {
+            if(offset > m_mappedData.length() || size > m_mappedData.length() - offset)
+                return false;
+            checksum = crc32c(m_mappedData.getPtr() + offset, static_cast<size_t>(size), checksum);
+            return true;
+        }
+        // read in blocks, the checksummed chunks can be as large as the file
+        const size_t blockSize = 64 * 1024;
+        buffer.resize(static_cast<size_t>(std::min<uint64>(size, blockSize)));
+        if(pFile != nullptr)
+            pFile->seek(static_cast<size_t>(offset));
+        while(size > 0)
+        {
+            size_t readSize = static_cast<size_t>(std::min<uint64>(size, blockSize));
+            size_t bytesRead = (pFile != nullptr) ? pFile->readArray(buffer.data(), readSize) : readAt(offset, buffer.data(), readSize);
+            if(bytesRead != readSize)
+                return false;
+            checksum = crc32c(buffer.data(), readSize, checksum);
+            offset += readSize;
+            size -= readSize;
+        }
+        return true;
+    };
+
+    // the checksum leaves out the nested chunks, which are the direct children of the chunk in the index
+    const auto& entry = m_index[entryIndex];
+    auto depth = std::count(entry.path.begin(), entry.path.end(), '/');
+    uint64 position = entry.offset + chunkHeaderSize(entry.path);
+    uint64 end = position + entry.length;
+    checksum = 0;
+    for(size_t i = entryIndex + 1; i < m_index.size() && m_index[i].offset < end; i++)
+    {
+        const auto& child = m_index[i];
+        if(std::count(child.path.begin(), child.path.end(), '/') != depth + 1)
+            continue;
+        if(child.offset < position || !addRange(position, child.offset - position))
+            return FAILURE;
+        position = child.offset + chunkHeaderSize(child.path) + child.length;
+    }
+    if(position > end || !addRange(position, end - position))
+        return FAILURE;
+    return SUCCESS;
+}
+
+gep::Result gep::Chunkfile::verifyIndexEntry(size_t entryIndex, RawFile* pFile)
+{
+    uint32 checksum;
+    if(computeChecksum(entryIndex, pFile, checksum) != SUCCESS)
+        return FAILURE;
+    return (checksum == m_index[entryIndex].checksum) ? SUCCESS : FAILURE;
+}
+
+gep::Result gep::Chunkfile::verifyChunk(const ChunkIndexEntry& entry)
+{
+    if(loadChunkIndex() != SUCCESS)
+        return FAILURE;
+    GEP_ASSERT(&entry >= m_index.data() && &entry < m_index.data() + m_index.size(), "the entry is not from the chunk index of this file");
+    return verifyIndexEntry(&entry - m_index.data(), nullptr);
+}
+
+gep::Result gep::Chunkfile::verifyChecksums(JobQueue* pJobQueue)
+{
+    GEP_ASSERT(m_operation != Operation::write, "checksums can not be verified in write operation");
+    if(loadChunkIndex() != SUCCESS)
+        return FAILURE;
+    if(pJobQueue == nullptr)
+    {
+        for(size_t i = 0; i < m_index.size(); i++)
+        {
+            if(verifyIndexEntry(i, nullptr) != SUCCESS)
+                return FAILURE;
+        }
+        return SUCCESS;
+    }
+
+    // a few batches per thread, every batch with its own file in read operation
+    size_t numBatches = std::min<size_t>(m_index.size(), 4 * std::max<uint32>(pJobQueue->getNumThreads(), 1));
+    std::atomic<bool> corrupted(false);
+    runJobsAndWait(*pJobQueue, numBatches, [this, numBatches, &corrupted](size_t batch)
+    {
+        RawFile file;
+        if(readsFromFile())
+            file.open(m_filename.c_str(), "rb");
+        if(readsFromFile() && !file.isOpen())
+        {
+            corrupted = true;
+            return;
+        }
+        for(size_t i = batch; i < m_index.size() && !corrupted; i += numBatches)
+        {
+            if(verifyIndexEntry(i, file.isOpen() ? &file : nullptr) != SUCCESS)
+                corrupted = true;
+        }
+    });
+    return corrupted ? FAILURE : SUCCESS;
+}
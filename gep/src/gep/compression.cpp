@@ -0,0 +1,218 @@
+#include "stdafx.h"
+#include "gep/compression.h"
+#include <vector>
+
+namespace
+{
+    const size_t minMatch = 4;
+    /// the last bytes of a block are always literals
+    const size_t lastLiterals = 5;
+    /// matches have to start at least this far before the end
+    const size_t matchStartLimit = 12;
+    const size_t maxOffset = 65535;
+    const int hashBits = 14;
+
+    inline gep::uint32 read32(const gep::uint8* p)
+    {
+        gep::uint32 value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline gep::uint64 read64(const gep::uint8* p)
+    {
+        gep::uint64 value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline gep::uint32 hashSequence(gep::uint32 sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - hashBits);
+    }
+
+    inline gep::uint8* writeLength(gep::uint8* pOut, size_t length)
+    {
+        while(length >= 255)
+        {
+            *pOut++ = 255;
+            length -= 255;
+        }
+        *pOut++ = static_cast<gep::uint8>(length);
+        return pOut;
+    }
+
+    gep::uint8* writeSequence(gep::uint8* pOut, const gep::uint8* pLiterals, size_t numLiterals, size_t offset, size_t matchLength)
+    {
+        gep::uint8* pToken = pOut++;
+        if(numLiterals >= 15)
+        {
+            *pToken = 15 << 4;
+            pOut = writeLength(pOut, numLiterals - 15);
+        }
+        else
+            *pToken = static_cast<gep::uint8>(numLiterals << 4);
+        if(numLiterals > 0)
+            memcpy(pOut, pLiterals, numLiterals);
+        pOut += numLiterals;
+        // the last sequence only has literals
+        if(matchLength == 0)
+            return pOut;
+
+        *pOut++ = static_cast<gep::uint8>(offset);
+        *pOut++ = static_cast<gep::uint8>(offset >> 8);
+        matchLength -= minMatch;
+        if(matchLength >= 15)
+        {
+            *pToken |= 15;
+            pOut = writeLength(pOut, matchLength - 15);
+        }
+        else
+            *pToken |= static_cast<gep::uint8>(matchLength);
+        return pOut;
+    }
+
+    /// \return false if the length does not fit into the source
+    inline bool readLength(const gep::uint8*& pIn, const gep::uint8* pEnd, size_t& length)
+    {
+        gep::uint8 value;
+        do
+        {
+            if(pIn >= pEnd)
+                return false;
+            value = *pIn++;
+            length += value;
+        } while(value == 255);
+        return true;
+    }
+}
+
+size_t gep::Lz4::getMaxCompressedSize(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t gep::Lz4::compress(const uint8* pSource, size_t sourceSize, uint8* pDestination, size_t destinationSize)
+{
+    GEP_ASSERT(destinationSize >= getMaxCompressedSize(sourceSize), "the destination is too small", destinationSize, sourceSize);
+    GEP_UNUSED(destinationSize);
+    uint8* pOut = pDestination;
+    size_t anchor = 0;
+    if(sourceSize > matchStartLimit)
+    {
+        // positions + 1, so that 0 is no position
+        std::vector<uint32> table(static_cast<size_t>(1) << hashBits, 0);
+        const size_t matchStartEnd = sourceSize - matchStartLimit;
+        const size_t matchEnd = sourceSize - lastLiterals;
+        size_t position = 0;
+        size_t misses = 0;
+        while(position < matchStartEnd)
+        {
+            uint32 sequence = read32(pSource + position);
+            uint32 hash = hashSequence(sequence);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32>(position + 1);
+            if(candidate == 0 || position - (candidate - 1) > maxOffset || read32(pSource + candidate - 1) != sequence)
+            {
+                // skip faster through data which does not compress
+                position += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            size_t match = candidate - 1;
+            while(position > anchor && match > 0 && pSource[position - 1] == pSource[match - 1])
+            {
+                position--;
+                match--;
+            }
+            size_t length = minMatch;
+            while(position + length + 8 <= matchEnd && read64(pSource + match + length) == read64(pSource + position + length))
+                length += 8;
+            while(position + length < matchEnd && pSource[match + length] == pSource[position + length])
+                length++;
+
+            pOut = writeSequence(pOut, pSource + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+            if(position - 2 < matchStartEnd)
+                table[hashSequence(read32(pSource + position - 2))] = static_cast<uint32>(position - 2 + 1);
+        }
+    }
+    pOut = writeSequence(pOut, pSource + anchor, sourceSize - anchor, 0, 0);
+    return pOut - pDestination;
+}
+
+size_t gep::Lz4::decompress(const uint8* pSource, size_t sourceSize, uint8* pDestination, size_t destinationSize)
+{
+    const uint8* pIn = pSource;
+    const uint8* pInEnd = pSource + sourceSize;
+    uint8* pOut = pDestination;
+    uint8* pOutEnd = pDestination + destinationSize;
+    while(pIn < pInEnd)
+    {
+        uint8 token = *pIn++;
+        size_t numLiterals = token >> 4;
+        if(numLiterals == 15 && !readLength(pIn, pInEnd, numLiterals))
+            return 0;
+        if(numLiterals > static_cast<size_t>(pInEnd - pIn) || numLiterals > static_cast<size_t>(pOutEnd - pOut))
+            return 0;
+        if(numLiterals > 0)
+            memcpy(pOut, pIn, numLiterals);
+        pIn += numLiterals;
+        pOut += numLiterals;
+        if(pIn == pInEnd)
+            break;
+
+        if(pInEnd - pIn < 2)
+            return 0;
+        size_t offset = pIn[0] | (pIn[1] << 8);
+        pIn += 2;
+        if(offset == 0 || offset > static_cast<size_t>(pOut - pDestination))
+            return 0;
+        size_t length = token & 15;
+        if(length == 15 && !readLength(pIn, pInEnd, length))
+            return 0;
+        length += minMatch;
+        if(length > static_cast<size_t>(pOutEnd - pOut))
+            return 0;
+
+        // the match may overlap the bytes it produces, blocks of 8 are fine as long as they do not
+        const uint8* pMatch = pOut - offset;
+        if(offset >= 8)
+        {
+            for(; length >= 8; length -= 8, pOut += 8, pMatch += 8)
+                memcpy(pOut, pMatch, 8);
+        }
+        for(; length > 0; length--)
+            *pOut++ = *pMatch++;
+    }
+    return pOut - pDestination;
+}
+
+void gep::shuffleBytes(const uint8* pSource, uint8* pDestination, size_t size, size_t elementSize)
+{
+    size_t numElements = (elementSize > 0) ? size / elementSize : 0;
+    for(size_t byte = 0; byte < elementSize && numElements > 0; byte++)
+    {
+        uint8* pOut = pDestination + byte * numElements;
+        for(size_t i = 0; i < numElements; i++)
+            pOut[i] = pSource[i * elementSize + byte];
+    }
+    size_t shuffled = numElements * elementSize;
+    if(size > shuffled)
+        memcpy(pDestination + shuffled, pSource + shuffled, size - shuffled);
+}
+
+void gep::unshuffleBytes(const uint8* pSource, uint8* pDestination, size_t size, size_t elementSize)
+{
+    size_t numElements = (elementSize > 0) ? size / elementSize : 0;
+    for(size_t byte = 0; byte < elementSize && numElements > 0; byte++)
+    {
+        const uint8* pIn = pSource + byte * numElements;
+        for(size_t i = 0; i < numElements; i++)
+            pDestination[i * elementSize + byte] = pIn[i];
+    }
+    size_t shuffled = numElements * elementSize;
+    if(size > shuffled)
+        memcpy(pDestination + shuffled, pSource + shuffled, size - shuffled);
+}
@@ -1,9 +1,24 @@
 #include "stdafx.h"
 #include "gep/directory.h"
 #include "gep/exception.h"
+#include "gep/file.h"
 #include <sstream>
+#ifndef _WIN32
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
-gep::DirectoryWatcher::DirectoryWatcher(const char* path, WatchSubdirs::Enum watchSubdirs, uint32 watch)
+#ifdef _WIN32
+
+gep::DirectoryWatcher::DirectoryWatcher(const char* path, WatchSubdirs::Enum watchSubdirs, uint32 watch, uint32 debounceMilliseconds,
+    uint32 writeTimeoutMilliseconds) :
+    m_path(path),
+    m_debounceTime(std::chrono::milliseconds(debounceMilliseconds)),
+    m_writeTimeout(std::chrono::milliseconds(writeTimeoutMilliseconds))
 {
     m_watchSubdirs = watchSubdirs;
     m_filter = 0;
@@ -58,11 +73,12 @@ void gep::DirectoryWatcher::doRead()
         m_filter, nullptr, &m_overlapped, nullptr);
 }
 
-void gep::DirectoryWatcher::enumerateChanges(std::function<void(const char* filename, Action::Enum action)> func)
+void gep::DirectoryWatcher::readChanges()
 {
     OVERLAPPED* lpOverlapped;
     DWORD numberOfBytes;
     ULONG_PTR completionKey;
+    Clock::time_point now = Clock::now();
     while( GetQueuedCompletionStatus(m_completionPort, &numberOfBytes, &completionKey, &lpOverlapped, 0) != 0)
     {
         //Copy the buffer
@@ -80,10 +96,17 @@ void gep::DirectoryWatcher::enumerateChanges(std::function<void(const char* file
             int bytesNeeded = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength/2, nullptr, 0, nullptr, nullptr);
             if(bytesNeeded > 0)
             {
-                char* dir = (char*)alloca(bytesNeeded+1);
-                WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength/2, dir, bytesNeeded, nullptr, nullptr);
-                dir[bytesNeeded] = '\0';
-                func(dir, (Action::Enum)info->Action);
+                std::string filename(bytesNeeded, '\0');
+                WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength/2, &filename[0], bytesNeeded, nullptr, nullptr);
+                auto action = (Action::Enum)info->Action;
+                if(action == Action::modified)
+                    modified(filename, false, now);
+                else
+                {
+                    if(action == Action::removed || action == Action::renamedOldName)
+                        m_pendingModifications.erase(filename);
+                    addChange(filename, action);
+                }
             }
             if(info->NextEntryOffset == 0)
                 break;
@@ -92,3 +115,275 @@ void gep::DirectoryWatcher::enumerateChanges(std::function<void(const char* file
         }
     }
 }
+
+#else
+
+gep::DirectoryWatcher::DirectoryWatcher(const char* path, WatchSubdirs::Enum watchSubdirs, uint32 watch, uint32 debounceMilliseconds,
+    uint32 writeTimeoutMilliseconds) :
+    m_path(path),
+    m_debounceTime(std::chrono::milliseconds(debounceMilliseconds)),
+    m_writeTimeout(std::chrono::milliseconds(writeTimeoutMilliseconds)),
+    m_watch(watch)
+{
+    m_watchSubdirs = watchSubdirs;
+    m_mask = 0;
+    if(watch & Watch::reads)
+        m_mask |= IN_ACCESS;
+    // files saved through a temporary file are moved into place instead of being written
+    if(watch & Watch::writes)
+        m_mask |= IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO;
+    if(watch & Watch::creates)
+        m_mask |= IN_CREATE;
+    if(watch & Watch::renames)
+        m_mask |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    // new subdirectories have to be watched as well
+    if(watchSubdirs == WatchSubdirs::yes)
+        m_mask |= IN_CREATE | IN_MOVED_TO;
+    // pending modifications of removed files are dropped
+    m_mask |= IN_DELETE | IN_MOVED_FROM;
+
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_inotify < 0)
+    {
+        std::ostringstream msg;
+        msg << "Couldn't create inotify instance for directory '" << path << "'";
+        throw Exception(msg.str());
+    }
+    m_wakeEvent = eventfd(0, EFD_CLOEXEC);
+    if(m_wakeEvent < 0)
+    {
+        close(m_inotify);
+        std::ostringstream msg;
+        msg << "Couldn't create wake event for directory '" << path << "'";
+        throw Exception(msg.str());
+    }
+
+    addWatch("");
+    if(m_directories.empty())
+    {
+        close(m_inotify);
+        close(m_wakeEvent);
+        std::ostringstream msg;
+        msg << "Couldn't open directory '" << path << "'. Maybe it does not exist?";
+        throw Exception(msg.str());
+    }
+
+    m_thread = std::thread([this]() { watchLoop(); });
+}
+
+gep::DirectoryWatcher::~DirectoryWatcher()
+{
+    uint64 value = 1;
+    ssize_t written = write(m_wakeEvent, &value, sizeof(value));
+    GEP_ASSERT(written == sizeof(value), "could not wake up the directory watcher thread");
+    GEP_UNUSED(written);
+    m_thread.join();
+    close(m_wakeEvent);
+    close(m_inotify);
+}
+
+void gep::DirectoryWatcher::addWatch(const std::string& directory)
+{
+    std::string path = m_path + "/" + directory;
+    int descriptor = inotify_add_watch(m_inotify, path.c_str(), m_mask | IN_ONLYDIR);
+    if(descriptor < 0)
+        return;
+    m_directories[descriptor] = directory;
+    if(m_watchSubdirs != WatchSubdirs::yes)
+        return;
+
+    DIR* pDirectory = opendir(path.c_str());
+    if(pDirectory == nullptr)
+        return;
+    while(dirent* pEntry = readdir(pDirectory))
+    {
+        if(strcmp(pEntry->d_name, ".") == 0 || strcmp(pEntry->d_name, "..") == 0)
+            continue;
+        std::string subdirectory = directory + pEntry->d_name;
+        if(pEntry->d_type == DT_DIR || (pEntry->d_type == DT_UNKNOWN && directoryExists((m_path + "/" + subdirectory).c_str())))
+            addWatch(subdirectory + "/");
+    }
+    closedir(pDirectory);
+}
+
+void gep::DirectoryWatcher::rescan(Clock::time_point now)
+{
+    // directories which were created or removed in the meantime are only found by starting over,
+    // watches which still exist keep their descriptor
+    m_directories.clear();
+    m_pendingModifications.clear();
+    addWatch("");
+    if(!(m_watch & (Watch::reads | Watch::writes)))
+        return;
+
+    // any of the files may have changed
+    for(auto& directory : m_directories)
+    {
+        std::string path = m_path + "/" + directory.second;
+        DIR* pDirectory = opendir(path.c_str());
+        if(pDirectory == nullptr)
+            continue;
+        while(dirent* pEntry = readdir(pDirectory))
+        {
+            std::string filename = directory.second + pEntry->d_name;
+            if(pEntry->d_type == DT_REG || (pEntry->d_type == DT_UNKNOWN && fileExists((m_path + "/" + filename).c_str())))
+                modified(filename, false, now);
+        }
+        closedir(pDirectory);
+    }
+}
+
+void gep::DirectoryWatcher::watchLoop()
+{
+    pollfd descriptors[2] = { { m_inotify, POLLIN, 0 }, { m_wakeEvent, POLLIN, 0 } };
+    alignas(inotify_event) char buffer[4096];
+    Clock::time_point nextReady = Clock::time_point::max();
+    for(;;)
+    {
+        // sleep until something happens or the next modification is ready to be reported
+        int timeout = -1;
+        if(nextReady != Clock::time_point::max())
+        {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextReady - Clock::now()).count() + 1;
+            timeout = (wait > 0) ? static_cast<int>(wait) : 0;
+        }
+        if(poll(descriptors, 2, timeout) < 0 && errno != EINTR)
+            return;
+        if(descriptors[1].revents & POLLIN)
+            return;
+        if(descriptors[0].revents & POLLIN)
+        {
+            for(;;)
+            {
+                ssize_t size = read(m_inotify, buffer, sizeof(buffer));
+                if(size <= 0)
+                    break;
+                handleEvents(buffer, static_cast<size_t>(size));
+            }
+        }
+        nextReady = releaseModifications(Clock::now());
+    }
+}
+
+void gep::DirectoryWatcher::handleEvents(const char* pBuffer, size_t size)
+{
+    Clock::time_point now = Clock::now();
+    for(size_t offset = 0; offset < size; )
+    {
+        auto pEvent = reinterpret_cast<const inotify_event*>(pBuffer + offset);
+        offset += sizeof(inotify_event) + pEvent->len;
+
+        // the kernel dropped events, it is not known what changed
+        if(pEvent->mask & IN_Q_OVERFLOW)
+        {
+            rescan(now);
+            continue;
+        }
+        auto directory = m_directories.find(pEvent->wd);
+        if(directory == m_directories.end())
+            continue;
+        if(pEvent->mask & IN_IGNORED)
+        {
+            m_directories.erase(directory);
+            continue;
+        }
+        if(pEvent->len == 0)
+            continue;
+        std::string filename = directory->second + pEvent->name;
+
+        if(pEvent->mask & IN_ISDIR)
+        {
+            if(m_watchSubdirs == WatchSubdirs::yes && (pEvent->mask & (IN_CREATE | IN_MOVED_TO)))
+                addWatch(filename + "/");
+        }
+        else if(pEvent->mask & IN_MODIFY)
+            modified(filename, true, now);
+        else if((pEvent->mask & (IN_CLOSE_WRITE | IN_ACCESS)) || ((pEvent->mask & IN_MOVED_TO) && (m_watch & Watch::writes)))
+            modified(filename, false, now);
+        if(pEvent->mask & (IN_DELETE | IN_MOVED_FROM))
+            m_pendingModifications.erase(filename);
+
+        if(!(m_watch & (Watch::creates | Watch::renames)))
+            continue;
+        if(pEvent->mask & IN_CREATE)
+            addChange(filename, Action::added);
+        if(!(m_watch & Watch::renames))
+            continue;
+        if(pEvent->mask & IN_DELETE)
+            addChange(filename, Action::removed);
+        else if(pEvent->mask & IN_MOVED_FROM)
+            addChange(filename, Action::renamedOldName);
+        else if(pEvent->mask & IN_MOVED_TO)
+            addChange(filename, Action::renamedNewName);
+    }
+}
+
+#endif
+
+void gep::DirectoryWatcher::addChange(const std::string& filename, Action::Enum action)
+{
+    std::lock_guard<std::mutex> lock(m_changesMutex);
+    Change change = { filename, action };
+    m_changes.push_back(change);
+}
+
+void gep::DirectoryWatcher::modified(const std::string& filename, bool writing, Clock::time_point now)
+{
+    // every further change of the file pushes its modification back
+    PendingModification& modification = m_pendingModifications[filename];
+    modification.writing = writing;
+    modification.readyTime = now + m_debounceTime;
+}
+
+gep::DirectoryWatcher::Clock::time_point gep::DirectoryWatcher::releaseModifications(Clock::time_point now)
+{
+    Clock::time_point nextReady = Clock::time_point::max();
+    for(auto it = m_pendingModifications.begin(); it != m_pendingModifications.end(); )
+    {
+        PendingModification& modification = it->second;
+        if(modification.writing)
+        {
+            // the notification that the file was closed may have been lost, e.g. in an overflow of the event queue
+            Clock::time_point expireTime = modification.readyTime + m_writeTimeout;
+            if(expireTime > now)
+            {
+                if(expireTime < nextReady)
+                    nextReady = expireTime;
+                ++it;
+                continue;
+            }
+        }
+#ifdef _WIN32
+        // there is no notification when the writer closes the file, wait until it can be read
+        if(modification.readyTime <= now && !RawFile((m_path + "\\" + it->first).c_str(), "rb").isOpen())
+            modification.readyTime = now + m_debounceTime;
+#endif
+        if(modification.readyTime <= now)
+        {
+            addChange(it->first, Action::modified);
+            it = m_pendingModifications.erase(it);
+            continue;
+        }
+        if(modification.readyTime < nextReady)
+            nextReady = modification.readyTime;
+        ++it;
+    }
+    return nextReady;
+}
+
+void gep::DirectoryWatcher::enumerateChanges(std::function<void(const char* filename, Action::Enum action)> func)
+{
+#ifdef _WIN32
+    readChanges();
+    releaseModifications(Clock::now());
+#endif
+    std::deque<Change> changes;
+    {
+        std::lock_guard<std::mutex> lock(m_changesMutex);
+        changes.swap(m_changes);
+    }
+    for(auto& change : changes)
+    {
+        func(change.filename.c_str(), change.action);
+    }
+}
@@ -1,6 +1,20 @@
 #include "stdafx.h"
 #include "gep/file.h"
 
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#endif
+
 bool gep::fileExists(const char* name)
 {
     DWORD attributes = GetFileAttributesA(name);
@@ -22,3 +36,177 @@ void gep::createDirectory( const char* pathToDir )
         CreateDirectoryA( pathToDir, nullptr );
     }
 }
+
+gep::MappedFile::MappedFile() :
+    m_pData(nullptr),
+    m_size(0),
+    m_isOpen(false)
+#ifdef _WIN32
+    , m_fileHandle(INVALID_HANDLE_VALUE),
+    m_mappingHandle(nullptr)
+#endif
+{
+}
+
+gep::MappedFile::~MappedFile()
+{
+    close();
+}
+
+gep::Result gep::MappedFile::open(const char* filename, AccessPattern::Enum accessPattern)
+{
+    close();
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if(accessPattern == AccessPattern::Sequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if(accessPattern == AccessPattern::Random)
+        flags |= FILE_FLAG_RANDOM_ACCESS;
+    m_fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if(m_fileHandle == INVALID_HANDLE_VALUE)
+        return FAILURE;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(m_fileHandle, &size) || static_cast<uint64>(size.QuadPart) > static_cast<size_t>(-1))
+    {
+        close();
+        return FAILURE;
+    }
+    m_size = static_cast<uint64>(size.QuadPart);
+    // empty files can not be mapped, they are open without data
+    if(m_size > 0)
+    {
+        m_mappingHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(m_mappingHandle != nullptr)
+            m_pData = static_cast<uint8*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+        if(m_pData == nullptr)
+        {
+            close();
+            return FAILURE;
+        }
+    }
+#else
+    int file = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if(file < 0)
+        return FAILURE;
+    struct stat info;
+    if(fstat(file, &info) != 0 || static_cast<uint64>(info.st_size) > static_cast<size_t>(-1))
+    {
+        ::close(file);
+        return FAILURE;
+    }
+    m_size = static_cast<uint64>(info.st_size);
+    if(m_size > 0)
+    {
+        void* pData = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if(pData == MAP_FAILED)
+        {
+            ::close(file);
+            m_size = 0;
+            return FAILURE;
+        }
+        m_pData = static_cast<uint8*>(pData);
+        // the hints are only advice, failing to give them is not an error
+        if(accessPattern == AccessPattern::Sequential)
+        {
+            madvise(m_pData, static_cast<size_t>(m_size), MADV_SEQUENTIAL);
+            madvise(m_pData, static_cast<size_t>(m_size), MADV_WILLNEED);
+        }
+        else if(accessPattern == AccessPattern::Random)
+            madvise(m_pData, static_cast<size_t>(m_size), MADV_RANDOM);
+    }
+    // the mapping keeps the file alive
+    ::close(file);
+#endif
+    m_isOpen = true;
+    return SUCCESS;
+}
+
+void gep::MappedFile::close()
+{
+#ifdef _WIN32
+    if(m_pData != nullptr)
+        UnmapViewOfFile(m_pData);
+    if(m_mappingHandle != nullptr)
+        CloseHandle(m_mappingHandle);
+    if(m_fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_fileHandle);
+    m_mappingHandle = nullptr;
+    m_fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if(m_pData != nullptr)
+        munmap(m_pData, static_cast<size_t>(m_size));
+#endif
+    m_pData = nullptr;
+    m_size = 0;
+    m_isOpen = false;
+}
+
+gep::uint64 gep::copyFileRange(RawFile& source, uint64 sourceOffset, uint64 size, RawFile& destination)
+{
+    GEP_ASSERT(source.isOpen() && destination.isOpen());
+    // what is still buffered has to be in the file before the operating system appends to it
+    fflush(destination.m_pHandle);
+    int64 destinationPosition = RawFile::tell(destination.m_pHandle);
+    uint64 copied = 0;
+#ifndef _WIN32
+    int in = fileno(source.m_pHandle);
+    int out = fileno(destination.m_pHandle);
+    off_t inOffset = static_cast<off_t>(sourceOffset);
+    bool useCopyFileRange = true;
+    while(copied < size)
+    {
+        size_t length = static_cast<size_t>(std::min<uint64>(size - copied, 1 << 30));
+        ssize_t result = useCopyFileRange ? copy_file_range(in, &inOffset, out, nullptr, length, 0) : sendfile(out, in, &inOffset, length);
+        if(result < 0 && useCopyFileRange && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+        {
+            // older kernels and some file systems can not copy between files, sendfile can for regular files
+            useCopyFileRange = false;
+            continue;
+        }
+        if(result <= 0)
+            break;
+        copied += static_cast<uint64>(result);
+    }
+#endif
+    if(copied < size)
+    {
+        // through memory where the operating system can not copy
+        int64 sourcePosition = RawFile::tell(source.m_pHandle);
+        RawFile::seekTo(source.m_pHandle, static_cast<int64>(sourceOffset + copied), SEEK_SET);
+        RawFile::seekTo(destination.m_pHandle, destinationPosition + static_cast<int64>(copied), SEEK_SET);
+        std::vector<uint8> buffer(static_cast<size_t>(std::min<uint64>(size - copied, 64 * 1024)));
+        while(copied < size)
+        {
+            size_t length = static_cast<size_t>(std::min<uint64>(size - copied, buffer.size()));
+            size_t bytesRead = fread(buffer.data(), 1, length, source.m_pHandle);
+            if(bytesRead == 0 || fwrite(buffer.data(), 1, bytesRead, destination.m_pHandle) != bytesRead)
+                break;
+            copied += bytesRead;
+        }
+        RawFile::seekTo(source.m_pHandle, sourcePosition, SEEK_SET);
+    }
+    // the position of the stream has to follow what was written around it
+    RawFile::seekTo(destination.m_pHandle, destinationPosition + static_cast<int64>(copied), SEEK_SET);
+    return copied;
+}
+
+gep::Result gep::flushToDisk(RawFile& file)
+{
+    if(!file.isOpen() || fflush(file.m_pHandle) != 0)
+        return FAILURE;
+#ifdef _WIN32
+    return (_commit(_fileno(file.m_pHandle)) == 0) ? SUCCESS : FAILURE;
+#else
+    return (fsync(fileno(file.m_pHandle)) == 0) ? SUCCESS : FAILURE;
+#endif
+}
+
+gep::Result gep::replaceFile(const char* source, const char* destination)
+{
+#ifdef _WIN32
+    return MoveFileExA(source, destination, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? SUCCESS : FAILURE;
+#else
+    // rename replaces an existing destination atomically
+    return (rename(source, destination) == 0) ? SUCCESS : FAILURE;
+#endif
+}
@@ -0,0 +1,177 @@
+#include "stdafx.h"
+#include "gep/framepacing.h"
+#include "gep/timer.h"
+#include <cmath>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <mmsystem.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+namespace
+{
+    /// \brief sleeps roughly the given time, the operating system decides how roughly
+    void sleepFor(double seconds)
+    {
+#ifdef _WIN32
+        DWORD milliseconds = static_cast<DWORD>(seconds * 1000.0);
+        // Sleep(0) only gives up the rest of the time slice
+        Sleep(milliseconds);
+#else
+        timespec duration;
+        duration.tv_sec = static_cast<time_t>(seconds);
+        duration.tv_nsec = static_cast<long>((seconds - duration.tv_sec) * 1e9);
+        while (nanosleep(&duration, &duration) != 0 && errno == EINTR) {}
+#endif
+    }
+
+    inline void spinPause()
+    {
+#ifdef _WIN32
+        YieldProcessor();
+#elif defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    // the sleep is never trusted closer than this, and the spin never gets longer than the maximum
+#ifdef _WIN32
+    const double minSpinSeconds = 0.0005;
+    const double initialSpinSeconds = 0.002;
+#else
+    const double minSpinSeconds = 0.00005;
+    const double initialSpinSeconds = 0.0002;
+#endif
+    const double maxSpinSeconds = 0.004;
+}
+
+gep::FixedTimestep::FixedTimestep(float tickRate, uint32 maxStepsPerFrame) :
+    m_accumulator(0.0),
+    m_numDroppedSteps(0)
+{
+    setTickRate(tickRate);
+    setMaxStepsPerFrame(maxStepsPerFrame);
+}
+
+void gep::FixedTimestep::setTickRate(float tickRate)
+{
+    GEP_ASSERT(tickRate > 0.0f, "tick rate has to be positive", tickRate);
+    m_stepTime = 1.0 / tickRate;
+    reset();
+}
+
+void gep::FixedTimestep::setMaxStepsPerFrame(uint32 maxStepsPerFrame)
+{
+    GEP_ASSERT(maxStepsPerFrame > 0, "at least one step per frame is needed");
+    m_maxStepsPerFrame = maxStepsPerFrame;
+}
+
+gep::uint32 gep::FixedTimestep::advance(float frameTime)
+{
+    m_accumulator += std::max(frameTime, 0.0f);
+    uint32 numSteps = static_cast<uint32>(m_accumulator / m_stepTime);
+    if (numSteps > m_maxStepsPerFrame)
+    {
+        m_numDroppedSteps += numSteps - m_maxStepsPerFrame;
+        numSteps = m_maxStepsPerFrame;
+        // keep the fraction so that alpha stays continuous
+        m_accumulator = std::fmod(m_accumulator, m_stepTime) + numSteps * m_stepTime;
+    }
+    m_accumulator -= numSteps * m_stepTime;
+    if (m_accumulator < 0.0)
+        m_accumulator = 0.0;
+    return numSteps;
+}
+
+void gep::FixedTimestep::reset()
+{
+    m_accumulator = 0.0;
+    m_numDroppedSteps = 0;
+}
+
+gep::FrameLimiter::FrameLimiter() :
+    m_targetTicks(0),
+    m_nextDeadline(0),
+    m_spinTicks(static_cast<uint64>(initialSpinSeconds * Timer::getTicksPerSecond())),
+    m_averageOversleep(0.0),
+    m_timerResolutionRaised(false)
+{
+}
+
+gep::FrameLimiter::~FrameLimiter()
+{
+    setTargetFrameTime(0.0f);
+}
+
+void gep::FrameLimiter::setTargetFrameTime(float seconds)
+{
+    m_targetTicks = static_cast<uint64>(std::max(seconds, 0.0f) * Timer::getTicksPerSecond());
+    m_nextDeadline = 0;
+#ifdef _WIN32
+    // without this Sleep has a granularity of 15.6 ms, far too coarse to hit a frame time
+    bool raise = (m_targetTicks != 0);
+    if (raise != m_timerResolutionRaised)
+    {
+        if (raise)
+            timeBeginPeriod(1);
+        else
+            timeEndPeriod(1);
+        m_timerResolutionRaised = raise;
+    }
+#endif
+}
+
+float gep::FrameLimiter::getTargetFrameTime() const
+{
+    return static_cast<float>(m_targetTicks * Timer::getSecondsPerTick());
+}
+
+void gep::FrameLimiter::waitForNextFrame()
+{
+    if (m_targetTicks == 0)
+        return;
+
+    uint64 now = Timer::getCurrentTicks();
+    if (m_nextDeadline == 0)
+    {
+        m_nextDeadline = now + m_targetTicks;
+        return;
+    }
+
+    // more than a whole frame behind, e.g. after a loading hitch: start over instead of rushing to catch up
+    if (now > m_nextDeadline + m_targetTicks)
+    {
+        m_nextDeadline = now + m_targetTicks;
+        return;
+    }
+
+    waitUntil(m_nextDeadline);
+    m_nextDeadline += m_targetTicks;
+}
+
+void gep::FrameLimiter::waitUntil(uint64 deadline)
+{
+    const double secondsPerTick = Timer::getSecondsPerTick();
+    uint64 now = Timer::getCurrentTicks();
+    while (now + m_spinTicks < deadline)
+    {
+        uint64 wakeUp = deadline - m_spinTicks;
+        sleepFor((wakeUp - now) * secondsPerTick);
+        now = Timer::getCurrentTicks();
+
+        double oversleep = (now > wakeUp) ? static_cast<double>(now - wakeUp) : 0.0;
+        m_averageOversleep = m_averageOversleep * 0.9 + oversleep * 0.1;
+        // twice the average lateness covers most wake ups, the rest is caught by the spin
+        double spinSeconds = std::min(std::max(2.0 * m_averageOversleep * secondsPerTick, minSpinSeconds), maxSpinSeconds);
+        m_spinTicks = static_cast<uint64>(spinSeconds / secondsPerTick);
+    }
+
+    while (now < deadline)
+    {
+        spinPause();
+        now = Timer::getCurrentTicks();
+    }
+}
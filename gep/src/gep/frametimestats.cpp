@@ -0,0 +1,228 @@
+#include "stdafx.h"
+#include "gep/frametimestats.h"
+#include "gep/file.h"
+#include <cmath>
+
+namespace
+{
+    // the histogram covers 0.01 ms to 10 s
+    const double histogramMin = 0.00001;
+    const double histogramDecades = 6.0;
+
+    inline double bucketRatio()
+    {
+        static const double ratio = std::pow(10.0, histogramDecades / gep::FrameTimeStats::NUM_HISTOGRAM_BUCKETS);
+        return ratio;
+    }
+
+    const char* phaseNames[] = { "update_callbacks_ms", "resource_update_ms", "render_ms" };
+    static_assert(GEP_ARRAY_SIZE(phaseNames) == gep::FramePhase::Count, "a phase is missing a name");
+}
+
+gep::FrameTimeStats::FrameTimeStats(size_t historyLength)
+{
+    setHistoryLength(historyLength);
+}
+
+void gep::FrameTimeStats::setHistoryLength(size_t historyLength)
+{
+    GEP_ASSERT(historyLength > 0, "the history needs at least one frame");
+    m_history.assign(historyLength, Frame());
+    m_cumulative.assign(historyLength, 0.0);
+    clear();
+}
+
+void gep::FrameTimeStats::clear()
+{
+    m_newest = m_history.size() - 1;
+    m_numFrames = 0;
+    m_frameNumber = 0;
+    m_sum = 0.0;
+    m_sumOfSquares = 0.0;
+    for (auto& sum : m_phaseSums)
+        sum = 0.0;
+    for (auto& count : m_histogram)
+        count = 0;
+    m_minQueue.clear();
+    m_maxQueue.clear();
+}
+
+gep::uint32 gep::FrameTimeStats::getBucket(float frameTime)
+{
+    if (frameTime <= histogramMin)
+        return 0;
+    double bucket = std::log(frameTime / histogramMin) / std::log(bucketRatio());
+    return static_cast<uint32>(std::min(bucket, static_cast<double>(NUM_HISTOGRAM_BUCKETS - 1)));
+}
+
+float gep::FrameTimeStats::getBucketLowerBound(uint32 bucket)
+{
+    return static_cast<float>(histogramMin * std::pow(bucketRatio(), static_cast<double>(bucket)));
+}
+
+void gep::FrameTimeStats::recomputeSums()
+{
+    // the running sums pick up rounding errors from every add and subtract, start over from time to time
+    m_sum = 0.0;
+    m_sumOfSquares = 0.0;
+    for (auto& sum : m_phaseSums)
+        sum = 0.0;
+    for (size_t i = 0; i < m_numFrames; i++)
+    {
+        const Frame& frame = m_history[(m_newest + m_history.size() - i) % m_history.size()];
+        m_sum += frame.total;
+        m_sumOfSquares += static_cast<double>(frame.total) * frame.total;
+        for (uint32 phase = 0; phase < FramePhase::Count; phase++)
+            m_phaseSums[phase] += frame.phases[phase];
+    }
+}
+
+void gep::FrameTimeStats::addFrame(float frameTime, const float* phaseTimes)
+{
+    const size_t length = m_history.size();
+    size_t slot = (m_newest + 1) % length;
+    double previousCumulative = m_cumulative[m_newest];
+
+    if (m_numFrames == length)
+    {
+        // the slot still holds the oldest frame, take it out of the statistics
+        const Frame& oldest = m_history[slot];
+        m_sum -= oldest.total;
+        m_sumOfSquares -= static_cast<double>(oldest.total) * oldest.total;
+        for (uint32 phase = 0; phase < FramePhase::Count; phase++)
+            m_phaseSums[phase] -= oldest.phases[phase];
+        m_histogram[getBucket(oldest.total)]--;
+    }
+    else
+    {
+        m_numFrames++;
+    }
+
+    Frame& frame = m_history[slot];
+    frame.total = frameTime;
+    for (uint32 phase = 0; phase < FramePhase::Count; phase++)
+    {
+        frame.phases[phase] = (phaseTimes != nullptr) ? phaseTimes[phase] : 0.0f;
+        m_phaseSums[phase] += frame.phases[phase];
+    }
+    m_sum += frameTime;
+    m_sumOfSquares += static_cast<double>(frameTime) * frameTime;
+    m_histogram[getBucket(frameTime)]++;
+    m_cumulative[slot] = ((m_frameNumber == 0) ? 0.0 : previousCumulative) + frameTime;
+    m_newest = slot;
+
+    // sliding window min and max, every frame enters and leaves each queue once
+    const uint64 frameNumber = m_frameNumber++;
+    while (!m_minQueue.empty() && m_minQueue.back().second >= frameTime)
+        m_minQueue.pop_back();
+    m_minQueue.emplace_back(frameNumber, frameTime);
+    while (!m_maxQueue.empty() && m_maxQueue.back().second <= frameTime)
+        m_maxQueue.pop_back();
+    m_maxQueue.emplace_back(frameNumber, frameTime);
+    while (m_minQueue.front().first + length <= frameNumber)
+        m_minQueue.pop_front();
+    while (m_maxQueue.front().first + length <= frameNumber)
+        m_maxQueue.pop_front();
+
+    if (m_frameNumber % length == 0)
+        recomputeSums();
+}
+
+float gep::FrameTimeStats::getNewest() const
+{
+    return (m_numFrames == 0) ? 0.0f : m_history[m_newest].total;
+}
+
+float gep::FrameTimeStats::getMean() const
+{
+    return (m_numFrames == 0) ? 0.0f : static_cast<float>(m_sum / m_numFrames);
+}
+
+float gep::FrameTimeStats::getVariance() const
+{
+    if (m_numFrames < 2)
+        return 0.0f;
+    double mean = m_sum / m_numFrames;
+    double variance = (m_sumOfSquares - mean * m_sum) / (m_numFrames - 1);
+    return static_cast<float>(std::max(variance, 0.0));
+}
+
+float gep::FrameTimeStats::getStandardDeviation() const
+{
+    return std::sqrt(getVariance());
+}
+
+float gep::FrameTimeStats::getMin() const
+{
+    return m_minQueue.empty() ? 0.0f : m_minQueue.front().second;
+}
+
+float gep::FrameTimeStats::getMax() const
+{
+    return m_maxQueue.empty() ? 0.0f : m_maxQueue.front().second;
+}
+
+float gep::FrameTimeStats::getPercentile(float percentile) const
+{
+    if (m_numFrames == 0)
+        return 0.0f;
+    GEP_ASSERT(percentile >= 0.0f && percentile <= 100.0f, "percentile out of range", percentile);
+
+    double target = percentile / 100.0 * m_numFrames;
+    uint32 below = 0;
+    for (uint32 bucket = 0; bucket < NUM_HISTOGRAM_BUCKETS; bucket++)
+    {
+        uint32 count = m_histogram[bucket];
+        if (count == 0 || below + count < target)
+        {
+            below += count;
+            continue;
+        }
+        // assume the frames are spread evenly (on the log scale) inside the bucket
+        double fraction = (target - below) / count;
+        float value = static_cast<float>(getBucketLowerBound(bucket) * std::pow(bucketRatio(), fraction));
+        return std::min(std::max(value, getMin()), getMax());
+    }
+    return getMax();
+}
+
+float gep::FrameTimeStats::getPhaseMean(FramePhase::Enum phase) const
+{
+    GEP_ASSERT(phase < FramePhase::Count);
+    return (m_numFrames == 0) ? 0.0f : static_cast<float>(m_phaseSums[phase] / m_numFrames);
+}
+
+float gep::FrameTimeStats::calcAverage(size_t numFrames) const
+{
+    if (numFrames == 0 || m_numFrames == 0)
+        return 0.0f;
+    if (numFrames >= m_numFrames)
+        return getMean();
+    // the frame numFrames before the newest one is still in the history
+    size_t before = (m_newest + m_history.size() - numFrames) % m_history.size();
+    return static_cast<float>((m_cumulative[m_newest] - m_cumulative[before]) / numFrames);
+}
+
+gep::Result gep::FrameTimeStats::writeCsv(const char* filename) const
+{
+    RawFile file(filename, "w");
+    if (!file.isOpen())
+        return FAILURE;
+    FILE* pFile = file.m_pHandle;
+
+    fprintf(pFile, "frame,total_ms");
+    for (auto name : phaseNames)
+        fprintf(pFile, ",%s", name);
+    fprintf(pFile, "\n");
+
+    uint64 firstFrameNumber = m_frameNumber - m_numFrames;
+    for (size_t i = 0; i < m_numFrames; i++)
+    {
+        const Frame& frame = m_history[(m_newest + m_history.size() - m_numFrames + 1 + i) % m_history.size()];
+        fprintf(pFile, "%llu,%.4f", firstFrameNumber + i, frame.total * 1000.0f);
+        for (uint32 phase = 0; phase < FramePhase::Count; phase++)
+            fprintf(pFile, ",%.4f", frame.phases[phase] * 1000.0f);
+        fprintf(pFile, "\n");
+    }
+    return ferror(pFile) ? FAILURE : SUCCESS;
+}
@@ -32,6 +32,7 @@ namespace gep
 		//order of initialization:
 		m_pMemoryManager = new MemoryManager;
 		m_pResourceManager = new ResourceManager;
+		m_pResourceManager->initialize();
 		m_pRenderer = new Renderer;
 		m_pRendererExtractor = new RendererExtractor;
 		m_pUpdateFramework = new UpdateFramework;
@@ -41,6 +42,7 @@ namespace gep
 	void GlobalManager::destroy()
 	{
 		//order of initialization:
+		m_pResourceManager->destroy();
 		delete m_pMemoryManager;
 		delete m_pResourceManager;
 		delete m_pRenderer;
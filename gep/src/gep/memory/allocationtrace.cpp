@@ -0,0 +1,399 @@
+#include "stdafx.h"
+#include "gep/memory/allocationtrace.h"
+#include "gep/memory/allocators.h"
+#include "gep/memory/memtools.h"
+#include "gep/timer.h"
+#include "gep/file.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char traceMagic[8] = { 'G', 'E', 'P', 'A', 'T', 'R', 'C', '1' };
+
+    /// \brief system malloc, to compare the engine allocators against
+    class MallocAllocator : public gep::IAllocator
+    {
+    public:
+        virtual void* allocateMemory(size_t size) override { return malloc(size); }
+        virtual void freeMemory(void* mem) override { free(mem); }
+    };
+
+    /// \brief what one replaying thread measured
+    struct ThreadReplay
+    {
+        std::vector<gep::uint32> latencyTicks;
+        gep::uint64 numFailedAllocations;
+        size_t reservedAtPeak;
+        gep::uint64 startTicks;
+        gep::uint64 endTicks;
+    };
+
+    void replayOnThread(const gep::AllocationTrace& trace, gep::IAllocator& allocator, size_t peakEvent,
+                        std::atomic<gep::uint32>& numWaiting, ThreadReplay& out, size_t* pResidentAtPeak)
+    {
+        const auto& events = trace.getEvents();
+        std::vector<void*> slots(trace.getNumIds(), nullptr);
+        out.latencyTicks.resize(events.size());
+        out.numFailedAllocations = 0;
+        out.reservedAtPeak = 0;
+        // allocators without a parent, like the StdAllocator, do not know what they reserve from the system
+        auto pStatistics = dynamic_cast<gep::IAllocatorStatistics*>(&allocator);
+        if(pStatistics != nullptr && pStatistics->getParentAllocator() == nullptr)
+            pStatistics = nullptr;
+
+        // all threads start at the same time so they actually compete
+        numWaiting.fetch_sub(1);
+        while(numWaiting.load() != 0)
+            std::this_thread::yield();
+
+        out.startTicks = gep::Timer::getCurrentTicks();
+        gep::uint64 before = out.startTicks;
+        for(size_t i = 0; i < events.size(); i++)
+        {
+            const gep::AllocationTrace::Event& event = events[i];
+            if(event.size != gep::AllocationTrace::FREE)
+            {
+                void* mem = allocator.allocateMemory(event.size);
+                slots[event.id] = mem;
+                if(mem == nullptr)
+                    out.numFailedAllocations++;
+            }
+            else if(slots[event.id] != nullptr)
+            {
+                allocator.freeMemory(slots[event.id]);
+                slots[event.id] = nullptr;
+            }
+            gep::uint64 after = gep::Timer::getCurrentTicks();
+            out.latencyTicks[i] = static_cast<gep::uint32>(std::min<gep::uint64>(after - before, 0xFFFFFFFF));
+            if(i == peakEvent)
+            {
+                // outside of the timed part
+                if(pStatistics != nullptr)
+                    out.reservedAtPeak = pStatistics->getNumBytesReserved();
+                if(pResidentAtPeak != nullptr)
+                    *pResidentAtPeak = gep::AllocationReplay::getResidentMemory();
+                after = gep::Timer::getCurrentTicks();
+            }
+            before = after;
+        }
+        out.endTicks = gep::Timer::getCurrentTicks();
+
+        // allocations the trace never freed
+        for(void* mem : slots)
+        {
+            if(mem != nullptr)
+                allocator.freeMemory(mem);
+        }
+    }
+}
+
+gep::AllocationTrace::AllocationTrace() :
+    m_numIds(0)
+{
+}
+
+void gep::AllocationTrace::recordAllocation(void* mem, size_t size)
+{
+    if(mem == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Event event = { m_numIds++, static_cast<uint32>(std::min<size_t>(size, FREE - 1)) };
+    m_liveIds[mem] = event.id;
+    m_events.push_back(event);
+}
+
+void gep::AllocationTrace::recordFree(void* mem)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_liveIds.find(mem);
+    if(it == m_liveIds.end())
+        return;
+    Event event = { it->second, FREE };
+    m_liveIds.erase(it);
+    m_events.push_back(event);
+}
+
+void gep::AllocationTrace::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_liveIds.clear();
+    m_numIds = 0;
+}
+
+size_t gep::AllocationTrace::getPeakBytes(size_t* pEventIndex) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint32> sizes(m_numIds, 0);
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    size_t peakEvent = 0;
+    for(size_t i = 0; i < m_events.size(); i++)
+    {
+        const Event& event = m_events[i];
+        if(event.size != FREE)
+        {
+            sizes[event.id] = event.size;
+            bytes += event.size;
+        }
+        else
+            bytes -= sizes[event.id];
+        if(bytes > peakBytes)
+        {
+            peakBytes = bytes;
+            peakEvent = i;
+        }
+    }
+    if(pEventIndex != nullptr)
+        *pEventIndex = peakEvent;
+    return peakBytes;
+}
+
+size_t gep::AllocationTrace::getPeakCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t count = 0;
+    size_t peakCount = 0;
+    for(auto& event : m_events)
+    {
+        if(event.size != FREE)
+            peakCount = std::max(peakCount, ++count);
+        else
+            count--;
+    }
+    return peakCount;
+}
+
+gep::uint32 gep::AllocationTrace::getLargestAllocation() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32 largest = 0;
+    for(auto& event : m_events)
+    {
+        if(event.size != FREE)
+            largest = std::max(largest, event.size);
+    }
+    return largest;
+}
+
+gep::Result gep::AllocationTrace::saveToFile(const char* filename) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RawFile file(filename, "wb");
+    if(!file.isOpen())
+        return FAILURE;
+    uint64 numEvents = m_events.size();
+    file.writeArray(traceMagic, sizeof(traceMagic));
+    file.write(m_numIds);
+    file.write(numEvents);
+    if(numEvents > 0)
+        file.writeArray(&m_events[0], m_events.size());
+    return ferror(file.m_pHandle) ? FAILURE : SUCCESS;
+}
+
+gep::Result gep::AllocationTrace::loadFromFile(const char* filename)
+{
+    RawFile file(filename, "rb");
+    if(!file.isOpen())
+        return FAILURE;
+    char magic[sizeof(traceMagic)];
+    uint32 numIds = 0;
+    uint64 numEvents = 0;
+    if(file.readArray(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, traceMagic, sizeof(magic)) != 0 ||
+       file.read(numIds) != sizeof(numIds) || file.read(numEvents) != sizeof(numEvents) ||
+       numEvents > file.getSize() / sizeof(Event))
+        return FAILURE;
+    std::vector<Event> events(static_cast<size_t>(numEvents));
+    if(numEvents > 0 && file.readArray(&events[0], events.size()) != events.size() * sizeof(Event))
+        return FAILURE;
+    for(auto& event : events)
+    {
+        if(event.id >= numIds)
+            return FAILURE;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.swap(events);
+    m_liveIds.clear();
+    m_numIds = numIds;
+    return SUCCESS;
+}
+
+void* gep::TracingAllocator::allocateMemory(size_t size)
+{
+    void* mem = m_pParent->allocateMemory(size);
+    m_pTrace->recordAllocation(mem, size);
+    return mem;
+}
+
+void gep::TracingAllocator::freeMemory(void* mem)
+{
+    if(mem == nullptr)
+        return;
+    m_pTrace->recordFree(mem);
+    m_pParent->freeMemory(mem);
+}
+
+gep::AllocationReplayResult gep::AllocationReplay::replay(const AllocationTrace& trace, uint32 numThreads, const AllocatorFactory& getAllocator)
+{
+    GEP_ASSERT(numThreads > 0, "at least one thread is needed");
+    size_t peakEvent = 0;
+    size_t peakBytes = trace.getPeakBytes(&peakEvent);
+
+    std::vector<ThreadReplay> replays(numThreads);
+    std::vector<IAllocator*> allocators(numThreads);
+    for(uint32 i = 0; i < numThreads; i++)
+        allocators[i] = getAllocator(i);
+
+    size_t residentBefore = getResidentMemory();
+    size_t residentAtPeak = residentBefore;
+    std::atomic<uint32> numWaiting(numThreads);
+    std::vector<std::thread> threads;
+    for(uint32 i = 1; i < numThreads; i++)
+    {
+        threads.push_back(std::thread(&replayOnThread, std::cref(trace), std::ref(*allocators[i]), peakEvent,
+                                      std::ref(numWaiting), std::ref(replays[i]), nullptr));
+    }
+    // the resident memory is sampled by this thread
+    replayOnThread(trace, *allocators[0], peakEvent, numWaiting, replays[0], &residentAtPeak);
+    for(auto& thread : threads)
+        thread.join();
+
+    AllocationReplayResult result;
+    result.numThreads = numThreads;
+    result.numOperations = 0;
+    result.numFailedAllocations = 0;
+    result.peakBytesUsed = peakBytes * numThreads;
+    result.peakBytesReserved = 0;
+    result.peakResidentGrowth = (residentAtPeak > residentBefore) ? residentAtPeak - residentBefore : 0;
+
+    uint64 startTicks = replays[0].startTicks;
+    uint64 endTicks = replays[0].endTicks;
+    std::vector<uint32> latencies;
+    latencies.reserve(trace.getEvents().size() * numThreads);
+    for(uint32 i = 0; i < numThreads; i++)
+    {
+        ThreadReplay& replay = replays[i];
+        result.numOperations += replay.latencyTicks.size();
+        result.numFailedAllocations += replay.numFailedAllocations;
+        startTicks = std::min(startTicks, replay.startTicks);
+        endTicks = std::max(endTicks, replay.endTicks);
+        latencies.insert(latencies.end(), replay.latencyTicks.begin(), replay.latencyTicks.end());
+        // a thread safe allocator is shared by all threads, it only counts once
+        if(std::find(allocators.begin(), allocators.begin() + i, allocators[i]) == allocators.begin() + i)
+            result.peakBytesReserved += replay.reservedAtPeak;
+    }
+    if(result.peakBytesReserved == 0)
+        result.peakBytesReserved = result.peakResidentGrowth;
+    result.fragmentation = (result.peakBytesReserved > result.peakBytesUsed) ?
+        1.0 - static_cast<double>(result.peakBytesUsed) / result.peakBytesReserved : 0.0;
+
+    const double secondsPerTick = Timer::getSecondsPerTick();
+    result.seconds = (endTicks - startTicks) * secondsPerTick;
+    result.operationsPerSecond = (result.seconds > 0.0) ? result.numOperations / result.seconds : 0.0;
+    auto percentile = [&](double fraction) -> double
+    {
+        if(latencies.empty())
+            return 0.0;
+        size_t index = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+        return latencies[index] * secondsPerTick;
+    };
+    result.latencyMedian = percentile(0.5);
+    result.latency99 = percentile(0.99);
+    result.latency999 = percentile(0.999);
+    result.latencyMax = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end()) * secondsPerTick;
+    return result;
+}
+
+size_t gep::AllocationReplay::getResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    RawFile file("/proc/self/statm", "r");
+    if(!file.isOpen())
+        return 0;
+    unsigned long long totalPages = 0;
+    unsigned long long residentPages = 0;
+    if(fscanf(file.m_pHandle, "%llu %llu", &totalPages, &residentPages) != 2)
+        return 0;
+    return static_cast<size_t>(residentPages * sysconf(_SC_PAGESIZE));
+#endif
+}
+
+void gep::AllocationReplay::compareAllocators(const AllocationTrace& trace, uint32 maxThreads)
+{
+    // the fixed size allocators are sized so that the whole trace fits
+    size_t maxSize = std::max<size_t>(trace.getLargestAllocation(), 1);
+    size_t peakLive = std::max<size_t>(trace.getPeakCount(), 1);
+    size_t peakAlignedBytes = 0;
+    size_t alignedBytes = 0;
+    std::vector<uint32> sizes(trace.getNumIds(), 0);
+    for(auto& event : trace.getEvents())
+    {
+        if(event.size != AllocationTrace::FREE)
+        {
+            sizes[event.id] = event.size;
+            alignedBytes += memtools::AlignedSize(event.size);
+            peakAlignedBytes = std::max(peakAlignedBytes, alignedBytes);
+        }
+        else
+            alignedBytes -= memtools::AlignedSize(sizes[event.id]);
+    }
+    peakAlignedBytes = std::max<size_t>(peakAlignedBytes, 1);
+
+    printf("%llu events, %llu bytes peak, %llu allocations alive at most, largest allocation %llu bytes\n\n",
+        static_cast<unsigned long long>(trace.getEvents().size()), static_cast<unsigned long long>(trace.getPeakBytes()),
+        static_cast<unsigned long long>(peakLive), static_cast<unsigned long long>(maxSize));
+    printf("%-12s %7s %12s %10s %10s %10s %10s %12s %12s %6s %8s\n", "allocator", "threads", "ops/s",
+        "p50 ns", "p99 ns", "p99.9 ns", "max ns", "used KiB", "reserved KiB", "frag", "failed");
+
+    MallocAllocator mallocAllocator;
+    for(int allocatorIndex = 0; allocatorIndex < 4; allocatorIndex++)
+    {
+        const char* names[] = { "malloc", "StdAllocator", "Pool", "Stack" };
+        // 1, 2, 4, ... threads and maxThreads itself
+        for(uint32 numThreads = 1; numThreads <= maxThreads; numThreads = (numThreads == maxThreads) ? maxThreads + 1 : std::min(numThreads * 2, maxThreads))
+        {
+            // the pool and stack allocators are not thread safe, every thread gets its own
+            std::vector<std::unique_ptr<IAllocator>> ownedAllocators;
+            AllocatorFactory factory = [&](uint32) -> IAllocator*
+            {
+                switch(allocatorIndex)
+                {
+                case 0:
+                    return &mallocAllocator;
+                case 1:
+                    return &StdAllocator::globalInstance();
+                case 2:
+                    ownedAllocators.emplace_back(new PoolAllocator(maxSize, peakLive));
+                    return ownedAllocators.back().get();
+                default:
+                    ownedAllocators.emplace_back(new StackAllocator(true, peakAlignedBytes));
+                    return ownedAllocators.back().get();
+                }
+            };
+            AllocationReplayResult result = replay(trace, numThreads, factory);
+            printf("%-12s %7u %12.0f %10.0f %10.0f %10.0f %10.0f %12llu %12llu %5.1f%% %8llu\n", names[allocatorIndex], numThreads,
+                result.operationsPerSecond, result.latencyMedian * 1e9, result.latency99 * 1e9, result.latency999 * 1e9,
+                result.latencyMax * 1e9, static_cast<unsigned long long>(result.peakBytesUsed / 1024),
+                static_cast<unsigned long long>(result.peakBytesReserved / 1024), result.fragmentation * 100.0,
+                static_cast<unsigned long long>(result.numFailedAllocations));
+        }
+    }
+    printf("\nlatencies include reading the timer, the resident memory is sampled by the first thread only\n");
+}
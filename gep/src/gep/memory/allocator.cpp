@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "gep/memory/allocator.h"
+#include "gep/memory/allocationtrace.h"
 #include "gep/threading/mutex.h"
 #include "gep/exit.h"
 
@@ -15,7 +16,10 @@ void* gep::StdAllocator::allocateMemory(size_t size)
     if(m_bytesAllocated > m_peakBytesAllocated)
         m_peakBytesAllocated = m_bytesAllocated;
     m_numAllocations++;
-    return malloc(size);
+    void* mem = malloc(size);
+    if(m_pTrace != nullptr)
+        m_pTrace->recordAllocation(mem, size);
+    return mem;
 }
 
 void gep::StdAllocator::freeMemory(void* mem)
@@ -25,6 +29,8 @@ void gep::StdAllocator::freeMemory(void* mem)
     {
         ++m_numFrees;
         m_bytesAllocated -= _msize(mem);
+        if(m_pTrace != nullptr)
+            m_pTrace->recordFree(mem);
         free(mem);
     }
 }
@@ -54,6 +60,12 @@ gep::IAllocator* gep::StdAllocator::getParentAllocator() const
     return nullptr;
 }
 
+void gep::StdAllocator::setTrace(AllocationTrace* pTrace)
+{
+    ScopedLock<Mutex> lock(m_allocationLock);
+    m_pTrace = pTrace;
+}
+
 gep::StdAllocator& gep::StdAllocator::globalInstance()
 {
     // double locking pattern
@@ -2,6 +2,8 @@
 #include "gep/exception.h"
 #include "gep/utils.h"
 #include "gep/modelloader.h"
+#include "gep/vfs.h"
+#include "gep/statcache.h"
 
 #include "thModelloader.inl"
 #include "AssimpModelloader.inl"
@@ -19,12 +21,36 @@ gep::ModelLoader::ModelLoader(IAllocator* pAllocator) :
 }
 
 gep::ModelLoader::~ModelLoader()
+{
+    discardModelData();
+}
+
+void gep::ModelLoader::discardModelData()
 {
     if(m_pModelDataAllocator != nullptr)
     {
         m_pModelDataAllocator->freeToMarker(m_pStartMarker);
         GEP_DELETE(m_pAllocator, m_pModelDataAllocator);
+        m_pModelDataAllocator = nullptr;
     }
+    m_modelData = ModelData();
+    m_nodes = ArrayPtr<NodeDrawData>();
+    m_nodeLookupByName.clear();
+}
+
+std::string gep::ModelLoader::getCachePath(const char* pFilename)
+{
+    unsigned int nameHash = gep::hashOf( pFilename, strlen(pFilename) );
+    return std::string( ".modelCache/" ) + std::to_string( nameHash ) + std::string( ".thModel" );
+}
+
+bool gep::ModelLoader::isThModel(const char* pFilename)
+{
+    auto szFileExtension = gep::findLast(
+        pFilename,                     // `begin`
+        pFilename + strlen(pFilename), // `end`
+        '.');                          // What to look for.
+    return strcmp(szFileExtension, ".thModel") == 0;
 }
 
 void gep::ModelLoader::loadFile(const char* pFilename, uint32 loadWhat)
@@ -33,47 +59,33 @@ void gep::ModelLoader::loadFile(const char* pFilename, uint32 loadWhat)
     m_filename = pFilename;
 
     // Check if the file actually exists.
-    if(!fileExists(pFilename))
+    if(!g_vfs.exists(pFilename))
     {
         std::ostringstream msg;
         msg << "File '" << pFilename << "' does not exist";
         throw LoadingError(msg.str());
     }
 
-    auto szFileExtension = gep::findLast(
-        pFilename,                     // `begin`
-        pFilename + strlen(pFilename), // `end`
-        '.');                          // What to look for.
-
-    if (strcmp(szFileExtension, ".thModel") == 0)
+    if (isThModel(pFilename))
     {
         // If the file extension is .thModel, we try to load a thModel...
         loadThModel(pFilename, loadWhat);
     }
     else
     {
-        unsigned int nameHash = gep::hashOf( pFilename, strlen(pFilename) );
-        std::string hashPath = std::string( ".modelCache/" ) + std::to_string( nameHash ) + std::string( ".thModel" );
+        std::string hashPath = getCachePath( pFilename );
         std::string hashInfoPath = hashPath + std::string( ".info" );
 
-        gep::RawFile file;
-        file.open( pFilename, "rb" );
-        uint32 size = file.getSize();
-        ArrayPtr<uint8> assimpFileData= GEP_NEW_ARRAY( m_pAllocator, uint8, size );
-
-        file.readArray( assimpFileData.getPtr(), assimpFileData.length() );
-
+        gep::VfsFile file;
+        g_vfs.open( pFilename, file );
+        unsigned int hash = gep::hashOf( file.getData().getPtr(), file.getData().length() );
         file.close();
 
-        unsigned int hash = gep::hashOf( assimpFileData.getPtr(), assimpFileData.length() );
-
-        GEP_DELETE_ARRAY( m_pAllocator, assimpFileData );
-
         bool loadCache = false;
 
-        if( gep::fileExists( hashPath.c_str()) )
+        if( g_statCache.fileExists( hashPath.c_str() ) )
         {
-            if( !gep::fileExists( hashInfoPath.c_str() ) )
+            if( !g_statCache.fileExists( hashInfoPath.c_str() ) )
             {
                 g_globalManager.getLogging()->logWarning(
                     "Found cached file of %s, but no information file, something seems wrong, recreating cache....", pFilename );
@@ -103,16 +115,26 @@ void gep::ModelLoader::loadFile(const char* pFilename, uint32 loadWhat)
                 {
                     g_globalManager.getLogging()->logMessage( "Change of source file '%s' detected, recreating cache...", pFilename );
                 }
-
             }
         }
 
         if( loadCache )
         {
             g_globalManager.getLogging()->logMessage( "Loading cached file for %s (%s)", pFilename, hashPath.c_str() );
-            loadThModel( hashPath.c_str(), loadWhat );
+            // a cut off or corrupted cache is noticed by the checksums while it is loaded
+            try
+            {
+                loadThModel( hashPath.c_str(), loadWhat, true );
+            }
+            catch( LoadingError& e )
+            {
+                g_globalManager.getLogging()->logWarning( "The cached file of %s can not be loaded (%s), recreating cache...", pFilename, e.what() );
+                discardModelData();
+                loadCache = false;
+            }
         }
-        else
+
+        if( !loadCache )
         {
 
             // ... else, we try to load the file using assimp.
@@ -120,7 +142,14 @@ void gep::ModelLoader::loadFile(const char* pFilename, uint32 loadWhat)
 
             createDirectory( ".modelCache" );
 
-            writeThModel( hashPath.c_str() );
+            // without the info file the incomplete cache is not used and written again next time
+            if( writeThModel( hashPath.c_str() ) != SUCCESS )
+            {
+                g_globalManager.getLogging()->logWarning( "The cached file of %s could not be written", pFilename );
+                remove( hashInfoPath.c_str() );
+                g_statCache.invalidate( ".modelCache" );
+                return;
+            }
 
             gep::RawFile infoFile;
             infoFile.open( hashInfoPath.c_str(), "wb" );
@@ -132,13 +161,14 @@ void gep::ModelLoader::loadFile(const char* pFilename, uint32 loadWhat)
             infoFile.write( infoData );
 
             infoFile.close();
+            g_statCache.invalidate( ".modelCache" );
 
         }
     }
 }
 
 
-void gep::ModelLoader::writeThModel( const char* fileName )
+gep::Result gep::ModelLoader::writeThModel( const char* fileName )
 {
     Chunkfile file( fileName, Chunkfile::Operation::write );
 
@@ -338,14 +368,15 @@ void gep::ModelLoader::writeThModel( const char* fileName )
 
             file.write( mesh.vertices.length() );
 
-            file.startWriteChunk( "vertices" );
+            // the per vertex data is most of the file, the shuffled floats and indices compress well
+            file.startWriteChunk( "vertices", ChunkCompression::Lz4, sizeof( float ) );
             static_assert( sizeof( float ) * 3 == sizeof( vec3 ), "The following line expects vectors to be sizeof 3 floats!" );
             file.writeArray( mesh.vertices );
             file.endWriteChunk();
 
             if( ( mesh.PerVertexFlags & PerVertexData::Normal ) != 0 )
             {
-                file.startWriteChunk( "normals" );
+                file.startWriteChunk( "normals", ChunkCompression::Lz4, sizeof( int16 ) );
                 for( auto& normal : mesh.normals )
                 {
                     file.write( compressFloat( normal.x ) );
@@ -358,7 +389,7 @@ void gep::ModelLoader::writeThModel( const char* fileName )
 
             if( ( mesh.PerVertexFlags & PerVertexData::Tangent ) != 0 )
             {
-                file.startWriteChunk( "tangents" );
+                file.startWriteChunk( "tangents", ChunkCompression::Lz4, sizeof( int16 ) );
                 for( auto& tangent : mesh.tangents )
                 {
                     file.write( compressFloat( tangent.x ) );
@@ -370,7 +401,7 @@ void gep::ModelLoader::writeThModel( const char* fileName )
 
             if( ( mesh.PerVertexFlags & PerVertexData::Bitangent ) != 0 )
             {
-                file.startWriteChunk( "bitangents" );
+                file.startWriteChunk( "bitangents", ChunkCompression::Lz4, sizeof( int16 ) );
                 for( auto& bitangent : mesh.bitangents )
                 {
                     file.write( compressFloat( bitangent.x ) );
@@ -381,7 +412,7 @@ void gep::ModelLoader::writeThModel( const char* fileName )
             }
 
             {
-                file.startWriteChunk( "texcoords" );
+                file.startWriteChunk( "texcoords", ChunkCompression::Lz4 );
 
                 uint32 numTexCoords = 0;
 
@@ -436,10 +467,11 @@ void gep::ModelLoader::writeThModel( const char* fileName )
             }
 
             {
-                file.startWriteChunk( "faces" );
+                bool largeIndices = mesh.vertices.length() > std::numeric_limits<uint16>::max();
+                file.startWriteChunk( "faces", ChunkCompression::Lz4, static_cast< uint8 >( largeIndices ? sizeof( uint32 ) : sizeof( uint16 ) ) );
 
                 file.write( ( uint32 ) mesh.faces.length() );
-                if( mesh.vertices.length() > std::numeric_limits<uint16>::max() )
+                if( largeIndices )
                 {
                     static_assert( sizeof( uint32 ) * 3 == sizeof( FaceData ), "The following line expects FaceData to be sizeof 3 uint32!" );
 
@@ -502,5 +534,5 @@ void gep::ModelLoader::writeThModel( const char* fileName )
 
         file.endWriteChunk();
     }
-    file.endWriting();
+    return file.endWriting();
 }
@@ -0,0 +1,142 @@
+#include "stdafx.h"
+#include "gep/perfcounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+namespace
+{
+    const char* counterNames[] = { "instructions", "cycles", "l1d_misses", "cache_misses", "branch_misses" };
+    static_assert(GEP_ARRAY_SIZE(counterNames) == gep::PerfCounter::Count, "a counter is missing a name");
+
+#ifdef __linux__
+    struct EventConfig
+    {
+        gep::uint32 type;
+        gep::uint64 config;
+    };
+
+    const EventConfig eventConfigs[] =
+    {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+    };
+    static_assert(GEP_ARRAY_SIZE(eventConfigs) == gep::PerfCounter::Count, "a counter is missing its event");
+#endif
+}
+
+const char* gep::PerfCounter::getName(Enum counter)
+{
+    GEP_ASSERT(counter < Count);
+    return counterNames[counter];
+}
+
+gep::PerfCounterGroup::PerfCounterGroup() :
+    m_numOpen(0)
+{
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        m_fds[i] = -1;
+        m_readIndex[i] = -1;
+    }
+}
+
+gep::PerfCounterGroup::~PerfCounterGroup()
+{
+    close();
+}
+
+gep::Result gep::PerfCounterGroup::open()
+{
+    close();
+#ifdef __linux__
+    int leader = -1;
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = eventConfigs[i].type;
+        attr.config = eventConfigs[i].config;
+        // the group is started at once when it is complete
+        attr.disabled = (leader == -1) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+        // ENOENT: the cpu does not have this event, EACCES: perf_event_paranoid is too strict
+        if (fd == -1)
+            continue;
+        if (leader == -1)
+            leader = fd;
+        m_fds[i] = fd;
+        m_readIndex[i] = m_numOpen++;
+    }
+    if (leader == -1)
+        return FAILURE;
+
+    if (ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1)
+    {
+        close();
+        return FAILURE;
+    }
+    return SUCCESS;
+#else
+    return FAILURE;
+#endif
+}
+
+void gep::PerfCounterGroup::close()
+{
+    // members before the leader
+    for (int i = PerfCounter::Count - 1; i >= 0; i--)
+    {
+#ifdef __linux__
+        if (m_fds[i] != -1)
+            ::close(m_fds[i]);
+#endif
+        m_fds[i] = -1;
+        m_readIndex[i] = -1;
+    }
+    m_numOpen = 0;
+}
+
+bool gep::PerfCounterGroup::read(uint64 (&values)[PerfCounter::Count]) const
+{
+    for (auto& value : values)
+        value = 0;
+#ifdef __linux__
+    if (m_numOpen == 0)
+        return false;
+
+    // number of counters, time enabled, time running, then one value per counter in the order they were opened
+    uint64 buffer[3 + PerfCounter::Count];
+    int leader = -1;
+    for (int i = 0; i < PerfCounter::Count && leader == -1; i++)
+        leader = m_fds[i];
+    ssize_t size = ::read(leader, buffer, sizeof(buffer));
+    if (size < static_cast<ssize_t>((3 + m_numOpen) * sizeof(uint64)) || buffer[0] != static_cast<uint64>(m_numOpen))
+        return false;
+    // the group did not get onto the pmu at all, e.g. because other groups occupy it
+    if (buffer[2] == 0)
+        return false;
+
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        if (m_readIndex[i] >= 0)
+            values[i] = buffer[3 + m_readIndex[i]];
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,767 @@
+#include "stdafx.h"
+#include "gep/profiler.h"
+#include "gep/timer.h"
+#include "gep/file.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+const char gep::ProfileCapture::MAGIC[8] = { 'G', 'E', 'P', 'P', 'R', 'O', 'F', '\0' };
+
+namespace
+{
+    struct RawEvent
+    {
+        gep::uint64 ticks;
+        const char* pName;
+        gep::uint32 frame;
+        gep::ProfileEventType::Enum type;
+    };
+
+    const gep::uint32 eventsPerBlock = 1024;
+
+    struct Block
+    {
+        RawEvent events[eventsPerBlock];
+        /// written by the recording thread only, published with release
+        std::atomic<gep::uint32> count;
+        std::atomic<Block*> pNext;
+
+        Block() : count(0), pNext(nullptr) {}
+    };
+
+    struct ZoneTotals
+    {
+        gep::uint64 calls = 0;
+        gep::uint64 inclusive[gep::PerfCounter::Count] = {};
+        gep::uint64 self[gep::PerfCounter::Count] = {};
+    };
+    typedef std::unordered_map<const char*, ZoneTotals> CounterTotals;
+
+    /// \brief counter values at the begin of a zone which has not ended yet
+    struct CounterFrame
+    {
+        const char* pName;
+        gep::uint64 start[gep::PerfCounter::Count];
+        gep::uint64 children[gep::PerfCounter::Count];
+        bool valid;
+    };
+
+    /// \brief events of one thread, single producer (the thread) and single consumer (collect)
+    ///
+    /// The thread only ever appends. Blocks the consumer is done with are freed by the thread itself
+    /// the next time it needs a new block, so neither side has to wait for the other.
+    struct ThreadBuffer
+    {
+        gep::uint32 threadId;
+        std::string name;
+
+        // owned by the recording thread
+        Block* pOldest;
+        Block* pWrite;
+
+        // owned by the consumer
+        Block* pRead;
+        gep::uint32 readIndex;
+
+        /// first block the consumer still needs, everything before it can be freed
+        std::atomic<Block*> pFirstNeeded;
+        /// set when the thread exited, the buffer is freed once it was drained
+        std::atomic<bool> finished;
+
+        ThreadBuffer(gep::uint32 id) :
+            threadId(id),
+            readIndex(0),
+            finished(false)
+        {
+            pOldest = pWrite = pRead = new Block;
+            pFirstNeeded = pOldest;
+        }
+
+        ~ThreadBuffer()
+        {
+            while (pOldest != nullptr)
+            {
+                Block* pNext = pOldest->pNext.load(std::memory_order_relaxed);
+                delete pOldest;
+                pOldest = pNext;
+            }
+        }
+
+        void appendBlock()
+        {
+            Block* pNew = new Block;
+            pWrite->pNext.store(pNew, std::memory_order_release);
+            pWrite = pNew;
+
+            Block* pFirstNeededNow = pFirstNeeded.load(std::memory_order_acquire);
+            while (pOldest != pFirstNeededNow)
+            {
+                Block* pNext = pOldest->pNext.load(std::memory_order_relaxed);
+                delete pOldest;
+                pOldest = pNext;
+            }
+        }
+
+        inline void record(gep::ProfileEventType::Enum type, const char* pName, gep::uint32 frame)
+        {
+            gep::uint32 count = pWrite->count.load(std::memory_order_relaxed);
+            if (count == eventsPerBlock)
+            {
+                appendBlock();
+                count = 0;
+            }
+            RawEvent& event = pWrite->events[count];
+            event.ticks = gep::Timer::getCurrentTicks();
+            event.pName = pName;
+            event.frame = frame;
+            event.type = type;
+            pWrite->count.store(count + 1, std::memory_order_release);
+        }
+
+        // performance counters, only touched by the thread itself apart from the totals
+        gep::PerfCounterGroup counters;
+        bool countersOpened = false;
+        std::vector<CounterFrame> counterStack;
+        std::mutex counterTotalsMutex;
+        CounterTotals counterTotals;
+
+        void beginCounters(const char* pName)
+        {
+            if (!countersOpened)
+            {
+                countersOpened = true;
+                counters.open();
+            }
+            if (!counters.isOpen())
+                return;
+            counterStack.emplace_back();
+            CounterFrame& frame = counterStack.back();
+            frame.pName = pName;
+            memset(frame.children, 0, sizeof(frame.children));
+            frame.valid = counters.read(frame.start);
+        }
+
+        void endCounters()
+        {
+            if (counterStack.empty())
+                return;
+            gep::uint64 end[gep::PerfCounter::Count];
+            bool valid = counters.read(end);
+            CounterFrame frame = counterStack.back();
+            counterStack.pop_back();
+            if (!valid || !frame.valid)
+                return;
+
+            gep::uint64 delta[gep::PerfCounter::Count];
+            for (int i = 0; i < gep::PerfCounter::Count; i++)
+                delta[i] = end[i] - frame.start[i];
+            if (!counterStack.empty())
+            {
+                for (int i = 0; i < gep::PerfCounter::Count; i++)
+                    counterStack.back().children[i] += delta[i];
+            }
+            bool recursive = std::any_of(counterStack.begin(), counterStack.end(),
+                [&frame](const CounterFrame& outer) { return outer.pName == frame.pName; });
+
+            std::lock_guard<std::mutex> lock(counterTotalsMutex);
+            ZoneTotals& totals = counterTotals[frame.pName];
+            totals.calls++;
+            for (int i = 0; i < gep::PerfCounter::Count; i++)
+            {
+                totals.self[i] += delta[i] - std::min(frame.children[i], delta[i]);
+                if (!recursive)
+                    totals.inclusive[i] += delta[i];
+            }
+        }
+    };
+
+    // recording and counters can be switched on separately, both are checked with a single load in the zone functions
+    const gep::uint32 flagRecording = 1;
+    const gep::uint32 flagCounters = 2;
+    std::atomic<gep::uint32> g_flags(0);
+    std::atomic<gep::uint32> g_availableCounters(0);
+    std::atomic<gep::uint32> g_frameNumber(0);
+
+    std::mutex g_buffersMutex;
+    std::vector<ThreadBuffer*> g_buffers;
+    gep::uint32 g_nextThreadId = 1;
+    /// counter totals of threads which exited before collectCounters picked them up
+    CounterTotals g_finishedCounterTotals;
+
+    /// \brief registers the buffer of a thread on first use and marks it finished on thread exit
+    struct ThreadBufferHandle
+    {
+        ThreadBuffer* pBuffer;
+
+        ThreadBufferHandle()
+        {
+            std::lock_guard<std::mutex> lock(g_buffersMutex);
+            pBuffer = new ThreadBuffer(g_nextThreadId++);
+            g_buffers.push_back(pBuffer);
+        }
+
+        ~ThreadBufferHandle()
+        {
+            pBuffer->finished.store(true, std::memory_order_release);
+        }
+    };
+
+    inline ThreadBuffer& getThreadBuffer()
+    {
+        static thread_local ThreadBufferHandle handle;
+        return *handle.pBuffer;
+    }
+
+    /// \brief moves all events of a buffer the consumer has not seen yet into out
+    void drain(ThreadBuffer& buffer, std::vector<RawEvent>& out)
+    {
+        for (;;)
+        {
+            gep::uint32 count = buffer.pRead->count.load(std::memory_order_acquire);
+            out.insert(out.end(), buffer.pRead->events + buffer.readIndex, buffer.pRead->events + count);
+            buffer.readIndex = count;
+            if (count < eventsPerBlock)
+                break;
+            Block* pNext = buffer.pRead->pNext.load(std::memory_order_acquire);
+            if (pNext == nullptr)
+                break;
+            buffer.pRead = pNext;
+            buffer.readIndex = 0;
+        }
+        buffer.pFirstNeeded.store(buffer.pRead, std::memory_order_release);
+    }
+
+    void mergeTotals(CounterTotals& to, const CounterTotals& from)
+    {
+        for (auto& entry : from)
+        {
+            ZoneTotals& totals = to[entry.first];
+            totals.calls += entry.second.calls;
+            for (int i = 0; i < gep::PerfCounter::Count; i++)
+            {
+                totals.inclusive[i] += entry.second.inclusive[i];
+                totals.self[i] += entry.second.self[i];
+            }
+        }
+    }
+
+    /// \brief frees the buffer of a thread which exited, if neither events nor counter totals are left in it
+    ///
+    /// Must be called with g_buffersMutex locked. Counter totals are moved to g_finishedCounterTotals.
+    bool releaseIfFinished(ThreadBuffer* pBuffer, bool finished)
+    {
+        if (!finished)
+            return false;
+        // a finished thread does not record anymore, so this is stable
+        if (pBuffer->pRead->count.load(std::memory_order_acquire) != pBuffer->readIndex ||
+            pBuffer->pRead->pNext.load(std::memory_order_acquire) != nullptr)
+            return false;
+        mergeTotals(g_finishedCounterTotals, pBuffer->counterTotals);
+        delete pBuffer;
+        return true;
+    }
+
+    void writeVarint(std::vector<char>& out, gep::uint64 value)
+    {
+        do
+        {
+            gep::uint8 byte = value & 0x7F;
+            value >>= 7;
+            if (value != 0)
+                byte |= 0x80;
+            out.push_back(static_cast<char>(byte));
+        }
+        while (value != 0);
+    }
+
+    bool readVarint(const char*& p, const char* pEnd, gep::uint64& value)
+    {
+        value = 0;
+        for (gep::uint32 shift = 0; shift < 64; shift += 7)
+        {
+            if (p == pEnd)
+                return false;
+            gep::uint8 byte = static_cast<gep::uint8>(*p++);
+            value |= static_cast<gep::uint64>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    template <class T>
+    void writeValue(std::vector<char>& out, T value)
+    {
+        out.insert(out.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(T));
+    }
+
+    template <class T>
+    bool readValue(const char*& p, const char* pEnd, T& value)
+    {
+        if (static_cast<size_t>(pEnd - p) < sizeof(T))
+            return false;
+        memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    void writeString(std::vector<char>& out, const std::string& str)
+    {
+        gep::uint16 length = static_cast<gep::uint16>(std::min<size_t>(str.length(), 0xFFFF));
+        writeValue(out, length);
+        out.insert(out.end(), str.begin(), str.begin() + length);
+    }
+
+    bool readString(const char*& p, const char* pEnd, std::string& str)
+    {
+        gep::uint16 length;
+        if (!readValue(p, pEnd, length) || pEnd - p < length)
+            return false;
+        str.assign(p, length);
+        p += length;
+        return true;
+    }
+
+    void writeJsonString(FILE* pFile, const std::string& str)
+    {
+        fputc('"', pFile);
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+                fprintf(pFile, "\\%c", c);
+            else if (static_cast<unsigned char>(c) < 0x20)
+                fprintf(pFile, "\\u%04x", c);
+            else
+                fputc(c, pFile);
+        }
+        fputc('"', pFile);
+    }
+}
+
+void gep::Profiler::setEnabled(bool enabled)
+{
+    if (enabled)
+        g_flags.fetch_or(flagRecording, std::memory_order_relaxed);
+    else
+        g_flags.fetch_and(~flagRecording, std::memory_order_relaxed);
+}
+
+bool gep::Profiler::isEnabled()
+{
+    return (g_flags.load(std::memory_order_relaxed) & flagRecording) != 0;
+}
+
+void gep::Profiler::beginZone(const char* name)
+{
+    uint32 flags = g_flags.load(std::memory_order_relaxed);
+    if (flags == 0)
+        return;
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (flags & flagRecording)
+        buffer.record(ProfileEventType::ZoneBegin, name, 0);
+    // read the counters last, so that recording is not counted into the zone
+    if (flags & flagCounters)
+        buffer.beginCounters(name);
+}
+
+void gep::Profiler::endZone()
+{
+    uint32 flags = g_flags.load(std::memory_order_relaxed);
+    if (flags == 0)
+        return;
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (flags & flagCounters)
+        buffer.endCounters();
+    if (flags & flagRecording)
+        buffer.record(ProfileEventType::ZoneEnd, nullptr, 0);
+}
+
+void gep::Profiler::markFrame()
+{
+    uint32 frame = g_frameNumber.fetch_add(1, std::memory_order_relaxed);
+    if (!isEnabled())
+        return;
+    getThreadBuffer().record(ProfileEventType::Frame, nullptr, frame);
+}
+
+void gep::Profiler::setThreadName(const char* name)
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    buffer.name = name;
+}
+
+void gep::Profiler::collect(ProfileCapture& capture)
+{
+    capture.ticksPerSecond = Timer::getTicksPerSecond();
+    // pointer lookups are cheap, but the same literal can live at different addresses in different
+    // modules and the capture might already contain names from an earlier collect, so merge by content as well
+    std::unordered_map<const char*, uint32> nameIndices;
+    std::unordered_map<std::string, uint32> nameContents;
+    for (uint32 i = 0; i < capture.names.size(); i++)
+    {
+        nameContents[capture.names[i]] = i;
+    }
+
+    std::vector<RawEvent> rawEvents;
+    std::lock_guard<std::mutex> lock(g_buffersMutex);
+    for (auto it = g_buffers.begin(); it != g_buffers.end(); )
+    {
+        ThreadBuffer* pBuffer = *it;
+        // read before draining, so that everything the thread recorded is visible
+        bool finished = pBuffer->finished.load(std::memory_order_acquire);
+        rawEvents.clear();
+        drain(*pBuffer, rawEvents);
+
+        if (!rawEvents.empty())
+        {
+            auto threadIt = std::find_if(capture.threads.begin(), capture.threads.end(),
+                [pBuffer](const ProfileThread& thread) { return thread.threadId == pBuffer->threadId; });
+            if (threadIt == capture.threads.end())
+            {
+                capture.threads.emplace_back();
+                threadIt = capture.threads.end() - 1;
+                threadIt->threadId = pBuffer->threadId;
+            }
+            threadIt->name = pBuffer->name;
+
+            for (const RawEvent& raw : rawEvents)
+            {
+                ProfileEvent event;
+                event.ticks = raw.ticks;
+                event.type = raw.type;
+                event.data = raw.frame;
+                if (raw.type == ProfileEventType::ZoneBegin)
+                {
+                    auto nameIt = nameIndices.find(raw.pName);
+                    if (nameIt == nameIndices.end())
+                    {
+                        auto contentIt = nameContents.find(raw.pName);
+                        uint32 index;
+                        if (contentIt != nameContents.end())
+                            index = contentIt->second;
+                        else
+                        {
+                            index = static_cast<uint32>(capture.names.size());
+                            capture.names.push_back(raw.pName);
+                            nameContents[raw.pName] = index;
+                        }
+                        nameIt = nameIndices.insert(std::make_pair(raw.pName, index)).first;
+                    }
+                    event.data = nameIt->second;
+                }
+                threadIt->events.push_back(event);
+            }
+        }
+
+        if (releaseIfFinished(pBuffer, finished))
+            it = g_buffers.erase(it);
+        else
+            ++it;
+    }
+}
+
+gep::Result gep::Profiler::setCountersEnabled(bool enabled)
+{
+    if (!enabled)
+    {
+        g_flags.fetch_and(~flagCounters, std::memory_order_relaxed);
+        return SUCCESS;
+    }
+
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (!buffer.counters.isOpen())
+    {
+        buffer.countersOpened = true;
+        buffer.counters.open();
+    }
+    uint32 available = 0;
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        if (buffer.counters.isAvailable(static_cast<PerfCounter::Enum>(i)))
+            available |= 1 << i;
+    }
+    g_availableCounters.store(available, std::memory_order_relaxed);
+    if (available == 0)
+        return FAILURE;
+    g_flags.fetch_or(flagCounters, std::memory_order_relaxed);
+    return SUCCESS;
+}
+
+bool gep::Profiler::areCountersEnabled()
+{
+    return (g_flags.load(std::memory_order_relaxed) & flagCounters) != 0;
+}
+
+bool gep::Profiler::isCounterAvailable(PerfCounter::Enum counter)
+{
+    GEP_ASSERT(counter < PerfCounter::Count);
+    return (g_availableCounters.load(std::memory_order_relaxed) & (1 << counter)) != 0;
+}
+
+void gep::Profiler::collectCounters(std::vector<ProfileZoneCounters>& zones)
+{
+    CounterTotals totals;
+    {
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        totals.swap(g_finishedCounterTotals);
+        for (auto it = g_buffers.begin(); it != g_buffers.end(); )
+        {
+            ThreadBuffer* pBuffer = *it;
+            bool finished = pBuffer->finished.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> totalsLock(pBuffer->counterTotalsMutex);
+                mergeTotals(totals, pBuffer->counterTotals);
+                pBuffer->counterTotals.clear();
+            }
+            if (releaseIfFinished(pBuffer, finished))
+                it = g_buffers.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // the same name can show up under different pointers, see collect
+    std::unordered_map<std::string, size_t> zoneIndices;
+    for (size_t i = 0; i < zones.size(); i++)
+        zoneIndices[zones[i].name] = i;
+    for (auto& entry : totals)
+    {
+        auto indexIt = zoneIndices.find(entry.first);
+        if (indexIt == zoneIndices.end())
+        {
+            indexIt = zoneIndices.insert(std::make_pair(std::string(entry.first), zones.size())).first;
+            zones.emplace_back();
+            zones.back().name = entry.first;
+        }
+        ProfileZoneCounters& zone = zones[indexIt->second];
+        zone.calls += entry.second.calls;
+        for (int i = 0; i < PerfCounter::Count; i++)
+        {
+            zone.inclusive[i] += entry.second.inclusive[i];
+            zone.self[i] += entry.second.self[i];
+        }
+    }
+}
+
+gep::ProfileZoneCounters::ProfileZoneCounters() :
+    calls(0)
+{
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        inclusive[i] = 0;
+        self[i] = 0;
+    }
+}
+
+float gep::ProfileZoneCounters::getIpc() const
+{
+    if (inclusive[PerfCounter::Cycles] == 0)
+        return 0.0f;
+    return static_cast<float>(static_cast<double>(inclusive[PerfCounter::Instructions]) / inclusive[PerfCounter::Cycles]);
+}
+
+float gep::ProfileZoneCounters::getPerCall(PerfCounter::Enum counter) const
+{
+    GEP_ASSERT(counter < PerfCounter::Count);
+    return (calls == 0) ? 0.0f : static_cast<float>(static_cast<double>(inclusive[counter]) / calls);
+}
+
+gep::Result gep::ProfileZoneCounters::writeReport(const std::vector<ProfileZoneCounters>& zones, const char* filename)
+{
+    RawFile file(filename, "w");
+    if (!file.isOpen())
+        return FAILURE;
+    FILE* pFile = file.m_pHandle;
+
+    std::vector<const ProfileZoneCounters*> sorted;
+    for (auto& zone : zones)
+        sorted.push_back(&zone);
+    // fall back to instructions when there is no cycle counter
+    PerfCounter::Enum sortBy = Profiler::isCounterAvailable(PerfCounter::Cycles) ? PerfCounter::Cycles : PerfCounter::Instructions;
+    std::stable_sort(sorted.begin(), sorted.end(), [sortBy](const ProfileZoneCounters* a, const ProfileZoneCounters* b)
+    {
+        return a->inclusive[sortBy] > b->inclusive[sortBy];
+    });
+
+    fprintf(pFile, "%-40s %10s %8s", "zone", "calls", "ipc");
+    for (int i = 0; i < PerfCounter::Count; i++)
+        fprintf(pFile, " %18s", (std::string(PerfCounter::getName(static_cast<PerfCounter::Enum>(i))) + "/call").c_str());
+    fprintf(pFile, " %18s\n", "self_cycles/call");
+
+    bool hasIpc = Profiler::isCounterAvailable(PerfCounter::Instructions) && Profiler::isCounterAvailable(PerfCounter::Cycles);
+    for (auto pZone : sorted)
+    {
+        fprintf(pFile, "%-40s %10llu", pZone->name.c_str(), pZone->calls);
+        if (hasIpc)
+            fprintf(pFile, " %8.2f", pZone->getIpc());
+        else
+            fprintf(pFile, " %8s", "-");
+        for (int i = 0; i < PerfCounter::Count; i++)
+        {
+            auto counter = static_cast<PerfCounter::Enum>(i);
+            if (Profiler::isCounterAvailable(counter))
+                fprintf(pFile, " %18.1f", pZone->getPerCall(counter));
+            else
+                fprintf(pFile, " %18s", "-");
+        }
+        if (Profiler::isCounterAvailable(PerfCounter::Cycles) && pZone->calls != 0)
+            fprintf(pFile, " %18.1f\n", static_cast<double>(pZone->self[PerfCounter::Cycles]) / pZone->calls);
+        else
+            fprintf(pFile, " %18s\n", "-");
+    }
+    return ferror(pFile) ? FAILURE : SUCCESS;
+}
+
+gep::Result gep::ProfileCapture::writeChromeTrace(const char* filename) const
+{
+    RawFile file(filename, "w");
+    if (!file.isOpen())
+        return FAILURE;
+    FILE* pFile = file.m_pHandle;
+
+    uint64 firstTicks = ~0ull;
+    for (auto& thread : threads)
+    {
+        if (!thread.events.empty())
+            firstTicks = std::min(firstTicks, thread.events.front().ticks);
+    }
+    const double microsecondsPerTick = 1000000.0 / static_cast<double>(ticksPerSecond);
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (auto& thread : threads)
+    {
+        if (!thread.name.empty())
+        {
+            fprintf(pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread.threadId);
+            writeJsonString(pFile, thread.name);
+            fprintf(pFile, "}}");
+            first = false;
+        }
+        for (auto& event : thread.events)
+        {
+            double ts = static_cast<double>(event.ticks - firstTicks) * microsecondsPerTick;
+            fprintf(pFile, "%s", first ? "" : ",\n");
+            first = false;
+            switch (event.type)
+            {
+            case ProfileEventType::ZoneBegin:
+                fprintf(pFile, "{\"name\":");
+                writeJsonString(pFile, names[event.data]);
+                fprintf(pFile, ",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", ts, thread.threadId);
+                break;
+            case ProfileEventType::ZoneEnd:
+                fprintf(pFile, "{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", ts, thread.threadId);
+                break;
+            case ProfileEventType::Frame:
+                fprintf(pFile, "{\"name\":\"Frame %u\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", event.data, ts, thread.threadId);
+                break;
+            }
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+    return ferror(pFile) ? FAILURE : SUCCESS;
+}
+
+gep::Result gep::ProfileCapture::writeBinary(const char* filename) const
+{
+    std::vector<char> out;
+    out.insert(out.end(), MAGIC, MAGIC + sizeof(MAGIC));
+    writeValue(out, VERSION);
+    writeValue(out, ticksPerSecond);
+    writeValue(out, static_cast<uint32>(names.size()));
+    for (auto& name : names)
+    {
+        writeString(out, name);
+    }
+    writeValue(out, static_cast<uint32>(threads.size()));
+    for (auto& thread : threads)
+    {
+        writeValue(out, thread.threadId);
+        writeString(out, thread.name);
+        writeValue(out, static_cast<uint32>(thread.events.size()));
+        uint64 lastTicks = 0;
+        for (auto& event : thread.events)
+        {
+            out.push_back(static_cast<char>(event.type));
+            writeVarint(out, event.ticks - lastTicks);
+            if (event.type != ProfileEventType::ZoneEnd)
+                writeVarint(out, event.data);
+            lastTicks = event.ticks;
+        }
+    }
+
+    RawFile file(filename, "wb");
+    if (!file.isOpen())
+        return FAILURE;
+    return (file.writeArray(out.data(), out.size()) == out.size()) ? SUCCESS : FAILURE;
+}
+
+gep::Result gep::ProfileCapture::readBinary(const char* filename)
+{
+    std::vector<char> in;
+    {
+        RawFile file(filename, "rb");
+        if (!file.isOpen())
+            return FAILURE;
+        in.resize(file.getSize());
+        if (file.readArray(in.data(), in.size()) != in.size())
+            return FAILURE;
+    }
+
+    const char* p = in.data();
+    const char* pEnd = p + in.size();
+    if (in.size() < sizeof(MAGIC) || memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        return FAILURE;
+    p += sizeof(MAGIC);
+
+    uint32 version, numNames, numThreads;
+    if (!readValue(p, pEnd, version) || version != VERSION || !readValue(p, pEnd, ticksPerSecond))
+        return FAILURE;
+
+    if (!readValue(p, pEnd, numNames))
+        return FAILURE;
+    names.clear();
+    names.resize(numNames);
+    for (auto& name : names)
+    {
+        if (!readString(p, pEnd, name))
+            return FAILURE;
+    }
+
+    if (!readValue(p, pEnd, numThreads))
+        return FAILURE;
+    threads.clear();
+    threads.resize(numThreads);
+    for (auto& thread : threads)
+    {
+        uint32 numEvents;
+        if (!readValue(p, pEnd, thread.threadId) || !readString(p, pEnd, thread.name) || !readValue(p, pEnd, numEvents))
+            return FAILURE;
+        thread.events.reserve(numEvents);
+        uint64 ticks = 0;
+        for (uint32 i = 0; i < numEvents; i++)
+        {
+            ProfileEvent event;
+            uint64 delta, data = 0;
+            if (p == pEnd)
+                return FAILURE;
+            event.type = static_cast<ProfileEventType::Enum>(*p++);
+            if (event.type > ProfileEventType::Frame || !readVarint(p, pEnd, delta))
+                return FAILURE;
+            if (event.type != ProfileEventType::ZoneEnd && !readVarint(p, pEnd, data))
+                return FAILURE;
+            if (event.type == ProfileEventType::ZoneBegin && data >= numNames)
+                return FAILURE;
+            ticks += delta;
+            event.ticks = ticks;
+            event.data = static_cast<uint32>(data);
+            thread.events.push_back(event);
+        }
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,232 @@
+#include "stdafx.h"
+#include "gep/samplingprofiler.h"
+#include "gep/stackwalker.h"
+#include "gep/exit.h"
+#include "gep/file.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <string.h>
+
+#ifdef __linux__
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    typedef gep::StackWalker::address_t address_t;
+
+    // every sample is stored as its number of frames followed by the frames, innermost first.
+    // The buffer starts out zeroed, so a sample which did not fit anymore ends the data with a count of 0.
+    address_t* g_pBuffer = nullptr;
+    size_t g_bufferSize = 0;
+    std::atomic<size_t> g_writePosition(0);
+    std::atomic<size_t> g_numSamples(0);
+    std::atomic<size_t> g_numDropped(0);
+    std::atomic<bool> g_sampling(false);
+    /// number of signal handlers inside the buffer, stop waits for this to reach 0
+    std::atomic<int> g_handlersRunning(0);
+    std::string g_exitFilename;
+
+    /// \brief longest function name kept when symbolizing
+    const size_t maxNameLength = 256;
+
+#ifdef __linux__
+    timer_t g_timer;
+    bool g_timerCreated = false;
+
+    void onSignal(int, siginfo_t*, void* pContext)
+    {
+        int savedErrno = errno;
+        g_handlersRunning.fetch_add(1);
+        if (g_sampling.load())
+        {
+            address_t frames[gep::SamplingProfiler::MAX_FRAMES];
+            size_t numFrames = gep::StackWalker::getCallstack(0, gep::ArrayPtr<address_t>(frames), pContext);
+            if (numFrames > 0)
+            {
+                size_t position = g_writePosition.fetch_add(numFrames + 1, std::memory_order_relaxed);
+                if (position + numFrames + 1 <= g_bufferSize)
+                {
+                    memcpy(g_pBuffer + position + 1, frames, numFrames * sizeof(address_t));
+                    g_pBuffer[position] = numFrames;
+                    g_numSamples.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                    g_numDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        g_handlersRunning.fetch_sub(1);
+        errno = savedErrno;
+    }
+#endif
+
+    void writeAtExit()
+    {
+        gep::SamplingProfiler::writeFoldedStacks(g_exitFilename.c_str());
+        free(g_pBuffer);
+        g_pBuffer = nullptr;
+        g_bufferSize = 0;
+    }
+}
+
+gep::Result gep::SamplingProfiler::start(uint32 samplesPerSecond, size_t bufferSize)
+{
+#ifdef __linux__
+    GEP_ASSERT(samplesPerSecond > 0, "the sample rate has to be positive");
+    GEP_ASSERT(bufferSize > MAX_FRAMES, "the buffer is too small to hold a single sample", bufferSize);
+    stop();
+
+    free(g_pBuffer);
+    g_pBuffer = static_cast<address_t*>(calloc(bufferSize, sizeof(address_t)));
+    g_bufferSize = (g_pBuffer != nullptr) ? bufferSize : 0;
+    g_writePosition = 0;
+    g_numSamples = 0;
+    g_numDropped = 0;
+    if (g_pBuffer == nullptr)
+        return FAILURE;
+
+    // the handler stays installed after stopping, a late SIGPROF would terminate the process otherwise
+    static bool s_handlerInstalled = false;
+    if (!s_handlerInstalled)
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &onSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0)
+            return FAILURE;
+        s_handlerInstalled = true;
+    }
+
+    sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &g_timer) != 0)
+        return FAILURE;
+    g_timerCreated = true;
+
+    itimerspec interval;
+    uint64 nanoseconds = 1000000000ull / samplesPerSecond;
+    interval.it_interval.tv_sec = static_cast<time_t>(nanoseconds / 1000000000ull);
+    interval.it_interval.tv_nsec = static_cast<long>(nanoseconds % 1000000000ull);
+    interval.it_value = interval.it_interval;
+    g_sampling = true;
+    if (timer_settime(g_timer, 0, &interval, nullptr) != 0)
+    {
+        stop();
+        return FAILURE;
+    }
+    return SUCCESS;
+#else
+    GEP_UNUSED(samplesPerSecond);
+    GEP_UNUSED(bufferSize);
+    return FAILURE;
+#endif
+}
+
+void gep::SamplingProfiler::stop()
+{
+#ifdef __linux__
+    if (!g_timerCreated)
+        return;
+    timer_delete(g_timer);
+    g_timerCreated = false;
+    g_sampling = false;
+    // a handler which already passed the check keeps writing, wait for it
+    while (g_handlersRunning.load() != 0)
+        sched_yield();
+#endif
+}
+
+bool gep::SamplingProfiler::isRunning()
+{
+    return g_sampling.load();
+}
+
+size_t gep::SamplingProfiler::getNumSamples()
+{
+    return g_numSamples.load(std::memory_order_relaxed);
+}
+
+size_t gep::SamplingProfiler::getNumDroppedSamples()
+{
+    return g_numDropped.load(std::memory_order_relaxed);
+}
+
+gep::Result gep::SamplingProfiler::writeFoldedStacks(const char* filename)
+{
+    stop();
+
+    // count the distinct stacks first, so that every address is only symbolized once
+    std::map<std::vector<address_t>, size_t> stackCounts;
+    std::vector<address_t> addresses;
+    size_t end = std::min(g_writePosition.load(), g_bufferSize);
+    for (size_t position = 0; position < end; )
+    {
+        size_t numFrames = g_pBuffer[position];
+        if (numFrames == 0 || position + 1 + numFrames > end)
+            break;
+        const address_t* pFrames = g_pBuffer + position + 1;
+        stackCounts[std::vector<address_t>(pFrames, pFrames + numFrames)]++;
+        addresses.insert(addresses.end(), pFrames, pFrames + numFrames);
+        position += numFrames + 1;
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+    std::unordered_map<address_t, std::string> names;
+    if (!addresses.empty())
+    {
+        std::vector<char> resolved(addresses.size() * maxNameLength);
+        StackWalker::resolveFunctionNames(ArrayPtr<address_t>(&addresses[0], addresses.size()), &resolved[0], maxNameLength);
+        for (size_t i = 0; i < addresses.size(); i++)
+        {
+            std::string name = &resolved[i * maxNameLength];
+            // ';' separates the frames in the folded format
+            std::replace(name.begin(), name.end(), ';', ':');
+            names[addresses[i]] = name;
+        }
+    }
+
+    // several call sites in the same functions fold into the same line
+    std::map<std::string, size_t> foldedCounts;
+    for (auto& entry : stackCounts)
+    {
+        std::string folded;
+        for (auto it = entry.first.rbegin(); it != entry.first.rend(); ++it)
+        {
+            if (!folded.empty())
+                folded += ';';
+            folded += names[*it];
+        }
+        foldedCounts[folded] += entry.second;
+    }
+
+    RawFile file(filename, "w");
+    if (!file.isOpen())
+        return FAILURE;
+    FILE* pFile = file.m_pHandle;
+    for (auto& entry : foldedCounts)
+        fprintf(pFile, "%s %llu\n", entry.first.c_str(), static_cast<unsigned long long>(entry.second));
+    return ferror(pFile) ? FAILURE : SUCCESS;
+}
+
+gep::Result gep::SamplingProfiler::startUntilExit(const char* filename, uint32 samplesPerSecond)
+{
+    if (start(samplesPerSecond) != SUCCESS)
+        return FAILURE;
+    bool registered = !g_exitFilename.empty();
+    g_exitFilename = filename;
+    if (!registered)
+        return gep::atexit(&writeAtExit);
+    return SUCCESS;
+}
@@ -0,0 +1,489 @@
+#include "stdafx.h"
+#include "gep/stackwalker.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <DbgHelp.h>
+#include <Tlhelp32.h>
+#else
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <cxxabi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+#endif
+
+bool gep::StackWalker::s_isInitialized = false;
+
+#ifdef _WIN32
+
+size_t gep::StackWalker::getCallstack(size_t framesToSkip, ArrayPtr<address_t> functionAddresses, CONTEXT* pContext)
+{
+    if(functionAddresses.length() < 63 && pContext == nullptr)
+    {
+        return RtlCaptureStackBackTrace((DWORD)framesToSkip, (DWORD)functionAddresses.length(), (void**)functionAddresses.getPtr(), nullptr);
+    }
+
+    HANDLE hThread = GetCurrentThread();
+    HANDLE hProcess = GetCurrentProcess();
+    STACKFRAME64 stackframe;
+    DWORD imageType;
+    CONTEXT c;
+
+    if(pContext == nullptr)
+    {
+        c.ContextFlags = CONTEXT_FULL;
+        RtlCaptureContext(&c);
+    }
+    else
+        c = *pContext;
+
+#ifdef _M_X64 //x64
+    imageType = IMAGE_FILE_MACHINE_AMD64;
+    stackframe.AddrPC.Offset = c.Rip;
+    stackframe.AddrPC.Mode = AddrModeFlat;
+    stackframe.AddrFrame.Offset = c.Rbp;
+    stackframe.AddrFrame.Mode = AddrModeFlat;
+    stackframe.AddrStack.Offset = c.Rsp;
+    stackframe.AddrStack.Mode = AddrModeFlat;
+#else //x86
+    imageType = IMAGE_FILE_MACHINE_I386;
+    stackframe.AddrPC.Offset = (DWORD64)c.Eip;
+    stackframe.AddrPC.Mode = AddrModeFlat;
+    stackframe.AddrFrame.Offset = (DWORD64)c.Ebp;
+    stackframe.AddrFrame.Mode = AddrModeFlat;
+    stackframe.AddrStack.Offset = (DWORD64)c.Esp;
+    stackframe.AddrStack.Mode = AddrModeFlat;
+#endif
+    stackframe.AddrReturn.Offset = 0;
+
+    size_t frameNum = 0;
+
+    // do ... while so that we don't skip the first stackframe
+    do
+    {
+        if( stackframe.AddrPC.Offset == stackframe.AddrReturn.Offset )
+        {
+            break; //endless callstack
+        }
+        if(frameNum >= framesToSkip)
+        {
+            if(frameNum - framesToSkip >= functionAddresses.length())
+                break;
+            functionAddresses[frameNum - framesToSkip] = (address_t)stackframe.AddrPC.Offset;
+        }
+        frameNum++;
+    }
+    while (StackWalk64(imageType, hProcess, hThread, &stackframe, &c, nullptr, nullptr, nullptr, nullptr));
+
+    if(frameNum < framesToSkip)
+        return 0;
+    return frameNum - framesToSkip;
+}
+
+void gep::StackWalker::resolve(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength, bool withLines)
+{
+  HANDLE hProcess = GetCurrentProcess();
+  if(!s_isInitialized)
+  {
+    DWORD symOptions = SymGetOptions();
+    symOptions |= SYMOPT_LOAD_LINES;
+    symOptions |= SYMOPT_FAIL_CRITICAL_ERRORS;
+    symOptions |= SYMOPT_DEFERRED_LOADS;
+    symOptions = SymSetOptions( symOptions );
+
+    std::string searchPath = generateSearchPath();
+    SymInitialize(hProcess, searchPath.c_str(), TRUE);
+
+    s_isInitialized = true;
+  }
+
+  size_t symbolSize = sizeof(IMAGEHLP_SYMBOL64) + uiMaxFuncNameLength;
+  IMAGEHLP_SYMBOL64* symbol = (IMAGEHLP_SYMBOL64*)calloc( symbolSize, 1 );
+
+  symbol->SizeOfStruct = (DWORD)symbolSize;
+  symbol->MaxNameLength = (DWORD)uiMaxFuncNameLength;
+
+  IMAGEHLP_LINE64 line;
+  line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+  for(size_t i=0; i<functionAddresses.length(); i++)
+  {
+    char* funcName = pFunctionNames + (uiMaxFuncNameLength * i);
+    *funcName = '\0';
+
+    DWORD64 offset = 0;
+    DWORD displacement = 0;
+
+    if(functionAddresses[i] != 0)
+    {
+      if( SymGetSymFromAddr64(hProcess, functionAddresses[i], &offset, symbol ) == TRUE )
+      {
+        char undecoratedName[512];
+        char* symbolName = symbol->Name;
+        if( SymUnDName64(symbol, undecoratedName, GEP_ARRAY_SIZE(undecoratedName)) == TRUE )
+        {
+          symbolName = undecoratedName;
+        }
+
+        if( withLines && SymGetLineFromAddr64( hProcess, functionAddresses[i], &displacement, &line ) == TRUE )
+        {
+          sprintf_s(funcName, uiMaxFuncNameLength, "%s(%d): %s", line.FileName, line.LineNumber, symbolName );
+        }
+        else
+        {
+          sprintf_s(funcName, uiMaxFuncNameLength, "%s", symbolName);
+        }
+      }
+      else {
+        sprintf_s(funcName, uiMaxFuncNameLength, "unknown %x", functionAddresses[i]);
+      }
+      funcName[uiMaxFuncNameLength-1] = '\0';
+    }
+    else {
+      strcpy_s(funcName, uiMaxFuncNameLength, "unknown");
+    }
+  }
+
+  free(symbol);
+}
+
+std::string gep::StackWalker::generateSearchPath()
+{
+  const char* defaultPathList[] = {"_NT_SYMBOL_PATH", "_NT_ALTERNATE_SYMBOL_PATH", "SYSTEMROOT"};
+
+  std::string path;
+  char temp[512] = {'\0'};
+  DWORD len;
+
+  for(int i=0; i<GEP_ARRAY_SIZE(defaultPathList); i++)
+  {
+    if( (len = GetEnvironmentVariableA( defaultPathList[i], temp, GEP_ARRAY_SIZE(temp) )) > 0 )
+    {
+      path += temp;
+    }
+  }
+  return path;
+}
+
+#else
+
+namespace
+{
+    /// \brief turns "ns::Class::function(int, float) const" into "ns::Class::function"
+    void stripParameters(std::string& name)
+    {
+        const char constSuffix[] = " const";
+        if (name.size() > sizeof(constSuffix) && name.compare(name.size() - sizeof(constSuffix) + 1, std::string::npos, constSuffix) == 0)
+            name.resize(name.size() - sizeof(constSuffix) + 1);
+        if (name.empty() || name.back() != ')')
+            return;
+        int depth = 0;
+        for (size_t i = name.size(); i-- > 0; )
+        {
+            if (name[i] == ')')
+                depth++;
+            else if (name[i] == '(' && --depth == 0)
+            {
+                name.resize(i);
+                return;
+            }
+        }
+    }
+
+    gep::StackWalker::address_t getInstructionPointer(const void* pContext)
+    {
+        const ucontext_t* pUContext = static_cast<const ucontext_t*>(pContext);
+#if defined(__x86_64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.pc);
+#else
+        GEP_UNUSED(pUContext);
+        return 0;
+#endif
+    }
+
+    /// \brief the frame pointer of the interrupted function, 0 if the architecture is not supported
+    gep::StackWalker::address_t getFramePointer(const void* pContext)
+    {
+        const ucontext_t* pUContext = static_cast<const ucontext_t*>(pContext);
+#if defined(__x86_64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_RBP]);
+#elif defined(__i386__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_EBP]);
+#elif defined(__aarch64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.regs[29]);
+#else
+        GEP_UNUSED(pUContext);
+        return 0;
+#endif
+    }
+
+    gep::StackWalker::address_t getStackPointer(const void* pContext)
+    {
+        const ucontext_t* pUContext = static_cast<const ucontext_t*>(pContext);
+#if defined(__x86_64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_RSP]);
+#elif defined(__i386__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.gregs[REG_ESP]);
+#elif defined(__aarch64__)
+        return static_cast<gep::StackWalker::address_t>(pUContext->uc_mcontext.sp);
+#else
+        GEP_UNUSED(pUContext);
+        return 0;
+#endif
+    }
+
+    /// \brief checks if a page can be read without faulting, async-signal-safe
+    ///
+    /// rt_sigprocmask copies the new mask from the address before it looks at the invalid "how",
+    /// so it fails with EFAULT for an unreadable address and with EINVAL otherwise, changing nothing.
+    bool isReadable(gep::StackWalker::address_t address)
+    {
+#ifdef __linux__
+        int savedErrno = errno;
+        const size_t kernelSigsetSize = 8;
+        long result = syscall(SYS_rt_sigprocmask, ~0, reinterpret_cast<void*>(address), nullptr, kernelSigsetSize);
+        bool isFault = (result == -1 && errno == EFAULT);
+        errno = savedErrno;
+        return !isFault;
+#else
+        GEP_UNUSED(address);
+        return true;
+#endif
+    }
+
+    /// \brief follows the chain of saved frame pointers, starting at the interrupted function of a signal context
+    ///
+    /// Unlike backtrace this neither allocates nor takes locks, so it can run inside a signal handler. It needs
+    /// the code to keep frame pointers (-fno-omit-frame-pointer), the stack ends at the first function without one.
+    /// A function interrupted before it set up its frame hides its direct caller.
+    /// Every frame is a return address, the interrupted instruction is stored one byte after it to look the same.
+    size_t walkFramePointers(const void* pContext, gep::StackWalker::address_t* pFrames, size_t maxFrames)
+    {
+        typedef gep::StackWalker::address_t address_t;
+        // a frame larger than this is taken for a broken chain
+        const address_t maxFrameSize = 1024 * 1024;
+        const address_t pageSize = 4096;
+
+        address_t instruction = getInstructionPointer(pContext);
+        address_t framePointer = getFramePointer(pContext);
+        address_t stackPointer = getStackPointer(pContext);
+        if (instruction == 0 || maxFrames == 0)
+            return 0;
+        size_t numFrames = 0;
+        pFrames[numFrames++] = instruction + 1;
+
+        address_t readablePage = 0;
+        while (numFrames < maxFrames)
+        {
+            // the callers are further up the stack, every frame stores the previous frame pointer and the return address
+            if (framePointer <= stackPointer || framePointer - stackPointer > maxFrameSize || framePointer % sizeof(address_t) != 0)
+                break;
+            address_t firstPage = framePointer & ~(pageSize - 1);
+            address_t lastPage = (framePointer + sizeof(address_t)) & ~(pageSize - 1);
+            if ((firstPage != readablePage && !isReadable(firstPage)) || (lastPage != firstPage && !isReadable(lastPage)))
+                break;
+            readablePage = lastPage;
+
+            const address_t* pFrame = reinterpret_cast<const address_t*>(framePointer);
+            address_t returnAddress = pFrame[1];
+            if (returnAddress == 0)
+                break;
+            pFrames[numFrames++] = returnAddress;
+            stackPointer = framePointer;
+            framePointer = pFrame[0];
+        }
+        return numFrames;
+    }
+
+    /// \brief the addresses of one loaded module, resolved together with a single addr2line run
+    struct ModuleAddresses
+    {
+        std::vector<size_t> indices;
+        std::vector<gep::StackWalker::address_t> offsets;
+    };
+
+    std::string quoteForShell(const std::string& str)
+    {
+        std::string quoted = "'";
+        for (char c : str)
+        {
+            if (c == '\'')
+                quoted += "'\\''";
+            else
+                quoted += c;
+        }
+        return quoted + "'";
+    }
+
+    /// \brief runs addr2line on a module, function names and "file:line" go into the given index of functions and locations
+    void runAddr2line(const std::string& module, const ModuleAddresses& addresses, std::vector<std::string>& functions, std::vector<std::string>& locations)
+    {
+        // keep the command line reasonably short
+        const size_t addressesPerRun = 256;
+        for (size_t first = 0; first < addresses.offsets.size(); first += addressesPerRun)
+        {
+            size_t last = std::min(first + addressesPerRun, addresses.offsets.size());
+            std::string command = "addr2line -C -f -e " + quoteForShell(module);
+            char hex[32];
+            for (size_t i = first; i < last; i++)
+            {
+                snprintf(hex, sizeof(hex), " 0x%zx", addresses.offsets[i]);
+                command += hex;
+            }
+            command += " 2>/dev/null";
+
+            FILE* pPipe = popen(command.c_str(), "r");
+            if (pPipe == nullptr)
+                return;
+            char line[4096];
+            for (size_t i = first; i < last; i++)
+            {
+                if (fgets(line, sizeof(line), pPipe) == nullptr)
+                    break;
+                line[strcspn(line, "\n")] = '\0';
+                size_t index = addresses.indices[i];
+                if (strcmp(line, "??") != 0)
+                    functions[index] = line;
+                if (fgets(line, sizeof(line), pPipe) == nullptr)
+                    break;
+                line[strcspn(line, "\n")] = '\0';
+                if (strncmp(line, "??", 2) != 0)
+                    locations[index] = line;
+            }
+            pclose(pPipe);
+        }
+    }
+}
+
+size_t gep::StackWalker::getCallstack(size_t framesToSkip, ArrayPtr<address_t> functionAddresses, context_t* pContext)
+{
+    // backtrace is not async-signal-safe, it may allocate or take the loader lock when it unwinds the first time
+    if (pContext != nullptr)
+    {
+        address_t frames[256];
+        size_t numWanted = std::min(framesToSkip + functionAddresses.length(), GEP_ARRAY_SIZE(frames));
+        size_t numFrames = walkFramePointers(pContext, frames, numWanted);
+        size_t numWritten = 0;
+        for (size_t i = framesToSkip; i < numFrames; i++)
+            functionAddresses[numWritten++] = frames[i];
+        return numWritten;
+    }
+
+    void* frames[256];
+    // like on Windows the first frame is this function
+    size_t numWanted = framesToSkip + functionAddresses.length() + 4;
+    int numFrames = backtrace(frames, static_cast<int>(std::min(numWanted, GEP_ARRAY_SIZE(frames))));
+
+    // search for the caller, this also takes care of frames interceptors (like the one of the address sanitizer) put in between
+    size_t first = framesToSkip;
+    address_t caller = reinterpret_cast<address_t>(__builtin_return_address(0));
+    for (int i = 1; i < numFrames; i++)
+    {
+        if (reinterpret_cast<address_t>(frames[i]) == caller)
+        {
+            first = i - 1 + framesToSkip;
+            break;
+        }
+    }
+
+    size_t numWritten = 0;
+    for (size_t i = first; i < static_cast<size_t>(numFrames) && numWritten < functionAddresses.length(); i++)
+        functionAddresses[numWritten++] = reinterpret_cast<address_t>(frames[i]);
+    return numWritten;
+}
+
+void gep::StackWalker::resolve(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength, bool withLines)
+{
+    // addr2line knows the local symbols and the debug information, dladdr only the exported symbols
+    const size_t count = functionAddresses.length();
+    std::vector<std::string> functions(count), locations(count), fallbacks(count);
+    std::unordered_map<std::string, ModuleAddresses> modules;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // the addresses are return addresses, the call itself is the instruction before. A call at the end of
+        // a function (e.g. to a noreturn function) would show up as the following function otherwise
+        address_t returnAddress = functionAddresses[i];
+        Dl_info info;
+        if (returnAddress == 0 || dladdr(reinterpret_cast<void*>(returnAddress - 1), &info) == 0 || info.dli_fname == nullptr)
+            continue;
+
+        // position independent modules are looked up by the offset, others by the address
+        auto pHeader = static_cast<const ElfW(Ehdr)*>(info.dli_fbase);
+        address_t offset = returnAddress - 1;
+        if (pHeader != nullptr && pHeader->e_type == ET_DYN)
+            offset -= reinterpret_cast<address_t>(info.dli_fbase);
+
+        if (info.dli_sname != nullptr)
+        {
+            int status = 0;
+            char* pDemangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            fallbacks[i] = (status == 0) ? pDemangled : info.dli_sname;
+            free(pDemangled);
+        }
+        else
+        {
+            char hex[32];
+            snprintf(hex, sizeof(hex), "+0x%zx", offset);
+            const char* pModuleName = strrchr(info.dli_fname, '/');
+            fallbacks[i] = std::string((pModuleName != nullptr) ? pModuleName + 1 : info.dli_fname) + hex;
+        }
+
+        // the main executable is reported under the name it was started with
+        std::string module = info.dli_fname;
+        if (module.empty() || access(module.c_str(), R_OK) != 0)
+            module = "/proc/self/exe";
+        ModuleAddresses& moduleAddresses = modules[module];
+        moduleAddresses.indices.push_back(i);
+        moduleAddresses.offsets.push_back(offset);
+    }
+
+    for (auto& module : modules)
+        runAddr2line(module.first, module.second, functions, locations);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        char* funcName = pFunctionNames + (uiMaxFuncNameLength * i);
+        std::string name = !functions[i].empty() ? functions[i] : fallbacks[i];
+        if (name.empty())
+            name = (functionAddresses[i] == 0) ? "unknown" : "unknown " + std::to_string(functionAddresses[i]);
+        if (!withLines)
+            stripParameters(name);
+
+        // addr2line prints file:line, sometimes followed by " (discriminator n)"
+        size_t colon = locations[i].rfind(':', locations[i].find(" ("));
+        if (withLines && colon != std::string::npos && colon > 0)
+        {
+            int lineNumber = atoi(locations[i].c_str() + colon + 1);
+            snprintf(funcName, uiMaxFuncNameLength, "%s(%d): %s", locations[i].substr(0, colon).c_str(), lineNumber, name.c_str());
+        }
+        else
+            snprintf(funcName, uiMaxFuncNameLength, "%s", name.c_str());
+    }
+}
+
+#endif
+
+void gep::StackWalker::resolveCallstack(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength)
+{
+    resolve(functionAddresses, pFunctionNames, uiMaxFuncNameLength, true);
+}
+
+void gep::StackWalker::resolveFunctionNames(ArrayPtr<address_t> functionAddresses, char* pFunctionNames, size_t uiMaxFuncNameLength)
+{
+    resolve(functionAddresses, pFunctionNames, uiMaxFuncNameLength, false);
+}
@@ -0,0 +1,288 @@
+#include "stdafx.h"
+#include "gep/statcache.h"
+#include "gep/utils.h"
+#include <algorithm>
+#include <ctype.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+    typedef gep::StatCache::Type Type;
+
+    /// \brief normalizes the path the way it is stored in the cache and hashes it
+    std::string makeKey(const char* path, gep::uint64& hash)
+    {
+        std::string key(path);
+        // a directory has the same key with and without a trailing slash
+        while(key.size() > 1 && (key.back() == '/' || key.back() == '\\'))
+            key.pop_back();
+#ifdef _WIN32
+        // the file system ignores the case, the cache has to as well
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+#endif
+        hash = gep::normalizeAndHashPath(key, gep::NormalizationOptions::PreserveLeadingSlash);
+        return key;
+    }
+
+    inline gep::uint64 hashKey(const std::string& key)
+    {
+        return gep::hashPath(key.c_str(), key.length());
+    }
+
+    bool isBelow(const std::string& path, const std::string& directory)
+    {
+        return path.compare(0, directory.length(), directory) == 0 &&
+            (path.length() == directory.length() || path[directory.length()] == '/');
+    }
+
+    /// \brief asks the file system about a single path
+    Type::Enum statPath(const char* path, gep::uint64& size)
+    {
+        size = 0;
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if(!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+            return Type::None;
+        if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            return Type::Directory;
+        size = (static_cast<gep::uint64>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        return Type::File;
+#else
+        struct stat status;
+        if(stat(path, &status) != 0)
+            return Type::None;
+        if(S_ISDIR(status.st_mode))
+            return Type::Directory;
+        size = static_cast<gep::uint64>(status.st_size);
+        return Type::File;
+#endif
+    }
+
+    /// \brief calls func(name, type, sizeKnown, size) for each file and directory in the directory
+    /// \return false if the directory can not be read
+    template <typename Func>
+    bool forEachFile(const std::string& directory, Func func)
+    {
+#ifdef _WIN32
+        // one call returns the attributes and sizes of many files
+        WIN32_FIND_DATAA data;
+        HANDLE handle = FindFirstFileExA((directory + "\\*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if(handle == INVALID_HANDLE_VALUE)
+            return false;
+        do
+        {
+            if(strcmp(data.cFileName, ".") == 0 || strcmp(data.cFileName, "..") == 0)
+                continue;
+            if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                func(data.cFileName, Type::Directory, true, 0);
+            else
+                func(data.cFileName, Type::File, true, (static_cast<gep::uint64>(data.nFileSizeHigh) << 32) | data.nFileSizeLow);
+        } while(FindNextFileA(handle, &data));
+        FindClose(handle);
+        return true;
+#else
+        // getdents64 returns many names per call, the sizes are only asked for when they are needed
+        struct LinuxDirent64
+        {
+            gep::uint64 d_ino;
+            gep::int64 d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+        int descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(descriptor < 0)
+            return false;
+        alignas(LinuxDirent64) char buffer[32 * 1024];
+        for(;;)
+        {
+            long size = syscall(SYS_getdents64, descriptor, buffer, sizeof(buffer));
+            if(size <= 0)
+                break;
+            for(long offset = 0; offset < size; )
+            {
+                auto pEntry = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+                offset += pEntry->d_reclen;
+                const char* name = pEntry->d_name;
+                if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                    continue;
+                if(pEntry->d_type == DT_DIR)
+                    func(name, Type::Directory, true, 0);
+                else if(pEntry->d_type != DT_UNKNOWN && pEntry->d_type != DT_LNK)
+                    func(name, Type::File, false, 0);
+                else
+                {
+                    // the file system does not know the type or it is a link, follow it
+                    struct stat status;
+                    if(fstatat(descriptor, name, &status, 0) != 0)
+                        continue;
+                    if(S_ISDIR(status.st_mode))
+                        func(name, Type::Directory, true, 0);
+                    else
+                        func(name, Type::File, true, static_cast<gep::uint64>(status.st_size));
+                }
+            }
+        }
+        close(descriptor);
+        return true;
+#endif
+    }
+}
+
+gep::StatCache::StatCache()
+{
+}
+
+gep::StatCache& gep::StatCache::instance()
+{
+    static StatCache cache;
+    return cache;
+}
+
+void gep::StatCache::addDirectory(const char* directory)
+{
+    uint64 hash;
+    std::string key = makeKey(directory, hash);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(std::find(m_directories.begin(), m_directories.end(), key) == m_directories.end())
+        m_directories.push_back(key);
+}
+
+bool gep::StatCache::isCached(const std::string& path) const
+{
+    for(auto& directory : m_directories)
+    {
+        if(isBelow(path, directory))
+            return true;
+    }
+    return false;
+}
+
+void gep::StatCache::invalidate(const char* path)
+{
+    uint64 hash;
+    std::string key = makeKey(path, hash);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(!isCached(key))
+        return;
+    for(auto it = m_entries.begin(); it != m_entries.end(); )
+    {
+        if(isBelow(it->second.path, key))
+            it = m_entries.erase(it);
+        else
+            ++it;
+    }
+    // the directory has to be listed again to see a new file
+    size_t slash = key.rfind('/');
+    if(slash != std::string::npos)
+    {
+        auto parent = m_entries.find(hashPath(key.c_str(), slash));
+        if(parent != m_entries.end() && parent->second.path.compare(0, std::string::npos, key, 0, slash) == 0)
+            parent->second.listed = false;
+    }
+}
+
+void gep::StatCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
+
+gep::StatCache::Entry* gep::StatCache::lookup(const std::string& path, uint64 hash)
+{
+    auto it = m_entries.find(hash);
+    if(it != m_entries.end())
+        return (it->second.path == path) ? &it->second : nullptr;
+
+    Entry entry = { path, Type::None, false, true, 0 };
+    size_t slash = path.rfind('/');
+    bool isCachedDirectory = std::find(m_directories.begin(), m_directories.end(), path) != m_directories.end();
+    if(isCachedDirectory || slash == std::string::npos || slash == 0)
+    {
+        // the cached directories themselves are not listed in their parent
+        entry.type = statPath(path.c_str(), entry.size);
+        return &(m_entries[hash] = entry);
+    }
+
+    std::string parentPath = path.substr(0, slash);
+    Entry* pParent = lookup(parentPath, hashKey(parentPath));
+    if(pParent == nullptr)
+        return nullptr;
+    if(pParent->type == Type::Directory && !pParent->listed)
+    {
+        listDirectory(*pParent);
+        it = m_entries.find(hash);
+        if(it != m_entries.end())
+            return (it->second.path == path) ? &it->second : nullptr;
+    }
+    // the directory was listed without the file, it does not exist
+    return &(m_entries[hash] = entry);
+}
+
+void gep::StatCache::listDirectory(Entry& directory)
+{
+    directory.listed = true;
+    std::string prefix = directory.path + "/";
+    forEachFile(directory.path, [&](const char* name, Type::Enum type, bool sizeKnown, uint64 size)
+    {
+        uint64 hash;
+        Entry file = { makeKey((prefix + name).c_str(), hash), type, false, sizeKnown, size };
+        Entry& stored = m_entries[hash];
+        if(stored.path.empty() || stored.path == file.path)
+            stored = file;
+        else
+        {
+            // two paths with the same hash, lookups of both go to the file system
+            stored.path.clear();
+            stored.type = Type::None;
+        }
+    });
+}
+
+gep::StatCache::Type::Enum gep::StatCache::getType(const char* path)
+{
+    uint64 hash;
+    std::string key = makeKey(path, hash);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(isCached(key))
+        {
+            Entry* pEntry = lookup(key, hash);
+            if(pEntry != nullptr)
+                return pEntry->type;
+        }
+    }
+    uint64 size;
+    return statPath(path, size);
+}
+
+gep::uint64 gep::StatCache::getFileSize(const char* path)
+{
+    uint64 hash;
+    std::string key = makeKey(path, hash);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(isCached(key))
+        {
+            Entry* pEntry = lookup(key, hash);
+            if(pEntry != nullptr)
+            {
+                if(!pEntry->sizeKnown)
+                {
+                    statPath(pEntry->path.c_str(), pEntry->size);
+                    pEntry->sizeKnown = true;
+                }
+                return pEntry->size;
+            }
+        }
+    }
+    uint64 size;
+    statPath(path, size);
+    return size;
+}
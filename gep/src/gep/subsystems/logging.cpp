@@ -1,28 +1,102 @@
 #include "stdafx.h"
 #include "..\..\..\include\gepimpl\subsystems\logging.h"
+#include "gep/binarylog.h"
 #include <cstdarg>
-#include <iostream>
-#include <iomanip>
-#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	/// ids of the Logging instances which are alive, guards freeing their rings against exiting threads
+	gep::Mutex g_aliveLoggingMutex;
+	std::vector<gep::uint32> g_aliveLoggingIds;
+	std::atomic<gep::uint32> g_nextLoggingId(1);
+
+	/// \brief has to be called while holding g_aliveLoggingMutex
+	bool isLoggingAlive(gep::uint32 loggingId)
+	{
+		return std::find(g_aliveLoggingIds.begin(), g_aliveLoggingIds.end(), loggingId) != g_aliveLoggingIds.end();
+	}
 
+	/// \brief remembers the ring the current thread owns in each Logging instance and returns them when the thread exits
+	struct ThreadRingHandles
+	{
+		struct Entry
+		{
+			gep::uint32 loggingId;
+			gep::LogRingBuffer* pRing;
+		};
+		std::vector<Entry> entries;
+
+		gep::LogRingBuffer* find(gep::uint32 loggingId) const
+		{
+			for (auto& entry : entries)
+			{
+				if (entry.loggingId == loggingId)
+					return entry.pRing;
+			}
+			return nullptr;
+		}
+
+		/// \brief forgets the rings of destroyed instances, has to be called while holding g_aliveLoggingMutex
+		void removeDead()
+		{
+			entries.erase(std::remove_if(entries.begin(), entries.end(),
+				[](const Entry& entry) { return !isLoggingAlive(entry.loggingId); }), entries.end());
+		}
+
+		~ThreadRingHandles()
+		{
+			if (entries.empty())
+				return;
+			// the logging instances might have been destroyed (and their rings freed) already
+			gep::ScopedLock<gep::Mutex> lock(g_aliveLoggingMutex);
+			removeDead();
+			for (auto& entry : entries)
+				entry.pRing->inUse.store(false, std::memory_order_release);
+		}
+	};
+
+	thread_local ThreadRingHandles t_ringHandles;
+	thread_local bool t_isLogWriterThread = false;
+
+	inline gep::int64 currentLogTimestamp()
+	{
+		using namespace std::chrono;
+		return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+	}
+}
 
 void gep::Logging::logMessage(GEP_PRINTF_FORMAT_STRING const char * fmt, ...)
 {
-	printMessage(LogChannel::message, fmt);
+	va_list args;
+	va_start(args, fmt);
+	printMessage(LogChannel::message, fmt, args);
+	va_end(args);
 }
 
 void gep::Logging::logWarning(GEP_PRINTF_FORMAT_STRING const char * fmt, ...)
 {
-	printMessage(LogChannel::warning, fmt);
+	va_list args;
+	va_start(args, fmt);
+	printMessage(LogChannel::warning, fmt, args);
+	va_end(args);
 }
 
 void gep::Logging::logError(GEP_PRINTF_FORMAT_STRING const char * fmt, ...)
 {
-	printMessage(LogChannel::error, fmt);
+	va_list args;
+	va_start(args, fmt);
+	printMessage(LogChannel::error, fmt, args);
+	va_end(args);
 }
 
 void gep::Logging::registerSink(ILogSink * pSink)
 {
+	ScopedLock<Mutex> lock(m_sinkMutex);
 	for (int i = 0; i < MAX_SINK_OBJECTS; i++)
 	{
 		if (m_pSinkObjects[i] == nullptr)
@@ -35,66 +109,447 @@ void gep::Logging::registerSink(ILogSink * pSink)
 
 void gep::Logging::deregisterSink(ILogSink * pSink)
 {
+	ScopedLock<Mutex> lock(m_sinkMutex);
 	for (int i = 0; i < MAX_SINK_OBJECTS; i++)
 	{
 		if (pSink == m_pSinkObjects[i])
 		{
 			//TODO call deregister function in LogSink
 			// so it knows it is deregistered
+			pSink->flush();
 			m_pSinkObjects[i] = nullptr;
 			return;
 		}
 	}
 }
 
-void gep::Logging::printMessage(LogChannel channel, const char * fmt, ...)
+void gep::Logging::flush()
 {
-	va_list args;
+	ScopedLock<Mutex> lock(m_sinkMutex);
+	drainRings();
+	flushSinks();
+}
 
-	va_start(args, fmt);
-	int len = _vscprintf(fmt, args) + 1;
-	char* msg = new char[len];
-	vsprintf_s(msg, len, fmt, args);
+void gep::Logging::setFlushThresholds(uint32 intervalMs, size_t numBytes)
+{
+	m_flushIntervalMs.store(intervalMs, std::memory_order_relaxed);
+	m_flushSize.store(numBytes, std::memory_order_relaxed);
+	wakeWriter();
+}
+
+void gep::Logging::printMessage(LogChannel channel, const char * fmt, va_list args)
+{
+	LogRingBuffer* pRing = getThreadRing();
+
+	uint32 write = pRing->writeIndex.load(std::memory_order_relaxed);
+	while (write - pRing->readIndex.load(std::memory_order_acquire) >= LOG_RING_CAPACITY)
+	{
+		// the writer thread can not wait for itself, messages logged by sinks are dropped instead
+		if (t_isLogWriterThread || !m_running.load(std::memory_order_relaxed))
+		{
+			m_numDroppedMessages.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		wakeWriter();
+		std::this_thread::yield();
+	}
+
+	LogRecord& record = pRing->records[write & (LOG_RING_CAPACITY - 1)];
+	record.timestamp = currentLogTimestamp();
+	record.channel = channel;
+	if (m_binaryMode.load(std::memory_order_relaxed))
+	{
+		record.pFormat = fmt;
+		record.length = static_cast<uint32>(packLogArguments(fmt, args, record.text, LOG_MAX_MESSAGE_LENGTH));
+	}
+	else
+	{
+		record.pFormat = nullptr;
+		int length = vsnprintf(record.text, LOG_MAX_MESSAGE_LENGTH, fmt, args);
+		if (length < 0)
+		{
+			record.text[0] = '\0';
+			length = 0;
+		}
+		record.length = (length < LOG_MAX_MESSAGE_LENGTH) ? length : LOG_MAX_MESSAGE_LENGTH - 1;
+	}
+	pRing->writeIndex.store(write + 1, std::memory_order_release);
+
+	// waking the writer for every message would cost a syscall each time, it polls on its own otherwise
+	if (channel == LogChannel::error || write + 1 - pRing->readIndex.load(std::memory_order_relaxed) >= LOG_RING_CAPACITY / 2)
+		wakeWriter();
+}
+
+gep::LogRingBuffer* gep::Logging::getThreadRing()
+{
+	LogRingBuffer* pRing = t_ringHandles.find(m_instanceId);
+	if (pRing != nullptr)
+		return pRing;
+
+	// happens once per thread and logging instance, not per message
+	ScopedLock<Mutex> lock(g_aliveLoggingMutex);
+	t_ringHandles.removeDead();
+
+	// reuse the ring of a thread that already exited
+	for (LogRingBuffer* pCur = m_pFirstRing.load(std::memory_order_acquire); pCur != nullptr; pCur = pCur->pNext)
+	{
+		bool expected = false;
+		if (pCur->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+		{
+			pRing = pCur;
+			break;
+		}
+	}
+
+	if (pRing == nullptr)
+	{
+		pRing = new LogRingBuffer;
+		pRing->inUse.store(true, std::memory_order_relaxed);
+		LogRingBuffer* pHead = m_pFirstRing.load(std::memory_order_relaxed);
+		do
+		{
+			pRing->pNext = pHead;
+		}
+		while (!m_pFirstRing.compare_exchange_weak(pHead, pRing, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	ThreadRingHandles::Entry entry = { m_instanceId, pRing };
+	t_ringHandles.entries.push_back(entry);
+	return pRing;
+}
+
+size_t gep::Logging::getNumRingBuffers()
+{
+	size_t numRings = 0;
+	for (LogRingBuffer* pCur = m_pFirstRing.load(std::memory_order_acquire); pCur != nullptr; pCur = pCur->pNext)
+		numRings++;
+	return numRings;
+}
+
+void gep::Logging::wakeWriter()
+{
+	if (!m_wakeupPending.exchange(true, std::memory_order_acq_rel))
+		m_wakeup.increment();
+}
+
+void gep::Logging::writerLoop()
+{
+	t_isLogWriterThread = true;
+	auto lastFlush = std::chrono::steady_clock::now();
+
+	while (m_running.load(std::memory_order_acquire))
+	{
+		uint32 intervalMs = m_flushIntervalMs.load(std::memory_order_relaxed);
+		m_wakeup.waitAndDecrement(intervalMs);
+		m_wakeupPending.store(false, std::memory_order_release);
+
+		ScopedLock<Mutex> lock(m_sinkMutex);
+		drainRings();
+
+		auto now = std::chrono::steady_clock::now();
+		bool intervalPassed = now - lastFlush >= std::chrono::milliseconds(intervalMs);
+		if (m_errorSinceFlush || m_bytesSinceFlush >= m_flushSize.load(std::memory_order_relaxed) ||
+			(intervalPassed && m_bytesSinceFlush > 0))
+		{
+			flushSinks();
+			lastFlush = now;
+		}
+	}
+}
+
+void gep::Logging::drainRings()
+{
+	// only take what is there now so that a busy producer can not keep the writer here forever
+	const size_t maxRingsPerPass = 64;
+	uint32 readEnd[maxRingsPerPass];
+	LogRingBuffer* pRings[maxRingsPerPass];
+	size_t numRings = 0;
+
+	LogRingBuffer* pCur = m_pFirstRing.load(std::memory_order_acquire);
+	while (pCur != nullptr)
+	{
+		numRings = 0;
+		for (; pCur != nullptr && numRings < maxRingsPerPass; pCur = pCur->pNext)
+		{
+			uint32 read = pCur->readIndex.load(std::memory_order_relaxed);
+			uint32 end = pCur->writeIndex.load(std::memory_order_acquire);
+			if (read != end)
+			{
+				pRings[numRings] = pCur;
+				readEnd[numRings] = end;
+				numRings++;
+			}
+		}
+
+		// merge the rings by timestamp so that messages of different threads stay in order
+		for (;;)
+		{
+			size_t oldest = numRings;
+			int64 oldestTimestamp = 0;
+			for (size_t i = 0; i < numRings; i++)
+			{
+				uint32 read = pRings[i]->readIndex.load(std::memory_order_relaxed);
+				if (read == readEnd[i])
+					continue;
+				int64 timestamp = pRings[i]->records[read & (LOG_RING_CAPACITY - 1)].timestamp;
+				if (oldest == numRings || timestamp < oldestTimestamp)
+				{
+					oldest = i;
+					oldestTimestamp = timestamp;
+				}
+			}
+			if (oldest == numRings)
+				break;
+
+			LogRingBuffer* pRing = pRings[oldest];
+			uint32 read = pRing->readIndex.load(std::memory_order_relaxed);
+			writeRecord(pRing->records[read & (LOG_RING_CAPACITY - 1)]);
+			pRing->readIndex.store(read + 1, std::memory_order_release);
+		}
+	}
+
+	uint32 numDropped = m_numDroppedMessages.exchange(0, std::memory_order_relaxed);
+	if (numDropped > 0)
+	{
+		LogRecord record;
+		record.timestamp = currentLogTimestamp();
+		record.channel = LogChannel::warning;
+		record.pFormat = nullptr;
+		record.length = snprintf(record.text, LOG_MAX_MESSAGE_LENGTH, "%u log messages were dropped because the ring buffer was full", numDropped);
+		writeRecord(record);
+	}
+}
+
+void gep::Logging::writeRecord(const LogRecord& record)
+{
+	if (m_pBinaryFile != nullptr)
+	{
+		writeBinaryRecord(record);
+		// regular messages are only read from the binary file
+		if (record.channel == LogChannel::message)
+			return;
+	}
+
+	const char* pText = record.text;
+	int textLength = static_cast<int>(record.length);
+	char formatted[LOG_MAX_MESSAGE_LENGTH];
+	if (record.pFormat != nullptr)
+	{
+		textLength = static_cast<int>(formatPackedLogArguments(record.pFormat, record.text, record.length, formatted, sizeof(formatted)));
+		pText = formatted;
+	}
+
+	// formatting the date is expensive, only do it when the second changes
+	int64 second = record.timestamp / 1000000;
+	if (second != m_cachedSecond)
+	{
+		std::time_t time = static_cast<std::time_t>(second);
+		std::tm localTime;
+#ifdef _WIN32
+		localtime_s(&localTime, &time);
+#else
+		localtime_r(&time, &localTime);
+#endif
+		strftime(m_cachedTimePrefix, sizeof(m_cachedTimePrefix), "%Y-%m-%d %H:%M:%S", &localTime);
+		m_cachedSecond = second;
+	}
+
+	char line[LOG_MAX_MESSAGE_LENGTH + 64];
+	int length = snprintf(line, sizeof(line), "%s.%03d: %s: %.*s",
+		m_cachedTimePrefix, static_cast<int>((record.timestamp / 1000) % 1000),
+		ILogSink::logChannelChar(record.channel), textLength, pText);
 
 	for (int i = 0; i < MAX_SINK_OBJECTS; i++)
 	{
-		m_pSinkObjects[i]->take(channel , msg);
+		if (m_pSinkObjects[i] != nullptr)
+			m_pSinkObjects[i]->take(record.channel, line);
 	}
 
-	va_end(args);
-	delete[] msg;
+	m_bytesSinceFlush += (length > 0) ? length : 0;
+	if (record.channel == LogChannel::error)
+		m_errorSinceFlush = true;
 }
 
-#include <iostream>
-gep::Logging::Logging()
+void gep::Logging::writeBinaryRecord(const LogRecord& record)
+{
+	using namespace BinaryLog;
+	uint8 channel = static_cast<uint8>(record.channel);
+
+	if (record.pFormat != nullptr)
+	{
+		// the text of a format string is written once, messages only refer to its address
+		uint64 formatId = reinterpret_cast<uintptr_t>(record.pFormat);
+		if (m_knownFormats.insert(record.pFormat).second)
+		{
+			RecordType type = RecordType::formatString;
+			size_t formatLength = strlen(record.pFormat);
+			uint16 length = static_cast<uint16>(formatLength < 0xFFFF ? formatLength : 0xFFFF);
+			fwrite(&type, sizeof(type), 1, m_pBinaryFile);
+			fwrite(&formatId, sizeof(formatId), 1, m_pBinaryFile);
+			fwrite(&length, sizeof(length), 1, m_pBinaryFile);
+			fwrite(record.pFormat, 1, length, m_pBinaryFile);
+			m_bytesSinceFlush += sizeof(type) + sizeof(formatId) + sizeof(length) + length;
+		}
+
+		RecordType type = RecordType::message;
+		uint16 argsSize = static_cast<uint16>(record.length);
+		fwrite(&type, sizeof(type), 1, m_pBinaryFile);
+		fwrite(&record.timestamp, sizeof(record.timestamp), 1, m_pBinaryFile);
+		fwrite(&channel, sizeof(channel), 1, m_pBinaryFile);
+		fwrite(&formatId, sizeof(formatId), 1, m_pBinaryFile);
+		fwrite(&argsSize, sizeof(argsSize), 1, m_pBinaryFile);
+		fwrite(record.text, 1, argsSize, m_pBinaryFile);
+		m_bytesSinceFlush += sizeof(type) + sizeof(record.timestamp) + sizeof(channel) + sizeof(formatId) + sizeof(argsSize) + argsSize;
+	}
+	else
+	{
+		RecordType type = RecordType::text;
+		uint16 length = static_cast<uint16>(record.length);
+		fwrite(&type, sizeof(type), 1, m_pBinaryFile);
+		fwrite(&record.timestamp, sizeof(record.timestamp), 1, m_pBinaryFile);
+		fwrite(&channel, sizeof(channel), 1, m_pBinaryFile);
+		fwrite(&length, sizeof(length), 1, m_pBinaryFile);
+		fwrite(record.text, 1, length, m_pBinaryFile);
+		m_bytesSinceFlush += sizeof(type) + sizeof(record.timestamp) + sizeof(channel) + sizeof(length) + length;
+	}
+
+	if (record.channel == LogChannel::error)
+		m_errorSinceFlush = true;
+}
+
+gep::Result gep::Logging::setBinaryLogFile(const char* pFilename)
+{
+	ScopedLock<Mutex> lock(m_sinkMutex);
+	// everything logged so far belongs to the old destination
+	drainRings();
+	flushSinks();
+
+	if (m_pBinaryFile != nullptr)
+	{
+		fclose(m_pBinaryFile);
+		m_pBinaryFile = nullptr;
+	}
+	m_knownFormats.clear();
+
+	if (pFilename != nullptr)
+	{
+		m_pBinaryFile = fopen(pFilename, "wb");
+		if (m_pBinaryFile != nullptr)
+		{
+			setvbuf(m_pBinaryFile, nullptr, _IOFBF, LOG_DEFAULT_FLUSH_SIZE);
+			uint32 header[2] = { BinaryLog::VERSION, 0 };
+			fwrite(BinaryLog::MAGIC, sizeof(BinaryLog::MAGIC), 1, m_pBinaryFile);
+			fwrite(header, sizeof(header), 1, m_pBinaryFile);
+		}
+	}
+
+	m_binaryMode.store(m_pBinaryFile != nullptr, std::memory_order_relaxed);
+	return (pFilename == nullptr || m_pBinaryFile != nullptr) ? SUCCESS : FAILURE;
+}
+
+void gep::Logging::flushSinks()
+{
+	for (int i = 0; i < MAX_SINK_OBJECTS; i++)
+	{
+		if (m_pSinkObjects[i] != nullptr)
+			m_pSinkObjects[i]->flush();
+	}
+	if (m_pBinaryFile != nullptr)
+		fflush(m_pBinaryFile);
+	m_bytesSinceFlush = 0;
+	m_errorSinceFlush = false;
+}
+
+gep::Logging::Logging() :
+	m_pFirstRing(nullptr),
+	m_instanceId(g_nextLoggingId.fetch_add(1)),
+	m_running(true),
+	m_wakeup(0),
+	m_wakeupPending(false),
+	m_flushIntervalMs(LOG_DEFAULT_FLUSH_INTERVAL_MS),
+	m_flushSize(LOG_DEFAULT_FLUSH_SIZE),
+	m_numDroppedMessages(0),
+	m_binaryMode(false),
+	m_bytesSinceFlush(0),
+	m_errorSinceFlush(false),
+	m_cachedSecond(-1),
+	m_pBinaryFile(nullptr)
 {
 	memset(m_pSinkObjects, 0, sizeof(m_pSinkObjects));
+	m_cachedTimePrefix[0] = '\0';
+	{
+		ScopedLock<Mutex> lock(g_aliveLoggingMutex);
+		g_aliveLoggingIds.push_back(m_instanceId);
+	}
+	m_writerThread = std::thread([this]() { writerLoop(); });
 }
 
 gep::Logging::~Logging()
 {
+	m_running.store(false, std::memory_order_release);
+	m_wakeup.increment();
+	m_writerThread.join();
+
+	// whatever was logged while the writer shut down
+	flush();
+	if (m_pBinaryFile != nullptr)
+		fclose(m_pBinaryFile);
+
 	for (int i = 0; i < MAX_SINK_OBJECTS; i++)
 	{
 		delete m_pSinkObjects[i];
 		m_pSinkObjects[i] = nullptr;
 	}
+
+	// threads which exit from now on leave the rings alone
+	{
+		ScopedLock<Mutex> lock(g_aliveLoggingMutex);
+		g_aliveLoggingIds.erase(std::find(g_aliveLoggingIds.begin(), g_aliveLoggingIds.end(), m_instanceId));
+	}
+	LogRingBuffer* pRing = m_pFirstRing.exchange(nullptr);
+	while (pRing != nullptr)
+	{
+		LogRingBuffer* pNext = pRing->pNext;
+		delete pRing;
+		pRing = pNext;
+	}
 }
 
 void gep::ConsoleLogSink::take(LogChannel channel, const char * msg)
 {
-	//https://en.cppreference.com/w/cpp/io/manip/put_time for the time format
-	std::time_t time = std::time(nullptr);
-	std::cout << std::put_time(std::localtime(&time), "%b %F %T") << ": " << ILogSink::logChannelChar(channel) << ": " << msg << "\n";
+	fputs(msg, stdout);
+	fputc('\n', stdout);
+}
+
+void gep::ConsoleLogSink::flush()
+{
+	fflush(stdout);
+}
+
+gep::FileLogSink::FileLogSink()
+{
+	// stays open for the whole lifetime of the sink, the buffer is written out in one go on flush
+	m_pFile = fopen(filename, "a");
+	if (m_pFile != nullptr)
+		setvbuf(m_pFile, m_buffer, _IOFBF, sizeof(m_buffer));
+}
+
+gep::FileLogSink::~FileLogSink()
+{
+	if (m_pFile != nullptr)
+		fclose(m_pFile);
 }
 
 void gep::FileLogSink::take(LogChannel channel, const char * msg)
 {
-	std::ofstream logStream;
-	logStream.open("SystemLogFile.log", logStream.app);
+	if (m_pFile == nullptr)
+		return;
+	fputs(msg, m_pFile);
+	fputc('\n', m_pFile);
+}
 
-	//https://en.cppreference.com/w/cpp/io/manip/put_time for the time format
-	std::time_t time = std::time(nullptr);
-	logStream <<std::put_time(std::localtime(&time), "%b %F %T") <<": "<< ILogSink::logChannelChar(channel) << ": " << msg << "\n";
-	logStream.flush();
-	logStream.close();
+void gep::FileLogSink::flush()
+{
+	if (m_pFile != nullptr)
+		fflush(m_pFile);
 }
@@ -1,7 +1,7 @@
 #include "stdafx.h"
 #include "gepimpl/subsystems/renderer/ddsLoader.h"
 #include "gep/utils.h"
-#include "gep/file.h"
+#include "gep/vfs.h"
 #include "gep/math3d/algorithm.h"
 
 namespace
@@ -35,8 +35,8 @@ void gep::DDSLoader::loadFile(const char* filename)
 {
     m_filename = filename;
 
-    RawFile file(filename, "rb");
-    if(!file.isOpen())
+    VfsFile file;
+    if(g_vfs.open(filename, file) != SUCCESS)
     {
         throw DDSLoadingException(format("The file '%s' does not exist", filename));
     }
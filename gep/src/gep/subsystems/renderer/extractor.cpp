@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "..\..\..\..\include\gepimpl\subsystems\renderer\extractor.h"
+#include "gep/profiler.h"
 
 namespace gep {
 
@@ -12,4 +13,14 @@ namespace gep {
 	{
 		return mat4();
 	}
+
+	void gep::RendererExtractor::beginDebugMarker(const char* name)
+	{
+		Profiler::beginZone(name);
+	}
+
+	void gep::RendererExtractor::endDebugMarker()
+	{
+		Profiler::endZone();
+	}
 }
@@ -7,6 +7,8 @@
 #include "gepimpl/subsystems/renderer/vertexbuffer.h"
 #include "gepimpl/subsystems/renderer/extractor.h"
 #include "gep/exception.h"
+#include "gep/profiler.h"
+#include "gep/vfs.h"
 
 void gep::ModelMaterial::setShader(ResourcePtr<Shader> pShader)
 {
@@ -85,6 +87,7 @@ void gep::Model::doFindMinMax(mat4 transformation, const ModelLoader::NodeDrawDa
 
 void gep::Model::drawHelper(ID3D11DeviceContext* pContext, mat4 transformation, ArrayPtr<mat4> bones, const ModelLoader::NodeDrawData* pNode, mat4& view, mat4& projection)
 {
+    GEP_PROFILE_SCOPE("Model::drawHelper");
     GEP_ASSERT(pNode != nullptr,"pNode may not be null");
     transformation = transformation * pNode->transform;
 
@@ -500,8 +503,28 @@ gep::ModelFileLoader::ModelFileLoader(const char* filename) :
     m_pRenderer = static_cast<Renderer*>(g_globalManager.getRenderer());
 }
 
+void gep::ModelFileLoader::prefetch(AsyncIo& io, std::function<void()> onDone)
+{
+    // other models are loaded from their cache, which is only written again if it is missing or outdated
+    std::vector<std::string> files(1, m_resourceId);
+    if(!ModelLoader::isThModel(m_resourceId.c_str()))
+        files.push_back(ModelLoader::getCachePath(m_resourceId.c_str()));
+    g_vfs.prefetch(io, files, IoPriority::Normal, [this, onDone](const std::vector<std::string>& prefetched)
+    {
+        m_prefetchedFiles = prefetched;
+        onDone();
+    });
+}
+
 gep::Model* gep::ModelFileLoader::loadResource(Model* pInPlace)
 {
+    // the prefetched files are only needed by this load, a reload reads them from the disk again
+    SCOPE_EXIT
+    {
+        for(auto& file : m_prefetchedFiles)
+            g_vfs.releasePrefetched(file);
+        m_prefetchedFiles.clear();
+    });
     Model* result = pInPlace;
     bool isInPlace = true;
     if(pInPlace == nullptr || pInPlace->isLoaded())
@@ -4,6 +4,7 @@
 #include "gep/interfaces/logging.h"
 #include "gepimpl/subsystems/renderer/renderer.h"
 #include "gepimpl/subsystems/renderer/ddsLoader.h"
+#include "gep/vfs.h"
 
 gep::ITexture2DLoader::ITexture2DLoader(const char* resourceId) : 
 	IResourceLoader(resourceId)
@@ -38,7 +39,8 @@ void gep::DummyTexture2DLoader::postLoad(ResourcePtr<IResource> pResource)
 
 gep::Texture2DFileLoader::Texture2DFileLoader(const char* filename) :
 	ITexture2DLoader(filename),
-    m_isRegistered(false)
+    m_isRegistered(false),
+    m_isPrefetched(false)
 {
     m_pRenderer = static_cast<Renderer*>(g_globalManager.getRenderer());
 }
@@ -51,8 +53,24 @@ gep::Texture2DFileLoader::~Texture2DFileLoader()
     }
 }
 
+void gep::Texture2DFileLoader::prefetch(AsyncIo& io, std::function<void()> onDone)
+{
+    g_vfs.prefetch(io, std::vector<std::string>(1, m_resourceId), IoPriority::Normal, [this, onDone](const std::vector<std::string>& prefetched)
+    {
+        m_isPrefetched = !prefetched.empty();
+        onDone();
+    });
+}
+
 gep::Texture2D* gep::Texture2DFileLoader::loadResource(Texture2D* pInPlace)
 {
+    // the prefetched file is only needed by this load, a reload reads it from the disk again
+    SCOPE_EXIT
+    {
+        if(m_isPrefetched)
+            g_vfs.releasePrefetched(m_resourceId);
+        m_isPrefetched = false;
+    });
     Texture2D* result = pInPlace;
     bool isInPlace = true;
     if(pInPlace == nullptr || pInPlace->isLoaded())
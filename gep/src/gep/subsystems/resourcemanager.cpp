@@ -1,26 +1,491 @@
 #include "stdafx.h"
 #include "..\..\..\include\gepimpl\subsystems\resourceManager.h"
+#include "gep/exception.h"
+#include "gep/utils.h"
+#include "gep/globalManager.h"
+#include "gep/interfaces/logging.h"
+#include "gep/file.h"
+#include "gep/vfs.h"
+#include "gep/statcache.h"
+#include <algorithm>
+#include <chrono>
+
+DefineWeakRefStaticMembers(gep::IResource)
+
+namespace
+{
+	/// \brief makes sure that all equivalent file paths look the same, without allocating
+	///
+	/// E.g. "./data/models/something.FBX" referes to the same file as "data\models\toilet\..\something.FBX".
+	/// Note: We preserve leading slashes because resources like FMOD sounds use them as ID.
+	/// \return the hash the resources and reload listeners are looked up by
+	inline gep::uint64 normalizeResourcePath(std::string& path)
+	{
+		return gep::normalizeAndHashPath(path, gep::NormalizationOptions::PreserveLeadingSlash);
+	}
+
+	/// \brief finds the entry of a normalized path by its hash, the paths only tell apart entries with the same hash
+	template <class Map>
+	typename Map::iterator findPath(Map& map, gep::uint64 hash, const std::string& path)
+	{
+		auto range = map.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (it->second.path == path)
+				return it;
+		}
+		return map.end();
+	}
+
+	inline gep::uint64 hashResourceId(const std::string& resourceId)
+	{
+		return gep::hashPath(resourceId.c_str(), resourceId.length());
+	}
+}
+
+gep::ResourceManager::ResourceManager()
+  : m_dataDirWatcher("data", DirectoryWatcher::WatchSubdirs::yes, DirectoryWatcher::Watch::writes | DirectoryWatcher::Watch::creates | DirectoryWatcher::Watch::renames),
+	m_timeSinceLastCheck(0.1f),
+	m_updateNum(0),
+	m_pAsyncIo(nullptr),
+	m_pJobQueue(nullptr),
+	m_numPendingLoads(0)
+{
+}
 
 void gep::ResourceManager::initialize()
 {
+	m_pAsyncIo = new AsyncIo(RESOURCE_IO_THREADS);
+	// leave one hardware thread for the main thread
+	uint32 numHardwareThreads = std::thread::hardware_concurrency();
+	m_pJobQueue = new JobQueue(numHardwareThreads > 1 ? numHardwareThreads - 1 : 1);
+
+	// shipped builds have their data in one archive, which replaces opening every file on its own
+	if (fileExists("data.pak") && g_vfs.mountArchive("data.pak") != SUCCESS)
+		g_globalManager.getLogging()->logError("The archive 'data.pak' is damaged, loading the loose files instead");
+
+	// changes in the data directory are reported by m_dataDirWatcher, the model cache is only written by the ModelLoader, which invalidates it
+	g_statCache.addDirectory("data");
+	g_statCache.addDirectory(".modelCache");
 }
 
 void gep::ResourceManager::destroy()
 {
+	// let the loads which are in flight finish, the loaders and handles are owned by them
+	// the reads complete first, they hand their loads on to the job threads
+	if (m_pAsyncIo != nullptr)
+		m_pAsyncIo->waitUntilIdle();
+	if (m_pJobQueue != nullptr)
+		m_pJobQueue->waitUntilIdle();
+	applyCompletedLoads();
+	GEP_ASSERT(m_numPendingLoads == 0, "asynchronous loads left after shutting down the job threads", m_numPendingLoads);
+	delete m_pAsyncIo;
+	delete m_pJobQueue;
+	m_pAsyncIo = nullptr;
+	m_pJobQueue = nullptr;
+
+	// deleteResource removes from m_loadedResources, so take a copy first
+	std::vector<IResource*> resources;
+	for (auto& entry : m_loadedResources)
+	{
+		IResource* pResource = entry.second.pResource.get();
+		if (pResource == nullptr)
+			continue;
+		auto dummy = m_resourceDummies.find(pResource->getLoader()->getResourceType());
+		if (dummy != m_resourceDummies.end() && dummy->second == pResource)
+		{
+			// failed loads never got their handle replaced, give its slot back
+			releaseDummyReference(entry.second.pResource);
+			continue;
+		}
+		resources.push_back(pResource);
+	}
+	for (IResource* pResource : resources)
+	{
+		deleteResource(pResource);
+	}
+	for (auto& entry : m_failedInitialLoad)
+	{
+		entry.first->release();
+	}
+	for (auto& entry : m_resourceDummies)
+	{
+		IResource* pDummy = entry.second;
+		if (pDummy != nullptr)
+		{
+			IResourceLoader* pLoader = pDummy->getLoader();
+			pDummy->unload();
+			pLoader->deleteResource(pDummy);
+			pLoader->release();
+		}
+	}
+	m_failedInitialLoad.clear();
+	m_resourceDummies.clear();
+	m_fileChangedListener.clear();
+	m_loadedResources.clear();
+}
+
+void gep::ResourceManager::update(float elapsedTime)
+{
+	applyCompletedLoads();
+
+	m_timeSinceLastCheck -= elapsedTime;
+	if (m_timeSinceLastCheck <= 0.0f)
+	{
+		checkForChangedFiles();
+		m_timeSinceLastCheck = 0.1f;
+	}
+}
+
+void gep::ResourceManager::checkForChangedFiles()
+{
+	m_updateNum++;
+	ScopedLock<Mutex> lock(m_fileChangedLock);
+	m_dataDirWatcher.enumerateChanges([=](const char* filename, DirectoryWatcher::Action::Enum action)
+	{
+		std::string path = "data/" + std::string(filename);
+		uint64 hash = normalizeResourcePath(path);
+		g_statCache.invalidate(path.c_str());
+		if (action != DirectoryWatcher::Action::modified)
+			return;
+		auto listener = findPath(m_fileChangedListener, hash, path);
+		if (listener == m_fileChangedListener.end())
+			return;
+		ReloadInfo& info = listener->second;
+
+		// Some modified events come in twice. Make sure to not handle them twice
+		if (info.updateNum == m_updateNum)
+			return;
+		g_globalManager.getLogging()->logMessage("Reloading '%s' resource from file '%s'.", info.pLoader->getResourceType(), filename);
+		info.updateNum = m_updateNum;
+		// the watcher only reports files which are done being written
+		reloadWithLoader(info.pResource, info.pLoader);
+	});
+}
+
+gep::Result gep::ResourceManager::reloadWithLoader(ResourcePtr<IResource>& pResource, IResourceLoader* pLoader)
+{
+	try {
+		auto dummy = m_resourceDummies.find(pLoader->getResourceType());
+		GEP_ASSERT(dummy != m_resourceDummies.end(), "resource type not registered yet");
+		IResource* pDummyResource = dummy->second;
+		IResource* pResourceToReload = pResource.get();
+		IResource* pNewResource = pLoader->loadResource((pDummyResource == pResourceToReload) ? nullptr : pResourceToReload);
+		if (pNewResource != nullptr)
+		{
+			m_failedInitialLoad.erase(pLoader);
+			if (pResourceToReload != nullptr && pResourceToReload != pDummyResource)
+			{
+				// swap if it did not reload inplace
+				if (pResourceToReload != pNewResource)
+				{
+					pNewResource->swapPlaces(*pResourceToReload);
+					removeFromNewList(pResourceToReload);
+					pLoader->deleteResource(pResourceToReload);
+				}
+			}
+			else
+			{
+				//replace the dummy resource
+				invalidateAndReplace(pResource, pNewResource);
+			}
+
+			if (pNewResource->getFinalizeOptions() > 0)
+			{
+				m_newResources.append(pNewResource);
+			}
+			pNewResource->setLoader(pLoader);
+			return SUCCESS;
+		}
+		g_globalManager.getLogging()->logError("Failed to reload '%s' resource '%s'. Loader returned null.", pLoader->getResourceType(), pLoader->getResourceId());
+	}
+	catch (LoadingError& ex)
+	{
+		g_globalManager.getLogging()->logError("Failed to reload '%s' resource '%s' error:\n%s", pLoader->getResourceType(), pLoader->getResourceId(), ex.what());
+	}
+	return FAILURE;
+}
+
+gep::ResourcePtr<gep::IResource> gep::ResourceManager::doLoadResource(IResourceLoader& loader)
+{
+	uint64 hash = normalizeResourcePath(loader.m_resourceId);
+	auto alreadyLoaded = findPath(m_loadedResources, hash, loader.m_resourceId);
+	if (alreadyLoaded != m_loadedResources.end())
+	{
+		g_globalManager.getLogging()->logMessage("Reusing already loaded resource '%s'", loader.m_resourceId.c_str());
+		return alreadyLoaded->second.pResource;
+	}
+	IResourceLoader* pLoader = loader.moveToHeap();
+	GEP_ASSERT(pLoader != nullptr);
+	try {
+		IResource* pResult = pLoader->loadResource(nullptr);
+		if (pResult != nullptr)
+		{
+			if (pResult->getFinalizeOptions() > 0)
+			{
+				m_newResources.append(pResult);
+			}
+			pResult->setLoader(pLoader);
+
+			auto result = makeResourcePtr(pResult, false);
+			pLoader->postLoad(result);
+			addLoadedResource(hash, pLoader->getResourceId(), result);
+			return result;
+		}
+	}
+	catch (LoadingError& ex)
+	{
+		g_globalManager.getLogging()->logError("%s", ex.what());
+	}
+	m_failedInitialLoad[pLoader] = true;
+	auto dummy = m_resourceDummies.find(pLoader->getResourceType());
+	GEP_ASSERT(dummy != m_resourceDummies.end() && dummy->second != nullptr, "Unkown resource type", pLoader->getResourceType());
+	auto result = makeResourcePtr(dummy->second, true);
+	addLoadedResource(hash, pLoader->getResourceId(), result);
+	pLoader->postLoad(result);
+	return result;
+}
+
+gep::ResourcePtr<gep::IResource> gep::ResourceManager::doLoadResourceAsync(IResourceLoader& loader, ResourceLoadBatch* pBatch)
+{
+	GEP_ASSERT(m_pJobQueue != nullptr, "the resource manager has not been initialized");
+	uint64 hash = normalizeResourcePath(loader.m_resourceId);
+	// this also finds loads which are still in flight, their handle gets swapped in once they are done
+	auto alreadyLoaded = findPath(m_loadedResources, hash, loader.m_resourceId);
+	if (alreadyLoaded != m_loadedResources.end())
+		return alreadyLoaded->second.pResource;
+
+	IResourceLoader* pLoader = loader.moveToHeap();
+	GEP_ASSERT(pLoader != nullptr);
+	auto dummy = m_resourceDummies.find(pLoader->getResourceType());
+	GEP_ASSERT(dummy != m_resourceDummies.end() && dummy->second != nullptr, "Unkown resource type", pLoader->getResourceType());
+
+	PendingLoad* pLoad = new PendingLoad;
+	pLoad->pLoader = pLoader;
+	pLoad->pResource = makeResourcePtr(dummy->second, true);
+	pLoad->pBatch = pBatch;
+	pLoad->pResult = nullptr;
+	addLoadedResource(hash, pLoader->getResourceId(), pLoad->pResource);
+	m_numPendingLoads++;
+	if (pBatch != nullptr)
+		pBatch->m_numQueued++;
+
+	// the loader reads its files through the io service, the expensive part runs on a job thread once they are in memory
+	JobQueue* pJobQueue = m_pJobQueue;
+	pLoader->prefetch(*m_pAsyncIo, [this, pLoad, pJobQueue]()
+	{
+		pJobQueue->submit([this, pLoad]() { executeLoad(pLoad); });
+	});
+
+	return pLoad->pResource;
+}
+
+void gep::ResourceManager::executeLoad(PendingLoad* pLoad)
+{
+	try {
+		pLoad->pResult = pLoad->pLoader->loadResource(nullptr);
+		if (pLoad->pResult == nullptr)
+			pLoad->error = format("Loading '%s' returned null", pLoad->pLoader->getResourceId());
+	}
+	catch (LoadingError& ex)
+	{
+		pLoad->error = ex.what();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_completedLoadsMutex);
+		m_completedLoads.push_back(pLoad);
+	}
+	m_loadCompleted.notify_all();
 }
 
-void gep::ResourceManager::deleteResource(IResource * pResource)
+void gep::ResourceManager::applyCompletedLoads()
 {
+	std::vector<PendingLoad*> completed;
+	{
+		std::lock_guard<std::mutex> lock(m_completedLoadsMutex);
+		completed.swap(m_completedLoads);
+	}
+	for (PendingLoad* pLoad : completed)
+	{
+		applyCompletedLoad(pLoad);
+	}
 }
 
-void gep::ResourceManager::registerResourceType(IResource * pDummy)
+void gep::ResourceManager::applyCompletedLoad(PendingLoad* pLoad)
 {
+	SCOPE_EXIT{ delete pLoad; });
+	m_numPendingLoads--;
+	IResourceLoader* pLoader = pLoad->pLoader;
+	IResource* pResult = pLoad->pResult;
+
+	if (pResult != nullptr)
+	{
+		// every handle given out so far now points at the real resource
+		invalidateAndReplace(pLoad->pResource, pResult);
+		if (pResult->getFinalizeOptions() > 0)
+		{
+			m_newResources.append(pResult);
+		}
+		pResult->setLoader(pLoader);
+	}
+	else
+	{
+		g_globalManager.getLogging()->logError("%s", pLoad->error.c_str());
+		m_failedInitialLoad[pLoader] = true;
+		if (pLoad->pBatch != nullptr)
+			pLoad->pBatch->m_numFailed++;
+	}
+	pLoader->postLoad(pLoad->pResource);
+
+	if (pLoad->pBatch != nullptr)
+		pLoad->pBatch->m_numFinished++;
 }
 
-void gep::ResourceManager::registerResourceType(const char * resourceType)
+gep::Result gep::ResourceManager::waitForBatch(ResourceLoadBatch& batch, uint32 timeoutMs)
 {
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	for (;;)
+	{
+		applyCompletedLoads();
+		if (batch.isDone())
+			return SUCCESS;
+
+		std::unique_lock<std::mutex> lock(m_completedLoadsMutex);
+		auto hasCompletedLoads = [this]() { return !m_completedLoads.empty(); };
+		if (timeoutMs == 0xFFFFFFFF)
+		{
+			m_loadCompleted.wait(lock, hasCompletedLoads);
+		}
+		else if (!m_loadCompleted.wait_until(lock, deadline, hasCompletedLoads))
+		{
+			return FAILURE;
+		}
+	}
+}
+
+void gep::ResourceManager::removeFromNewList(IResource* pResource)
+{
+	for (size_t i = 0; i < m_newResources.length(); i++)
+	{
+		if (m_newResources[i] == pResource)
+		{
+			m_newResources.removeAtIndexUnordered(i);
+			break;
+		}
+	}
+}
+
+void gep::ResourceManager::reloadResource(ResourcePtr<IResource> pResource)
+{
+	IResource* pCurrent = pResource.get();
+	GEP_ASSERT(pCurrent != nullptr, "reloading an invalid resource pointer");
+	IResourceLoader* pLoader = pCurrent->getLoader();
+	auto dummy = m_resourceDummies.find(pLoader->getResourceType());
+	if (dummy != m_resourceDummies.end() && dummy->second == pCurrent)
+	{
+		// the pointer is still on the dummy because its load failed, its own loader is only known by its id
+		pLoader = nullptr;
+		for (auto& failed : m_failedInitialLoad)
+		{
+			const std::string& resourceId = failed.first->m_resourceId;
+			auto loaded = findPath(m_loadedResources, hashResourceId(resourceId), resourceId);
+			if (loaded != m_loadedResources.end() && loaded->second.pResource.getWeakRefIndex() == pResource.getWeakRefIndex())
+			{
+				pLoader = failed.first;
+				break;
+			}
+		}
+		// e.g. an asynchronous load which is still in flight
+		if (pLoader == nullptr)
+			return;
+	}
+	reloadWithLoader(pResource, pLoader);
+}
+
+void gep::ResourceManager::addLoadedResource(uint64 hash, const std::string& resourceId, ResourcePtr<IResource> pResource)
+{
+	LoadedResource loaded;
+	loaded.path = resourceId;
+	loaded.pResource = pResource;
+	m_loadedResources.insert(std::make_pair(hash, loaded));
+}
+
+void gep::ResourceManager::deleteResource(IResource* pResource)
+{
+	if (pResource == nullptr)
+		return;
+	auto pLoader = pResource->getLoader();
+	auto loaded = findPath(m_loadedResources, hashResourceId(pLoader->m_resourceId), pLoader->m_resourceId);
+	if (loaded != m_loadedResources.end())
+		m_loadedResources.erase(loaded);
+	auto dummy = m_resourceDummies.find(pLoader->getResourceType());
+	GEP_ASSERT(dummy != m_resourceDummies.end(), "resource type not registered yet");
+	if (pResource != dummy->second)
+	{
+		removeFromNewList(pResource);
+		pResource->unload();
+		pLoader->deleteResource(pResource);
+		pLoader->release();
+	}
+}
+
+void gep::ResourceManager::registerResourceType(IResource* pDummy)
+{
+	std::string name = pDummy->getLoader()->getResourceType();
+	GEP_ASSERT(m_resourceDummies.find(name) == m_resourceDummies.end(), "resource type already exists");
+	m_resourceDummies[name] = pDummy;
+}
+
+void gep::ResourceManager::registerResourceType(const char* resourceType)
+{
+	std::string name = resourceType;
+	GEP_ASSERT(m_resourceDummies.find(name) == m_resourceDummies.end(), "resource type already exists");
+	m_resourceDummies[name] = nullptr;
 }
 
 void gep::ResourceManager::finalizeResourcesWithFlags(uint32 flags)
 {
+	for (size_t i = 0; i < m_newResources.length(); )
+	{
+		IResource* pResource = m_newResources[i];
+		uint32 resourceFlags = pResource->getFinalizeOptions();
+		if ((resourceFlags & ResourceFinalize::NotYet) == 0 && (resourceFlags & flags) > 0)
+		{
+			pResource->finalize();
+			m_newResources.removeAtIndexUnordered(i); // this removes a element => we don't need to increment the index
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+void gep::ResourceManager::registerLoaderForReload(const std::string& filename, IResourceLoader* pLoader, ResourcePtr<IResource> pResource)
+{
+	std::string fixedpath(filename);
+	uint64 hash = normalizeResourcePath(fixedpath);
+	ScopedLock<Mutex> lock(m_fileChangedLock);
+	auto listener = findPath(m_fileChangedListener, hash, fixedpath);
+	if (listener == m_fileChangedListener.end())
+	{
+		ReloadInfo newInfo;
+		newInfo.path = fixedpath;
+		listener = m_fileChangedListener.insert(std::make_pair(hash, newInfo));
+	}
+	ReloadInfo& info = listener->second;
+	info.pLoader = pLoader;
+	info.pResource = pResource;
+	info.updateNum = m_updateNum;
+}
+
+void gep::ResourceManager::deregisterLoaderForReload(const std::string& filename, IResourceLoader* pLoader)
+{
+	std::string fixedpath(filename);
+	uint64 hash = normalizeResourcePath(fixedpath);
+	ScopedLock<Mutex> lock(m_fileChangedLock);
+	auto listener = findPath(m_fileChangedListener, hash, fixedpath);
+	if (listener != m_fileChangedListener.end() && listener->second.pLoader == pLoader)
+		m_fileChangedListener.erase(listener);
 }
@@ -1,33 +1,194 @@
 #include "stdafx.h"
-#include "..\..\..\include\gepimpl\subsystems\updateFramework.h"
+#include "gepimpl/subsystems/updateFramework.h"
+#include "gep/interfaces/resourcemanager.h"
+#include "gep/interfaces/renderer.h"
+#include "gep/globalManager.h"
+#include "gep/profiler.h"
+#include "gep/memory/allocator.h"
+#include "gep/memory/allocationtrace.h"
+#include "gep/interfaces/logging.h"
 
 namespace gep
 {
+	UpdateFramework::UpdateFramework() :
+		m_elapsedTime(1.0f / 60.0f),
+		m_running(false),
+		m_useFixedTimestep(false),
+		m_nextCallbackId(0),
+		m_pAllocationTrace(nullptr),
+		m_numTraceFramesLeft(0),
+		m_isTracingAllocations(false)
+	{
+	}
+
+	UpdateFramework::~UpdateFramework()
+	{
+		advanceAllocationTrace(true);
+	}
 
 	void gep::UpdateFramework::stop()
 	{
+		m_running = false;
 	}
 
 	void gep::UpdateFramework::run()
 	{
+		Profiler::setThreadName("main");
+		m_running = true;
+		m_fixedTimestep.reset();
+		PointInTime lastFrameStart(m_gameTimer);
+		advanceAllocationTrace(false);
+		while (m_running)
+		{
+			float phaseTimes[FramePhase::Count];
+			{
+				GEP_PROFILE_SCOPE("update callbacks");
+				if (m_useFixedTimestep)
+				{
+					uint32 numSteps = m_fixedTimestep.advance(m_elapsedTime);
+					for (uint32 step = 0; step < numSteps && m_running; step++)
+					{
+						runCallbacks(m_fixedTimestep.getStepTime());
+					}
+				}
+				else
+				{
+					runCallbacks(m_elapsedTime);
+				}
+			}
+			PointInTime callbacksDone(m_gameTimer);
+			phaseTimes[FramePhase::UpdateCallbacks] = callbacksDone - lastFrameStart;
+			{
+				GEP_PROFILE_SCOPE("resource manager");
+				g_globalManager.getResourceManager()->update(m_elapsedTime);
+			}
+			PointInTime resourcesDone(m_gameTimer);
+			phaseTimes[FramePhase::ResourceUpdate] = resourcesDone - callbacksDone;
+			{
+				GEP_PROFILE_SCOPE("renderer");
+				g_globalManager.getRendererExtractor()->setInterpolationAlpha(getInterpolationAlpha());
+				g_globalManager.getRenderer()->update(m_elapsedTime);
+			}
+			PointInTime renderDone(m_gameTimer);
+			phaseTimes[FramePhase::Render] = renderDone - resourcesDone;
+
+			{
+				GEP_PROFILE_SCOPE("frame limiter");
+				m_frameLimiter.waitForNextFrame();
+			}
+
+			GEP_PROFILE_FRAME();
+			PointInTime frameStart(m_gameTimer);
+			m_elapsedTime = frameStart - lastFrameStart;
+			m_frameTimeStats.addFrame(m_elapsedTime, phaseTimes);
+			lastFrameStart = frameStart;
+			advanceAllocationTrace(!m_running);
+		}
+	}
+
+	void gep::UpdateFramework::recordAllocationTrace(const char* filename, uint32 numFrames)
+	{
+		GEP_ASSERT(filename != nullptr && numFrames > 0);
+		GEP_ASSERT(m_pAllocationTrace == nullptr, "already recording an allocation trace", m_allocationTraceFile.c_str());
+		m_pAllocationTrace = new AllocationTrace();
+		m_allocationTraceFile = filename;
+		m_numTraceFramesLeft = numFrames;
+	}
+
+	void gep::UpdateFramework::advanceAllocationTrace(bool isStopping)
+	{
+		if (m_pAllocationTrace == nullptr)
+			return;
+		// the recording starts with the first whole frame after it was requested
+		if (!m_isTracingAllocations && !isStopping)
+		{
+			g_stdAllocator.setTrace(m_pAllocationTrace);
+			m_isTracingAllocations = true;
+			return;
+		}
+		if (!isStopping && --m_numTraceFramesLeft > 0)
+			return;
+
+		g_stdAllocator.setTrace(nullptr);
+		if (m_pAllocationTrace->saveToFile(m_allocationTraceFile.c_str()) == SUCCESS)
+			g_globalManager.getLogging()->logMessage("Recorded %u allocation events into '%s'", static_cast<uint32>(m_pAllocationTrace->getEvents().size()), m_allocationTraceFile.c_str());
+		else
+			g_globalManager.getLogging()->logError("Could not write the allocation trace '%s'", m_allocationTraceFile.c_str());
+		delete m_pAllocationTrace;
+		m_pAllocationTrace = nullptr;
+		m_isTracingAllocations = false;
+	}
+
+	void gep::UpdateFramework::runCallbacks(float elapsedTime)
+	{
+		// a callback might deregister itself, so iterate over a copy
+		auto callbacks = m_callbacks;
+		for (auto& callback : callbacks)
+		{
+			callback.function(elapsedTime);
+		}
+	}
+
+	void gep::UpdateFramework::setFixedTimestep(float tickRate, uint32 maxStepsPerFrame)
+	{
+		m_useFixedTimestep = (tickRate > 0.0f);
+		if (m_useFixedTimestep)
+		{
+			m_fixedTimestep.setTickRate(tickRate);
+			m_fixedTimestep.setMaxStepsPerFrame(maxStepsPerFrame);
+		}
+	}
+
+	float gep::UpdateFramework::getInterpolationAlpha() const
+	{
+		return m_useFixedTimestep ? m_fixedTimestep.getInterpolationAlpha() : 1.0f;
+	}
+
+	void gep::UpdateFramework::setTargetFrameTime(float seconds)
+	{
+		m_frameLimiter.setTargetFrameTime(seconds);
 	}
 
 	float gep::UpdateFramework::getElapsedTime() const
 	{
-		return 0.0f;
+		return m_elapsedTime;
 	}
 
 	float gep::UpdateFramework::calcElapsedTimeAverage(size_t numFrames) const
 	{
-		return 0.0f;
+		if (m_frameTimeStats.getNumFrames() == 0)
+			return m_elapsedTime;
+		return m_frameTimeStats.calcAverage(numFrames);
+	}
+
+	const FrameTimeStats& gep::UpdateFramework::getFrameTimeStats() const
+	{
+		return m_frameTimeStats;
+	}
+
+	void gep::UpdateFramework::setFrameTimeHistoryLength(size_t numFrames)
+	{
+		m_frameTimeStats.setHistoryLength(numFrames);
 	}
 
 	CallbackId gep::UpdateFramework::registerUpdateCallback(std::function<void(float elapsedTime)> callback)
 	{
-		return CallbackId(0);
+		Callback entry;
+		entry.id = m_nextCallbackId++;
+		entry.function = callback;
+		m_callbacks.push_back(entry);
+		return CallbackId(entry.id);
 	}
 
 	void gep::UpdateFramework::deregisterUpdateCallback(CallbackId id)
 	{
+		for (auto it = m_callbacks.begin(); it != m_callbacks.end(); ++it)
+		{
+			if (it->id == id.id)
+			{
+				m_callbacks.erase(it);
+				return;
+			}
+		}
 	}
 }
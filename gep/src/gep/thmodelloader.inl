@@ -1,20 +1,54 @@
 #include "gep/file.h"
 #include "gep/chunkfile.h"
+#include "gep/profiler.h"
 #include <sstream>
 
 namespace
 {
-    float readCompressedFloat(gep::Chunkfile& file)
+    /// \brief reads vectors which were written with one int16 per component
+    ///
+    /// The data is only needed until it is converted, so it is read as a view into the mapping instead of being copied.
+    void readCompressedVectors(gep::Chunkfile& file, gep::ArrayPtr<gep::vec3> vectors, const char* pFilename)
     {
-        gep::int16 data = 0;
-        file.read(data);
-        return (float)data / (float)std::numeric_limits<gep::int16>::max();
+        auto data = file.readArrayView<gep::uint8>(vectors.length() * 3 * sizeof(gep::int16));
+        if (data.length() != vectors.length() * 3 * sizeof(gep::int16))
+        {
+            std::ostringstream msg;
+            msg << "File '" << pFilename << "' is corrupted";
+            throw gep::LoadingError(msg.str());
+        }
+        const gep::uint8* pData = data.getPtr();
+        for (auto& vector : vectors)
+        {
+            // the data in the mapping is not aligned
+            gep::int16 components[3];
+            memcpy(components, pData, sizeof(components));
+            pData += sizeof(components);
+            vector.x = (float)components[0] / (float)std::numeric_limits<gep::int16>::max();
+            vector.y = (float)components[1] / (float)std::numeric_limits<gep::int16>::max();
+            vector.z = (float)components[2] / (float)std::numeric_limits<gep::int16>::max();
+        }
+    }
+
+    /// \brief starts the next chunk, a chunk which can not be read or does not match its checksum means the file is corrupted
+    void startReadChunk(gep::Chunkfile& file, const char* pFilename)
+    {
+        if (file.startReadChunk() != gep::SUCCESS)
+        {
+            std::ostringstream msg;
+            msg << "File '" << pFilename << "' is corrupted";
+            throw gep::LoadingError(msg.str());
+        }
     }
 }
 
-inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat)
+inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat, bool verifyChecksums)
 {
-    Chunkfile file(pFilename, Chunkfile::Operation::read);
+    GEP_PROFILE_SCOPE("ModelLoader::loadThModel");
+    // the data is copied out of the mapping into the model data, which outlives the file
+    Chunkfile file(pFilename, Chunkfile::Operation::mapped);
+    // each chunk is checked when it is started, so the file is only gone through once
+    file.setVerifyChecksums(verifyChecksums);
 
     if (file.startReading("thModel") != SUCCESS)
     {
@@ -47,7 +81,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
     uint32 numNodes = 0;
     //Read the size info
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (file.getCurrentChunkName() != "sizeinfo")
         {
             std::ostringstream msg;
@@ -222,7 +256,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
 
     // Load textures
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (file.getCurrentChunkName() != "textures")
         {
             std::ostringstream msg;
@@ -263,7 +297,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
 
     // Read Materials
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (file.getCurrentChunkName() != "materials")
         {
             std::ostringstream msg;
@@ -291,7 +325,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
 
                 for (auto& material : m_modelData.materials)
                 {
-                    file.startReadChunk();
+                    startReadChunk(file, pFilename);
                     if (file.getCurrentChunkName() != "mat")
                     {
                         std::ostringstream msg;
@@ -341,7 +375,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
     // Read Bones
     if (file.getFileVersion() >= ModelFormatVersion::Version3)
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (file.getCurrentChunkName() != "bones")
         {
             std::ostringstream msg;
@@ -381,7 +415,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
 
     // Read Meshes
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (file.getCurrentChunkName() != "meshes")
         {
             std::ostringstream msg;
@@ -399,7 +433,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
             for (auto& mesh : m_modelData.meshes)
             {
                 mesh.PerVertexFlags = vertexFlags[ meshIdx ];
-                file.startReadChunk();
+                startReadChunk(file, pFilename);
                 if (file.getCurrentChunkName() != "mesh")
                 {
                     std::ostringstream msg;
@@ -418,7 +452,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                 uint32 numVertices = 0;
                 file.read(numVertices);
 
-                file.startReadChunk();
+                startReadChunk(file, pFilename);
                 if (file.getCurrentChunkName() != "vertices")
                 {
                     std::ostringstream msg;
@@ -433,26 +467,21 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                 file.endReadChunk();
 
                 {
-                    file.startReadChunk();
+                    startReadChunk(file, pFilename);
                     if (file.getCurrentChunkName() == "normals")
                     {
                         if (loadWhat & Load::Normals)
                         {
                             memstat.vertexData += allocationSize<vec3>(numVertices);
                             mesh.normals = GEP_NEW_ARRAY(m_pModelDataAllocator, vec3, numVertices);
-                            for (auto& normal : mesh.normals)
-                            {
-                                normal.x = readCompressedFloat(file);
-                                normal.y = readCompressedFloat(file);
-                                normal.z = readCompressedFloat(file);
-                            }
+                            readCompressedVectors(file, mesh.normals, pFilename);
                             file.endReadChunk();
                         }
                         else
                         {
                             file.skipCurrentChunk();
                         }
-                        file.startReadChunk();
+                        startReadChunk(file, pFilename);
                     }
                     if (file.getCurrentChunkName() == "tangents")
                     {
@@ -460,19 +489,14 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                         {
                             memstat.vertexData += allocationSize<vec3>(numVertices);
                             mesh.tangents = GEP_NEW_ARRAY(m_pModelDataAllocator, vec3, numVertices);
-                            for (auto& tangent : mesh.tangents)
-                            {
-                                tangent.x = readCompressedFloat(file);
-                                tangent.y = readCompressedFloat(file);
-                                tangent.z = readCompressedFloat(file);
-                            }
+                            readCompressedVectors(file, mesh.tangents, pFilename);
                             file.endReadChunk();
                         }
                         else
                         {
                             file.skipCurrentChunk();
                         }
-                        file.startReadChunk();
+                        startReadChunk(file, pFilename);
                     }
                     if (file.getCurrentChunkName() == "bitangents")
                     {
@@ -480,19 +504,14 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                         {
                             memstat.vertexData += allocationSize<vec3>(numVertices);
                             mesh.bitangents = GEP_NEW_ARRAY(m_pModelDataAllocator, vec3, numVertices);
-                            for (auto& bitangent : mesh.bitangents)
-                            {
-                                bitangent.x = readCompressedFloat(file);
-                                bitangent.y = readCompressedFloat(file);
-                                bitangent.z = readCompressedFloat(file);
-                            }
+                            readCompressedVectors(file, mesh.bitangents, pFilename);
                             file.endReadChunk();
                         }
                         else
                         {
                             file.skipCurrentChunk();
                         }
-                        file.startReadChunk();
+                        startReadChunk(file, pFilename);
                     }
                     if (file.getCurrentChunkName() == "texcoords")
                     {
@@ -529,7 +548,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                         {
                             file.skipCurrentChunk();
                         }
-                        file.startReadChunk();
+                        startReadChunk(file, pFilename);
                     }
                     if (file.getFileVersion() >= ModelFormatVersion::Version3 && file.getCurrentChunkName() == "bones")
                     {
@@ -576,7 +595,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
                         {
                             file.skipCurrentChunk();
                         }
-                        file.startReadChunk();
+                        startReadChunk(file, pFilename);
                     }
                     if (file.getCurrentChunkName() == "faces")
                     {
@@ -628,7 +647,7 @@ inline void gep::ModelLoader::loadThModel(const char* pFilename, uint32 loadWhat
 
     // Read Nodes
     {
-        file.startReadChunk();
+        startReadChunk(file, pFilename);
         if (loadWhat & Load::Nodes)
         {
             {
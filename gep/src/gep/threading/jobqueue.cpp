@@ -0,0 +1,68 @@
+#include "stdafx.h"
+#include "gep/threading/jobqueue.h"
+
+gep::JobQueue::JobQueue(uint32 numThreads) :
+    m_numRunningJobs(0),
+    m_stopping(false)
+{
+    if (numThreads == 0)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    m_threads.reserve(numThreads);
+    for (uint32 i = 0; i < numThreads; i++)
+    {
+        m_threads.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+gep::JobQueue::~JobQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobAvailable.notify_all();
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void gep::JobQueue::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        GEP_ASSERT(!m_stopping, "submitting a job to a queue which is shutting down");
+        m_jobs.push_back(std::move(job));
+    }
+    m_jobAvailable.notify_one();
+}
+
+void gep::JobQueue::waitUntilIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return m_jobs.empty() && m_numRunningJobs == 0; });
+}
+
+void gep::JobQueue::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+        // queued jobs are still executed when stopping, whoever submitted them might wait for them
+        if (m_jobs.empty())
+            return;
+
+        std::function<void()> job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        m_numRunningJobs++;
+        lock.unlock();
+
+        job();
+
+        lock.lock();
+        m_numRunningJobs--;
+        if (m_jobs.empty() && m_numRunningJobs == 0)
+            m_idle.notify_all();
+    }
+}
@@ -1,73 +1,199 @@
 #include "stdafx.h"
 #include "gep/timer.h"
 #include "gep/exception.h"
+
+#ifdef _WIN32
 #include <Windows.h>
+#include <intrin.h>
+#else
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
 
-gep::Timer::Timer()
-{
-	QueryPerformanceFrequency(&frequency);
-	QueryPerformanceCounter;
-}
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define GEP_TIMER_HAS_TSC
+#endif
 
-float gep::Timer::getTimeAsFloat() const
+namespace
 {
-    return 0.0f;
-}
+    /// \brief the clock all timers count in, chosen and calibrated once
+    struct TickSource
+    {
+        bool useTsc;
+        gep::uint64 ticksPerSecond;
+        double secondsPerTick;
 
-double gep::Timer::getTimeAsDouble() const
-{
-    return 0.0;
+        TickSource();
+    };
+
+    /// \brief the operating system's monotonic clock in its native unit
+    gep::uint64 readReferenceClock()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER count;
+        QueryPerformanceCounter(&count);
+        return count.QuadPart;
+#else
+        timespec now;
+        // the raw clock is not slewed by ntp, if it is missing the slewed one is still monotonic
+        if (clock_gettime(CLOCK_MONOTONIC_RAW, &now) != 0)
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<gep::uint64>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+#endif
+    }
+
+    gep::uint64 getReferenceFrequency()
+    {
+#ifdef _WIN32
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return frequency.QuadPart;
+#else
+        return 1000000000ull;
+#endif
+    }
+
+#ifdef GEP_TIMER_HAS_TSC
+    inline gep::uint64 readTsc()
+    {
+        return __rdtsc();
+    }
+
+    /// \brief only a tsc which runs at a constant rate in all power states and on all cores can be used as a clock
+    bool hasInvariantTsc()
+    {
+#ifdef _WIN32
+        int regs[4];
+        __cpuid(regs, 0x80000000);
+        if (static_cast<unsigned>(regs[0]) < 0x80000007)
+            return false;
+        __cpuid(regs, 0x80000007);
+        return (regs[3] & (1 << 8)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+            return false;
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        return (edx & (1 << 8)) != 0;
+#endif
+    }
+#endif
+
+    TickSource::TickSource() :
+        useTsc(false),
+        ticksPerSecond(getReferenceFrequency())
+    {
+#ifdef GEP_TIMER_HAS_TSC
+        if (hasInvariantTsc())
+        {
+            // measure the tsc frequency against the reference clock for a couple of milliseconds
+            const gep::uint64 referenceFrequency = getReferenceFrequency();
+            const gep::uint64 calibrationTicks = referenceFrequency / 200;
+            gep::uint64 referenceStart = readReferenceClock();
+            gep::uint64 tscStart = readTsc();
+            gep::uint64 referenceEnd, tscEnd;
+            do
+            {
+                referenceEnd = readReferenceClock();
+                tscEnd = readTsc();
+            }
+            while (referenceEnd - referenceStart < calibrationTicks);
+
+            double tscFrequency = static_cast<double>(tscEnd - tscStart) * referenceFrequency / (referenceEnd - referenceStart);
+            // a hypervisor might advertise an invariant tsc it does not deliver
+            if (tscFrequency > 1.0e8)
+            {
+                useTsc = true;
+                ticksPerSecond = static_cast<gep::uint64>(tscFrequency + 0.5);
+            }
+        }
+#endif
+        secondsPerTick = 1.0 / static_cast<double>(ticksPerSecond);
+    }
+
+    const TickSource& getTickSource()
+    {
+        static TickSource source;
+        return source;
+    }
 }
 
-gep::uint64 gep::Timer::getTime() const
+gep::Timer::Timer() :
+    m_startTicks(getCurrentTicks()),
+    m_pausedTime(0),
+    m_isPaused(false)
 {
-    return 0;
 }
 
-void gep::Timer::pause()
+float gep::Timer::getTimeAsFloat() const
 {
+    return static_cast<float>(getTimeAsDouble());
 }
 
-void gep::Timer::unpause()
+double gep::Timer::getTimeAsDouble() const
 {
+    return static_cast<double>(getTime()) * getSecondsPerTick();
 }
 
-gep::PointInTime::PointInTime(Timer& timer)
+gep::uint64 gep::Timer::getTime() const
 {
-	this->timer = timer;
+    if (m_isPaused)
+        return m_pausedTime;
+    return getCurrentTicks() - m_startTicks;
 }
 
-float gep::PointInTime::operator - (const PointInTime& rh) const
+void gep::Timer::pause()
 {
-   return 0.0f;
+    if (m_isPaused)
+        return;
+    m_pausedTime = getTime();
+    m_isPaused = true;
 }
 
-bool gep::PointInTime::operator < (const PointInTime& rh) const
+void gep::Timer::unpause()
 {
-    return false;
+    if (!m_isPaused)
+        return;
+    // continue exactly where the timer stopped
+    m_startTicks = getCurrentTicks() - m_pausedTime;
+    m_isPaused = false;
 }
 
-bool gep::PointInTime::operator > (const PointInTime& rh) const
+gep::uint64 gep::Timer::getCurrentTicks()
 {
-    return false;
+    const TickSource& source = getTickSource();
+#ifdef GEP_TIMER_HAS_TSC
+    if (source.useTsc)
+        return readTsc();
+#endif
+    GEP_UNUSED(source);
+    return readReferenceClock();
 }
 
-bool gep::PointInTime::operator <= (const PointInTime& rh) const
+double gep::Timer::getSecondsPerTick()
 {
-    return false;
+    return getTickSource().secondsPerTick;
 }
 
-bool gep::PointInTime::operator >= (const PointInTime& rh) const
+gep::uint64 gep::Timer::getTicksPerSecond()
 {
-    return false;
+    return getTickSource().ticksPerSecond;
 }
 
-bool gep::PointInTime::operator == (const PointInTime& rh) const
+const char* gep::Timer::getClockName()
 {
-    return false;
+#ifdef _WIN32
+    return getTickSource().useTsc ? "invariant tsc" : "QueryPerformanceCounter";
+#else
+    return getTickSource().useTsc ? "invariant tsc" : "CLOCK_MONOTONIC_RAW";
+#endif
 }
 
-bool gep::PointInTime::operator != (const PointInTime& rh) const
+float gep::PointInTime::operator - (const PointInTime& rh) const
 {
-    return false;
+    // signed, the earlier point might be on the left
+    return static_cast<float>(static_cast<double>(static_cast<int64>(m_ticks - rh.m_ticks)) * Timer::getSecondsPerTick());
 }
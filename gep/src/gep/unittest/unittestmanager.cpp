@@ -2,8 +2,162 @@
 #include "gep/unittest/UnittestManager.h"
 #include <sstream>
 #include <stdarg.h>
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#include <deque>
 #include "gep/timer.h"
+#include "gep/file.h"
+
+namespace
+{
+    /// \brief switches the console to the given windows console color (0x0C red, 0x0A green, 0x07 default)
+    void setConsoleColor(unsigned short color)
+    {
+#ifdef _WIN32
+        SetConsoleTextAttribute (GetStdHandle (STD_OUTPUT_HANDLE), color);
+#else
+        // no escape sequences in redirected output
+        if (!isatty(fileno(stdout)))
+            return;
+        fflush(stdout);
+        const char* sequence = (color == 0x0C) ? "\033[31m" : (color == 0x0A) ? "\033[32m" : "\033[0m";
+        printf("%s", sequence);
+#endif
+    }
+
+    double calcMedian(std::vector<double> values)
+    {
+        std::sort(values.begin(), values.end());
+        size_t middle = values.size() / 2;
+        return (values.size() % 2 == 1) ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+    }
+
+    /// \brief formats seconds with a unit which keeps the number readable
+    std::string formatTime(double seconds)
+    {
+        char buffer[32];
+        if (seconds < 1e-6)
+            sprintf(buffer, "%.2f ns", seconds * 1e9);
+        else if (seconds < 1e-3)
+            sprintf(buffer, "%.2f us", seconds * 1e6);
+        else
+            sprintf(buffer, "%.2f ms", seconds * 1e3);
+        return buffer;
+    }
+
+    void printSlowestTests(gep::UnittestLog& log, std::vector<gep::UnittestTiming> timings)
+    {
+        const size_t numSlowest = 10;
+        if(timings.empty())
+            return;
+        std::sort(timings.begin(), timings.end(), [](const gep::UnittestTiming& a, const gep::UnittestTiming& b)
+        {
+            return a.seconds > b.seconds;
+        });
+        log.logMessage("Slowest tests:\n");
+        for(size_t i = 0; i < timings.size() && i < numSlowest; i++)
+            log.logMessage("  %12s  %s.%s\n", formatTime(timings[i].seconds).c_str(), timings[i].group.c_str(), timings[i].name.c_str());
+        log.logMessage("\n");
+    }
+
+    void writeJsonString(FILE* pFile, const std::string& str)
+    {
+        fputc('"', pFile);
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+                fprintf(pFile, "\\%c", c);
+            else
+                fputc(c, pFile);
+        }
+        fputc('"', pFile);
+    }
+
+    /// \brief reads a json string starting at the opening quote, p ends up behind the closing quote
+    bool readJsonString(const char*& p, const char* pEnd, std::string& str)
+    {
+        str.clear();
+        if (p == pEnd || *p != '"')
+            return false;
+        for (p++; p != pEnd; p++)
+        {
+            if (*p == '"')
+            {
+                p++;
+                return true;
+            }
+            if (*p == '\\' && p + 1 != pEnd)
+                p++;
+            str += *p;
+        }
+        return false;
+    }
+
+    inline void skipWhitespace(const char*& p, const char* pEnd)
+    {
+        while (p != pEnd && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+}
+
+void gep::BenchmarkState::startTiming()
+{
+    m_startTicks = Timer::getCurrentTicks();
+}
+
+void gep::BenchmarkState::stopTiming()
+{
+    if(m_stopTicks == 0)
+        m_stopTicks = Timer::getCurrentTicks();
+}
+
+void gep::BenchmarkState::pauseTiming()
+{
+    GEP_ASSERT(m_pauseTicks == 0, "timing is already paused");
+    m_pauseTicks = Timer::getCurrentTicks();
+}
+
+void gep::BenchmarkState::resumeTiming()
+{
+    GEP_ASSERT(m_pauseTicks != 0, "timing is not paused");
+    m_pausedTicks += Timer::getCurrentTicks() - m_pauseTicks;
+    m_pauseTicks = 0;
+}
+
+double gep::BenchmarkState::getElapsedSeconds() const
+{
+    if(m_startTicks == 0 || m_stopTicks == 0)
+        return -1.0;
+    return (m_stopTicks - m_startTicks - m_pausedTicks) * Timer::getSecondsPerTick();
+}
+
+void gep::BenchmarkState::setCounter(const char* name, double value)
+{
+    for(auto& counter : m_counters)
+    {
+        if(counter.first == name)
+        {
+            counter.second = value;
+            return;
+        }
+    }
+    m_counters.push_back(std::make_pair(std::string(name), value));
+}
+
+void gep::doNotOptimizeAddress(const void* pValue)
+{
+    GEP_UNUSED(pValue);
+}
 
 gep::UnittestManager* gep::UnittestManager::s_globalInstance = nullptr;
 
@@ -45,10 +199,12 @@ int gep::UnittestManager::runAllTests()
 {
     int numFailedTests = 0;
     UnittestLog log;
+    std::vector<UnittestTiming> timings;
     for(auto it = m_groups.begin(); it < m_groups.end(); ++it)
     {
-        numFailedTests += (*it)->runAllSubtests(log);
+        numFailedTests += (*it)->runAllSubtests(log, &timings);
     }
+    printSlowestTests(log, timings);
     if(numFailedTests > 0)
     {
 		log.logFailure("\n%d tests failed\n", numFailedTests);
@@ -60,6 +216,346 @@ int gep::UnittestManager::runAllTests()
     return numFailedTests;
 }
 
+#ifndef _WIN32
+namespace
+{
+    /// \brief a range of tests of one group, run by one child process
+    struct TestJob
+    {
+        size_t groupIndex;
+        size_t firstTest;
+    };
+
+    /// \brief output and results of one group collected from its child processes
+    struct GroupProgress
+    {
+        std::string log;
+        size_t numFinished;
+        int numFailed;
+    };
+
+    struct TestWorker
+    {
+        pid_t pid;
+        int controlFd; ///< the child reports "S <test>" when a test starts and "E <test> <passed> <seconds>" when it ends
+        int logFd; ///< stdout and stderr of the child
+        TestJob job;
+        bool testRunning;
+        size_t currentTest;
+        size_t nextTest; ///< the first test of the job which has not ended yet
+        gep::uint64 testStartTicks;
+        bool timedOut;
+        std::string controlBuffer;
+    };
+
+    void writeAll(int fd, const char* data, size_t size)
+    {
+        while(size > 0)
+        {
+            ssize_t written = write(fd, data, size);
+            if(written < 0 && errno == EINTR)
+                continue;
+            if(written <= 0)
+                return;
+            data += written;
+            size -= written;
+        }
+    }
+
+    /// \brief runs inside the forked child, never returns
+    void runTestJob(gep::UnittestGroup& group, size_t firstTest, int controlFd)
+    {
+        gep::UnittestLog log;
+        char line[64];
+        for(size_t i = firstTest; i < group.getNumSubtests(); i++)
+        {
+            int length = snprintf(line, sizeof(line), "S %u\n", static_cast<unsigned int>(i));
+            writeAll(controlFd, line, length);
+            double seconds = 0.0;
+            bool passed = group.runSubtest(i, log, seconds);
+            // the log has to arrive before the end of the test is reported
+            fflush(stdout);
+            fflush(stderr);
+            length = snprintf(line, sizeof(line), "E %u %d %.9f\n", static_cast<unsigned int>(i), passed ? 1 : 0, seconds);
+            writeAll(controlFd, line, length);
+        }
+        // skip static destructors and atexit handlers, they belong to the parent
+        _exit(0);
+    }
+
+    /// \brief reads what is available, closes the descriptor and sets it to -1 at the end of the stream
+    void readPipe(int& fd, std::string& target)
+    {
+        char buffer[4096];
+        ssize_t numRead = read(fd, buffer, sizeof(buffer));
+        if(numRead > 0)
+            target.append(buffer, numRead);
+        else if(numRead == 0 || errno != EINTR)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+#endif
+
+int gep::UnittestManager::runAllTestsParallel(uint32 numWorkers, float timeoutSeconds)
+{
+#ifdef _WIN32
+    UnittestLog log;
+    log.logMessage("Running tests in parallel is not supported on this platform, running them serially\n\n");
+    GEP_UNUSED(numWorkers);
+    GEP_UNUSED(timeoutSeconds);
+    return runAllTests();
+#else
+    GEP_ASSERT(numWorkers > 0, "at least one worker is needed");
+    // reads of up to 4 KB, how much log of one worker is read before the others get their turn
+    const size_t maxLogReadsPerPass = 16;
+    UnittestLog log;
+    const uint64 startTicks = Timer::getCurrentTicks();
+    const uint64 timeoutTicks = static_cast<uint64>(timeoutSeconds * Timer::getTicksPerSecond());
+
+    std::deque<TestJob> jobs;
+    std::vector<GroupProgress> progress(m_groups.size());
+    for(size_t i = 0; i < m_groups.size(); i++)
+    {
+        progress[i].numFinished = 0;
+        progress[i].numFailed = 0;
+        if(m_groups[i]->getNumSubtests() > 0)
+        {
+            TestJob job = { i, 0 };
+            jobs.push_back(job);
+        }
+    }
+
+    std::vector<TestWorker> workers;
+    std::vector<UnittestTiming> timings;
+    std::vector<std::string> failedTests;
+    int numFailedTests = 0;
+    int numGroupsFailed = 0;
+
+    auto finishTest = [&](size_t groupIndex, size_t testIndex, bool passed, double seconds)
+    {
+        UnittestGroup& group = *m_groups[groupIndex];
+        UnittestTiming timing = { group.getName(), group.getSubtestName(testIndex), seconds, passed };
+        timings.push_back(timing);
+        GroupProgress& groupProgress = progress[groupIndex];
+        if(!passed)
+        {
+            groupProgress.numFailed++;
+            numFailedTests++;
+            failedTests.push_back(timing.group + "." + timing.name);
+        }
+        if(++groupProgress.numFinished < group.getNumSubtests())
+            return;
+
+        // the whole group is done, print it in one piece so the output of the workers does not interleave
+        log.logMessage("Starting Test Group %s\n", group.getName());
+        fwrite(groupProgress.log.data(), 1, groupProgress.log.size(), stdout);
+        if(groupProgress.numFailed > 0)
+        {
+            log.logFailure("%d Tests failed in group %s\n\n", groupProgress.numFailed, group.getName());
+            numGroupsFailed++;
+        }
+        else
+            log.logSuccess("All Tests in group %s passed\n\n", group.getName());
+    };
+
+    auto parseControl = [&](TestWorker& worker)
+    {
+        size_t end;
+        while((end = worker.controlBuffer.find('\n')) != std::string::npos)
+        {
+            std::string line = worker.controlBuffer.substr(0, end);
+            worker.controlBuffer.erase(0, end + 1);
+            unsigned int testIndex = 0;
+            int passed = 0;
+            double seconds = 0.0;
+            if(sscanf(line.c_str(), "S %u", &testIndex) == 1)
+            {
+                worker.testRunning = true;
+                worker.currentTest = testIndex;
+                worker.testStartTicks = Timer::getCurrentTicks();
+            }
+            else if(sscanf(line.c_str(), "E %u %d %lf", &testIndex, &passed, &seconds) == 3)
+            {
+                worker.testRunning = false;
+                worker.nextTest = testIndex + 1;
+                finishTest(worker.job.groupIndex, testIndex, passed != 0, seconds);
+            }
+        }
+    };
+
+    while(!jobs.empty() || !workers.empty())
+    {
+        while(workers.size() < numWorkers && !jobs.empty())
+        {
+            TestJob job = jobs.front();
+            jobs.pop_front();
+            int controlPipe[2];
+            int logPipe[2];
+            if(pipe(controlPipe) != 0 || pipe(logPipe) != 0)
+            {
+                GEP_ASSERT(false, "creating the pipes for a test worker failed", errno);
+                return -1;
+            }
+            // anything still buffered would be written a second time by the child
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if(pid == 0)
+            {
+                close(controlPipe[0]);
+                close(logPipe[0]);
+                dup2(logPipe[1], STDOUT_FILENO);
+                dup2(logPipe[1], STDERR_FILENO);
+                close(logPipe[1]);
+                runTestJob(*m_groups[job.groupIndex], job.firstTest, controlPipe[1]);
+            }
+            close(controlPipe[1]);
+            close(logPipe[1]);
+            if(pid < 0)
+            {
+                GEP_ASSERT(false, "forking a test worker failed", errno);
+                close(controlPipe[0]);
+                close(logPipe[0]);
+                return -1;
+            }
+            TestWorker worker;
+            worker.pid = pid;
+            worker.controlFd = controlPipe[0];
+            worker.logFd = logPipe[0];
+            worker.job = job;
+            worker.testRunning = false;
+            worker.currentTest = job.firstTest;
+            worker.nextTest = job.firstTest;
+            worker.testStartTicks = Timer::getCurrentTicks();
+            worker.timedOut = false;
+            workers.push_back(worker);
+        }
+
+        std::vector<pollfd> fds;
+        for(auto& worker : workers)
+        {
+            pollfd fd = { -1, POLLIN, 0 };
+            fd.fd = worker.controlFd;
+            fds.push_back(fd);
+            fd.fd = worker.logFd;
+            fds.push_back(fd);
+        }
+        // the timeout only bounds how late a hanging test is noticed
+        poll(&fds[0], fds.size(), 50);
+
+        for(size_t i = 0; i < workers.size(); i++)
+        {
+            TestWorker& worker = workers[i];
+            if(fds[i * 2 + 1].revents != 0)
+                readPipe(worker.logFd, progress[worker.job.groupIndex].log);
+            if(fds[i * 2].revents != 0)
+            {
+                // the child flushes its log before it reports the end of a test, so the log has to be read completely first.
+                // A child which keeps logging must not starve the others, its control messages wait for the next pass then
+                pollfd logFd = { worker.logFd, POLLIN, 0 };
+                size_t numLogReads = 0;
+                while(worker.logFd >= 0 && numLogReads < maxLogReadsPerPass && poll(&logFd, 1, 0) > 0)
+                {
+                    readPipe(worker.logFd, progress[worker.job.groupIndex].log);
+                    logFd.fd = worker.logFd;
+                    numLogReads++;
+                }
+                if(numLogReads < maxLogReadsPerPass)
+                {
+                    readPipe(worker.controlFd, worker.controlBuffer);
+                    parseControl(worker);
+                }
+            }
+            if(worker.testRunning && !worker.timedOut && timeoutSeconds > 0.0f &&
+               Timer::getCurrentTicks() - worker.testStartTicks > timeoutTicks)
+            {
+                kill(worker.pid, SIGKILL);
+                worker.timedOut = true;
+            }
+        }
+
+        for(size_t i = 0; i < workers.size(); )
+        {
+            TestWorker& worker = workers[i];
+            if(worker.controlFd >= 0 || worker.logFd >= 0)
+            {
+                i++;
+                continue;
+            }
+            int status = 0;
+            while(waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {}
+            UnittestGroup& group = *m_groups[worker.job.groupIndex];
+            if(worker.testRunning)
+            {
+                // the test never reported its end, the process crashed or was killed
+                double seconds = (Timer::getCurrentTicks() - worker.testStartTicks) * Timer::getSecondsPerTick();
+                char message[256];
+                if(worker.timedOut)
+                    snprintf(message, sizeof(message), "  Subtest %s timed out after %s\n", group.getSubtestName(worker.currentTest), formatTime(seconds).c_str());
+                else if(WIFSIGNALED(status))
+                    snprintf(message, sizeof(message), "  Subtest %s crashed with signal %d (%s)\n", group.getSubtestName(worker.currentTest), WTERMSIG(status), strsignal(WTERMSIG(status)));
+                else
+                    snprintf(message, sizeof(message), "  Subtest %s exited the process with code %d\n", group.getSubtestName(worker.currentTest), WEXITSTATUS(status));
+                progress[worker.job.groupIndex].log += message;
+                // the remaining tests of the group continue in a new process
+                if(worker.currentTest + 1 < group.getNumSubtests())
+                {
+                    TestJob job = { worker.job.groupIndex, worker.currentTest + 1 };
+                    jobs.push_front(job);
+                }
+                finishTest(worker.job.groupIndex, worker.currentTest, false, seconds);
+            }
+            else if(worker.nextTest < group.getNumSubtests())
+            {
+                // the process died between two tests, e.g. in the destructor of a static which a test created
+                char message[256];
+                if(WIFSIGNALED(status))
+                    snprintf(message, sizeof(message), "  Test worker crashed with signal %d (%s) before Subtest %s started\n", WTERMSIG(status), strsignal(WTERMSIG(status)), group.getSubtestName(worker.nextTest));
+                else
+                    snprintf(message, sizeof(message), "  Test worker exited with code %d before Subtest %s started\n", WEXITSTATUS(status), group.getSubtestName(worker.nextTest));
+                progress[worker.job.groupIndex].log += message;
+                if(worker.nextTest > worker.job.firstTest)
+                {
+                    // it got somewhere, so a new process retries the test which did not start
+                    TestJob job = { worker.job.groupIndex, worker.nextTest };
+                    jobs.push_front(job);
+                }
+                else
+                {
+                    // not a single test ran, retrying would die the same way. Count the test as failed to get past it
+                    if(worker.nextTest + 1 < group.getNumSubtests())
+                    {
+                        TestJob job = { worker.job.groupIndex, worker.nextTest + 1 };
+                        jobs.push_front(job);
+                    }
+                    finishTest(worker.job.groupIndex, worker.nextTest, false, 0.0);
+                }
+            }
+            workers.erase(workers.begin() + i);
+        }
+    }
+
+    double wallTime = (Timer::getCurrentTicks() - startTicks) * Timer::getSecondsPerTick();
+    log.logMessage("Ran %u tests in %u groups with %u workers in %s\n", static_cast<unsigned int>(timings.size()),
+        static_cast<unsigned int>(m_groups.size()), numWorkers, formatTime(wallTime).c_str());
+    printSlowestTests(log, timings);
+    if(numFailedTests > 0)
+    {
+        log.logFailure("\n%d tests failed in %d groups:\n", numFailedTests, numGroupsFailed);
+        for(auto& name : failedTests)
+            log.logFailure("  %s\n", name.c_str());
+    }
+    else
+    {
+        log.logSuccess("All tests passed\n");
+    }
+    return numFailedTests;
+#endif
+}
+
 gep::AssertCallbackResult gep::UnittestManager::failedAssert(const char* sourceFile, unsigned int line, const char* function, const char* expression, const char* msg, const char* additional)
 {
     std::ostringstream message;
@@ -77,7 +573,7 @@ gep::UnittestFailedException::UnittestFailedException(const char* file, unsigned
   m_line = line;
 }
 
-const char* gep::UnittestFailedException::what() const
+const char* gep::UnittestFailedException::what() const throw()
 {
   return m_message.c_str();
 }
@@ -88,83 +584,426 @@ gep::UnittestGroup::UnittestGroup(const char* name) :
     UnittestManager::instance().registerGroup(this);
 }
 
-int gep::UnittestGroup::runAllSubtests(UnittestLog& log)
+int gep::UnittestGroup::runAllSubtests(UnittestLog& log, std::vector<UnittestTiming>* pTimings)
 {
     int numTestsFailed = 0;
     log.logMessage("Starting Test Group %s\n", m_name);
-    for(auto it = m_tests.begin(); it != m_tests.end(); ++it)
+    for(size_t i = 0; i < m_tests.size(); i++)
     {
-        try
+        double seconds = 0.0;
+        bool passed = runSubtest(i, log, seconds);
+        if(!passed)
+            numTestsFailed++;
+        if(pTimings != nullptr)
+        {
+            UnittestTiming timing = { m_name, m_tests[i]->getName(), seconds, passed };
+            pTimings->push_back(timing);
+        }
+    }
+    if(numTestsFailed > 0)
+    {
+        log.logFailure("%d Tests failed in group %s\n\n", numTestsFailed, m_name);
+    }
+    else
+    {
+        log.logSuccess("All Tests in group %s passed\n\n", m_name);
+    }
+    return numTestsFailed;
+}
+
+bool gep::UnittestGroup::runSubtest(size_t index, UnittestLog& log, double& seconds)
+{
+    IUnittest* test = m_tests[index];
+    bool passed = false;
+    uint64 start = Timer::getCurrentTicks();
+    try
+    {
+        if(test->Initialize(log) != SUCCESS)
+        {
+            seconds = (Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick();
+            log.logFailure("  Subtest %s failed to initialize\n", test->getName());
+        }
+        else
         {
-            if((*it)->Initialize(log) != SUCCESS)
+            test->Run(log);
+            Result deinitialized = test->Deinitialize(log);
+            seconds = (Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick();
+            if(deinitialized != SUCCESS)
             {
-                log.logFailure("  Subtest %s failed to initialize\n", (*it)->getName());
-                numTestsFailed++;
+                log.logFailure("  Subtest %s failed to deinitialize\n", test->getName());
             }
             else
             {
-                (*it)->Run(log);
-                if((*it)->Deinitialize(log) != SUCCESS)
-                {
-                    log.logFailure("  Subtest %s failed to deinitialize\n", (*it)->getName());
-                    numTestsFailed++;
-                }
-                else
-                {
-                    log.logSuccess("  Subtest %s passed\n", (*it)->getName());
-                }
+                log.logSuccess("  Subtest %s passed (%s)\n", test->getName(), formatTime(seconds).c_str());
+                passed = true;
             }
         }
+    }
+    catch(UnittestFailedException& ex)
+    {
+        seconds = (Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick();
+        log.logFailure("  Subtest %s failed in file '%s' line %d\n%s\n", test->getName(), ex.getFile(), ex.getLine(), ex.what());
+    }
+    catch(std::exception& ex)
+    {
+        seconds = (Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick();
+        log.logFailure("  Subtest %s failed due to an exception '%s'\n", test->getName(), ex.what());
+    }
+    catch(...)
+    {
+        seconds = (Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick();
+        log.logFailure("  Subtest %s failed due to an unkown exception\n", test->getName());
+    }
+    return passed;
+}
+
+int gep::UnittestGroup::runAllBenchmarks(UnittestLog& log, const BenchmarkSettings& settings, std::vector<BenchmarkResult>& results)
+{
+    int numFailed = 0;
+    bool headerPrinted = false;
+    for(auto it = m_benchmarks.begin(); it != m_benchmarks.end(); ++it)
+    {
+        std::string fullName = std::string(m_name) + "." + (*it)->getName();
+        if(settings.filter != nullptr && fullName.find(settings.filter) == std::string::npos)
+            continue;
+        if(!headerPrinted)
+        {
+            log.logMessage("Benchmark Group %s\n", m_name);
+            headerPrinted = true;
+        }
+        try
+        {
+            BenchmarkResult result = UnittestManager::runBenchmark(**it, settings);
+            result.group = m_name;
+            results.push_back(result);
+        }
         catch(UnittestFailedException& ex)
         {
-            log.logFailure("  Subtest %s failed in file '%s' line %d\n%s\n", (*it)->getName(), ex.getFile(), ex.getLine(), ex.what());
-            numTestsFailed++;
+            log.logFailure("  Benchmark %s failed in file '%s' line %d\n%s\n", (*it)->getName(), ex.getFile(), ex.getLine(), ex.what());
+            numFailed++;
         }
         catch(std::exception& ex)
         {
-            log.logFailure("  Subtest %s failed due to an exception '%s'\n", (*it)->getName(), ex.what());
-            numTestsFailed++;
+            log.logFailure("  Benchmark %s failed due to an exception '%s'\n", (*it)->getName(), ex.what());
+            numFailed++;
         }
         catch(...)
         {
-            log.logFailure("  Subtest %s failed due to an unkown exception\n", (*it)->getName());
-            numTestsFailed++;
+            log.logFailure("  Benchmark %s failed due to an unkown exception\n", (*it)->getName());
+            numFailed++;
         }
     }
-    if(numTestsFailed > 0)
+    return numFailed;
+}
+
+void gep::UnittestGroup::registerTest(IUnittest* test)
+{
+    m_tests.push_back(test);
+}
+
+void gep::UnittestGroup::registerBenchmark(IBenchmark* benchmark)
+{
+    m_benchmarks.push_back(benchmark);
+}
+
+int gep::UnittestManager::runAllBenchmarks(const BenchmarkSettings& settings)
+{
+    UnittestLog log;
+    std::vector<BenchmarkResult> baseline;
+    if(settings.baseline != nullptr && readBenchmarkJson(settings.baseline, baseline) != SUCCESS)
     {
-        log.logFailure("%d Tests failed in group %s\n\n", numTestsFailed, m_name);
+        log.logFailure("Could not read the baseline '%s'\n", settings.baseline);
+        return 1;
     }
+
+    int numFailed = 0;
+    int numRegressed = 0;
+    std::vector<BenchmarkResult> results;
+    for(auto it = m_groups.begin(); it < m_groups.end(); ++it)
+    {
+        size_t first = results.size();
+        numFailed += (*it)->runAllBenchmarks(log, settings, results);
+        for(size_t i = first; i < results.size(); i++)
+        {
+            const BenchmarkResult& result = results[i];
+            log.logMessage("  %-32s %12s +- %-12s (%llu iterations x %u samples)", result.name.c_str(),
+                formatTime(result.median).c_str(), formatTime(result.mad).c_str(), result.iterations, result.numSamples);
+
+            auto baseIt = std::find_if(baseline.begin(), baseline.end(), [&result](const BenchmarkResult& base)
+            {
+                return base.group == result.group && base.name == result.name;
+            });
+            if(baseIt != baseline.end() && baseIt->median > 0.0)
+            {
+                double change = result.median / baseIt->median - 1.0;
+                if(change > settings.regressionThreshold)
+                {
+                    log.logFailure("  %+.1f%% REGRESSION\n", change * 100.0);
+                    numRegressed++;
+                }
+                else if(change < -settings.regressionThreshold)
+                    log.logSuccess("  %+.1f%%\n", change * 100.0);
+                else
+                    log.logMessage("  %+.1f%%\n", change * 100.0);
+            }
+            else
+                log.logMessage("\n");
+
+            for(auto& counter : result.counters)
+            {
+                log.logMessage("      %-30s %12.6g", counter.first.c_str(), counter.second);
+                if(baseIt != baseline.end())
+                {
+                    for(auto& baseCounter : baseIt->counters)
+                    {
+                        if(baseCounter.first == counter.first)
+                            log.logMessage("  (baseline %.6g)", baseCounter.second);
+                    }
+                }
+                log.logMessage("\n");
+            }
+        }
+    }
+
+    if(settings.jsonOutput != nullptr && writeBenchmarkJson(results, settings.jsonOutput) != SUCCESS)
+    {
+        log.logFailure("Could not write '%s'\n", settings.jsonOutput);
+        numFailed++;
+    }
+
+    if(numFailed + numRegressed > 0)
+        log.logFailure("\n%d benchmarks failed, %d regressed by more than %.0f%%\n", numFailed, numRegressed, settings.regressionThreshold * 100.0f);
     else
+        log.logSuccess("\n%u benchmarks run\n", static_cast<unsigned int>(results.size()));
+    return numFailed + numRegressed;
+}
+
+gep::BenchmarkResult gep::UnittestManager::runBenchmark(IBenchmark& benchmark, const BenchmarkSettings& settings)
+{
+    GEP_ASSERT(settings.numSamples > 0, "at least one sample is needed");
+    const double secondsPerTick = Timer::getSecondsPerTick();
+    std::vector<std::pair<std::string, double>> counters;
+    bool usesKeepRunning = true;
+    auto runSample = [&benchmark, &counters, &usesKeepRunning, secondsPerTick](uint64 iterations) -> double
     {
-        log.logSuccess("All Tests in group %s passed\n\n", m_name);
+        BenchmarkState state(iterations);
+        uint64 start = Timer::getCurrentTicks();
+        benchmark.Run(state);
+        double elapsed = state.getElapsedSeconds();
+        // a benchmark which never called keepRunning is measured as a whole
+        usesKeepRunning = (elapsed >= 0.0);
+        if(!usesKeepRunning)
+            elapsed = (Timer::getCurrentTicks() - start) * secondsPerTick;
+        counters = state.getCounters();
+        return elapsed;
+    };
+
+    // grow the iterations until a sample is long enough to be measured reliably, this warms up as well
+    GEP_ASSERT(settings.maxIterations > 0, "at least one iteration is needed");
+    uint64 iterations = 1;
+    for(;;)
+    {
+        double elapsed = runSample(iterations);
+        // more iterations would not change anything if the benchmark does not loop, its samples are repeated runs instead
+        if(!usesKeepRunning || elapsed >= settings.minSampleTime || iterations >= settings.maxIterations)
+            break;
+        double factor = (elapsed > 0.0) ? 1.2 * settings.minSampleTime / elapsed : 10.0;
+        double grown = iterations * std::min(std::max(factor, 2.0), 10.0);
+        // clamped in double, a loop which takes no measurable time would overflow otherwise
+        iterations = (grown >= static_cast<double>(settings.maxIterations)) ? settings.maxIterations : static_cast<uint64>(grown);
     }
-    return numTestsFailed;
+
+    for(uint32 i = 0; i < settings.numWarmupSamples; i++)
+        runSample(iterations);
+
+    std::vector<double> samples(settings.numSamples);
+    for(auto& sample : samples)
+        sample = runSample(iterations) / iterations;
+
+    BenchmarkResult result;
+    result.name = benchmark.getName();
+    result.iterations = iterations;
+    result.numSamples = settings.numSamples;
+    result.median = calcMedian(samples);
+    std::vector<double> deviations(samples.size());
+    for(size_t i = 0; i < samples.size(); i++)
+        deviations[i] = std::fabs(samples[i] - result.median);
+    result.mad = calcMedian(deviations);
+    result.min = *std::min_element(samples.begin(), samples.end());
+    double sum = 0.0;
+    for(double sample : samples)
+        sum += sample;
+    result.mean = sum / samples.size();
+    result.counters = counters;
+    return result;
 }
 
-void gep::UnittestGroup::registerTest(IUnittest* test)
+gep::Result gep::UnittestManager::writeBenchmarkJson(const std::vector<BenchmarkResult>& results, const char* filename)
 {
-    m_tests.push_back(test);
+    RawFile file(filename, "w");
+    if(!file.isOpen())
+        return FAILURE;
+    FILE* pFile = file.m_pHandle;
+
+    fprintf(pFile, "{\n  \"benchmarks\": [");
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+        fprintf(pFile, "%s\n    {\"group\": ", (i == 0) ? "" : ",");
+        writeJsonString(pFile, result.group);
+        fprintf(pFile, ", \"name\": ");
+        writeJsonString(pFile, result.name);
+        fprintf(pFile, ", \"iterations\": %llu, \"samples\": %u, \"median_ns\": %.4f, \"mad_ns\": %.4f, \"min_ns\": %.4f, \"mean_ns\": %.4f",
+            result.iterations, result.numSamples, result.median * 1e9, result.mad * 1e9, result.min * 1e9, result.mean * 1e9);
+        if(!result.counters.empty())
+        {
+            fprintf(pFile, ", \"counters\": {");
+            for(size_t j = 0; j < result.counters.size(); j++)
+            {
+                fprintf(pFile, (j == 0) ? "" : ", ");
+                writeJsonString(pFile, result.counters[j].first);
+                fprintf(pFile, ": %.9g", result.counters[j].second);
+            }
+            fprintf(pFile, "}");
+        }
+        fprintf(pFile, "}");
+    }
+    fprintf(pFile, "\n  ]\n}\n");
+    return ferror(pFile) ? FAILURE : SUCCESS;
+}
+
+gep::Result gep::UnittestManager::readBenchmarkJson(const char* filename, std::vector<BenchmarkResult>& results)
+{
+    RawFile file(filename, "rb");
+    if(!file.isOpen())
+        return FAILURE;
+    std::string json(file.getSize(), '\0');
+    if(!json.empty())
+        file.readArray(&json[0], json.size());
+
+    // every object inside the "benchmarks" array is one result
+    size_t arrayStart = json.find("\"benchmarks\"");
+    if(arrayStart == std::string::npos || (arrayStart = json.find('[', arrayStart)) == std::string::npos)
+        return FAILURE;
+    const char* p = json.c_str() + arrayStart + 1;
+    const char* pEnd = json.c_str() + json.size();
+    for(;;)
+    {
+        skipWhitespace(p, pEnd);
+        if(p != pEnd && *p == ',')
+        {
+            p++;
+            skipWhitespace(p, pEnd);
+        }
+        if(p == pEnd)
+            return FAILURE;
+        if(*p == ']')
+            return SUCCESS;
+        if(*p != '{')
+            return FAILURE;
+        p++;
+
+        BenchmarkResult result;
+        for(;;)
+        {
+            skipWhitespace(p, pEnd);
+            if(p != pEnd && *p == '}')
+            {
+                p++;
+                break;
+            }
+            std::string key, text;
+            if(!readJsonString(p, pEnd, key))
+                return FAILURE;
+            skipWhitespace(p, pEnd);
+            if(p == pEnd || *p++ != ':')
+                return FAILURE;
+            skipWhitespace(p, pEnd);
+            if(key == "counters" && p != pEnd && *p == '{')
+            {
+                p++;
+                for(;;)
+                {
+                    skipWhitespace(p, pEnd);
+                    if(p != pEnd && *p == ',')
+                    {
+                        p++;
+                        skipWhitespace(p, pEnd);
+                    }
+                    if(p != pEnd && *p == '}')
+                    {
+                        p++;
+                        break;
+                    }
+                    std::string counter;
+                    if(!readJsonString(p, pEnd, counter))
+                        return FAILURE;
+                    skipWhitespace(p, pEnd);
+                    if(p == pEnd || *p++ != ':')
+                        return FAILURE;
+                    char* pNumberEnd = nullptr;
+                    double value = strtod(p, &pNumberEnd);
+                    if(pNumberEnd == p)
+                        return FAILURE;
+                    p = pNumberEnd;
+                    result.counters.push_back(std::make_pair(counter, value));
+                }
+            }
+            else if(p != pEnd && *p == '"')
+            {
+                if(!readJsonString(p, pEnd, text))
+                    return FAILURE;
+                if(key == "group")
+                    result.group = text;
+                else if(key == "name")
+                    result.name = text;
+            }
+            else
+            {
+                char* pNumberEnd = nullptr;
+                double value = strtod(p, &pNumberEnd);
+                if(pNumberEnd == p)
+                    return FAILURE;
+                p = pNumberEnd;
+                if(key == "iterations")
+                    result.iterations = static_cast<uint64>(value);
+                else if(key == "samples")
+                    result.numSamples = static_cast<uint32>(value);
+                else if(key == "median_ns")
+                    result.median = value * 1e-9;
+                else if(key == "mad_ns")
+                    result.mad = value * 1e-9;
+                else if(key == "min_ns")
+                    result.min = value * 1e-9;
+                else if(key == "mean_ns")
+                    result.mean = value * 1e-9;
+            }
+            skipWhitespace(p, pEnd);
+            if(p != pEnd && *p == ',')
+                p++;
+        }
+        results.push_back(result);
+    }
 }
 
 void gep::UnittestLog::logFailure(const char* fmt, ...)
 {
-    SetConsoleTextAttribute (GetStdHandle (STD_OUTPUT_HANDLE), 0x0C);
+    setConsoleColor(0x0C);
     va_list ap;
     va_start(ap, fmt);
     vprintf(fmt, ap);
     va_end(ap);
-    SetConsoleTextAttribute (GetStdHandle (STD_OUTPUT_HANDLE), 0x07);
+    setConsoleColor(0x07);
 }
 
 void gep::UnittestLog::logSuccess(const char* fmt, ...)
 {
-    SetConsoleTextAttribute (GetStdHandle (STD_OUTPUT_HANDLE), 0x0A);
+    setConsoleColor(0x0A);
     va_list ap;
     va_start(ap, fmt);
     vprintf(fmt, ap);
     va_end(ap);
-    SetConsoleTextAttribute (GetStdHandle (STD_OUTPUT_HANDLE), 0x07);
+    setConsoleColor(0x07);
 }
 
 void gep::UnittestLog::logMessage(const char* fmt, ...)
@@ -181,6 +1020,12 @@ gep::SimpleUnittest::SimpleUnittest(const char* name, UnittestGroup& group) :
     group.registerTest(this);
 }
 
+gep::SimpleBenchmark::SimpleBenchmark(const char* name, UnittestGroup& group) :
+    m_name(name)
+{
+    group.registerBenchmark(this);
+}
+
 gep::Result gep::SimpleUnittest::Initialize(UnittestLog& log)
 {
     return SUCCESS;
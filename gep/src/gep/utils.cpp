@@ -1,5 +1,14 @@
 #include "stdafx.h"
 #include "gep/utils.h"
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GEP_SSE2_PATHS
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 std::string gep::format(const char* fmt, ...)
 {
@@ -50,91 +59,56 @@ std::wstring gep::convertToWideString(const std::string& toConvert)
 
 namespace
 {
-    /// \note Can only be used with types that do not require ctor/dtor calls for now.
-    template<typename T, size_t N>
-    class FixedStack
-    {
-    public:
-        enum { NumElements = N };
-        enum { NumBytes = NumElements * sizeof(T) };
-        typedef T ElementType;
-
-    public:
-        FixedStack() : m_current(m_data)
-        {
-        }
-
-    public:
-        void push(T element)
-        {
-            *m_current = std::move(element);
-            ++m_current;
-        }
+    const gep::uint64 fnvOffsetBasis = 14695981039346656037ull;
+    const gep::uint64 fnvPrime = 1099511628211ull;
+    /// deeper paths keep their segments on the heap
+    const size_t maxPathDepth = 64;
 
-        void pop() { --m_current; }
-
-        T& peek() { return *m_current; }
-        const T& peek() const { return *m_current; }
-
-    public:
-              T* begin()       { return m_data; }
-        const T* begin() const { return m_data; }
-              T* end()         { return m_current; }
-        const T* end() const   { return m_current; }
-
-        size_t length() const { return m_current - m_data; }
-        size_t capacity() const { return NumElements; }
-        size_t emptySpace() const { return capacity() - length(); }
-
-        bool isEmpty() const { return length() == 0; }
-
-    private:
-        T m_data[NumElements];
-        T* m_current;
-    };
+    inline bool isPathSeparator(char c)
+    {
+        return c == '/' || c == '\\';
+    }
 
-    struct StringView
+    inline gep::uint64 hashChar(gep::uint64 hash, char c)
     {
-        char* data;
-        size_t length;
+        return (hash ^ static_cast<gep::uint8>(c)) * fnvPrime;
+    }
 
-        char peek(gep::int32 position = 0) const { return *(data + position); }
-        bool isAt(char c) const
-        {
-            return !isAtEnd() && peek() == c;
-        }
-        bool isAt(gep::ArrayPtr<const char> string) const
-        {
-            if (isAtEnd() || string.length() > length)
-                return false;
-            return gep::areEqual(data, string.getPtr(), string.length());
-        }
-        bool isAtAny(gep::ArrayPtr<const char> string) const
-        {
-            if (isAtEnd())
-                return false;
-            return gep::contains(string, peek());
-        }
-        bool isAtEnd() const { return length == 0; }
-        bool canAdvance(gep::int32 amount = 1) const { return (gep::int64)length - amount >= 0; }
-        /// \return \c false if we cannot advance.
-        bool advance(gep::int32 amount = 1)
+    /// \return the position of the next path separator at or after \a position, \a length if there is none
+    inline size_t findPathSeparator(const char* path, size_t position, size_t length)
+    {
+#ifdef GEP_SSE2_PATHS
+        // check 16 chars at once, most path segments are longer than a few chars
+        const __m128i slash = _mm_set1_epi8('/');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        for(; position + 16 <= length; position += 16)
         {
-            if (!canAdvance(amount))
-                return false;
-
-            data += amount;
-            length -= amount;
-            return true;
+            __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(path + position));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chars, slash), _mm_cmpeq_epi8(chars, backslash)));
+            if(mask != 0)
+            {
+#ifdef _MSC_VER
+                unsigned long index;
+                _BitScanForward(&index, mask);
+                return position + index;
+#else
+                return position + __builtin_ctz(mask);
+#endif
+            }
         }
-    };
+#endif
+        while(position < length && !isPathSeparator(path[position]))
+            position++;
+        return position;
+    }
 }
 
-static auto g_pathSeparators = gep::makeArrayPtr("/\\");
-
-static bool isPathSeparator(char c)
+gep::uint64 gep::hashPath(const char* normalizedPath, size_t length)
 {
-    return gep::contains(g_pathSeparators, c);
+    uint64 hash = fnvOffsetBasis;
+    for(size_t i = 0; i < length; i++)
+        hash = hashChar(hash, normalizedPath[i]);
+    return hash;
 }
 
 size_t gep::normalizePath(char* path, size_t len, uint32 options)
@@ -142,110 +116,111 @@ size_t gep::normalizePath(char* path, size_t len, uint32 options)
     if (len == -1)
         len = strlen(path);
 
-    if (len == 0)
-        return 0;
+    return normalizeAndHashPath(path, len, path, options).length;
+}
 
-    // Convert all / slashes to \ slashes.
-    // This make the rest of this code much easier.
-    for (auto& c : makeArrayPtr(path, len))
+gep::NormalizedPath gep::normalizeAndHashPath(const char* path, size_t length, char* destination, uint32 options)
+{
+    // Each segment is written right away, the stack only remembers where the segments start,
+    // so that ../ can remove the last one again, and the hash of everything before it.
+    // The destination never gets ahead of the path, so both can be the same.
+    struct Segment
     {
-        if (c == '\\')
-            c = '/';
-    }
-
-    StringView state;
-    state.data = path;
-    state.length = len;
+        size_t start;
+        uint64 hashBefore;
+    };
+    Segment fixedStack[maxPathDepth];
+    std::vector<Segment> heapStack;
+    Segment* stack = fixedStack;
+    size_t capacity = maxPathDepth;
+    size_t depth = 0;
+    // the segments at the bottom of the stack which ../ can not remove, the leading slash and leading ../
+    size_t numFixed = 0;
+    size_t written = 0;
+    uint64 hash = fnvOffsetBasis;
+    size_t position = 0;
 
     // Skip initial ./ or .\ constructs.
-    if (state.isAt(makeArrayPtr("./", 2)))
-        state.advance(2);
-
-    FixedStack<StringView, 32> stack;
-
+    if (length >= 2 && path[0] == '.' && isPathSeparator(path[1]))
+        position = 2;
+
+    // If we are supposed to preserve a leading slash, and we are at one currently,
+    // it becomes the first segment.
+    bool preserveLeadingSlash = (options & NormalizationOptions::PreserveLeadingSlash) != 0;
+    bool hasLeadingSlash = preserveLeadingSlash && position < length && isPathSeparator(path[position]);
+    if (hasLeadingSlash)
     {
-        // If we are supposed to preserve a leading slash, and we are at one currently,
-        // we push it on the stack.
-        bool preserveLeadingSlash = (options & NormalizationOptions::PreserveLeadingSlash) != 0;
-        if(preserveLeadingSlash && state.isAt('/'))
-        {
-            StringView leadingSlash = state;
-            leadingSlash.length = 1;
-            stack.push(leadingSlash);
-        }
+        Segment leadingSlash = { written, hash };
+        stack[depth++] = leadingSlash;
+        numFixed++;
+        destination[written++] = '/';
+        hash = hashChar(hash, '/');
     }
 
     // Skip all leading slashes.
-    while(state.isAt('/'))
-        state.advance();
+    while (position < length && isPathSeparator(path[position]))
+        position++;
 
-    while(!state.isAtEnd())
+    while (position < length)
     {
-        if (state.isAt(makeArrayPtr("./", 2)))
+        size_t end = findPathSeparator(path, position, length);
+        size_t segmentLength = end - position;
+        bool endsWithSeparator = end < length;
+        bool isParent = segmentLength == 2 && path[position] == '.' && path[position + 1] == '.' && endsWithSeparator;
+
+        if (segmentLength == 1 && path[position] == '.' && endsWithSeparator)
         {
-            state.advance(2);
+            // ./ does not change anything
         }
-        else if (state.isAt(makeArrayPtr("../", 3)))
+        else if (isParent && depth > numFixed)
         {
-            // If the stack is currently empty, we preserve the ../
-            if (stack.isEmpty())
-            {
-                StringView dotDotSlash = state;
-                dotDotSlash.length = 3;
-
-                GEP_ASSERT(stack.emptySpace() > 0, "Stack is full. "
-                           "Increase the static capacity or use shorter strings as input!");
-
-                // Append the "../" string.
-                stack.push(dotDotSlash);
-            }
-            else
-            {
-                // To go one level up, just pop the last element off the stack.
-                stack.pop();
-            }
-
-            // Skip the "../"
-            state.advance(3);
+            // To go one level up, just drop the last segment.
+            depth--;
+            written = stack[depth].start;
+            hash = stack[depth].hashBefore;
+        }
+        else if (isParent && hasLeadingSlash)
+        {
+            // There is nothing above the root.
         }
         else
         {
-            StringView dir = state;
-
-            // Seek forward until we see a slash.
-            while (!state.isAtEnd() && !state.isAt('/'))
-                state.advance();
+            if (depth == capacity)
+            {
+                // deeper than any sane path, the stack continues on the heap
+                if (heapStack.empty())
+                    heapStack.assign(fixedStack, fixedStack + depth);
+                heapStack.resize(capacity * 2);
+                stack = heapStack.data();
+                capacity = heapStack.size();
+            }
+            Segment segment = { written, hash };
+            stack[depth++] = segment;
+            // Only a ../ at the start, or after other ones, gets here. It is preserved.
+            if (isParent)
+                numFixed++;
+            memmove(destination + written, path + position, segmentLength);
+            for (size_t i = 0; i < segmentLength; i++)
+                hash = hashChar(hash, destination[written + i]);
+            written += segmentLength;
 
             // Keep one trailing slash
-            if (state.isAt('/'))
-                state.advance();
-
-            // Length of the sub-string is the distance between the current and the previous state.
-            dir.length = state.data - dir.data;
-
-            GEP_ASSERT(stack.emptySpace() > 0, "Stack is full. "
-                       "Increase the static capacity or use shorter strings as input!");
-
-            // Append the current sub-string `dir`.
-            stack.push(dir);
+            if (endsWithSeparator)
+            {
+                destination[written++] = '/';
+                hash = hashChar(hash, '/');
+            }
         }
 
         // Skip all slashes.
-        while (state.isAt('/'))
-            state.advance();
-    }
-
-    auto result = path;
-    size_t newLen = 0;
-    for (auto& dir : stack)
-    {
-        memmove(result, dir.data, dir.length);
-        newLen += dir.length;
-        result += dir.length;
+        position = end;
+        while (position < length && isPathSeparator(path[position]))
+            position++;
     }
 
-    GEP_ASSERT(newLen <= len);
-    return newLen;
+    GEP_ASSERT(written <= length);
+    NormalizedPath result = { written, hash };
+    return result;
 }
 
 bool gep::areEqual(const char* lhs, const char* rhs, size_t count /*= -1*/)
@@ -0,0 +1,524 @@
+#include "stdafx.h"
+#include "gep/vfs.h"
+#include "gep/utils.h"
+#include "gep/statcache.h"
+#include <algorithm>
+
+namespace
+{
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+gep::VfsPath::VfsPath(const char* path) :
+    path(path),
+    original(path)
+{
+    // resources like FMOD sounds use leading slashes as part of their name
+    hash = normalizeAndHashPath(this->path, NormalizationOptions::PreserveLeadingSlash);
+}
+
+gep::VfsPath::VfsPath(const std::string& path) :
+    path(path),
+    original(path)
+{
+    hash = normalizeAndHashPath(this->path, NormalizationOptions::PreserveLeadingSlash);
+}
+
+// PakArchive
+//////////////////////////////////////////////////////////////////////////
+
+gep::PakArchive::PakArchive() :
+    m_pPaths(nullptr)
+{
+}
+
+gep::Result gep::PakArchive::open(const char* filename)
+{
+    close();
+    // the files are read in any order
+    if(m_file.open(filename, MappedFile::AccessPattern::Random) != SUCCESS)
+        return FAILURE;
+
+    Result result = FAILURE;
+    SCOPE_EXIT
+    {
+        if(result != SUCCESS)
+            close();
+    });
+
+    const uint8* pData = m_file.getData().getPtr();
+    uint64 fileSize = m_file.getSize();
+    Header header;
+    if(fileSize < sizeof(header))
+        return FAILURE;
+    memcpy(&header, pData, sizeof(header));
+    if(header.magic != MAGIC || header.version != VERSION)
+        return FAILURE;
+    uint64 tableEnd = sizeof(Header) + static_cast<uint64>(header.numEntries) * sizeof(Entry);
+    if(tableEnd + header.pathsSize > fileSize)
+        return FAILURE;
+
+    // the mapping is page aligned and the table follows the header, so it can be used in place
+    auto entries = ArrayPtr<const Entry>(reinterpret_cast<const Entry*>(pData + sizeof(Header)), header.numEntries);
+    const char* pPaths = reinterpret_cast<const char*>(pData + tableEnd);
+    for(size_t i = 0; i < entries.length(); i++)
+    {
+        const Entry& entry = entries[i];
+        if(entry.offset > fileSize || entry.size > fileSize - entry.offset)
+            return FAILURE;
+        if(entry.pathOffset > header.pathsSize || entry.pathLength > header.pathsSize - entry.pathOffset)
+            return FAILURE;
+        if(i > 0 && entries[i - 1].hash > entry.hash)
+            return FAILURE;
+        if(hashPath(pPaths + entry.pathOffset, entry.pathLength) != entry.hash)
+            return FAILURE;
+    }
+    m_entries = entries;
+    m_pPaths = pPaths;
+    m_filename = filename;
+
+    result = SUCCESS;
+    return SUCCESS;
+}
+
+void gep::PakArchive::close()
+{
+    m_file.close();
+    m_entries = ArrayPtr<const Entry>();
+    m_pPaths = nullptr;
+    m_filename.clear();
+}
+
+const gep::PakArchive::Entry* gep::PakArchive::find(const VfsPath& path) const
+{
+    auto pEnd = m_entries.getPtr() + m_entries.length();
+    auto pEntry = std::lower_bound(m_entries.getPtr(), pEnd, path.hash,
+        [](const Entry& entry, uint64 hash) { return entry.hash < hash; });
+    // different paths can have the same hash
+    for(; pEntry != pEnd && pEntry->hash == path.hash; pEntry++)
+    {
+        if(pEntry->pathLength == path.path.length() && memcmp(m_pPaths + pEntry->pathOffset, path.path.c_str(), pEntry->pathLength) == 0)
+            return pEntry;
+    }
+    return nullptr;
+}
+
+// PakWriter
+//////////////////////////////////////////////////////////////////////////
+
+void gep::PakWriter::addFile(const char* path, ArrayPtr<const uint8> data)
+{
+    File file;
+    file.path = VfsPath(path).path;
+    file.data.assign(data.getPtr(), data.getPtr() + data.length());
+    m_files.push_back(std::move(file));
+}
+
+void gep::PakWriter::addFileFromDisk(const char* path, const char* sourceFilename)
+{
+    File file;
+    file.path = VfsPath(path).path;
+    file.sourceFilename = sourceFilename;
+    m_files.push_back(std::move(file));
+}
+
+gep::Result gep::PakWriter::write(const char* filename)
+{
+    Result result = FAILURE;
+    RawFile output(filename, "wb");
+    SCOPE_EXIT
+    {
+        if(result != SUCCESS)
+        {
+            output.close();
+            remove(filename);
+        }
+    });
+    if(!output.isOpen())
+        return FAILURE;
+
+    // the table is sorted by hash, so that files can be found with a binary search
+    std::vector<PakArchive::Entry> entries(m_files.size());
+    std::vector<size_t> order(m_files.size());
+    for(size_t i = 0; i < m_files.size(); i++)
+    {
+        entries[i].hash = hashPath(m_files[i].path.c_str(), m_files[i].path.length());
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+    {
+        if(entries[lhs].hash != entries[rhs].hash)
+            return entries[lhs].hash < entries[rhs].hash;
+        return m_files[lhs].path < m_files[rhs].path;
+    });
+
+    std::string paths;
+    for(size_t i = 0; i < order.size(); i++)
+    {
+        File& file = m_files[order[i]];
+        PakArchive::Entry& entry = entries[order[i]];
+        if(i > 0 && file.path == m_files[order[i - 1]].path)
+            return FAILURE;
+        entry.pathOffset = static_cast<uint32>(paths.length());
+        entry.pathLength = static_cast<uint32>(file.path.length());
+        paths += file.path;
+        if(file.sourceFilename.empty())
+        {
+            entry.size = file.data.size();
+        }
+        else
+        {
+            // the sources are opened one at a time, archives can have more files than can be open at once
+            RawFile source(file.sourceFilename.c_str(), "rb");
+            if(!source.isOpen())
+                return FAILURE;
+            entry.size = source.getSize();
+        }
+    }
+
+    PakArchive::Header header;
+    header.magic = PakArchive::MAGIC;
+    header.version = PakArchive::VERSION;
+    header.numEntries = static_cast<uint32>(m_files.size());
+    header.pathsSize = static_cast<uint32>(paths.length());
+    uint64 offset = alignUp(sizeof(header) + entries.size() * sizeof(PakArchive::Entry) + paths.length(), PakArchive::DATA_ALIGNMENT);
+    for(size_t index : order)
+    {
+        entries[index].offset = offset;
+        offset = alignUp(static_cast<size_t>(offset + entries[index].size), PakArchive::DATA_ALIGNMENT);
+    }
+
+    if(output.write(header) != sizeof(header))
+        return FAILURE;
+    for(size_t index : order)
+    {
+        if(output.write(entries[index]) != sizeof(PakArchive::Entry))
+            return FAILURE;
+    }
+    if(output.writeArray(paths.data(), paths.length()) != paths.length())
+        return FAILURE;
+
+    const uint8 padding[PakArchive::DATA_ALIGNMENT] = {};
+    for(size_t index : order)
+    {
+        const PakArchive::Entry& entry = entries[index];
+        size_t paddingSize = static_cast<size_t>(entry.offset - output.position());
+        if(output.writeArray(padding, paddingSize) != paddingSize)
+            return FAILURE;
+        File& file = m_files[index];
+        if(file.sourceFilename.empty())
+        {
+            if(!file.data.empty() && output.writeArray(file.data.data(), file.data.size()) != file.data.size())
+                return FAILURE;
+        }
+        else
+        {
+            RawFile source(file.sourceFilename.c_str(), "rb");
+            if(!source.isOpen() || copyFileRange(source, 0, entry.size, output) != entry.size)
+                return FAILURE;
+        }
+    }
+
+    result = SUCCESS;
+    return SUCCESS;
+}
+
+// VfsFile
+//////////////////////////////////////////////////////////////////////////
+
+gep::VfsFile::VfsFile() :
+    m_position(0),
+    m_isOpen(false)
+{
+}
+
+void gep::VfsFile::close()
+{
+    m_pArchive.reset();
+    m_pPrefetched.reset();
+    m_mappedFile.close();
+    m_data = ArrayPtr<uint8>();
+    m_position = 0;
+    m_isOpen = false;
+}
+
+// VirtualFileSystem
+//////////////////////////////////////////////////////////////////////////
+
+gep::VirtualFileSystem::VirtualFileSystem() :
+    m_numDirectories(0)
+{
+}
+
+gep::VirtualFileSystem& gep::VirtualFileSystem::instance()
+{
+    static VirtualFileSystem s_instance;
+    return s_instance;
+}
+
+gep::Result gep::VirtualFileSystem::mountArchive(const char* filename)
+{
+    Mount mount;
+    mount.pArchive = std::make_shared<PakArchive>();
+    if(mount.pArchive->open(filename) != SUCCESS)
+        return FAILURE;
+    uint32 mountIndex = static_cast<uint32>(m_mounts.size());
+    m_archiveFiles.reserve(m_archiveFiles.size() + mount.pArchive->getEntries().length());
+    for(auto& entry : mount.pArchive->getEntries())
+    {
+        ArchiveFile& file = m_archiveFiles[entry.hash];
+        file.mountIndex = mountIndex;
+        file.pEntry = &entry;
+    }
+    m_mounts.push_back(std::move(mount));
+    return SUCCESS;
+}
+
+gep::Result gep::VirtualFileSystem::mountDirectory(const char* directory)
+{
+    if(!directoryExists(directory))
+        return FAILURE;
+    Mount mount;
+    mount.directory = directory;
+    normalizePath(mount.directory, NormalizationOptions::PreserveLeadingSlash);
+    if(mount.directory.empty() || mount.directory.back() != '/')
+        mount.directory += '/';
+    m_mounts.push_back(std::move(mount));
+    m_numDirectories++;
+    return SUCCESS;
+}
+
+void gep::VirtualFileSystem::unmountAll()
+{
+    m_mounts.clear();
+    m_archiveFiles.clear();
+    m_numDirectories = 0;
+}
+
+bool gep::VirtualFileSystem::findArchiveFile(const VfsPath& path, ArchiveFile& file) const
+{
+    auto it = m_archiveFiles.find(path.hash);
+    if(it == m_archiveFiles.end())
+        return false;
+    const PakArchive& archive = *m_mounts[it->second.mountIndex].pArchive;
+    const PakArchive::Entry& entry = *it->second.pEntry;
+    if(entry.pathLength == path.path.length() && archive.getPath(entry) == path.path)
+    {
+        file = it->second;
+        return true;
+    }
+    // another path with the same hash, the archives are searched one by one
+    for(size_t i = m_mounts.size(); i > 0; i--)
+    {
+        const Mount& mount = m_mounts[i - 1];
+        const PakArchive::Entry* pEntry = (mount.pArchive != nullptr) ? mount.pArchive->find(path) : nullptr;
+        if(pEntry != nullptr)
+        {
+            file.mountIndex = static_cast<uint32>(i - 1);
+            file.pEntry = pEntry;
+            return true;
+        }
+    }
+    return false;
+}
+
+gep::VirtualFileSystem::Location::Enum gep::VirtualFileSystem::locate(const VfsPath& path, ArchiveFile& archiveFile, std::string& diskPath) const
+{
+    bool inArchive = findArchiveFile(path, archiveFile);
+    // only directories mounted after the archive can override it
+    uint32 firstMount = inArchive ? archiveFile.mountIndex + 1 : 0;
+    for(size_t i = m_mounts.size(); m_numDirectories > 0 && i > firstMount; i--)
+    {
+        const Mount& mount = m_mounts[i - 1];
+        if(mount.pArchive != nullptr)
+            continue;
+        diskPath = mount.directory + path.path;
+        if(g_statCache.fileExists(diskPath.c_str()))
+            return Location::Loose;
+    }
+    if(inArchive)
+        return Location::Archive;
+    // normalizing can change what the path refers to, e.g. "link/../x" if link is a symbolic link
+    diskPath = path.original;
+    return g_statCache.fileExists(diskPath.c_str()) ? Location::Loose : Location::None;
+}
+
+bool gep::VirtualFileSystem::exists(const VfsPath& path) const
+{
+    ArchiveFile archiveFile;
+    std::string diskPath;
+    return locate(path, archiveFile, diskPath) != Location::None;
+}
+
+gep::Result gep::VirtualFileSystem::open(const VfsPath& path, VfsFile& file, MappedFile::AccessPattern::Enum accessPattern) const
+{
+    file.close();
+    file.m_pPrefetched = findPrefetched(path);
+    if(file.m_pPrefetched != nullptr)
+    {
+        file.m_data = ArrayPtr<uint8>(file.m_pPrefetched->data(), file.m_pPrefetched->size());
+        file.m_isOpen = true;
+        return SUCCESS;
+    }
+
+    ArchiveFile archiveFile;
+    std::string diskPath;
+    switch(locate(path, archiveFile, diskPath))
+    {
+    case Location::Archive:
+        file.m_pArchive = m_mounts[archiveFile.mountIndex].pArchive;
+        file.m_data = file.m_pArchive->getData(*archiveFile.pEntry);
+        break;
+    case Location::Loose:
+        if(file.m_mappedFile.open(diskPath.c_str(), accessPattern) != SUCCESS)
+            return FAILURE;
+        file.m_data = file.m_mappedFile.getData();
+        break;
+    case Location::None:
+        return FAILURE;
+    }
+    file.m_isOpen = true;
+    return SUCCESS;
+}
+
+bool gep::VirtualFileSystem::findLooseFile(const VfsPath& path, std::string& diskPath) const
+{
+    // reading it from memory is faster than streaming it from the disk again
+    if(findPrefetched(path) != nullptr)
+        return false;
+    ArchiveFile archiveFile;
+    return locate(path, archiveFile, diskPath) == Location::Loose;
+}
+
+gep::Result gep::VirtualFileSystem::openLoose(const VfsPath& path, RawFile& file, const char* pMode, std::string& diskPath) const
+{
+    ArchiveFile archiveFile;
+    if(locate(path, archiveFile, diskPath) != Location::Loose)
+        return FAILURE;
+    file.open(diskPath.c_str(), pMode);
+    return file.isOpen() ? SUCCESS : FAILURE;
+}
+
+std::shared_ptr<std::vector<gep::uint8>> gep::VirtualFileSystem::findPrefetched(const VfsPath& path) const
+{
+    std::lock_guard<std::mutex> lock(m_prefetchedMutex);
+    if(m_prefetched.empty())
+        return nullptr;
+    auto it = m_prefetched.find(path.hash);
+    if(it == m_prefetched.end() || it->second.path != path.path)
+        return nullptr;
+    return it->second.pData;
+}
+
+bool gep::VirtualFileSystem::addPrefetched(const VfsPath& path, std::shared_ptr<std::vector<uint8>> pData)
+{
+    std::lock_guard<std::mutex> lock(m_prefetchedMutex);
+    auto inserted = m_prefetched.insert(std::make_pair(path.hash, PrefetchedFile()));
+    PrefetchedFile& prefetched = inserted.first->second;
+    if(inserted.second)
+    {
+        prefetched.path = path.path;
+        prefetched.pData = std::move(pData);
+        prefetched.refCount = 1;
+        return true;
+    }
+    if(prefetched.path != path.path)
+        return false;
+    // read twice at the same time, the first one is kept
+    prefetched.refCount++;
+    return true;
+}
+
+bool gep::VirtualFileSystem::addPrefetchedReference(const VfsPath& path)
+{
+    std::lock_guard<std::mutex> lock(m_prefetchedMutex);
+    auto it = m_prefetched.find(path.hash);
+    if(it == m_prefetched.end() || it->second.path != path.path)
+        return false;
+    it->second.refCount++;
+    return true;
+}
+
+void gep::VirtualFileSystem::prefetch(AsyncIo& io, const std::vector<std::string>& paths, IoPriority::Enum priority,
+    std::function<void(const std::vector<std::string>& prefetched)> onDone)
+{
+    struct Prefetch
+    {
+        std::mutex mutex;
+        std::vector<std::string> prefetched;
+        size_t numLeft;
+        std::function<void(const std::vector<std::string>&)> onDone;
+
+        void finishOne(const std::string* pPrefetchedPath)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(pPrefetchedPath != nullptr)
+                    prefetched.push_back(*pPrefetchedPath);
+                if(--numLeft > 0)
+                    return;
+            }
+            onDone(prefetched);
+        }
+    };
+
+    auto pPrefetch = std::make_shared<Prefetch>();
+    // one more than there are reads, so that onDone is not called before all of them were issued
+    pPrefetch->numLeft = paths.size() + 1;
+    pPrefetch->onDone = std::move(onDone);
+
+    for(auto& path : paths)
+    {
+        VfsPath vfsPath(path);
+        if(addPrefetchedReference(vfsPath))
+        {
+            pPrefetch->finishOne(&path);
+            continue;
+        }
+
+        IoReadRequest request;
+        ArchiveFile archiveFile;
+        std::string diskPath;
+        switch(locate(vfsPath, archiveFile, diskPath))
+        {
+        case Location::Archive:
+            request.filename = m_mounts[archiveFile.mountIndex].pArchive->getFilename();
+            request.offset = archiveFile.pEntry->offset;
+            request.size = static_cast<size_t>(archiveFile.pEntry->size);
+            break;
+        case Location::Loose:
+            request.filename = diskPath;
+            request.size = static_cast<size_t>(g_statCache.getFileSize(diskPath.c_str()));
+            break;
+        case Location::None:
+            pPrefetch->finishOne(nullptr);
+            continue;
+        }
+
+        auto pData = std::make_shared<std::vector<uint8>>(request.size);
+        request.pDestination = pData->data();
+        request.priority = priority;
+        request.onComplete = [this, pPrefetch, vfsPath, path, pData](IoStatus::Enum status, size_t)
+        {
+            // a different file with the same hash is read from the disk again when it is opened
+            bool isPrefetched = status == IoStatus::Completed && addPrefetched(vfsPath, pData);
+            pPrefetch->finishOne(isPrefetched ? &path : nullptr);
+        };
+        io.read(std::move(request));
+    }
+    pPrefetch->finishOne(nullptr);
+}
+
+void gep::VirtualFileSystem::releasePrefetched(const VfsPath& path)
+{
+    std::lock_guard<std::mutex> lock(m_prefetchedMutex);
+    auto it = m_prefetched.find(path.hash);
+    // the read may have failed, or a different file with the same hash was prefetched
+    if(it == m_prefetched.end() || it->second.path != path.path)
+        return;
+    if(--it->second.refCount == 0)
+        m_prefetched.erase(it);
+}
@@ -0,0 +1,157 @@
+// logdecode.cpp : turns binary log files written by ILogging::setBinaryLogFile back into text
+//
+
+#include "stdafx.h"
+#include "gep/binarylog.h"
+#include "gep/interfaces/logging.h"
+#include <unordered_map>
+#include <ctime>
+
+namespace
+{
+    template <class T>
+    bool readValue(FILE* pFile, T& value)
+    {
+        return fread(&value, sizeof(T), 1, pFile) == 1;
+    }
+
+    bool readBytes(FILE* pFile, std::string& out, gep::uint16 length)
+    {
+        out.resize(length);
+        return length == 0 || fread(&out[0], 1, length, pFile) == length;
+    }
+
+    void printLine(FILE* pOut, gep::int64 timestamp, gep::uint8 channel, const char* pText, size_t length)
+    {
+        std::time_t time = static_cast<std::time_t>(timestamp / 1000000);
+        std::tm localTime;
+#ifdef _WIN32
+        localtime_s(&localTime, &time);
+#else
+        localtime_r(&time, &localTime);
+#endif
+        char timeString[32];
+        strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", &localTime);
+        fprintf(pOut, "%s.%03d: %s: %.*s\n", timeString, static_cast<int>((timestamp / 1000) % 1000),
+            gep::ILogSink::logChannelChar(static_cast<gep::LogChannel>(channel)), static_cast<int>(length), pText);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        printf("Usage: gep_logdecode <binary log file> [output file]\n");
+        return -1;
+    }
+
+    FILE* pIn = fopen(argv[1], "rb");
+    if (pIn == nullptr)
+    {
+        printf("Could not open '%s'\n", argv[1]);
+        return -1;
+    }
+    SCOPE_EXIT { fclose(pIn); });
+
+    char magic[sizeof(gep::BinaryLog::MAGIC)];
+    gep::uint32 header[2];
+    if (fread(magic, sizeof(magic), 1, pIn) != 1 || memcmp(magic, gep::BinaryLog::MAGIC, sizeof(magic)) != 0 ||
+        !readValue(pIn, header))
+    {
+        printf("'%s' is not a binary log file\n", argv[1]);
+        return -1;
+    }
+    if (header[0] != gep::BinaryLog::VERSION)
+    {
+        printf("'%s' has version %u, only version %u is supported\n", argv[1], header[0], gep::BinaryLog::VERSION);
+        return -1;
+    }
+
+    FILE* pOut = stdout;
+    if (argc == 3)
+    {
+        pOut = fopen(argv[2], "w");
+        if (pOut == nullptr)
+        {
+            printf("Could not open '%s' for writing\n", argv[2]);
+            return -1;
+        }
+    }
+    SCOPE_EXIT { if (pOut != stdout) fclose(pOut); });
+
+    std::unordered_map<gep::uint64, std::string> formats;
+    std::string data;
+    char formatted[4096];
+    size_t numRecords = 0;
+
+    for (;;)
+    {
+        gep::BinaryLog::RecordType type;
+        if (!readValue(pIn, type))
+            break; // regular end of the file
+
+        long recordStart = ftell(pIn) - 1;
+        bool complete = false;
+        switch (type)
+        {
+        case gep::BinaryLog::RecordType::formatString:
+            {
+                gep::uint64 formatId;
+                gep::uint16 length;
+                complete = readValue(pIn, formatId) && readValue(pIn, length) && readBytes(pIn, data, length);
+                if (complete)
+                    formats[formatId] = data;
+            }
+            break;
+        case gep::BinaryLog::RecordType::message:
+            {
+                gep::int64 timestamp;
+                gep::uint8 channel;
+                gep::uint64 formatId;
+                gep::uint16 argsSize;
+                complete = readValue(pIn, timestamp) && readValue(pIn, channel) && readValue(pIn, formatId) &&
+                    readValue(pIn, argsSize) && readBytes(pIn, data, argsSize);
+                if (!complete)
+                    break;
+
+                auto format = formats.find(formatId);
+                if (format == formats.end())
+                {
+                    int length = snprintf(formatted, sizeof(formatted), "<unknown format string 0x%llx>", static_cast<unsigned long long>(formatId));
+                    printLine(pOut, timestamp, channel, formatted, length);
+                }
+                else
+                {
+                    size_t length = gep::formatPackedLogArguments(format->second.c_str(), data.data(), data.size(), formatted, sizeof(formatted));
+                    printLine(pOut, timestamp, channel, formatted, length);
+                }
+            }
+            break;
+        case gep::BinaryLog::RecordType::text:
+            {
+                gep::int64 timestamp;
+                gep::uint8 channel;
+                gep::uint16 length;
+                complete = readValue(pIn, timestamp) && readValue(pIn, channel) && readValue(pIn, length) && readBytes(pIn, data, length);
+                if (complete)
+                    printLine(pOut, timestamp, channel, data.data(), data.size());
+            }
+            break;
+        default:
+            printf("Unknown record type %u at offset %ld, stopping\n", static_cast<unsigned int>(type), recordStart);
+            return -1;
+        }
+
+        if (!complete)
+        {
+            // happens when the program died while writing
+            printf("The log ends with an incomplete record at offset %ld\n", recordStart);
+            break;
+        }
+        numRecords++;
+    }
+
+    if (pOut != stdout)
+        printf("Decoded %u records\n", static_cast<unsigned int>(numRecords));
+    return 0;
+}
@@ -0,0 +1,15 @@
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+// disable security warnings
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <cstdio>
+#include <string>
+
+#include "gep/gepmodule.h"
+#include "gep/common.h"
@@ -1,6 +1,10 @@
 #include "stdafx.h"
 
 #include "gep/memory/allocators.h"
+#include "gep/memory/allocationtrace.h"
+#include <unordered_map>
+#include <vector>
+#include <string>
 
 using namespace gep;
 
@@ -412,3 +416,221 @@ GEP_UNITTEST_TEST(Allocator, DoubleEndedStackAllocator)
         deStackAllocator.getBack()->freeMemory(pb0);
     }
 }
+
+namespace
+{
+    /// \brief lets the std containers allocate from an IAllocator, so their real allocation patterns can be traced
+    template <class T>
+    struct ContainerAllocator
+    {
+        typedef T value_type;
+        IAllocator* pAllocator;
+
+        ContainerAllocator(IAllocator* pAllocator) : pAllocator(pAllocator) {}
+        template <class U>
+        ContainerAllocator(const ContainerAllocator<U>& other) : pAllocator(other.pAllocator) {}
+
+        T* allocate(size_t n) { return static_cast<T*>(pAllocator->allocateMemory(n * sizeof(T))); }
+        void deallocate(T* p, size_t) { pAllocator->freeMemory(p); }
+
+        template <class U>
+        bool operator==(const ContainerAllocator<U>& other) const { return pAllocator == other.pAllocator; }
+        template <class U>
+        bool operator!=(const ContainerAllocator<U>& other) const { return pAllocator != other.pAllocator; }
+    };
+
+    typedef std::basic_string<char, std::char_traits<char>, ContainerAllocator<char>> TracedString;
+
+    /// \brief like loading a few models: a file buffer, vertex and index arrays which grow while
+    /// parsing, mesh and node names, all alive until the model is released
+    void modelLoadingWorkload(IAllocator& allocator)
+    {
+        typedef std::vector<float, ContainerAllocator<float>> VertexArray;
+        typedef std::vector<uint32, ContainerAllocator<uint32>> IndexArray;
+        void* pFileData = allocator.allocateMemory(256 * 1024);
+        std::vector<VertexArray, ContainerAllocator<VertexArray>> vertices(&allocator);
+        std::vector<IndexArray, ContainerAllocator<IndexArray>> indices(&allocator);
+        std::vector<TracedString, ContainerAllocator<TracedString>> names(&allocator);
+        for(uint32 mesh = 0; mesh < 24; mesh++)
+        {
+            vertices.emplace_back(ContainerAllocator<float>(&allocator));
+            indices.emplace_back(ContainerAllocator<uint32>(&allocator));
+            uint32 numVertices = 64 << (mesh % 6);
+            for(uint32 i = 0; i < numVertices * 8; i++)
+                vertices.back().push_back(static_cast<float>(i));
+            for(uint32 i = 0; i < numVertices * 3; i++)
+                indices.back().push_back(i % numVertices);
+            names.emplace_back("mesh_with_a_name_longer_than_the_small_string_buffer_", ContainerAllocator<char>(&allocator));
+            names.back() += static_cast<char>('a' + mesh % 26);
+        }
+        allocator.freeMemory(pFileData);
+    }
+
+    /// \brief like the per frame extraction: many small short lived render commands and
+    /// a few growing arrays, everything is released at the end of the frame
+    void frameExtractionWorkload(IAllocator& allocator)
+    {
+        for(uint32 frame = 0; frame < 16; frame++)
+        {
+            std::vector<void*, ContainerAllocator<void*>> commands(&allocator);
+            for(uint32 i = 0; i < 256; i++)
+                commands.push_back(allocator.allocateMemory(32 + (i * 37) % 224));
+            for(void* pCommand : commands)
+                allocator.freeMemory(pCommand);
+        }
+    }
+
+    /// \brief a hashmap with string values which is filled and then churned by erasing and inserting
+    void hashmapChurnWorkload(IAllocator& allocator)
+    {
+        typedef std::pair<const uint32, TracedString> Entry;
+        std::unordered_map<uint32, TracedString, std::hash<uint32>, std::equal_to<uint32>, ContainerAllocator<Entry>>
+            map(16, std::hash<uint32>(), std::equal_to<uint32>(), ContainerAllocator<Entry>(&allocator));
+        uint32 random = 12345;
+        for(uint32 i = 0; i < 4096; i++)
+        {
+            random = random * 1664525 + 1013904223;
+            uint32 key = random % 2048;
+            if(map.find(key) != map.end())
+                map.erase(key);
+            else
+                map.emplace(key, TracedString("a value which needs its own allocation", ContainerAllocator<char>(&allocator)));
+        }
+    }
+
+    AllocationTrace& getWorkloadTrace(void (*workload)(IAllocator&))
+    {
+        static std::unordered_map<void*, AllocationTrace> s_traces;
+        AllocationTrace& trace = s_traces[reinterpret_cast<void*>(workload)];
+        if(trace.getEvents().empty())
+        {
+            TracingAllocator tracingAllocator(&StdAllocator::globalInstance(), &trace);
+            workload(tracingAllocator);
+        }
+        return trace;
+    }
+
+    /// \brief replays the trace without timing every single operation
+    void replayTrace(const AllocationTrace& trace, IAllocator& allocator, std::vector<void*>& slots)
+    {
+        slots.assign(trace.getNumIds(), nullptr);
+        for(auto& event : trace.getEvents())
+        {
+            if(event.size != AllocationTrace::FREE)
+                slots[event.id] = allocator.allocateMemory(event.size);
+            else
+            {
+                allocator.freeMemory(slots[event.id]);
+                slots[event.id] = nullptr;
+            }
+        }
+        for(void* mem : slots)
+            allocator.freeMemory(mem);
+    }
+
+    void benchmarkReplay(BenchmarkState& state, void (*workload)(IAllocator&), bool pool)
+    {
+        const AllocationTrace& trace = getWorkloadTrace(workload);
+        PoolAllocator poolAllocator(trace.getLargestAllocation(), trace.getPeakCount());
+        IAllocator& allocator = pool ? static_cast<IAllocator&>(poolAllocator) : StdAllocator::globalInstance();
+        std::vector<void*> slots;
+        while(state.keepRunning())
+        {
+            replayTrace(trace, allocator, slots);
+            doNotOptimize(slots);
+        }
+    }
+}
+
+GEP_UNITTEST_TEST(Allocator, AllocationTrace)
+{
+    AllocationTrace trace;
+    {
+        TracingAllocator allocator(&SimpleLeakCheckingAllocator::instance(), &trace);
+        void* p0 = allocator.allocateMemory(100);
+        void* p1 = allocator.allocateMemory(50);
+        allocator.freeMemory(p0);
+        void* p2 = allocator.allocateMemory(200);
+        allocator.freeMemory(p1);
+        allocator.freeMemory(p2);
+        allocator.freeMemory(nullptr);
+    }
+    SimpleLeakCheckingAllocator::destroyInstance();
+
+    GEP_ASSERT(trace.getEvents().size() == 6, "every allocation and free has to be recorded", trace.getEvents().size());
+    GEP_ASSERT(trace.getNumIds() == 3, "every allocation needs its own id", trace.getNumIds());
+    GEP_ASSERT(trace.getEvents()[2].id == 0 && trace.getEvents()[2].size == AllocationTrace::FREE, "the first free is wrong");
+    size_t peakEvent = 0;
+    GEP_ASSERT(trace.getPeakBytes(&peakEvent) == 250, "wrong peak", trace.getPeakBytes());
+    GEP_ASSERT(peakEvent == 3, "the peak is reached by the third allocation", peakEvent);
+    GEP_ASSERT(trace.getPeakCount() == 2, "wrong peak count", trace.getPeakCount());
+    GEP_ASSERT(trace.getLargestAllocation() == 200, "wrong largest allocation", trace.getLargestAllocation());
+
+    // save and load
+    GEP_ASSERT(trace.saveToFile("allocationtrace.tmp") == SUCCESS, "saving the trace failed");
+    AllocationTrace loaded;
+    GEP_ASSERT(loaded.loadFromFile("allocationtrace.tmp") == SUCCESS, "loading the trace failed");
+    remove("allocationtrace.tmp");
+    GEP_ASSERT(loaded.getEvents().size() == trace.getEvents().size() && loaded.getNumIds() == trace.getNumIds(), "the loaded trace differs");
+    for(size_t i = 0; i < trace.getEvents().size(); i++)
+    {
+        GEP_ASSERT(loaded.getEvents()[i].id == trace.getEvents()[i].id && loaded.getEvents()[i].size == trace.getEvents()[i].size,
+            "event %d of the loaded trace differs", i);
+    }
+    GEP_ASSERT(loaded.loadFromFile("file_that_does_not_exist.trace") == FAILURE, "loading a missing file has to fail");
+
+    // replay on several threads, every thread gets its own pool
+    std::vector<PoolAllocator*> pools;
+    auto result = AllocationReplay::replay(loaded, 2, [&](uint32) -> IAllocator*
+    {
+        pools.push_back(new PoolAllocator(200, 2));
+        return pools.back();
+    });
+    GEP_ASSERT(result.numThreads == 2 && result.numOperations == 12, "every thread has to replay every event", result.numOperations);
+    GEP_ASSERT(result.numFailedAllocations == 0, "the pools are big enough for the trace");
+    GEP_ASSERT(result.peakBytesUsed == 500, "the peak of both threads is wrong", result.peakBytesUsed);
+    GEP_ASSERT(result.peakBytesReserved >= result.peakBytesUsed, "the pools reserve at least what is used");
+    GEP_ASSERT(result.fragmentation >= 0.0 && result.fragmentation < 1.0, "the fragmentation is a fraction", result.fragmentation);
+    GEP_ASSERT(result.latencyMedian <= result.latency99 && result.latency99 <= result.latency999 && result.latency999 <= result.latencyMax,
+        "the latency percentiles are out of order");
+    for(size_t i = 0; i < pools.size(); i++)
+    {
+        GEP_ASSERT(pools[i]->getNumBytesUsed() == 0, "the replay has to free everything");
+        delete pools[i];
+    }
+
+    // a pool which is too small fails allocations
+    PoolAllocator smallPool(64, 2);
+    result = AllocationReplay::replay(loaded, 1, [&](uint32) -> IAllocator* { return &smallPool; });
+    GEP_ASSERT(result.numFailedAllocations == 2, "the allocations larger than the chunks have to fail", result.numFailedAllocations);
+}
+
+GEP_BENCHMARK(Allocator, ModelLoadingStd)
+{
+    benchmarkReplay(state, &modelLoadingWorkload, false);
+}
+
+GEP_BENCHMARK(Allocator, ModelLoadingPool)
+{
+    benchmarkReplay(state, &modelLoadingWorkload, true);
+}
+
+GEP_BENCHMARK(Allocator, FrameExtractionStd)
+{
+    benchmarkReplay(state, &frameExtractionWorkload, false);
+}
+
+GEP_BENCHMARK(Allocator, FrameExtractionPool)
+{
+    benchmarkReplay(state, &frameExtractionWorkload, true);
+}
+
+GEP_BENCHMARK(Allocator, HashmapChurnStd)
+{
+    benchmarkReplay(state, &hashmapChurnWorkload, false);
+}
+
+GEP_BENCHMARK(Allocator, HashmapChurnPool)
+{
+    benchmarkReplay(state, &hashmapChurnWorkload, true);
+}
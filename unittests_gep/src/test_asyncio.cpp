@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "gep/asyncio.h"
+#include "gep/file.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#ifdef __linux__
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace gep;
+
+namespace
+{
+    const char* testFilename = "asyncio_test.bin";
+    const uint32 testFileSize = 64 * 1024;
+
+    uint8 expectedByte(size_t offset)
+    {
+        return static_cast<uint8>((offset * 7) ^ (offset >> 8));
+    }
+
+    void writeTestFile()
+    {
+        std::vector<uint8> data(testFileSize);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = expectedByte(i);
+        RawFile file(testFilename, "wb");
+        GEP_ASSERT(file.isOpen(), "could not create test file");
+        file.writeArray(data.data(), data.size());
+    }
+
+    bool checkData(const uint8* pData, size_t offset, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            if (pData[i] != expectedByte(offset + i))
+                return false;
+        }
+        return true;
+    }
+
+    /// keeps the single io thread busy in a callback so that the next requests stay queued
+    struct IoThreadBlocker
+    {
+        std::atomic<bool> started;
+        std::atomic<bool> release;
+        uint8 buffer[16];
+
+        IoThreadBlocker(AsyncIo& io) : started(false), release(false)
+        {
+            IoReadRequest request;
+            request.filename = testFilename;
+            request.size = sizeof(buffer);
+            request.pDestination = buffer;
+            request.onComplete = [this](IoStatus::Enum, size_t)
+            {
+                started = true;
+                while (!release)
+                    std::this_thread::yield();
+            };
+            io.read(request);
+            while (!started)
+                std::this_thread::yield();
+        }
+    };
+
+    /// \brief polls the flag, the io service might never set it
+    bool waitFor(const std::atomic<bool>& flag, int timeoutMs)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (!flag && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return flag;
+    }
+
+    void testReads(IoBackend::Enum backend)
+    {
+        writeTestFile();
+        AsyncIo io(3, backend);
+        const size_t numRequests = 200;
+        std::vector<uint8> buffers(numRequests * 100);
+        std::vector<size_t> offsets(numRequests);
+        std::atomic<uint32> numCompleted(0);
+        std::atomic<uint32> numCorrect(0);
+        for (size_t i = 0; i < numRequests; i++)
+        {
+            offsets[i] = (i * 4099) % (testFileSize - 100);
+            uint8* pDestination = &buffers[i * 100];
+            size_t offset = offsets[i];
+            IoReadRequest request;
+            request.filename = testFilename;
+            request.offset = offset;
+            request.size = 100;
+            request.pDestination = pDestination;
+            request.priority = static_cast<IoPriority::Enum>(i % IoPriority::Count);
+            request.onComplete = [&, pDestination, offset](IoStatus::Enum status, size_t bytesRead)
+            {
+                if (status == IoStatus::Completed && bytesRead == 100 && checkData(pDestination, offset, 100))
+                    numCorrect++;
+                numCompleted++;
+            };
+            GEP_ASSERT(io.read(request) != INVALID_IO_REQUEST);
+        }
+        io.waitUntilIdle();
+        GEP_ASSERT(numCompleted == numRequests, "not all callbacks were called", numCompleted.load());
+        GEP_ASSERT(numCorrect == numRequests, "read wrong data", numCorrect.load(), io.getBackendName());
+        remove(testFilename);
+    }
+}
+
+GEP_UNITTEST_GROUP(AsyncIo)
+GEP_UNITTEST_TEST(AsyncIo, ThreadPoolReads)
+{
+    testReads(IoBackend::ThreadPool);
+}
+
+GEP_UNITTEST_TEST(AsyncIo, DefaultBackendReads)
+{
+    testReads(IoBackend::Default);
+}
+
+GEP_UNITTEST_TEST(AsyncIo, PriorityAndCoalescing)
+{
+    writeTestFile();
+    {
+        // io_uring may complete reads submitted together in any order, the pool with one thread does not
+        AsyncIo io(1, IoBackend::ThreadPool);
+        IoThreadBlocker blocker(io);
+
+        // 16 adjacent reads, queued in reverse order at low priority, should end up as a single read
+        std::vector<uint8> buffer(16 * 256);
+        std::vector<int> completionOrder;
+        std::mutex orderMutex;
+        for (int i = 15; i >= 0; i--)
+        {
+            IoReadRequest request;
+            request.filename = testFilename;
+            request.offset = 1024 + i * 256;
+            request.size = 256;
+            request.pDestination = &buffer[i * 256];
+            request.priority = IoPriority::Background;
+            request.onComplete = [&, i](IoStatus::Enum status, size_t)
+            {
+                GEP_ASSERT(status == IoStatus::Completed);
+                std::lock_guard<std::mutex> lock(orderMutex);
+                completionOrder.push_back(i);
+            };
+            io.read(request);
+        }
+
+        // a critical read of a different part of the file has to be serviced first
+        uint8 critical[64];
+        IoReadRequest request;
+        request.filename = testFilename;
+        request.offset = 32 * 1024;
+        request.size = sizeof(critical);
+        request.pDestination = critical;
+        request.priority = IoPriority::Critical;
+        request.onComplete = [&](IoStatus::Enum status, size_t)
+        {
+            GEP_ASSERT(status == IoStatus::Completed);
+            std::lock_guard<std::mutex> lock(orderMutex);
+            completionOrder.push_back(-1);
+        };
+        io.read(request);
+
+        blocker.release = true;
+        io.waitUntilIdle();
+
+        GEP_ASSERT(completionOrder.size() == 17);
+        GEP_ASSERT(completionOrder[0] == -1, "critical read was not serviced first");
+        for (int i = 0; i < 16; i++)
+        {
+            GEP_ASSERT(completionOrder[i + 1] == i, "coalesced requests complete in file order");
+        }
+        GEP_ASSERT(checkData(buffer.data(), 1024, buffer.size()), "coalesced read scattered wrong data");
+        GEP_ASSERT(checkData(critical, 32 * 1024, sizeof(critical)));
+        // blocker + critical read + one coalesced read
+        GEP_ASSERT(io.getNumReadsIssued() == 3, "reads were not coalesced", io.getNumReadsIssued());
+        GEP_ASSERT(io.getNumRequestsCompleted() == 18);
+    }
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(AsyncIo, Cancel)
+{
+    writeTestFile();
+    {
+        AsyncIo io(1);
+        IoThreadBlocker blocker(io);
+
+        uint8 buffer[2][128];
+        IoStatus::Enum statuses[2] = { IoStatus::Failed, IoStatus::Failed };
+        IoRequestId ids[2];
+        for (int i = 0; i < 2; i++)
+        {
+            IoReadRequest request;
+            request.filename = testFilename;
+            request.offset = i * 4096;
+            request.size = 128;
+            request.pDestination = buffer[i];
+            request.onComplete = [&statuses, i](IoStatus::Enum status, size_t) { statuses[i] = status; };
+            ids[i] = io.read(request);
+        }
+
+        GEP_ASSERT(io.cancel(ids[0]), "pending request could not be cancelled");
+        GEP_ASSERT(statuses[0] == IoStatus::Cancelled, "callback of cancelled request was not called");
+        GEP_ASSERT(!io.cancel(ids[0]), "request was cancelled twice");
+
+        blocker.release = true;
+        io.waitUntilIdle();
+        GEP_ASSERT(statuses[1] == IoStatus::Completed);
+        GEP_ASSERT(checkData(buffer[1], 4096, 128));
+        GEP_ASSERT(!io.cancel(ids[1]), "finished request can not be cancelled");
+    }
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(AsyncIo, Failures)
+{
+    writeTestFile();
+    {
+        AsyncIo io;
+        uint8 buffer[256];
+        IoStatus::Enum missingStatus = IoStatus::Completed;
+        IoStatus::Enum shortStatus = IoStatus::Completed;
+        size_t shortBytesRead = 0;
+
+        IoReadRequest request;
+        request.filename = "this file does not exist.bin";
+        request.size = sizeof(buffer);
+        request.pDestination = buffer;
+        request.onComplete = [&](IoStatus::Enum status, size_t) { missingStatus = status; };
+        io.read(request);
+
+        request.filename = testFilename;
+        request.offset = testFileSize - 100;
+        request.onComplete = [&](IoStatus::Enum status, size_t bytesRead) { shortStatus = status; shortBytesRead = bytesRead; };
+        io.read(request);
+
+        io.waitUntilIdle();
+        GEP_ASSERT(missingStatus == IoStatus::Failed);
+        GEP_ASSERT(shortStatus == IoStatus::Failed, "read past the end of the file did not fail");
+        GEP_ASSERT(shortBytesRead == 100, "bytes before the end of the file were not reported", shortBytesRead);
+        GEP_ASSERT(checkData(buffer, testFileSize - 100, 100));
+    }
+    remove(testFilename);
+}
+
+#ifdef __linux__
+GEP_UNITTEST_TEST(AsyncIo, IoUringPipe)
+{
+    // a pipe delivers what was written so far and blocks while it is empty, unlike a regular file
+    const char* pipeFilename = "asyncio_test.fifo";
+    remove(pipeFilename);
+    GEP_ASSERT(mkfifo(pipeFilename, 0600) == 0, "could not create the pipe");
+    writeTestFile();
+    // opened for writing and reading, so that opening it in the io service does not wait for a writer
+    int pipe = open(pipeFilename, O_RDWR);
+    SCOPE_EXIT{ close(pipe); remove(pipeFilename); remove(testFilename); });
+    GEP_ASSERT(pipe >= 0);
+
+    AsyncIo io(1, IoBackend::IoUring);
+    if (strcmp(io.getBackendName(), "io_uring") != 0)
+        return; // the kernel refuses io_uring, there is nothing to test
+
+    uint8 piped[100];
+    std::atomic<bool> pipedDone(false);
+    IoStatus::Enum pipedStatus = IoStatus::Failed;
+    size_t pipedBytesRead = 0;
+    IoReadRequest request;
+    request.filename = pipeFilename;
+    request.size = sizeof(piped);
+    request.pDestination = piped;
+    request.priority = IoPriority::Background;
+    request.onComplete = [&](IoStatus::Enum status, size_t bytesRead)
+    {
+        pipedStatus = status;
+        pipedBytesRead = bytesRead;
+        pipedDone = true;
+    };
+    io.read(request);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // the pending read of the pipe must not hold back a new request
+    uint8 critical[64];
+    std::atomic<bool> criticalDone(false);
+    request.filename = testFilename;
+    request.size = sizeof(critical);
+    request.pDestination = critical;
+    request.priority = IoPriority::Critical;
+    request.onComplete = [&](IoStatus::Enum status, size_t) { criticalDone = (status == IoStatus::Completed); };
+    io.read(request);
+    bool isCriticalDone = waitFor(criticalDone, 2000);
+    if (!isCriticalDone)
+    {
+        // let the pipe read finish so that the io service can shut down
+        uint8 filler[sizeof(piped)] = {};
+        GEP_ASSERT(write(pipe, filler, sizeof(filler)) == sizeof(filler));
+    }
+    GEP_ASSERT(isCriticalDone, "the critical read waited for the pipe");
+    GEP_ASSERT(checkData(critical, 0, sizeof(critical)));
+
+    // a short read is continued instead of ending the request
+    std::vector<uint8> data(sizeof(piped));
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = expectedByte(i);
+    GEP_ASSERT(write(pipe, data.data(), 10) == 10);
+    GEP_ASSERT(!waitFor(pipedDone, 50), "a short read ended the request", pipedBytesRead);
+    GEP_ASSERT(write(pipe, data.data() + 10, data.size() - 10) == static_cast<ssize_t>(data.size() - 10));
+    io.waitUntilIdle();
+    GEP_ASSERT(pipedStatus == IoStatus::Completed && pipedBytesRead == sizeof(piped), "the pipe was not read completely", pipedBytesRead);
+    GEP_ASSERT(checkData(piped, 0, sizeof(piped)));
+}
+#endif
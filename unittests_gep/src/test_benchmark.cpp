@@ -0,0 +1,153 @@
+#include "stdafx.h"
+#include "gep/file.h"
+#include "gep/timer.h"
+#include <cmath>
+
+using namespace gep;
+
+namespace
+{
+    /// not registered anywhere, runBenchmark is called on it directly
+    class SumBenchmark : public IBenchmark
+    {
+    public:
+        uint64 totalIterations;
+
+        SumBenchmark() : totalIterations(0) {}
+
+        virtual void Run(BenchmarkState& state) override
+        {
+            totalIterations += state.getIterations();
+            state.setCounter("calls", 0.0);
+            state.setCounter("calls", 1.0);
+            uint32 sum = 0;
+            while(state.keepRunning())
+            {
+                for(uint32 i = 0; i < 100; i++)
+                {
+                    sum += i;
+                    doNotOptimize(sum);
+                }
+            }
+        }
+
+        virtual const char* getName() const override { return "Sum"; }
+    };
+
+    /// does its work without the keepRunning loop
+    class WholeRunBenchmark : public IBenchmark
+    {
+    public:
+        uint32 numRuns;
+
+        WholeRunBenchmark() : numRuns(0) {}
+
+        virtual void Run(BenchmarkState& state) override
+        {
+            GEP_UNUSED(state);
+            numRuns++;
+            uint64 deadline = Timer::getCurrentTicks() + Timer::getTicksPerSecond() / 2000;
+            while(Timer::getCurrentTicks() < deadline) {}
+        }
+
+        virtual const char* getName() const override { return "WholeRun"; }
+    };
+}
+
+GEP_UNITTEST_GROUP(Benchmark)
+GEP_UNITTEST_TEST(Benchmark, Calibration)
+{
+    BenchmarkSettings settings;
+    settings.minSampleTime = 0.002f;
+    settings.numWarmupSamples = 1;
+    settings.numSamples = 5;
+
+    SumBenchmark benchmark;
+    BenchmarkResult result = UnittestManager::runBenchmark(benchmark, settings);
+    GEP_ASSERT(result.name == "Sum");
+    GEP_ASSERT(result.numSamples == 5);
+    GEP_ASSERT(result.iterations > 1, "iterations were not calibrated", result.iterations);
+    GEP_ASSERT(result.median * result.iterations > settings.minSampleTime * 0.5, "samples are too short", result.median * result.iterations);
+    GEP_ASSERT(result.min > 0.0 && result.min <= result.median && result.mad <= result.median);
+    // calibration, warmup and the samples all ran
+    GEP_ASSERT(benchmark.totalIterations >= result.iterations * 6, "not all samples were run", benchmark.totalIterations);
+    GEP_ASSERT(result.counters.size() == 1 && result.counters[0].first == "calls", "the counters of the last sample are missing");
+}
+
+GEP_UNITTEST_TEST(Benchmark, Limits)
+{
+    BenchmarkSettings settings;
+    settings.minSampleTime = 0.01f;
+    settings.numWarmupSamples = 1;
+    settings.numSamples = 5;
+
+    // the iterations of a benchmark without a loop are not grown, its samples are single runs
+    WholeRunBenchmark wholeRun;
+    BenchmarkResult result = UnittestManager::runBenchmark(wholeRun, settings);
+    GEP_ASSERT(result.iterations == 1, "a benchmark without a loop was calibrated", result.iterations);
+    GEP_ASSERT(wholeRun.numRuns == 1 + 1 + 5, "calibration, warmup and samples should run once each", wholeRun.numRuns);
+    GEP_ASSERT(result.median >= 0.0004, "the time of the whole run is missing", result.median);
+
+    // the calibration stops growing at the limit, even if a sample never gets long enough
+    settings.minSampleTime = 3600.0f;
+    settings.maxIterations = 5000;
+    SumBenchmark sum;
+    result = UnittestManager::runBenchmark(sum, settings);
+    GEP_ASSERT(result.iterations == settings.maxIterations, "the iterations were not capped", result.iterations);
+    GEP_ASSERT(result.median > 0.0);
+}
+
+GEP_UNITTEST_TEST(Benchmark, Json)
+{
+    std::vector<BenchmarkResult> results(2);
+    results[0].group = "Group";
+    results[0].name = "First \"quoted\"";
+    results[0].iterations = 1000;
+    results[0].numSamples = 15;
+    results[0].median = 12.5e-9;
+    results[0].mad = 0.25e-9;
+    results[0].min = 12e-9;
+    results[0].mean = 13e-9;
+    results[1].group = "Group";
+    results[1].name = "Second";
+    results[1].median = 1.5e-3;
+    results[1].counters.push_back(std::make_pair(std::string("collisions"), 3.0));
+    results[1].counters.push_back(std::make_pair(std::string("bias"), 0.015625));
+
+    GEP_ASSERT(UnittestManager::writeBenchmarkJson(results, "benchmark_test.json") == SUCCESS);
+    std::vector<BenchmarkResult> loaded;
+    GEP_ASSERT(UnittestManager::readBenchmarkJson("benchmark_test.json", loaded) == SUCCESS);
+    GEP_ASSERT(loaded.size() == 2, "wrong number of results", loaded.size());
+    GEP_ASSERT(loaded[0].group == "Group" && loaded[0].name == "First \"quoted\"");
+    GEP_ASSERT(loaded[0].iterations == 1000 && loaded[0].numSamples == 15);
+    GEP_ASSERT(std::fabs(loaded[0].median - 12.5e-9) < 1e-12 && std::fabs(loaded[0].mad - 0.25e-9) < 1e-12);
+    GEP_ASSERT(std::fabs(loaded[0].min - 12e-9) < 1e-12 && std::fabs(loaded[0].mean - 13e-9) < 1e-12);
+    GEP_ASSERT(loaded[1].name == "Second" && std::fabs(loaded[1].median - 1.5e-3) < 1e-9);
+    GEP_ASSERT(loaded[0].counters.empty(), "counters appeared from nowhere");
+    GEP_ASSERT(loaded[1].counters.size() == 2, "wrong number of counters", loaded[1].counters.size());
+    GEP_ASSERT(loaded[1].counters[0].first == "collisions" && loaded[1].counters[0].second == 3.0);
+    GEP_ASSERT(loaded[1].counters[1].first == "bias" && loaded[1].counters[1].second == 0.015625);
+
+    {
+        RawFile file("benchmark_test.json", "w");
+        fprintf(file.m_pHandle, "{\"benchmarks\": [{\"name\": ");
+    }
+    GEP_ASSERT(UnittestManager::readBenchmarkJson("benchmark_test.json", loaded) == FAILURE, "truncated file accepted");
+    remove("benchmark_test.json");
+}
+
+GEP_UNITTEST_TEST(Benchmark, PauseTiming)
+{
+    BenchmarkState notRun(1);
+    GEP_ASSERT(notRun.getElapsedSeconds() < 0.0, "a loop which never ran has a time");
+
+    BenchmarkState state(2);
+    while(state.keepRunning())
+    {
+        state.pauseTiming();
+        uint64 deadline = Timer::getCurrentTicks() + Timer::getTicksPerSecond() / 50;
+        while(Timer::getCurrentTicks() < deadline) {}
+        state.resumeTiming();
+    }
+    GEP_ASSERT(state.getElapsedSeconds() >= 0.0 && state.getElapsedSeconds() < 0.01, "the paused time was measured", state.getElapsedSeconds());
+}
@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include "gep/checksum.h"
+#include <vector>
+
+using namespace gep;
+
+namespace
+{
+    /// bit by bit, as in the definition of the CRC
+    uint32 referenceCrc32c(const uint8* pData, size_t size)
+    {
+        uint32 crc = 0xFFFFFFFF;
+        for(size_t i = 0; i < size; i++)
+        {
+            crc ^= pData[i];
+            for(int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+        }
+        return ~crc;
+    }
+}
+
+GEP_UNITTEST_GROUP(Checksum)
+GEP_UNITTEST_TEST(Checksum, Crc32c)
+{
+    // the check value of CRC32C
+    GEP_ASSERT(crc32c("123456789", 9) == 0xE3069283, "wrong checksum", crc32c("123456789", 9));
+    GEP_ASSERT(crc32c(nullptr, 0) == 0);
+
+    std::vector<uint8> data(1000);
+    for(size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8>(i * 7 + (i >> 3));
+    // every alignment and length around the word size
+    for(size_t start = 0; start < 9; start++)
+    {
+        for(size_t size = 0; size < 40; size++)
+        {
+            GEP_ASSERT(crc32c(&data[start], size) == referenceCrc32c(&data[start], size), "wrong checksum", start, size);
+        }
+    }
+
+    uint32 whole = crc32c(data.data(), data.size());
+    GEP_ASSERT(whole == referenceCrc32c(data.data(), data.size()));
+    uint32 pieces = crc32c(data.data(), 333);
+    pieces = crc32c(&data[333], data.size() - 333, pieces);
+    GEP_ASSERT(pieces == whole, "checksums in pieces differ", pieces, whole);
+}
+
+GEP_BENCHMARK(Checksum, Crc32c1MB)
+{
+    std::vector<uint8> data(1024 * 1024, 3);
+    while(state.keepRunning())
+    {
+        doNotOptimize(crc32c(data.data(), data.size()));
+    }
+    state.setCounter("hardware", hasHardwareCrc32c() ? 1.0 : 0.0);
+}
@@ -0,0 +1,761 @@
+#include "stdafx.h"
+#include "gep/chunkfile.h"
+#include "gep/file.h"
+#include "gep/checksum.h"
+#include "gep/threading/jobqueue.h"
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace gep;
+
+namespace
+{
+    const char* testFilename = "chunkfile_test.thTest";
+    const uint32 numValues = 1000;
+
+    float expectedValue(uint32 index)
+    {
+        return index * 0.5f - 100.0f;
+    }
+
+    void writeTestFile()
+    {
+        std::vector<float> values(numValues);
+        for(uint32 i = 0; i < numValues; i++)
+            values[i] = expectedValue(i);
+
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 2);
+        file.startWriteChunk("Data");
+        file.write<uint32>(42);
+        file.writeArrayWithLength<float, uint32>(ArrayPtr<float>(values.data(), values.size()));
+        file.endWriteChunk();
+        file.startWriteChunk("Skipped");
+        file.write<uint64>(7);
+        file.endWriteChunk();
+        file.endWriting();
+    }
+
+    void readTestFile(Chunkfile::Operation operation, IAllocator* pAllocator)
+    {
+        Chunkfile file(testFilename, operation);
+        GEP_ASSERT(file.isOpen(), "could not open the test file");
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.getFileVersion() == 2, "wrong version", file.getFileVersion());
+
+        GEP_ASSERT(file.startReadChunk() == SUCCESS);
+        GEP_ASSERT(file.getCurrentChunkName() == "Data", "wrong chunk", file.getCurrentChunkName());
+        uint32 value = 0;
+        GEP_ASSERT(file.read(value) == sizeof(uint32) && value == 42, "wrong value", value);
+        auto values = file.readAndAllocateArray<float, uint32>(pAllocator);
+        GEP_ASSERT(values.length() == numValues, "wrong array length", values.length());
+        for(uint32 i = 0; i < numValues; i++)
+            GEP_ASSERT(values[i] == expectedValue(i), "wrong array value", i, values[i]);
+        GEP_ASSERT(!file.currentChunkHasMoreData());
+        file.endReadChunk();
+        pAllocator->freeMemory(values.getPtr());
+
+        GEP_ASSERT(file.startReadChunk() == SUCCESS);
+        GEP_ASSERT(file.getCurrentChunkName() == "Skipped");
+        file.skipCurrentChunk();
+        file.endReading();
+    }
+}
+
+GEP_UNITTEST_GROUP(Chunkfile)
+GEP_UNITTEST_TEST(Chunkfile, ReadAndMapped)
+{
+    writeTestFile();
+    readTestFile(Chunkfile::Operation::read, &g_stdAllocator);
+    readTestFile(Chunkfile::Operation::mapped, &g_stdAllocator);
+
+    // allocated arrays are copies, which outlive the mapping
+    ArrayPtr<float> values;
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS && file.startReadChunk() == SUCCESS);
+        uint32 value = 0;
+        file.read(value);
+        values = file.readAndAllocateArray<float, uint32>(&g_stdAllocator);
+        file.endReadChunk();
+        file.startReadChunk();
+        file.skipCurrentChunk();
+        file.endReading();
+    }
+    GEP_ASSERT(values.length() == numValues && values[numValues - 1] == expectedValue(numValues - 1), "the array was not copied");
+    g_stdAllocator.freeMemory(values.getPtr());
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(Chunkfile, MappedErrors)
+{
+    {
+        Chunkfile file("chunkfile_does_not_exist.thTest", Chunkfile::Operation::mapped);
+        GEP_ASSERT(!file.isOpen());
+        GEP_ASSERT(file.startReading("thTest") == FAILURE, "read from a missing file");
+    }
+
+    // the header chunk is cut off in the middle of its length
+    writeTestFile();
+    {
+        MappedFile original;
+        GEP_ASSERT(original.open(testFilename) == SUCCESS);
+        RawFile truncated("chunkfile_truncated.thTest", "wb");
+        truncated.writeArray(original.getData().getPtr(), 10);
+    }
+    {
+        Chunkfile file("chunkfile_truncated.thTest", Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.isOpen());
+        GEP_ASSERT(file.startReading("thTest") == FAILURE, "read from a truncated file");
+    }
+    remove("chunkfile_truncated.thTest");
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(Chunkfile, MappedFile)
+{
+    {
+        RawFile file(testFilename, "wb");
+        for(uint32 i = 0; i < numValues; i++)
+            file.write(i);
+    }
+    {
+        MappedFile file;
+        GEP_ASSERT(file.open(testFilename, MappedFile::AccessPattern::Random) == SUCCESS);
+        GEP_ASSERT(file.isOpen() && file.getSize() == numValues * sizeof(uint32), "wrong size", file.getSize());
+        auto data = file.getData();
+        for(uint32 i = 0; i < numValues; i++)
+        {
+            uint32 value;
+            memcpy(&value, data.getPtr() + i * sizeof(uint32), sizeof(uint32));
+            GEP_ASSERT(value == i, "wrong data", i, value);
+        }
+        file.close();
+        GEP_ASSERT(!file.isOpen() && file.getData().length() == 0);
+    }
+    {
+        RawFile file(testFilename, "wb");
+    }
+    {
+        MappedFile file;
+        GEP_ASSERT(file.open(testFilename) == SUCCESS, "empty files can be opened");
+        GEP_ASSERT(file.getSize() == 0 && file.getData().getPtr() == nullptr);
+    }
+    remove(testFilename);
+}
+
+namespace
+{
+    /// a model like file, every mesh chunk contains the same nested chunks
+    void writeIndexedFile(bool writeIndex)
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1, writeIndex);
+        for(uint32 mesh = 0; mesh < 3; mesh++)
+        {
+            file.startWriteChunk("Mesh");
+            file.write(mesh);
+            file.startWriteChunk("Vertices");
+            for(uint32 i = 0; i < 100; i++)
+                file.write(mesh * 1000 + i);
+            file.endWriteChunk();
+            file.endWriteChunk();
+        }
+        file.startWriteChunk("Bones");
+        file.write<uint16>(12);
+        file.endWriteChunk();
+        file.endWriting();
+    }
+
+    void readIndexedFile(Chunkfile::Operation operation)
+    {
+        Chunkfile file(testFilename, operation);
+        auto pIndex = file.getChunkIndex();
+        GEP_ASSERT(pIndex != nullptr, "the chunk index is missing");
+        // the file type chunk, 3 meshes with their vertices and the bones
+        GEP_ASSERT(pIndex->size() == 8, "wrong number of chunks", pIndex->size());
+        GEP_ASSERT((*pIndex)[0].path == "thTest" && (*pIndex)[2].path == "thTest/Mesh/Vertices");
+
+        GEP_ASSERT(file.findChunk("thTest/Mesh", 3) == nullptr, "there are only 3 meshes");
+        GEP_ASSERT(file.findChunk("thTest/Vertices") == nullptr);
+        auto pVertices = file.findChunk("thTest/Mesh/Vertices", 2);
+        GEP_ASSERT(pVertices != nullptr && pVertices->length == 100 * sizeof(uint32), "wrong vertices chunk");
+
+        GEP_ASSERT(file.openChunkAt(*pVertices) == SUCCESS);
+        GEP_ASSERT(file.getCurrentChunkName() == "Vertices");
+        std::vector<uint32> vertices(100);
+        GEP_ASSERT(file.readArray(ArrayPtr<uint32>(vertices.data(), vertices.size())) == 100 * sizeof(uint32));
+        GEP_ASSERT(vertices[0] == 2000 && vertices[99] == 2099, "read the wrong mesh", vertices[0]);
+        file.endReadChunk();
+        GEP_ASSERT(pVertices->checksum == crc32c(vertices.data(), 100 * sizeof(uint32)), "wrong checksum");
+
+        // the nested chunks do not count for the checksum of a mesh
+        auto pMesh = file.findChunk("thTest/Mesh", 1);
+        uint32 meshNumber = 1;
+        GEP_ASSERT(pMesh != nullptr && pMesh->checksum == crc32c(&meshNumber, sizeof(meshNumber)), "wrong mesh checksum");
+
+        auto pBones = file.findChunk("thTest/Bones");
+        GEP_ASSERT(pBones != nullptr && file.openChunkAt(*pBones) == SUCCESS);
+        uint16 numBones = 0;
+        GEP_ASSERT(file.read(numBones) == sizeof(numBones) && numBones == 12, "wrong bones", numBones);
+        file.endReadChunk();
+    }
+}
+
+GEP_UNITTEST_TEST(Chunkfile, ChunkIndex)
+{
+    writeIndexedFile(true);
+    readIndexedFile(Chunkfile::Operation::read);
+    readIndexedFile(Chunkfile::Operation::mapped);
+    {
+        // the index does not disturb reading from the start
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.skipCurrentChunk();
+        file.skipCurrentChunk();
+    }
+
+    writeIndexedFile(false);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.getChunkIndex() == nullptr && file.findChunk("thTest/Bones") == nullptr, "found an index which was not written");
+    }
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(Chunkfile, LargeChunks)
+{
+    // more than a write block, the lengths of the outer chunks are patched in the file instead of the buffer
+    const uint32 numLargeValues = 2 * 1024 * 1024;
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("Outer");
+        file.startWriteChunk("Large");
+        for(uint32 i = 0; i < numLargeValues; i++)
+            file.write(i);
+        file.endWriteChunk();
+        file.startWriteChunk("Small");
+        file.write<uint8>(5);
+        file.endWriteChunk();
+        file.endWriteChunk();
+        file.endWriting();
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Outer");
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Large");
+        auto values = file.readArrayView<uint32>(numLargeValues);
+        GEP_ASSERT(values.length() == numLargeValues, "the large chunk is too short");
+        uint32 last;
+        memcpy(&last, &values[numLargeValues - 1], sizeof(last));
+        GEP_ASSERT(last == numLargeValues - 1, "wrong data", last);
+        file.endReadChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Small");
+        uint8 small = 0;
+        GEP_ASSERT(file.read(small) == 1 && small == 5);
+        file.endReadChunk();
+        file.endReadChunk();
+        file.endReading();
+
+        auto pSmall = file.findChunk("thTest/Outer/Small");
+        GEP_ASSERT(pSmall != nullptr && pSmall->length == 1, "the index is wrong after a flush");
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS, "the checksums are wrong after a flush");
+    }
+    remove(testFilename);
+}
+
+namespace
+{
+    const uint32 numCompressedValues = 50000;
+
+    void writeCompressedFile()
+    {
+        std::vector<float> values(numCompressedValues);
+        for(uint32 i = 0; i < numCompressedValues; i++)
+            values[i] = expectedValue(i % 100);
+        std::vector<uint32> noise(1000);
+        uint32 state = 1;
+        for(auto& value : noise)
+            value = state = state * 1664525u + 1013904223u;
+
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("Mesh");
+        file.startWriteChunk("Vertices", ChunkCompression::Lz4, sizeof(float));
+        file.writeArray(ArrayPtr<float>(values.data(), values.size()));
+        file.endWriteChunk();
+        file.startWriteChunk("Counted", ChunkCompression::Lz4);
+        file.writeArrayWithLength<float, uint32>(ArrayPtr<float>(values.data(), values.size()));
+        file.endWriteChunk();
+        // does not get smaller and is stored as it is
+        file.startWriteChunk("Noise", ChunkCompression::Lz4);
+        file.writeArray(ArrayPtr<uint32>(noise.data(), noise.size()));
+        file.endWriteChunk();
+        file.endWriteChunk();
+        file.startWriteChunk("After");
+        file.write<uint32>(77);
+        file.endWriteChunk();
+        file.endWriting();
+    }
+
+    void readCompressedFile(Chunkfile::Operation operation, JobQueue* pJobQueue)
+    {
+        Chunkfile file(testFilename, operation);
+        if(pJobQueue != nullptr)
+            GEP_ASSERT(file.decompressChunksInParallel(*pJobQueue) == SUCCESS);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+
+        // the whole chunk at once is decompressed into the destination
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Vertices");
+        std::vector<float> values(numCompressedValues);
+        GEP_ASSERT(file.readArray(ArrayPtr<float>(values.data(), values.size())) == numCompressedValues * sizeof(float));
+        for(uint32 i = 0; i < numCompressedValues; i++)
+            GEP_ASSERT(values[i] == expectedValue(i % 100), "wrong decompressed value", i, values[i]);
+        file.endReadChunk();
+
+        // in pieces, or as a view into the decompressed chunk in mapped operation
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Counted");
+        ArrayPtr<float> counted;
+        if(operation == Chunkfile::Operation::mapped)
+        {
+            uint32 length = 0;
+            file.read(length);
+            counted = file.readArrayView<float>(length);
+        }
+        else
+            counted = file.readAndAllocateArray<float, uint32>(&g_stdAllocator);
+        GEP_ASSERT(counted.length() == numCompressedValues, "wrong array length", counted.length());
+        GEP_ASSERT(counted[1] == expectedValue(1) && counted[numCompressedValues - 1] == expectedValue((numCompressedValues - 1) % 100));
+        GEP_ASSERT(!file.currentChunkHasMoreData());
+        file.endReadChunk();
+        if(operation != Chunkfile::Operation::mapped)
+            g_stdAllocator.freeMemory(counted.getPtr());
+
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Noise");
+        file.skipRead(sizeof(uint32));
+        file.skipCurrentChunk();
+        // the mesh
+        file.endReadChunk();
+
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "After");
+        uint32 value = 0;
+        GEP_ASSERT(file.read(value) == sizeof(value) && value == 77, "wrong data after the compressed chunks", value);
+        file.endReadChunk();
+        file.endReading();
+        // the view stays valid after the chunk ended
+        if(operation == Chunkfile::Operation::mapped)
+            GEP_ASSERT(counted[2] == expectedValue(2));
+    }
+}
+
+GEP_UNITTEST_TEST(Chunkfile, CompressedChunks)
+{
+    writeCompressedFile();
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        auto pVertices = file.findChunk("thTest/Mesh/Vertices");
+        GEP_ASSERT(pVertices != nullptr && pVertices->length < numCompressedValues * sizeof(float) / 4,
+            "the vertices were not compressed", pVertices->length);
+        auto pNoise = file.findChunk("thTest/Mesh/Noise");
+        GEP_ASSERT(pNoise != nullptr && pNoise->length == 1000 * sizeof(uint32), "incompressible data has to be stored as it is");
+
+        GEP_ASSERT(file.openChunkAt(*pVertices) == SUCCESS);
+        GEP_ASSERT(file.getCurrentChunkName() == "Vertices");
+        float first = 0.0f;
+        GEP_ASSERT(file.read(first) == sizeof(first) && first == expectedValue(0), "wrong first value", first);
+        file.skipCurrentChunk();
+    }
+    readCompressedFile(Chunkfile::Operation::read, nullptr);
+    readCompressedFile(Chunkfile::Operation::mapped, nullptr);
+    remove(testFilename);
+}
+
+GEP_UNITTEST_TEST(Chunkfile, ParallelDecompression)
+{
+    writeCompressedFile();
+    JobQueue jobQueue(4);
+    readCompressedFile(Chunkfile::Operation::read, &jobQueue);
+    readCompressedFile(Chunkfile::Operation::mapped, &jobQueue);
+    remove(testFilename);
+}
+
+namespace
+{
+    /// flips a bit of the file
+    void corruptFile(uint64 offset)
+    {
+        std::vector<uint8> data;
+        {
+            MappedFile file;
+            GEP_ASSERT(file.open(testFilename) == SUCCESS);
+            data.assign(file.getData().getPtr(), file.getData().getPtr() + file.getData().length());
+        }
+        data[static_cast<size_t>(offset)] ^= 0x10;
+        RawFile file(testFilename, "wb");
+        file.writeArray(data.data(), data.size());
+    }
+}
+
+GEP_UNITTEST_TEST(Chunkfile, Checksums)
+{
+    JobQueue jobQueue(2);
+    writeIndexedFile(true);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS);
+        GEP_ASSERT(file.verifyChecksums(&jobQueue) == SUCCESS);
+    }
+
+    // the last value of the second mesh's vertices
+    uint64 corruptOffset;
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        auto pVertices = file.findChunk("thTest/Mesh/Vertices", 1);
+        GEP_ASSERT(pVertices != nullptr);
+        corruptOffset = pVertices->offset + 1 + strlen("Vertices") + sizeof(uint32) + pVertices->length - 1;
+    }
+    corruptFile(corruptOffset);
+    for(auto operation : { Chunkfile::Operation::read, Chunkfile::Operation::mapped })
+    {
+        Chunkfile file(testFilename, operation);
+        GEP_ASSERT(file.verifyChecksums() == FAILURE, "the corruption was not found");
+        GEP_ASSERT(file.verifyChecksums(&jobQueue) == FAILURE, "the corruption was not found on the job queue");
+        GEP_ASSERT(file.verifyChunk(*file.findChunk("thTest/Mesh/Vertices", 1)) == FAILURE);
+        // the parent does not contain the data of its nested chunks in its checksum
+        GEP_ASSERT(file.verifyChunk(*file.findChunk("thTest/Mesh", 1)) == SUCCESS);
+        GEP_ASSERT(file.verifyChunk(*file.findChunk("thTest/Mesh/Vertices", 0)) == SUCCESS);
+
+        // verified when read
+        file.setVerifyChecksums(true);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.skipCurrentChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.skipRead(sizeof(uint32));
+        GEP_ASSERT(file.startReadChunk() == FAILURE, "read a corrupted chunk");
+        file.skipCurrentChunk();
+        file.skipCurrentChunk();
+        GEP_ASSERT(file.openChunkAt(*file.findChunk("thTest/Mesh/Vertices", 1)) == FAILURE);
+        GEP_ASSERT(file.openChunkAt(*file.findChunk("thTest/Bones")) == SUCCESS);
+        file.skipCurrentChunk();
+    }
+
+    // compressed chunks are checked as they are stored
+    writeCompressedFile();
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS);
+        auto pVertices = file.findChunk("thTest/Mesh/Vertices");
+        corruptOffset = pVertices->offset + 1 + strlen("Vertices") + sizeof(uint32) + pVertices->length / 2;
+    }
+    corruptFile(corruptOffset);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.verifyChecksums() == FAILURE, "the corruption of compressed data was not found");
+    }
+
+    // a cut off file has no index anymore
+    {
+        MappedFile original;
+        GEP_ASSERT(original.open(testFilename) == SUCCESS);
+        RawFile truncated("chunkfile_truncated.thTest", "wb");
+        truncated.writeArray(original.getData().getPtr(), original.getSize() - 20);
+    }
+    {
+        Chunkfile file("chunkfile_truncated.thTest", Chunkfile::Operation::read);
+        GEP_ASSERT(file.verifyChecksums() == FAILURE, "the truncation was not found");
+    }
+    remove("chunkfile_truncated.thTest");
+    remove(testFilename);
+}
+
+namespace
+{
+    uint32 fileChecksum(const char* filename)
+    {
+        MappedFile file;
+        GEP_ASSERT(file.open(filename) == SUCCESS);
+        return crc32c(file.getData().getPtr(), file.getData().length());
+    }
+}
+
+GEP_UNITTEST_TEST(Chunkfile, Modify)
+{
+    const std::string temporaryFilename = std::string(testFilename) + ".tmp";
+    writeCompressedFile();
+    uint32 originalChecksum = fileChecksum(testFilename);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::modify);
+        GEP_ASSERT(file.isOpen());
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        file.startWriting("thTest", 2);
+        // copied with its compressed children as they are
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.keepCurrentChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "After");
+        uint32 value = 0;
+        GEP_ASSERT(file.read(value) == sizeof(value) && value == 77);
+        file.endReadChunk();
+        file.startWriteChunk("After");
+        file.write(value + 1);
+        file.endWriteChunk();
+        file.startWriteChunk("Added");
+        file.write<uint16>(5);
+        file.endWriteChunk();
+        file.endReading();
+        file.endWriting();
+        GEP_ASSERT(fileChecksum(testFilename) == originalChecksum, "the original was changed before the modification ended");
+    }
+    GEP_ASSERT(!fileExists(temporaryFilename.c_str()), "the temporary file is left over");
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::mapped);
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS, "the modified file is corrupted");
+        auto pVertices = file.findChunk("thTest/Mesh/Vertices");
+        GEP_ASSERT(pVertices != nullptr && pVertices->length < numCompressedValues * sizeof(float) / 4, "the kept chunk is not in the index");
+        GEP_ASSERT(file.openChunkAt(*pVertices) == SUCCESS);
+        std::vector<float> values(numCompressedValues);
+        GEP_ASSERT(file.readArray(ArrayPtr<float>(values.data(), values.size())) == numCompressedValues * sizeof(float));
+        GEP_ASSERT(values[numCompressedValues - 1] == expectedValue((numCompressedValues - 1) % 100), "the kept chunk is wrong");
+        file.endReadChunk();
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS && file.getFileVersion() == 2, "wrong version", file.getFileVersion());
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.skipCurrentChunk();
+        uint32 value = 0;
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "After");
+        GEP_ASSERT(file.read(value) == sizeof(value) && value == 78, "the rewritten chunk is wrong", value);
+        file.endReadChunk();
+        uint16 added = 0;
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Added");
+        GEP_ASSERT(file.read(added) == sizeof(added) && added == 5);
+        file.endReadChunk();
+        file.endReading();
+    }
+
+    // without an index in the original the kept chunks are copied through memory
+    writeIndexedFile(false);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::modify);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        file.startWriting("thTest", 1);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.keepCurrentChunk();
+        // the rest of a chunk after a change
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        uint32 mesh = 0;
+        GEP_ASSERT(file.read(mesh) == sizeof(mesh) && mesh == 1);
+        file.startWriteChunk("Mesh");
+        file.write(mesh + 10);
+        file.keepRestOfCurrentChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS);
+        file.keepCurrentChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Bones");
+        file.keepCurrentChunk();
+        file.endReading();
+        file.endWriting();
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS, "the index of the modified file is wrong");
+        auto pMesh = file.findChunk("thTest/Mesh", 1);
+        uint32 mesh = 0;
+        GEP_ASSERT(pMesh != nullptr && file.openChunkAt(*pMesh) == SUCCESS);
+        GEP_ASSERT(file.read(mesh) == sizeof(mesh) && mesh == 11, "the changed mesh is wrong", mesh);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Vertices");
+        std::vector<uint32> vertices(100);
+        GEP_ASSERT(file.readArray(ArrayPtr<uint32>(vertices.data(), vertices.size())) == 100 * sizeof(uint32));
+        GEP_ASSERT(vertices[99] == 1099, "the kept rest is wrong", vertices[99]);
+        file.endReadChunk();
+        file.endReadChunk();
+        auto pBones = file.findChunk("thTest/Bones");
+        GEP_ASSERT(pBones != nullptr && pBones->length == sizeof(uint16));
+    }
+
+    // discarding leaves the original as it was
+    originalChecksum = fileChecksum(testFilename);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::modify);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        file.startWriting("thTest", 3);
+        file.discardChanges();
+        GEP_ASSERT(!fileExists(temporaryFilename.c_str()), "the temporary file was not removed");
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh", "reading stopped after discarding");
+        file.skipCurrentChunk();
+        file.skipCurrentChunk();
+        // the file type chunk which was started for writing
+        file.endWriteChunk();
+    }
+    GEP_ASSERT(fileChecksum(testFilename) == originalChecksum, "discarding changed the original");
+
+    // small kept chunks are collected in the write buffer, the ones which do not fit anymore are copied by the operating system
+    std::vector<uint8> large(4 * 1024 * 1024 + 1000);
+    for(size_t i = 0; i < large.size(); i++)
+        large[i] = static_cast<uint8>(i * 7);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        for(uint32 i = 0; i < 3; i++)
+        {
+            file.startWriteChunk("Small");
+            file.write(i);
+            file.endWriteChunk();
+        }
+        file.startWriteChunk("Large");
+        file.writeArray(ArrayPtr<uint8>(large.data(), large.size()));
+        file.endWriteChunk();
+        GEP_ASSERT(file.endWriting() == SUCCESS);
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::modify);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        file.startWriting("thTest", 2);
+        for(uint32 i = 0; i < 3; i++)
+        {
+            GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Small");
+            file.keepCurrentChunk();
+        }
+        file.startWriteChunk("Added");
+        file.write<uint16>(6);
+        file.endWriteChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Large");
+        file.keepCurrentChunk();
+        file.endReading();
+        GEP_ASSERT(file.endWriting() == SUCCESS);
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::read);
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS, "the kept chunks are corrupted");
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS && file.getFileVersion() == 2);
+        for(uint32 i = 0; i < 3; i++)
+        {
+            uint32 value = 0;
+            GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Small");
+            GEP_ASSERT(file.read(value) == sizeof(value) && value == i, "a small kept chunk is wrong", i, value);
+            file.endReadChunk();
+        }
+        uint16 added = 0;
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Added");
+        GEP_ASSERT(file.read(added) == sizeof(added) && added == 6);
+        file.endReadChunk();
+        std::vector<uint8> values(large.size());
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Large");
+        GEP_ASSERT(file.readArray(ArrayPtr<uint8>(values.data(), values.size())) == values.size());
+        GEP_ASSERT(values == large, "the large kept chunk is wrong");
+        file.endReadChunk();
+        file.endReading();
+    }
+    remove(testFilename);
+}
+
+#ifndef _WIN32
+GEP_UNITTEST_TEST(Chunkfile, WriteFailures)
+{
+    // every write to /dev/full fails as if the disk was full
+    std::vector<uint8> large(8 * 1024 * 1024, 1);
+    {
+        Chunkfile file("/dev/full", Chunkfile::Operation::write);
+        GEP_ASSERT(file.isOpen());
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("Small");
+        file.write<uint32>(1);
+        GEP_ASSERT(file.endWriteChunk() == SUCCESS, "nothing was written to the file yet");
+        GEP_ASSERT(file.endWriting() == FAILURE, "the failed flush was not reported");
+    }
+    {
+        // larger than the write buffer, written directly
+        Chunkfile file("/dev/full", Chunkfile::Operation::write);
+        file.startWriting("thTest", 1, false);
+        file.startWriteChunk("Large");
+        file.writeArray(ArrayPtr<uint8>(large.data(), large.size()));
+        GEP_ASSERT(file.endWriteChunk() == FAILURE, "the failed write was not reported");
+        GEP_ASSERT(file.endWriting() == FAILURE);
+    }
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("Large");
+        file.writeArray(ArrayPtr<uint8>(large.data(), large.size()));
+        GEP_ASSERT(file.endWriteChunk() == SUCCESS);
+        GEP_ASSERT(file.endWriting() == SUCCESS);
+    }
+    remove(testFilename);
+
+    // a modification which could not be written is discarded
+    writeCompressedFile();
+    uint32 originalChecksum = fileChecksum(testFilename);
+    const std::string temporaryFilename = std::string(testFilename) + ".tmp";
+    remove(temporaryFilename.c_str());
+    GEP_ASSERT(symlink("/dev/full", temporaryFilename.c_str()) == 0);
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::modify);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        file.startWriting("thTest", 2);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Mesh");
+        file.keepCurrentChunk();
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "After");
+        file.skipCurrentChunk();
+        file.startWriteChunk("Large");
+        file.writeArray(ArrayPtr<uint8>(large.data(), large.size()));
+        file.endWriteChunk();
+        file.endReading();
+        GEP_ASSERT(file.endWriting() == FAILURE);
+    }
+    GEP_ASSERT(fileChecksum(testFilename) == originalChecksum, "the original was replaced by the incomplete file");
+    GEP_ASSERT(!fileExists(temporaryFilename.c_str()), "the temporary file is left over");
+    remove(testFilename);
+}
+#endif
+
+namespace
+{
+    const uint32 numBenchmarkNormals = 100000;
+
+    int16 compressFloat(float value)
+    {
+        return static_cast<int16>(value * 32767);
+    }
+}
+
+// writes normals like ModelLoader::writeThModel, one component at a time
+GEP_BENCHMARK(Chunkfile, WriteNormals)
+{
+    while(state.keepRunning())
+    {
+        Chunkfile file(testFilename, Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("normals");
+        for(uint32 i = 0; i < numBenchmarkNormals; i++)
+        {
+            file.write(compressFloat(0.5f));
+            file.write(compressFloat(-0.25f));
+            file.write(compressFloat(i * 1e-5f));
+        }
+        file.endWriteChunk();
+        file.endWriting();
+    }
+    remove(testFilename);
+}
+
+// the same with an fwrite per component, as the chunkfile did before it had its own buffer
+GEP_BENCHMARK(Chunkfile, WriteNormalsFwrite)
+{
+    while(state.keepRunning())
+    {
+        RawFile file(testFilename, "wb");
+        for(uint32 i = 0; i < numBenchmarkNormals; i++)
+        {
+            file.write(compressFloat(0.5f));
+            file.write(compressFloat(-0.25f));
+            file.write(compressFloat(i * 1e-5f));
+        }
+    }
+    remove(testFilename);
+}
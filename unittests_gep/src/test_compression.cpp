@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "gep/compression.h"
+#include <random>
+#include <vector>
+
+using namespace gep;
+
+namespace
+{
+    std::vector<uint8> compress(const std::vector<uint8>& data)
+    {
+        std::vector<uint8> compressed(Lz4::getMaxCompressedSize(data.size()));
+        compressed.resize(Lz4::compress(data.data(), data.size(), compressed.data(), compressed.size()));
+        return compressed;
+    }
+
+    void checkRoundTrip(const std::vector<uint8>& data)
+    {
+        auto compressed = compress(data);
+        GEP_ASSERT(compressed.size() <= Lz4::getMaxCompressedSize(data.size()));
+        std::vector<uint8> decompressed(data.size());
+        size_t size = Lz4::decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size());
+        GEP_ASSERT(size == data.size() && decompressed == data, "the round trip changed the data", data.size(), size);
+    }
+
+    /// positions in a mesh, which repeat in their high bytes
+    std::vector<uint8> makeVertices(uint32 numFloats)
+    {
+        std::vector<uint8> data(numFloats * sizeof(float));
+        for(uint32 i = 0; i < numFloats; i++)
+        {
+            float value = (i % 3) * 10.0f + (i / 3) * 0.01f;
+            memcpy(&data[i * sizeof(float)], &value, sizeof(float));
+        }
+        return data;
+    }
+}
+
+GEP_UNITTEST_GROUP(Compression)
+GEP_UNITTEST_TEST(Compression, Lz4RoundTrip)
+{
+    std::mt19937 random(5);
+    checkRoundTrip(std::vector<uint8>());
+    checkRoundTrip(std::vector<uint8>(1, 7));
+    checkRoundTrip(std::vector<uint8>(100000, 0));
+    for(uint32 size : { 5u, 13u, 100u, 70000u })
+    {
+        std::vector<uint8> noise(size);
+        for(auto& byte : noise)
+            byte = static_cast<uint8>(random());
+        checkRoundTrip(noise);
+
+        // few different bytes give many short matches
+        std::vector<uint8> symbols(size);
+        for(auto& byte : symbols)
+            byte = static_cast<uint8>(random() % 3);
+        checkRoundTrip(symbols);
+    }
+    // matches further back than the largest offset
+    std::vector<uint8> far(200000);
+    for(size_t i = 0; i < far.size(); i++)
+        far[i] = static_cast<uint8>(random() % 256);
+    memcpy(&far[150000], &far[0], 1000);
+    checkRoundTrip(far);
+
+    auto zeros = compress(std::vector<uint8>(100000, 0));
+    GEP_ASSERT(zeros.size() < 1000, "repeated data did not compress", zeros.size());
+}
+
+GEP_UNITTEST_TEST(Compression, Lz4Malformed)
+{
+    auto data = makeVertices(3000);
+    auto compressed = compress(data);
+    std::vector<uint8> decompressed(data.size());
+    GEP_ASSERT(Lz4::decompress(compressed.data(), compressed.size() / 2, decompressed.data(), decompressed.size()) != data.size(),
+        "cut off data was accepted");
+    GEP_ASSERT(Lz4::decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size() - 1) != data.size(),
+        "wrote over the end of the destination");
+
+    // random data must never be read or written out of bounds
+    std::mt19937 random(11);
+    for(uint32 i = 0; i < 10000; i++)
+    {
+        std::vector<uint8> garbage(random() % 64);
+        for(auto& byte : garbage)
+            byte = (random() % 4 == 0) ? 255 : static_cast<uint8>(random());
+        std::vector<uint8> destination(random() % 128);
+        size_t size = Lz4::decompress(garbage.data(), garbage.size(), destination.data(), destination.size());
+        GEP_ASSERT(size <= destination.size());
+    }
+}
+
+GEP_UNITTEST_TEST(Compression, Shuffle)
+{
+    // 2 whole elements of 4 bytes and a rest
+    const uint8 data[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    const uint8 expected[] = { 1, 5, 2, 6, 3, 7, 4, 8, 9, 10 };
+    uint8 shuffled[10];
+    uint8 unshuffled[10];
+    shuffleBytes(data, shuffled, sizeof(data), 4);
+    GEP_ASSERT(memcmp(shuffled, expected, sizeof(data)) == 0, "wrong byte order");
+    unshuffleBytes(shuffled, unshuffled, sizeof(data), 4);
+    GEP_ASSERT(memcmp(unshuffled, data, sizeof(data)) == 0, "unshuffling did not restore the data");
+
+    // the shuffled floats compress better
+    auto vertices = makeVertices(30000);
+    std::vector<uint8> shuffledVertices(vertices.size());
+    shuffleBytes(vertices.data(), shuffledVertices.data(), vertices.size(), sizeof(float));
+    size_t plainSize = compress(vertices).size();
+    size_t shuffledSize = compress(shuffledVertices).size();
+    GEP_ASSERT(shuffledSize < plainSize, "shuffling did not help", shuffledSize, plainSize);
+}
+
+GEP_BENCHMARK(Compression, Lz4DecompressVertices)
+{
+    auto vertices = makeVertices(3 * 100000);
+    std::vector<uint8> shuffled(vertices.size());
+    shuffleBytes(vertices.data(), shuffled.data(), vertices.size(), sizeof(float));
+    auto compressed = compress(shuffled);
+    std::vector<uint8> decompressed(vertices.size());
+    while(state.keepRunning())
+    {
+        doNotOptimize(Lz4::decompress(compressed.data(), compressed.size(), decompressed.data(), decompressed.size()));
+        unshuffleBytes(decompressed.data(), vertices.data(), vertices.size(), sizeof(float));
+        doNotOptimize(vertices[0]);
+    }
+    state.setCounter("ratio", static_cast<double>(vertices.size()) / compressed.size());
+}
@@ -4,6 +4,12 @@
 #include "gep/container/DynamicArray.h"
 #include "gep/container/hashmap.h"
 #include "gep/memory/allocators.h"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace gep;
 
@@ -816,3 +822,471 @@ GEP_UNITTEST_TEST(Container, hashmap)
   }
 }
 
+
+namespace
+{
+    /// \brief the keys every container of a benchmark works with, so that the results compare
+    template <class K>
+    struct KeySet
+    {
+        std::vector<K> keys;
+        /// keys which are not in the container
+        std::vector<K> misses;
+        /// the keys in a random order
+        std::vector<K> lookupOrder;
+    };
+
+    inline uint32 makeKey(uint32 index, uint32*) { return index * 2654435761u; }
+    // the addresses of allocations of 16 bytes one after another, like pool or stack allocations
+    inline const void* makeKey(uint32 index, const void**) { return reinterpret_cast<const void*>(0x10000000 + static_cast<uintptr_t>(index) * 16); }
+    inline std::string makeKey(uint32 index, std::string*)
+    {
+        char name[64];
+        sprintf(name, "data/models/level_%u/object_%u.thModel", index % 16, index);
+        return name;
+    }
+
+    template <class K>
+    const KeySet<K>& getKeys(size_t size)
+    {
+        static KeySet<K> s_keys;
+        if(s_keys.keys.size() != size)
+        {
+            s_keys.keys.resize(size);
+            s_keys.misses.resize(size);
+            for(uint32 i = 0; i < size; i++)
+            {
+                s_keys.keys[i] = makeKey(i, static_cast<K*>(nullptr));
+                s_keys.misses[i] = makeKey(static_cast<uint32>(size) + i, static_cast<K*>(nullptr));
+            }
+            s_keys.lookupOrder = s_keys.keys;
+            uint32 random = 12345;
+            for(size_t i = size; i > 1; i--)
+            {
+                random = random * 1664525 + 1013904223;
+                std::swap(s_keys.lookupOrder[i - 1], s_keys.lookupOrder[random % i]);
+            }
+        }
+        return s_keys;
+    }
+
+    /// releases the map which was filled last, only one is kept alive to limit the memory use at 10M elements
+    void (*g_releaseFilledMap)() = nullptr;
+
+    template <class Map>
+    const Map& getFilledMap(const std::vector<typename Map::key_type>& keys)
+    {
+        static std::unique_ptr<Map> s_pMap;
+        if(s_pMap == nullptr || s_pMap->size() != keys.size())
+        {
+            if(g_releaseFilledMap != nullptr)
+                g_releaseFilledMap();
+            s_pMap.reset(new Map());
+            for(size_t i = 0; i < keys.size(); i++)
+                (*s_pMap)[keys[i]] = static_cast<uint32>(i);
+            g_releaseFilledMap = []() { s_pMap.reset(); };
+        }
+        return *s_pMap;
+    }
+
+    /// \brief makes a gep hash policy usable by the std containers
+    template <class HashPolicy>
+    struct PolicyHasher
+    {
+        template <class K>
+        size_t operator()(const K& key) const { return HashPolicy::hash(key); }
+    };
+
+    typedef std::unordered_map<uint32, uint32> StdIntMap;
+    typedef std::unordered_map<uint32, uint32, PolicyHasher<StdHashPolicy>> PolicyIntMap;
+    typedef std::unordered_map<const void*, uint32> StdPointerMap;
+    typedef std::unordered_map<const void*, uint32, PolicyHasher<PointerHashPolicy>> PolicyPointerMap;
+    typedef std::unordered_map<std::string, uint32> StdStringMap;
+    typedef std::unordered_map<std::string, uint32, PolicyHasher<StringHashPolicy>> PolicyStringMap;
+
+    template <class Map>
+    void benchmarkMapInsert(BenchmarkState& state, size_t size)
+    {
+        const auto& keys = getKeys<typename Map::key_type>(size);
+        Map map;
+        while(state.keepRunning())
+        {
+            for(size_t i = 0; i < size; i++)
+                map[keys.keys[i]] = static_cast<uint32>(i);
+            doNotOptimize(map.size());
+            state.pauseTiming();
+            map = Map();
+            state.resumeTiming();
+        }
+    }
+
+    template <class Map>
+    void benchmarkMapLookupHit(BenchmarkState& state, size_t size)
+    {
+        const auto& keys = getKeys<typename Map::key_type>(size);
+        const Map& map = getFilledMap<Map>(keys.keys);
+        while(state.keepRunning())
+        {
+            uint32 sum = 0;
+            for(auto& key : keys.lookupOrder)
+                sum += map.find(key)->second;
+            doNotOptimize(sum);
+        }
+    }
+
+    template <class Map>
+    void benchmarkMapLookupMiss(BenchmarkState& state, size_t size)
+    {
+        const auto& keys = getKeys<typename Map::key_type>(size);
+        const Map& map = getFilledMap<Map>(keys.keys);
+        size_t found = 0;
+        while(state.keepRunning())
+        {
+            for(auto& key : keys.misses)
+                found += (map.find(key) != map.end()) ? 1 : 0;
+            doNotOptimize(found);
+        }
+        GEP_ASSERT(found == 0, "a key which was never inserted has been found");
+    }
+
+    template <class Map>
+    void benchmarkMapErase(BenchmarkState& state, size_t size)
+    {
+        const auto& keys = getKeys<typename Map::key_type>(size);
+        Map map(getFilledMap<Map>(keys.keys));
+        while(state.keepRunning())
+        {
+            for(auto& key : keys.lookupOrder)
+                map.erase(key);
+            doNotOptimize(map.size());
+            state.pauseTiming();
+            for(size_t i = 0; i < size; i++)
+                map[keys.keys[i]] = static_cast<uint32>(i);
+            state.resumeTiming();
+        }
+    }
+
+    template <class Map>
+    void benchmarkMapIterate(BenchmarkState& state, size_t size)
+    {
+        const Map& map = getFilledMap<Map>(getKeys<typename Map::key_type>(size).keys);
+        while(state.keepRunning())
+        {
+            uint32 sum = 0;
+            for(auto& entry : map)
+                sum += entry.second;
+            doNotOptimize(sum);
+        }
+    }
+
+    template <class Map>
+    void benchmarkMapCopy(BenchmarkState& state, size_t size)
+    {
+        const Map& map = getFilledMap<Map>(getKeys<typename Map::key_type>(size).keys);
+        while(state.keepRunning())
+        {
+            Map copy(map);
+            doNotOptimize(copy.size());
+            state.pauseTiming();
+            copy = Map();
+            state.resumeTiming();
+        }
+    }
+
+    inline void append(std::vector<uint32>& array, uint32 value) { array.push_back(value); }
+    inline void append(DynamicArray<uint32>& array, uint32 value) { array.append(value); }
+    inline void removeFirstUnordered(std::vector<uint32>& array) { array[0] = array.back(); array.pop_back(); }
+    inline void removeFirstUnordered(DynamicArray<uint32>& array) { array.removeAtIndexUnordered(0); }
+
+    template <class Array>
+    void benchmarkArrayAppend(BenchmarkState& state, size_t size)
+    {
+        Array array;
+        while(state.keepRunning())
+        {
+            for(uint32 i = 0; i < size; i++)
+                append(array, i);
+            doNotOptimize(*array.begin());
+            state.pauseTiming();
+            array = Array();
+            state.resumeTiming();
+        }
+    }
+
+    template <class Array>
+    void benchmarkArrayIterate(BenchmarkState& state, size_t size)
+    {
+        Array array;
+        for(uint32 i = 0; i < size; i++)
+            append(array, i);
+        while(state.keepRunning())
+        {
+            uint32 sum = 0;
+            for(uint32 value : array)
+                sum += value;
+            doNotOptimize(sum);
+        }
+    }
+
+    template <class Array>
+    void benchmarkArrayCopy(BenchmarkState& state, size_t size)
+    {
+        Array array;
+        for(uint32 i = 0; i < size; i++)
+            append(array, i);
+        while(state.keepRunning())
+        {
+            Array copy(array);
+            doNotOptimize(*copy.begin());
+            state.pauseTiming();
+            copy = Array();
+            state.resumeTiming();
+        }
+    }
+
+    template <class Array>
+    void benchmarkArrayEraseUnordered(BenchmarkState& state, size_t size)
+    {
+        Array array;
+        while(state.keepRunning())
+        {
+            state.pauseTiming();
+            for(uint32 i = 0; i < size; i++)
+                append(array, i);
+            state.resumeTiming();
+            for(size_t i = 0; i < size; i++)
+                removeFirstUnordered(array);
+            doNotOptimize(array);
+        }
+    }
+
+    // hashes to compare hashOf and the hash policies against
+    uint32 fnv1a(const void* data, size_t length)
+    {
+        auto bytes = static_cast<const uint8*>(data);
+        uint32 hash = 2166136261u;
+        for(size_t i = 0; i < length; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+        return hash;
+    }
+
+    inline uint32 rotateLeft(uint32 value, int bits) { return (value << bits) | (value >> (32 - bits)); }
+
+    /// MurmurHash3 x86_32 by Austin Appleby, public domain
+    uint32 murmur3(const void* data, size_t length)
+    {
+        auto bytes = static_cast<const uint8*>(data);
+        const uint32 c1 = 0xcc9e2d51;
+        const uint32 c2 = 0x1b873593;
+        uint32 hash = 0;
+        size_t numBlocks = length / 4;
+        for(size_t i = 0; i < numBlocks; i++)
+        {
+            uint32 block;
+            memcpy(&block, bytes + i * 4, 4);
+            hash ^= rotateLeft(block * c1, 15) * c2;
+            hash = rotateLeft(hash, 13) * 5 + 0xe6546b64;
+        }
+        uint32 tail = 0;
+        switch(length & 3)
+        {
+        case 3: tail ^= bytes[numBlocks * 4 + 2] << 16;
+        case 2: tail ^= bytes[numBlocks * 4 + 1] << 8;
+        case 1: tail ^= bytes[numBlocks * 4];
+            hash ^= rotateLeft(tail * c1, 15) * c2;
+        }
+        hash ^= static_cast<uint32>(length);
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6b;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35;
+        hash ^= hash >> 16;
+        return hash;
+    }
+
+    inline const void* keyData(const uint32& key) { return &key; }
+    inline const void* keyData(const void* const& key) { return &key; }
+    inline const void* keyData(const std::string& key) { return key.data(); }
+    inline size_t keyLength(const uint32& key) { return sizeof(key); }
+    inline size_t keyLength(const void* const& key) { return sizeof(key); }
+    inline size_t keyLength(const std::string& key) { return key.size(); }
+
+    inline uint32 flipBit(uint32 key, size_t bit) { return key ^ (1u << bit); }
+    inline const void* flipBit(const void* key, size_t bit) { return reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(key) ^ (static_cast<uintptr_t>(1) << bit)); }
+    inline std::string flipBit(std::string key, size_t bit) { key[bit / 8] ^= static_cast<char>(1 << (bit % 8)); return key; }
+
+    template <class HashPolicy>
+    struct PolicyHash
+    {
+        template <class K>
+        uint32 operator()(const K& key) const { return HashPolicy::hash(key); }
+    };
+
+    struct StdHash
+    {
+        /// the low bits, which is what a power of two sized table uses
+        template <class K>
+        uint32 operator()(const K& key) const { return static_cast<uint32>(std::hash<K>()(key)); }
+    };
+
+    struct Fnv1aHash
+    {
+        template <class K>
+        uint32 operator()(const K& key) const { return fnv1a(keyData(key), keyLength(key)); }
+    };
+
+    struct Murmur3Hash
+    {
+        template <class K>
+        uint32 operator()(const K& key) const { return murmur3(keyData(key), keyLength(key)); }
+    };
+
+    const size_t numHashKeys = 100000;
+
+    /// \brief measures how well the hash spreads the keys and reports it with the counters
+    ///
+    /// collisions: keys with the same 32 bit hash as an earlier key
+    /// chi2_per_bucket: chi-squared of the bucket sizes of a power of two table with a bucket per key,
+    ///   divided by the number of buckets, about 1 for a uniform hash and much more if the low bits are poor
+    /// avalanche_bias: how far the chance that an output bit flips when one input bit flips is from 50%,
+    ///   averaged over all pairs of input and output bits, 0 is ideal and 1 the worst
+    template <class K, class Hash>
+    void measureHashQuality(BenchmarkState& state, const std::vector<K>& keys, Hash hash)
+    {
+        std::vector<uint32> hashes(keys.size());
+        for(size_t i = 0; i < keys.size(); i++)
+            hashes[i] = hash(keys[i]);
+
+        size_t numBuckets = 1;
+        while(numBuckets < keys.size())
+            numBuckets *= 2;
+        std::vector<uint32> bucketSizes(numBuckets, 0);
+        for(uint32 value : hashes)
+            bucketSizes[value & (numBuckets - 1)]++;
+        double expected = static_cast<double>(keys.size()) / numBuckets;
+        double chi2 = 0.0;
+        for(uint32 bucketSize : bucketSizes)
+            chi2 += (bucketSize - expected) * (bucketSize - expected) / expected;
+
+        std::sort(hashes.begin(), hashes.end());
+        size_t collisions = 0;
+        for(size_t i = 1; i < hashes.size(); i++)
+            collisions += (hashes[i] == hashes[i - 1]) ? 1 : 0;
+
+        // flips[inBit * 32 + outBit] counts how often the output bit flipped when the input bit flipped
+        const size_t numAvalancheKeys = std::min<size_t>(keys.size(), 1000);
+        std::vector<uint32> flips;
+        std::vector<uint32> numFlipped;
+        for(size_t i = 0; i < numAvalancheKeys; i++)
+        {
+            const K& key = keys[i * keys.size() / numAvalancheKeys];
+            uint32 original = hash(key);
+            size_t numBits = keyLength(key) * 8;
+            if(numFlipped.size() < numBits)
+            {
+                numFlipped.resize(numBits, 0);
+                flips.resize(numBits * 32, 0);
+            }
+            for(size_t bit = 0; bit < numBits; bit++)
+            {
+                uint32 changed = original ^ hash(flipBit(key, bit));
+                for(size_t outBit = 0; outBit < 32; outBit++)
+                    flips[bit * 32 + outBit] += (changed >> outBit) & 1;
+                numFlipped[bit]++;
+            }
+        }
+        double bias = 0.0;
+        for(size_t bit = 0; bit < numFlipped.size(); bit++)
+        {
+            for(size_t outBit = 0; outBit < 32; outBit++)
+                bias += std::fabs(static_cast<double>(flips[bit * 32 + outBit]) / numFlipped[bit] - 0.5) * 2.0;
+        }
+        bias /= std::max<size_t>(numFlipped.size() * 32, 1);
+
+        state.setCounter("collisions", static_cast<double>(collisions));
+        state.setCounter("chi2_per_bucket", chi2 / numBuckets);
+        state.setCounter("avalanche_bias", bias);
+    }
+
+    template <class K, class Hash>
+    void benchmarkHash(BenchmarkState& state, Hash hash)
+    {
+        const std::vector<K>& keys = getKeys<K>(numHashKeys).keys;
+        measureHashQuality(state, keys, hash);
+        while(state.keepRunning())
+        {
+            uint32 sum = 0;
+            for(auto& key : keys)
+                sum += hash(key);
+            doNotOptimize(sum);
+        }
+    }
+}
+
+#define GEP_ARRAY_BENCHMARKS(Name, Array, sizeName, size) \
+    GEP_BENCHMARK(Container, Name##Append_##sizeName) { benchmarkArrayAppend<Array>(state, size); } \
+    GEP_BENCHMARK(Container, Name##Iterate_##sizeName) { benchmarkArrayIterate<Array>(state, size); } \
+    GEP_BENCHMARK(Container, Name##Copy_##sizeName) { benchmarkArrayCopy<Array>(state, size); } \
+    GEP_BENCHMARK(Container, Name##EraseUnordered_##sizeName) { benchmarkArrayEraseUnordered<Array>(state, size); }
+
+#define GEP_MAP_BENCHMARKS(Name, Map, sizeName, size) \
+    GEP_BENCHMARK(Container, Name##Insert_##sizeName) { benchmarkMapInsert<Map>(state, size); } \
+    GEP_BENCHMARK(Container, Name##LookupHit_##sizeName) { benchmarkMapLookupHit<Map>(state, size); } \
+    GEP_BENCHMARK(Container, Name##LookupMiss_##sizeName) { benchmarkMapLookupMiss<Map>(state, size); } \
+    GEP_BENCHMARK(Container, Name##Erase_##sizeName) { benchmarkMapErase<Map>(state, size); } \
+    GEP_BENCHMARK(Container, Name##Iterate_##sizeName) { benchmarkMapIterate<Map>(state, size); } \
+    GEP_BENCHMARK(Container, Name##Copy_##sizeName) { benchmarkMapCopy<Map>(state, size); }
+
+typedef std::vector<uint32> StdVector;
+typedef DynamicArray<uint32> GepDynamicArray;
+
+GEP_ARRAY_BENCHMARKS(StdVector, StdVector, 8, 8)
+GEP_ARRAY_BENCHMARKS(DynamicArray, GepDynamicArray, 8, 8)
+GEP_ARRAY_BENCHMARKS(StdVector, StdVector, 1K, 1000)
+GEP_ARRAY_BENCHMARKS(DynamicArray, GepDynamicArray, 1K, 1000)
+GEP_ARRAY_BENCHMARKS(StdVector, StdVector, 100K, 100000)
+GEP_ARRAY_BENCHMARKS(DynamicArray, GepDynamicArray, 100K, 100000)
+GEP_ARRAY_BENCHMARKS(StdVector, StdVector, 10M, 10000000)
+GEP_ARRAY_BENCHMARKS(DynamicArray, GepDynamicArray, 10M, 10000000)
+
+// the gep Hashmap can not be measured yet, it does not store anything so far. Its hash policies are
+// measured inside std::unordered_map instead, against std::hash. The benchmarks of one map and size
+// follow each other, so the filled map is only built once for them.
+GEP_MAP_BENCHMARKS(StdIntMap, StdIntMap, 8, 8)
+GEP_MAP_BENCHMARKS(PolicyIntMap, PolicyIntMap, 8, 8)
+GEP_MAP_BENCHMARKS(StdPointerMap, StdPointerMap, 8, 8)
+GEP_MAP_BENCHMARKS(PolicyPointerMap, PolicyPointerMap, 8, 8)
+GEP_MAP_BENCHMARKS(StdStringMap, StdStringMap, 8, 8)
+GEP_MAP_BENCHMARKS(PolicyStringMap, PolicyStringMap, 8, 8)
+GEP_MAP_BENCHMARKS(StdIntMap, StdIntMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(PolicyIntMap, PolicyIntMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(StdPointerMap, StdPointerMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(PolicyPointerMap, PolicyPointerMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(StdStringMap, StdStringMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(PolicyStringMap, PolicyStringMap, 1K, 1000)
+GEP_MAP_BENCHMARKS(StdIntMap, StdIntMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(PolicyIntMap, PolicyIntMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(StdPointerMap, StdPointerMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(PolicyPointerMap, PolicyPointerMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(StdStringMap, StdStringMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(PolicyStringMap, PolicyStringMap, 100K, 100000)
+GEP_MAP_BENCHMARKS(StdIntMap, StdIntMap, 10M, 10000000)
+GEP_MAP_BENCHMARKS(PolicyIntMap, PolicyIntMap, 10M, 10000000)
+GEP_MAP_BENCHMARKS(StdPointerMap, StdPointerMap, 10M, 10000000)
+GEP_MAP_BENCHMARKS(PolicyPointerMap, PolicyPointerMap, 10M, 10000000)
+// 10M strings would need several GB
+GEP_MAP_BENCHMARKS(StdStringMap, StdStringMap, 1M, 1000000)
+GEP_MAP_BENCHMARKS(PolicyStringMap, PolicyStringMap, 1M, 1000000)
+
+GEP_BENCHMARK(Container, HashIntHashOf) { benchmarkHash<uint32>(state, PolicyHash<StdHashPolicy>()); }
+GEP_BENCHMARK(Container, HashIntStd) { benchmarkHash<uint32>(state, StdHash()); }
+GEP_BENCHMARK(Container, HashIntFnv1a) { benchmarkHash<uint32>(state, Fnv1aHash()); }
+GEP_BENCHMARK(Container, HashIntMurmur3) { benchmarkHash<uint32>(state, Murmur3Hash()); }
+GEP_BENCHMARK(Container, HashPointerPolicy) { benchmarkHash<const void*>(state, PolicyHash<PointerHashPolicy>()); }
+GEP_BENCHMARK(Container, HashPointerStd) { benchmarkHash<const void*>(state, StdHash()); }
+GEP_BENCHMARK(Container, HashPointerFnv1a) { benchmarkHash<const void*>(state, Fnv1aHash()); }
+GEP_BENCHMARK(Container, HashPointerMurmur3) { benchmarkHash<const void*>(state, Murmur3Hash()); }
+GEP_BENCHMARK(Container, HashStringHashOf) { benchmarkHash<std::string>(state, PolicyHash<StringHashPolicy>()); }
+GEP_BENCHMARK(Container, HashStringStd) { benchmarkHash<std::string>(state, StdHash()); }
+GEP_BENCHMARK(Container, HashStringFnv1a) { benchmarkHash<std::string>(state, Fnv1aHash()); }
+GEP_BENCHMARK(Container, HashStringMurmur3) { benchmarkHash<std::string>(state, Murmur3Hash()); }
@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "gep/directory.h"
+#include "gep/file.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+using namespace gep;
+
+namespace
+{
+    const char* watchedDirectory = "directorywatcher_test";
+
+    struct ReportedChange
+    {
+        std::string filename;
+        DirectoryWatcher::Action::Enum action;
+    };
+
+    /// \brief enumerates the changes until at least numChanges came in or the time is up
+    std::vector<ReportedChange> waitForChanges(DirectoryWatcher& watcher, size_t numChanges, uint32 milliseconds)
+    {
+        std::vector<ReportedChange> changes;
+        auto endTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+        do
+        {
+            watcher.enumerateChanges([&](const char* filename, DirectoryWatcher::Action::Enum action)
+            {
+                ReportedChange change = { filename, action };
+                std::replace(change.filename.begin(), change.filename.end(), '\\', '/');
+                changes.push_back(change);
+            });
+            if(changes.size() >= numChanges)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } while(std::chrono::steady_clock::now() < endTime);
+        return changes;
+    }
+
+    void writeText(const std::string& filename, const char* text)
+    {
+        RawFile file(filename.c_str(), "wb");
+        GEP_ASSERT(file.isOpen());
+        file.writeArray(text, strlen(text));
+    }
+}
+
+GEP_UNITTEST_GROUP(DirectoryWatcher)
+GEP_UNITTEST_TEST(DirectoryWatcher, CoalescesModifications)
+{
+    std::string directory(watchedDirectory);
+    createDirectory(directory.c_str());
+    createDirectory((directory + "/textures").c_str());
+    {
+        DirectoryWatcher watcher(watchedDirectory, DirectoryWatcher::WatchSubdirs::yes, DirectoryWatcher::Watch::writes, 50);
+        GEP_ASSERT(waitForChanges(watcher, 1, 100).empty(), "changes without touching a file");
+
+        // saving a file several times in a row is reported once
+        for(int i = 0; i < 5; i++)
+            writeText(directory + "/textures/wall.dds", "wall");
+        writeText(directory + "/level.txt", "level");
+        auto changes = waitForChanges(watcher, 2, 2000);
+        GEP_ASSERT(changes.size() == 2, "the modifications were not reported", changes.size());
+        GEP_ASSERT(waitForChanges(watcher, 1, 200).empty(), "the modifications were not merged");
+        std::sort(changes.begin(), changes.end(), [](const ReportedChange& lh, const ReportedChange& rh) { return lh.filename < rh.filename; });
+        GEP_ASSERT(changes[0].filename == "level.txt" && changes[0].action == DirectoryWatcher::Action::modified);
+        GEP_ASSERT(changes[1].filename == "textures/wall.dds" && changes[1].action == DirectoryWatcher::Action::modified);
+
+#ifndef _WIN32
+        // a file which is still open for writing is not reported before it was closed
+        {
+            RawFile file((directory + "/level.txt").c_str(), "wb");
+            file.write(uint32(1));
+            GEP_ASSERT(flushToDisk(file) == SUCCESS);
+            GEP_ASSERT(waitForChanges(watcher, 1, 200).empty(), "a file was reported while it was written");
+        }
+        changes = waitForChanges(watcher, 1, 2000);
+        GEP_ASSERT(changes.size() == 1 && changes[0].filename == "level.txt", "the closed file was not reported");
+#endif
+
+        // directories created after the watcher started are watched as well
+        createDirectory((directory + "/sounds").c_str());
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writeText(directory + "/sounds/step.wav", "step");
+        changes = waitForChanges(watcher, 1, 2000);
+        GEP_ASSERT(changes.size() == 1 && changes[0].filename == "sounds/step.wav", "the new directory is not watched");
+    }
+    remove((directory + "/sounds/step.wav").c_str());
+    remove((directory + "/textures/wall.dds").c_str());
+    remove((directory + "/level.txt").c_str());
+    rmdir((directory + "/sounds").c_str());
+    rmdir((directory + "/textures").c_str());
+    rmdir(directory.c_str());
+}
+
+#ifndef _WIN32
+GEP_UNITTEST_TEST(DirectoryWatcher, WriteTimeout)
+{
+    std::string directory(watchedDirectory);
+    createDirectory(directory.c_str());
+    {
+        DirectoryWatcher watcher(watchedDirectory, DirectoryWatcher::WatchSubdirs::no, DirectoryWatcher::Watch::writes, 20, 300);
+        // a file which stays open is reported once it did not change for the write timeout,
+        // in case the notification that it was closed got lost
+        RawFile file((directory + "/level.txt").c_str(), "wb");
+        file.write(uint32(1));
+        GEP_ASSERT(flushToDisk(file) == SUCCESS);
+        GEP_ASSERT(waitForChanges(watcher, 1, 150).empty(), "a file was reported before the write timeout");
+        auto changes = waitForChanges(watcher, 1, 2000);
+        GEP_ASSERT(changes.size() == 1 && changes[0].filename == "level.txt", "the file was not reported after the write timeout");
+    }
+    remove((directory + "/level.txt").c_str());
+    rmdir(directory.c_str());
+}
+#endif
@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include "gep/framepacing.h"
+#include "gep/timer.h"
+#include <cmath>
+
+using namespace gep;
+
+GEP_UNITTEST_GROUP(FramePacing)
+GEP_UNITTEST_TEST(FramePacing, FixedTimestep)
+{
+    FixedTimestep timestep(100.0f, 4);
+    GEP_ASSERT(std::fabs(timestep.getStepTime() - 0.01f) < 1e-6f);
+
+    // frames shorter than a step accumulate
+    GEP_ASSERT(timestep.advance(0.004f) == 0);
+    GEP_ASSERT(std::fabs(timestep.getInterpolationAlpha() - 0.4f) < 1e-4f, "wrong alpha", timestep.getInterpolationAlpha());
+    GEP_ASSERT(timestep.advance(0.004f) == 0);
+    GEP_ASSERT(timestep.advance(0.004f) == 1);
+    GEP_ASSERT(std::fabs(timestep.getInterpolationAlpha() - 0.2f) < 1e-4f, "wrong alpha", timestep.getInterpolationAlpha());
+
+    // several steps in one long frame
+    GEP_ASSERT(timestep.advance(0.025f) == 2);
+    GEP_ASSERT(std::fabs(timestep.getInterpolationAlpha() - 0.7f) < 1e-4f, "wrong alpha", timestep.getInterpolationAlpha());
+
+    // a hitch is capped and the rest is dropped, only the fraction of a step stays
+    GEP_ASSERT(timestep.advance(0.5f) == 4, "catch up steps not capped");
+    GEP_ASSERT(timestep.getNumDroppedSteps() == 46, "wrong number of dropped steps", timestep.getNumDroppedSteps());
+    GEP_ASSERT(std::fabs(timestep.getInterpolationAlpha() - 0.7f) < 1e-3f, "alpha jumped after dropping steps", timestep.getInterpolationAlpha());
+    GEP_ASSERT(timestep.advance(0.001f) == 0);
+
+    // the steps add up to the simulated time over many frames
+    timestep.reset();
+    uint32 totalSteps = 0;
+    for (int i = 0; i < 1000; i++)
+        totalSteps += timestep.advance(1.0f / 144.0f);
+    GEP_ASSERT(totalSteps == 694, "steps drifted", totalSteps);
+
+    GEP_ASSERT(timestep.advance(-1.0f) == 0, "negative frame times are ignored");
+}
+
+GEP_UNITTEST_TEST(FramePacing, FrameLimiter)
+{
+    FrameLimiter limiter;
+    // disabled limiter does not wait at all
+    uint64 start = Timer::getCurrentTicks();
+    for (int i = 0; i < 1000; i++)
+        limiter.waitForNextFrame();
+    GEP_ASSERT((Timer::getCurrentTicks() - start) * Timer::getSecondsPerTick() < 0.01);
+
+    const float target = 0.005f;
+    limiter.setTargetFrameTime(target);
+    GEP_ASSERT(std::fabs(limiter.getTargetFrameTime() - target) < 1e-6f);
+
+    limiter.waitForNextFrame();
+    start = Timer::getCurrentTicks();
+    uint64 last = start;
+    double shortest = 1.0;
+    const int numFrames = 40;
+    for (int i = 0; i < numFrames; i++)
+    {
+        limiter.waitForNextFrame();
+        uint64 now = Timer::getCurrentTicks();
+        shortest = std::min(shortest, (now - last) * Timer::getSecondsPerTick());
+        last = now;
+    }
+    double average = (last - start) * Timer::getSecondsPerTick() / numFrames;
+    GEP_ASSERT(average > target * 0.98 && average < target * 1.1, "frame limiter misses the target", average);
+    // a frame can come early only if the one before came late
+    GEP_ASSERT(shortest > target * 0.5, "frame limiter let a frame through way too early", shortest);
+
+    // waitUntil never returns early
+    for (int i = 0; i < 20; i++)
+    {
+        uint64 deadline = Timer::getCurrentTicks() + Timer::getTicksPerSecond() / 1000;
+        limiter.waitUntil(deadline);
+        GEP_ASSERT(Timer::getCurrentTicks() >= deadline);
+    }
+}
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+#include "gep/frametimestats.h"
+#include "gep/file.h"
+#include <cmath>
+#include <string>
+
+using namespace gep;
+
+namespace
+{
+    bool roughlyEqual(float a, float b, float relative)
+    {
+        return std::fabs(a - b) <= relative * std::fabs(b);
+    }
+}
+
+GEP_UNITTEST_GROUP(FrameTimeStats)
+GEP_UNITTEST_TEST(FrameTimeStats, RollingWindow)
+{
+    FrameTimeStats stats(4);
+    GEP_ASSERT(stats.getNumFrames() == 0);
+    GEP_ASSERT(stats.getMean() == 0.0f);
+
+    stats.addFrame(0.010f);
+    stats.addFrame(0.020f);
+    stats.addFrame(0.030f);
+    GEP_ASSERT(stats.getNumFrames() == 3);
+    GEP_ASSERT(roughlyEqual(stats.getMean(), 0.020f, 0.0001f), "wrong mean", stats.getMean());
+    GEP_ASSERT(roughlyEqual(stats.getVariance(), 0.0001f, 0.001f), "wrong variance", stats.getVariance());
+    GEP_ASSERT(stats.getMin() == 0.010f && stats.getMax() == 0.030f);
+
+    stats.addFrame(0.040f);
+    stats.addFrame(0.050f);
+    stats.addFrame(0.005f);
+    // the window now holds 0.03, 0.04, 0.05, 0.005
+    GEP_ASSERT(stats.getNumFrames() == 4);
+    GEP_ASSERT(roughlyEqual(stats.getMean(), 0.03125f, 0.0001f), "old frames did not drop out", stats.getMean());
+    GEP_ASSERT(stats.getMin() == 0.005f, "wrong min", stats.getMin());
+    GEP_ASSERT(stats.getMax() == 0.050f, "wrong max", stats.getMax());
+    GEP_ASSERT(stats.getNewest() == 0.005f);
+
+    GEP_ASSERT(roughlyEqual(stats.calcAverage(1), 0.005f, 0.0001f));
+    GEP_ASSERT(roughlyEqual(stats.calcAverage(2), 0.0275f, 0.0001f), "wrong average", stats.calcAverage(2));
+    GEP_ASSERT(roughlyEqual(stats.calcAverage(100), stats.getMean(), 0.0001f));
+
+    // the max drops out after the window moved past it
+    for (int i = 0; i < 4; i++)
+        stats.addFrame(0.016f);
+    GEP_ASSERT(stats.getMax() == 0.016f && stats.getMin() == 0.016f);
+    GEP_ASSERT(stats.getVariance() < 1e-9f, "variance should be 0", stats.getVariance());
+}
+
+GEP_UNITTEST_TEST(FrameTimeStats, Percentiles)
+{
+    FrameTimeStats stats(1000);
+    // 1 ms to 100 ms in 0.1 ms steps, 990 frames
+    for (int i = 10; i < 1000; i++)
+        stats.addFrame(i * 0.0001f);
+
+    // buckets are 5.5% wide
+    GEP_ASSERT(roughlyEqual(stats.getPercentile(50.0f), 0.0505f, 0.06f), "p50 off", stats.getPercentile(50.0f));
+    GEP_ASSERT(roughlyEqual(stats.getPercentile(95.0f), 0.09455f, 0.06f), "p95 off", stats.getPercentile(95.0f));
+    GEP_ASSERT(roughlyEqual(stats.getPercentile(99.0f), 0.09851f, 0.06f), "p99 off", stats.getPercentile(99.0f));
+    GEP_ASSERT(stats.getPercentile(0.0f) == stats.getMin());
+    GEP_ASSERT(stats.getPercentile(100.0f) <= stats.getMax());
+    GEP_ASSERT(stats.getPercentile(50.0f) <= stats.getPercentile(95.0f) && stats.getPercentile(95.0f) <= stats.getPercentile(99.0f));
+
+    // a spike dominates the tail but not the median
+    FrameTimeStats spiky(100);
+    for (int i = 0; i < 98; i++)
+        spiky.addFrame(0.016f);
+    spiky.addFrame(0.2f);
+    spiky.addFrame(0.2f);
+    GEP_ASSERT(roughlyEqual(spiky.getPercentile(50.0f), 0.016f, 0.06f));
+    GEP_ASSERT(roughlyEqual(spiky.getPercentile(99.0f), 0.2f, 0.06f), "spike not in p99", spiky.getPercentile(99.0f));
+}
+
+GEP_UNITTEST_TEST(FrameTimeStats, PhasesAndCsv)
+{
+    FrameTimeStats stats(3);
+    for (int i = 1; i <= 5; i++)
+    {
+        float phases[FramePhase::Count] = { 0.001f * i, 0.002f, 0.003f };
+        stats.addFrame(0.001f * i + 0.005f, phases);
+    }
+    GEP_ASSERT(roughlyEqual(stats.getPhaseMean(FramePhase::UpdateCallbacks), 0.004f, 0.0001f));
+    GEP_ASSERT(roughlyEqual(stats.getPhaseMean(FramePhase::Render), 0.003f, 0.0001f));
+
+    GEP_ASSERT(stats.writeCsv("frametimes_test.csv") == SUCCESS);
+    {
+        RawFile file("frametimes_test.csv", "rb");
+        GEP_ASSERT(file.isOpen());
+        std::string csv(file.getSize(), '\0');
+        file.readArray(&csv[0], csv.size());
+        GEP_ASSERT(csv.find("frame,total_ms,update_callbacks_ms,resource_update_ms,render_ms\n") == 0, "wrong csv header");
+        // oldest frame of the history first
+        GEP_ASSERT(csv.find("\n2,8.0000,3.0000,2.0000,3.0000\n") != std::string::npos, "wrong csv row");
+        GEP_ASSERT(csv.find("\n4,10.0000,5.0000,2.0000,3.0000\n") != std::string::npos, "wrong csv row");
+        GEP_ASSERT(csv.find("\n1,") == std::string::npos, "frame outside of the history written");
+    }
+    remove("frametimes_test.csv");
+
+    stats.setHistoryLength(10);
+    GEP_ASSERT(stats.getNumFrames() == 0 && stats.getHistoryLength() == 10);
+}
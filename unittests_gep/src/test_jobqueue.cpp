@@ -0,0 +1,53 @@
+#include "stdafx.h"
+#include "gep/threading/jobqueue.h"
+#include <atomic>
+
+using namespace gep;
+
+GEP_UNITTEST_GROUP(JobQueue)
+GEP_UNITTEST_TEST(JobQueue, ExecutesAllJobs)
+{
+    std::atomic<int> sum(0);
+    {
+        JobQueue queue(4);
+        GEP_ASSERT(queue.getNumThreads() == 4);
+        for (int i = 1; i <= 1000; i++)
+        {
+            queue.submit([&sum, i]() { sum += i; });
+        }
+        queue.waitUntilIdle();
+        GEP_ASSERT(sum == 500500, "not all jobs were executed", sum.load());
+    }
+}
+
+GEP_UNITTEST_TEST(JobQueue, JobsSubmittingJobs)
+{
+    // the resource manager chains its io and job stages like this
+    std::atomic<int> numExecuted(0);
+    JobQueue first(1);
+    JobQueue second(2);
+    for (int i = 0; i < 100; i++)
+    {
+        first.submit([&]()
+        {
+            numExecuted++;
+            second.submit([&]() { numExecuted++; });
+        });
+    }
+    first.waitUntilIdle();
+    second.waitUntilIdle();
+    GEP_ASSERT(numExecuted == 200, "chained jobs got lost", numExecuted.load());
+}
+
+GEP_UNITTEST_TEST(JobQueue, DestructorFinishesQueuedJobs)
+{
+    std::atomic<int> numExecuted(0);
+    {
+        JobQueue queue(1);
+        for (int i = 0; i < 50; i++)
+        {
+            queue.submit([&numExecuted]() { numExecuted++; });
+        }
+    }
+    GEP_ASSERT(numExecuted == 50, "queued jobs were dropped on destruction", numExecuted.load());
+}
@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "gep/binarylog.h"
+#include "gepimpl/subsystems/logging.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace gep;
+
+namespace
+{
+    size_t pack(char* pBuffer, size_t bufferSize, const char* fmt, ...)
+    {
+        va_list args;
+        va_start(args, fmt);
+        SCOPE_EXIT{ va_end(args); });
+        return packLogArguments(fmt, args, pBuffer, bufferSize);
+    }
+
+    /// packs the arguments, formats them again and compares the result with snprintf
+    template <class... Args>
+    void checkRoundTrip(const char* fmt, Args... args)
+    {
+        char expected[256];
+        snprintf(expected, sizeof(expected), fmt, args...);
+
+        char packed[512];
+        size_t packedSize = pack(packed, sizeof(packed), fmt, args...);
+        char decoded[256];
+        size_t length = formatPackedLogArguments(fmt, packed, packedSize, decoded, sizeof(decoded));
+
+        GEP_ASSERT(strcmp(expected, decoded) == 0, "decoded message differs", expected, decoded);
+        GEP_ASSERT(length == strlen(expected), "wrong length", length, expected);
+    }
+}
+
+GEP_UNITTEST_GROUP(BinaryLog)
+GEP_UNITTEST_TEST(BinaryLog, RoundTrip)
+{
+    checkRoundTrip("no arguments at all");
+    checkRoundTrip("100%% literal");
+    checkRoundTrip("%d %i %u", -42, 7, 4000000000u);
+    checkRoundTrip("%x %X %o %#x", 255u, 255u, 8u, 16u);
+    checkRoundTrip("%lld %llu", -1234567890123ll, 1234567890123ull);
+    checkRoundTrip("%zu %ld", static_cast<size_t>(12345), -5l);
+    checkRoundTrip("%hd %hhu", static_cast<short>(-3), static_cast<unsigned char>(200));
+    // values which do not fit are converted to the type of the length modifier
+    checkRoundTrip("%hhd %hd %hhu %hu %hhx %hX", 300, 70000, -1, -1, 511, 70000);
+    checkRoundTrip("%5d|%-5d|%05d", 42, 42, 42);
+    checkRoundTrip("%f %.2f %e %g", 3.5, 2.0 / 3.0, 12345.678, 0.0001);
+    checkRoundTrip("%c%c%c", 'g', 'e', 'p');
+    checkRoundTrip("%s and %s", "first", "second");
+    checkRoundTrip("[%10s][%-10s][%.3s]", "right", "left", "truncated");
+    checkRoundTrip("%*d|%.*f|%*.*s", 6, 1, 3, 3.14159, 8, 2, "abcdef");
+    checkRoundTrip("%.*s%s", 4, "    not terminated", "node");
+}
+
+GEP_UNITTEST_TEST(BinaryLog, StringsAreCopied)
+{
+    char name[16] = "original";
+    char packed[128];
+    size_t packedSize = pack(packed, sizeof(packed), "name: %s, null: %s", name, static_cast<const char*>(nullptr));
+    strcpy(name, "changed");
+
+    char decoded[128];
+    formatPackedLogArguments("name: %s, null: %s", packed, packedSize, decoded, sizeof(decoded));
+    GEP_ASSERT(strcmp(decoded, "name: original, null: (null)") == 0, "string was not copied", decoded);
+}
+
+GEP_UNITTEST_TEST(BinaryLog, Truncation)
+{
+    // only the first argument fits into the buffer
+    char packed[12];
+    size_t packedSize = pack(packed, sizeof(packed), "%d %d %s", 1, 2, "three");
+    GEP_ASSERT(packedSize == 8, "exactly one argument should have been stored", packedSize);
+
+    char decoded[64];
+    formatPackedLogArguments("%d %d %s", packed, packedSize, decoded, sizeof(decoded));
+    GEP_ASSERT(strcmp(decoded, "1 <truncated>") == 0, "missing arguments should be marked", decoded);
+
+    // the output buffer is too small
+    char small[8];
+    size_t length = formatPackedLogArguments("%d %d %s", packed, packedSize, small, sizeof(small));
+    GEP_ASSERT(length == 7 && small[7] == '\0', "output has to be cut and terminated", length);
+}
+
+namespace
+{
+    /// \brief keeps every line it receives, optionally blocks the writer thread until it is released
+    class CollectingSink : public ILogSink
+    {
+        std::mutex m_mutex;
+        std::condition_variable m_released;
+        bool m_isBlocking;
+
+    public:
+        std::vector<std::string> lines;
+        uint32 numFlushes;
+
+        CollectingSink(bool isBlocking = false) : m_isBlocking(isBlocking), numFlushes(0) {}
+
+        void release()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_isBlocking = false;
+            }
+            m_released.notify_all();
+        }
+
+        virtual void take(LogChannel channel, const char* msg) override
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_released.wait(lock, [this]() { return !m_isBlocking; });
+            }
+            lines.push_back(msg);
+        }
+
+        virtual void flush() override { numFlushes++; }
+    };
+
+    void logFromWorker(Logging& logging, int worker, int numMessages)
+    {
+        for(int i = 0; i < numMessages; i++)
+            logging.logMessage("worker %d message %d", worker, i);
+    }
+
+    /// checks that the sink got every message of every worker exactly once and in the order it was logged
+    void checkWorkerMessages(const CollectingSink& sink, int numWorkers, int numMessages)
+    {
+        GEP_ASSERT(sink.lines.size() == static_cast<size_t>(numWorkers * numMessages), "messages are missing", sink.lines.size());
+        std::vector<int> nextMessage(numWorkers, 0);
+        for(auto& line : sink.lines)
+        {
+            int worker = -1;
+            int message = -1;
+            const char* pText = strstr(line.c_str(), ": Message: ");
+            GEP_ASSERT(pText != nullptr && sscanf(pText, ": Message: worker %d message %d", &worker, &message) == 2, "unexpected line", line.c_str());
+            GEP_ASSERT(worker >= 0 && worker < numWorkers, "unexpected worker", line.c_str());
+            GEP_ASSERT(message == nextMessage[worker], "out of order", line.c_str(), nextMessage[worker]);
+            nextMessage[worker]++;
+        }
+    }
+}
+
+GEP_UNITTEST_GROUP(Logging)
+GEP_UNITTEST_TEST(Logging, MultipleThreads)
+{
+    const int numWorkers = 4;
+    // every ring wraps around several times
+    const int numMessages = 10 * LOG_RING_CAPACITY;
+    CollectingSink sink;
+    Logging logging;
+    logging.registerSink(&sink);
+    SCOPE_EXIT{ logging.deregisterSink(&sink); });
+
+    std::vector<std::thread> workers;
+    for(int i = 0; i < numWorkers; i++)
+        workers.emplace_back([&logging, i, numMessages]() { logFromWorker(logging, i, numMessages); });
+    for(auto& worker : workers)
+        worker.join();
+
+    logging.flush();
+    GEP_ASSERT(sink.numFlushes > 0, "flush did not reach the sink");
+    checkWorkerMessages(sink, numWorkers, numMessages);
+}
+
+GEP_UNITTEST_TEST(Logging, FullRing)
+{
+    // more than fit into the ring while the writer thread can not take any of them
+    const int numMessages = LOG_RING_CAPACITY + 10;
+    CollectingSink sink(true);
+    Logging logging;
+    logging.registerSink(&sink);
+    SCOPE_EXIT{ logging.deregisterSink(&sink); });
+
+    std::atomic<bool> isDone(false);
+    std::thread worker([&logging, &isDone, numMessages]()
+    {
+        logFromWorker(logging, 0, numMessages);
+        isDone = true;
+    });
+    SCOPE_EXIT{ sink.release(); if(worker.joinable()) worker.join(); });
+
+    // the writer is stuck in the sink with the first message, the worker has to wait for space in its ring
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    GEP_ASSERT(!isDone, "the worker did not wait for the full ring");
+
+    sink.release();
+    worker.join();
+    logging.flush();
+    // nothing was dropped, the worker waited instead
+    checkWorkerMessages(sink, 1, numMessages);
+}
+
+GEP_UNITTEST_TEST(Logging, SeveralInstances)
+{
+    CollectingSink sinkA;
+    CollectingSink sinkB;
+    Logging loggingA;
+    loggingA.registerSink(&sinkA);
+    SCOPE_EXIT{ loggingA.deregisterSink(&sinkA); });
+
+    std::thread worker([&loggingA, &sinkB]()
+    {
+        {
+            Logging loggingB;
+            loggingB.registerSink(&sinkB);
+            // switching between the instances keeps the ring of the thread in each of them
+            for(int i = 0; i < 100; i++)
+            {
+                loggingA.logMessage("worker %d message %d", 0, i);
+                loggingB.logMessage("worker %d message %d", 0, i);
+            }
+            loggingB.flush();
+            loggingB.deregisterSink(&sinkB);
+        }
+        // the ring of the destroyed instance must not be touched when the thread exits
+        loggingA.logMessage("worker %d message %d", 0, 100);
+    });
+    worker.join();
+    GEP_ASSERT(loggingA.getNumRingBuffers() == 1, "switching instances allocated new rings", loggingA.getNumRingBuffers());
+
+    // the ring of the exited thread is reused
+    std::thread nextWorker([&loggingA]() { loggingA.logMessage("worker %d message %d", 1, 0); });
+    nextWorker.join();
+    GEP_ASSERT(loggingA.getNumRingBuffers() == 1, "the ring of the exited thread was not reused", loggingA.getNumRingBuffers());
+
+    loggingA.flush();
+    GEP_ASSERT(sinkA.lines.size() == 102 && sinkB.lines.size() == 100, "messages are missing", sinkA.lines.size(), sinkB.lines.size());
+}
@@ -518,3 +518,72 @@ GEP_UNITTEST_TEST(math3d, AABB)
     GEP_ASSERT((box9.contains(box8)) == false);
     GEP_ASSERT(box7.contains(vec3(-4,4,2)) == true);
 }
+
+GEP_BENCHMARK(math3d, mat4Multiply)
+{
+    mat4 a = mat4::rotationMatrixXYZ(vec3(10, 20, 30));
+    mat4 b = mat4::translationMatrix(vec3(4, 5, 6));
+    while(state.keepRunning())
+    {
+        doNotOptimize(a);
+        mat4 result = a * b;
+        doNotOptimize(result);
+    }
+}
+
+GEP_BENCHMARK(math3d, mat4Inverse)
+{
+    mat4 m = mat4::rotationMatrixXYZ(vec3(10, 20, 30)) * mat4::translationMatrix(vec3(4, 5, 6));
+    while(state.keepRunning())
+    {
+        doNotOptimize(m);
+        mat4 result = m.inverse();
+        doNotOptimize(result);
+    }
+}
+
+GEP_BENCHMARK(math3d, mat4TransformPosition)
+{
+    mat4 m = mat4::rotationMatrixXYZ(vec3(10, 20, 30)) * mat4::translationMatrix(vec3(4, 5, 6));
+    vec3 v(1, 2, 3);
+    while(state.keepRunning())
+    {
+        doNotOptimize(v);
+        vec3 result = m.transformPosition(v);
+        doNotOptimize(result);
+    }
+}
+
+GEP_BENCHMARK(math3d, vec3Normalized)
+{
+    vec3 v(1, 2, 3);
+    while(state.keepRunning())
+    {
+        doNotOptimize(v);
+        vec3 result = v.normalized();
+        doNotOptimize(result);
+    }
+}
+
+GEP_BENCHMARK(math3d, QuaternionMultiply)
+{
+    Quaternion q(vec3(1.0f, 0.0f, 0.0f), 90.0f);
+    Quaternion r(vec3(0.0f, 0.0f, 1.0f), 35.0f);
+    while(state.keepRunning())
+    {
+        doNotOptimize(q);
+        Quaternion result = q * r;
+        doNotOptimize(result);
+    }
+}
+
+GEP_BENCHMARK(math3d, QuaternionToMat4)
+{
+    Quaternion q(vec3(1.0f, 2.0f, 3.0f).normalized(), 35.0f);
+    while(state.keepRunning())
+    {
+        doNotOptimize(q);
+        mat4 result = q.toMat4();
+        doNotOptimize(result);
+    }
+}
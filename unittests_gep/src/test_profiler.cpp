@@ -0,0 +1,241 @@
+#include "stdafx.h"
+#include "gep/profiler.h"
+#include "gep/file.h"
+#include <thread>
+#include <cstring>
+
+using namespace gep;
+
+namespace
+{
+    void recordNested(int depth)
+    {
+        GEP_PROFILE_SCOPE("nested");
+        if (depth > 0)
+            recordNested(depth - 1);
+    }
+
+    const ProfileThread* findThread(const ProfileCapture& capture, const char* name)
+    {
+        for (auto& thread : capture.threads)
+        {
+            if (thread.name == name)
+                return &thread;
+        }
+        return nullptr;
+    }
+
+    /// checks that every end has a begin and returns the deepest nesting level
+    int checkBalanced(const ProfileThread& thread)
+    {
+        int depth = 0, maxDepth = 0;
+        for (auto& event : thread.events)
+        {
+            if (event.type == ProfileEventType::ZoneBegin)
+                maxDepth = std::max(maxDepth, ++depth);
+            else if (event.type == ProfileEventType::ZoneEnd)
+                depth--;
+            GEP_ASSERT(depth >= 0, "zone ended which was never begun");
+        }
+        GEP_ASSERT(depth == 0, "zones left open");
+        return maxDepth;
+    }
+}
+
+GEP_UNITTEST_GROUP(Profiler)
+GEP_UNITTEST_TEST(Profiler, NestedZones)
+{
+    ProfileCapture discard;
+    Profiler::collect(discard);
+
+    Profiler::setEnabled(true);
+    Profiler::setThreadName("test main");
+    {
+        GEP_PROFILE_SCOPE("outer");
+        recordNested(4);
+        Profiler::markFrame();
+    }
+
+    // more events than fit into one block of the thread buffer
+    std::thread worker([]()
+    {
+        Profiler::setThreadName("test worker");
+        for (int i = 0; i < 3000; i++)
+        {
+            GEP_PROFILE_SCOPE("work");
+        }
+    });
+    worker.join();
+    Profiler::setEnabled(false);
+    {
+        GEP_PROFILE_SCOPE("not recorded");
+    }
+
+    ProfileCapture capture;
+    Profiler::collect(capture);
+    GEP_ASSERT(capture.ticksPerSecond > 0);
+
+    const ProfileThread* pMain = findThread(capture, "test main");
+    GEP_ASSERT(pMain != nullptr, "main thread missing");
+    GEP_ASSERT(pMain->events.size() == 13, "unexpected number of events", pMain->events.size());
+    GEP_ASSERT(checkBalanced(*pMain) == 6);
+    GEP_ASSERT(capture.names[pMain->events[0].data] == "outer");
+    GEP_ASSERT(capture.names[pMain->events[1].data] == "nested");
+    GEP_ASSERT(pMain->events[11].type == ProfileEventType::Frame);
+    for (size_t i = 1; i < pMain->events.size(); i++)
+    {
+        GEP_ASSERT(pMain->events[i].ticks >= pMain->events[i - 1].ticks, "events out of order");
+    }
+
+    const ProfileThread* pWorker = findThread(capture, "test worker");
+    GEP_ASSERT(pWorker != nullptr, "worker thread missing");
+    GEP_ASSERT(pWorker->events.size() == 6000, "events of a finished thread got lost", pWorker->events.size());
+    GEP_ASSERT(checkBalanced(*pWorker) == 1);
+
+    for (auto& name : capture.names)
+    {
+        GEP_ASSERT(name != "not recorded", "recorded while disabled");
+    }
+
+    // everything was taken out already
+    ProfileCapture empty;
+    Profiler::collect(empty);
+    GEP_ASSERT(empty.threads.empty());
+}
+
+GEP_UNITTEST_TEST(Profiler, Export)
+{
+    ProfileCapture discard;
+    Profiler::collect(discard);
+
+    Profiler::setEnabled(true);
+    Profiler::setThreadName("export \"test\"");
+    {
+        GEP_PROFILE_SCOPE("a");
+        {
+            GEP_PROFILE_SCOPE("b");
+        }
+        Profiler::markFrame();
+    }
+    Profiler::setEnabled(false);
+
+    ProfileCapture capture;
+    Profiler::collect(capture);
+
+    GEP_ASSERT(capture.writeBinary("profiler_test.gprof") == SUCCESS);
+    ProfileCapture loaded;
+    GEP_ASSERT(loaded.readBinary("profiler_test.gprof") == SUCCESS);
+    GEP_ASSERT(loaded.ticksPerSecond == capture.ticksPerSecond);
+    GEP_ASSERT(loaded.names == capture.names);
+    GEP_ASSERT(loaded.threads.size() == capture.threads.size());
+    for (size_t t = 0; t < capture.threads.size(); t++)
+    {
+        auto& expected = capture.threads[t];
+        auto& actual = loaded.threads[t];
+        GEP_ASSERT(actual.threadId == expected.threadId && actual.name == expected.name);
+        GEP_ASSERT(actual.events.size() == expected.events.size());
+        for (size_t i = 0; i < expected.events.size(); i++)
+        {
+            GEP_ASSERT(actual.events[i].ticks == expected.events[i].ticks);
+            GEP_ASSERT(actual.events[i].type == expected.events[i].type);
+            if (expected.events[i].type != ProfileEventType::ZoneEnd)
+            {
+                GEP_ASSERT(actual.events[i].data == expected.events[i].data);
+            }
+        }
+    }
+    remove("profiler_test.gprof");
+
+    GEP_ASSERT(capture.writeChromeTrace("profiler_test.json") == SUCCESS);
+    {
+        RawFile file("profiler_test.json", "rb");
+        GEP_ASSERT(file.isOpen());
+        std::string json(file.getSize(), '\0');
+        file.readArray(&json[0], json.size());
+        GEP_ASSERT(json.find("\"traceEvents\"") != std::string::npos);
+        GEP_ASSERT(json.find("{\"name\":\"b\",\"ph\":\"B\"") != std::string::npos);
+        GEP_ASSERT(json.find("\"ph\":\"E\"") != std::string::npos);
+        GEP_ASSERT(json.find("\"ph\":\"i\"") != std::string::npos, "frame boundary missing");
+        GEP_ASSERT(json.find("export \\\"test\\\"") != std::string::npos, "thread name not escaped");
+    }
+    remove("profiler_test.json");
+}
+
+GEP_UNITTEST_TEST(Profiler, Counters)
+{
+    std::vector<ProfileZoneCounters> discard;
+    Profiler::collectCounters(discard);
+
+    if (Profiler::setCountersEnabled(true) != SUCCESS)
+    {
+        // no pmu or not allowed to use it, zones keep working without counters
+        GEP_ASSERT(!Profiler::areCountersEnabled());
+        {
+            GEP_PROFILE_SCOPE("no counters");
+        }
+        std::vector<ProfileZoneCounters> zones;
+        Profiler::collectCounters(zones);
+        GEP_ASSERT(zones.empty());
+        return;
+    }
+    GEP_ASSERT(Profiler::areCountersEnabled());
+
+    volatile uint64 sink = 0;
+    {
+        GEP_PROFILE_SCOPE("outer");
+        for (int i = 0; i < 100000; i++)
+            sink = sink + i;
+        recordNested(3);
+    }
+    std::thread worker([&sink]()
+    {
+        GEP_PROFILE_SCOPE("outer");
+        for (int i = 0; i < 100000; i++)
+            sink = sink + i;
+    });
+    worker.join();
+    Profiler::setCountersEnabled(false);
+    {
+        GEP_PROFILE_SCOPE("not counted");
+    }
+
+    std::vector<ProfileZoneCounters> zones;
+    Profiler::collectCounters(zones);
+    const ProfileZoneCounters* pOuter = nullptr;
+    const ProfileZoneCounters* pNested = nullptr;
+    for (auto& zone : zones)
+    {
+        if (zone.name == "outer")
+            pOuter = &zone;
+        else if (zone.name == "nested")
+            pNested = &zone;
+        GEP_ASSERT(zone.name != "not counted", "counted while disabled");
+    }
+    GEP_ASSERT(pOuter != nullptr && pNested != nullptr, "zones missing");
+    GEP_ASSERT(pOuter->calls == 2, "the zone of the finished thread got lost", pOuter->calls);
+    GEP_ASSERT(pNested->calls == 4);
+    for (int i = 0; i < PerfCounter::Count; i++)
+    {
+        GEP_ASSERT(pOuter->self[i] <= pOuter->inclusive[i]);
+        // the recursion is only counted once inclusive
+        GEP_ASSERT(pNested->self[i] <= pNested->inclusive[i]);
+    }
+    if (Profiler::isCounterAvailable(PerfCounter::Instructions))
+    {
+        GEP_ASSERT(pOuter->getPerCall(PerfCounter::Instructions) > 100000.0f, "too few instructions", pOuter->getPerCall(PerfCounter::Instructions));
+        GEP_ASSERT(pOuter->inclusive[PerfCounter::Instructions] > pNested->inclusive[PerfCounter::Instructions]);
+    }
+
+    GEP_ASSERT(ProfileZoneCounters::writeReport(zones, "profiler_counters.txt") == SUCCESS);
+    {
+        RawFile file("profiler_counters.txt", "rb");
+        GEP_ASSERT(file.isOpen());
+        std::string report(file.getSize(), '\0');
+        file.readArray(&report[0], report.size());
+        GEP_ASSERT(report.find("instructions/call") != std::string::npos);
+        GEP_ASSERT(report.find("\nouter ") != std::string::npos);
+    }
+    remove("profiler_counters.txt");
+
+    Profiler::collectCounters(discard);
+}
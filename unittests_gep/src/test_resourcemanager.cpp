@@ -0,0 +1,203 @@
+#include "stdafx.h"
+#include "gepimpl/subsystems/resourceManager.h"
+#include "gep/file.h"
+#include "gep/utils.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+using namespace gep;
+
+namespace
+{
+    /// \brief lets the test decide when the loads on the job threads may finish
+    struct LoadGate
+    {
+        std::mutex mutex;
+        std::condition_variable opened;
+        bool isOpen;
+        std::atomic<int> numLoads;
+
+        LoadGate() : isOpen(false), numLoads(0) {}
+
+        void open()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                isOpen = true;
+            }
+            opened.notify_all();
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            opened.wait(lock, [this]() { return isOpen; });
+        }
+    };
+
+    class TestResource : public IResource
+    {
+        IResourceLoader* m_pLoader;
+
+    public:
+        int value;
+
+        TestResource(int value) : m_pLoader(nullptr), value(value) {}
+
+        virtual IResourceLoader* getLoader() override { return m_pLoader; }
+        virtual void setLoader(IResourceLoader* pLoader) override { m_pLoader = pLoader; }
+        virtual void unload() override {}
+        virtual void finalize() override {}
+        virtual uint32 getFinalizeOptions() override { return ResourceFinalize::NotRequired; }
+        virtual bool isLoaded() override { return true; }
+        virtual IResource* getSuperResource() override { return nullptr; }
+    };
+
+    /// \brief loads a TestResource with the value plus the number of times it was loaded before
+    class TestResourceLoader : public IResourceLoader
+    {
+        int m_value;
+        LoadGate* m_pGate;
+
+    public:
+        TestResourceLoader(const char* resourceId, int value, LoadGate* pGate) :
+            IResourceLoader(resourceId), m_value(value), m_pGate(pGate) {}
+
+        virtual IResource* loadResource(IResource* pInPlace) override
+        {
+            if (m_pGate == nullptr)
+                return new TestResource(m_value);
+            m_pGate->wait();
+            int numLoads = m_pGate->numLoads++;
+            if (pInPlace != nullptr)
+            {
+                static_cast<TestResource*>(pInPlace)->value = m_value + numLoads;
+                return pInPlace;
+            }
+            return new TestResource(m_value + numLoads);
+        }
+
+        virtual void deleteResource(IResource* pResource) override { delete pResource; }
+        virtual void postLoad(ResourcePtr<IResource> pResource) override {}
+        GEP_RESOURCELOADER_DEFAULT_FUNCTIONS(TestResourceLoader, "TestResource")
+    };
+
+    /// \brief a loader whose resource can never be loaded
+    class FailingResourceLoader : public IResourceLoader
+    {
+    public:
+        FailingResourceLoader(const char* resourceId) : IResourceLoader(resourceId) {}
+
+        virtual IResource* loadResource(IResource* pInPlace) override { return nullptr; }
+        virtual void deleteResource(IResource* pResource) override { delete pResource; }
+        virtual void postLoad(ResourcePtr<IResource> pResource) override {}
+        GEP_RESOURCELOADER_DEFAULT_FUNCTIONS(FailingResourceLoader, "TestResource")
+    };
+
+    bool createDataDirectory()
+    {
+        createDirectory("data");
+        return true;
+    }
+
+    /// \brief a resource manager with the dummy of the test resources registered
+    struct TestResourceManager
+    {
+        /// the manager watches the data directory, it has to exist before the manager is constructed
+        bool dataDirectoryCreated;
+        ResourceManager manager;
+        TestResource* pDummy;
+
+        TestResourceManager() : dataDirectoryCreated(createDataDirectory())
+        {
+            manager.initialize();
+            TestResourceLoader dummyLoader("dummy", -1, nullptr);
+            IResourceLoader* pLoader = dummyLoader.moveToHeap();
+            pDummy = static_cast<TestResource*>(pLoader->loadResource(nullptr));
+            pDummy->setLoader(pLoader);
+            manager.registerResourceType(pDummy);
+        }
+
+        ~TestResourceManager()
+        {
+            manager.destroy();
+        }
+    };
+}
+
+GEP_UNITTEST_GROUP(ResourceManager)
+GEP_UNITTEST_TEST(ResourceManager, LoadAsync)
+{
+    // the gate and the batch outlive the manager, which finishes the loads in flight when it is destroyed
+    LoadGate gate;
+    ResourceLoadBatch batch;
+    TestResourceManager test;
+    SCOPE_EXIT{ gate.open(); });
+    TestResourceLoader loader("data/async.test", 10, &gate);
+    auto pResource = test.manager.loadResourceAsync<TestResource>(loader, &batch);
+
+    // the dummy is returned right away, the load can not finish before the gate is open
+    GEP_ASSERT(pResource.get() == test.pDummy, "the dummy was not returned while loading");
+    GEP_ASSERT(batch.getNumQueued() == 1 && !batch.isDone());
+    GEP_ASSERT(test.manager.waitForBatch(batch, 0) == FAILURE, "the batch is done before its load");
+    GEP_ASSERT(test.manager.waitForBatch(batch, 20) == FAILURE, "the batch is done before its load");
+    GEP_ASSERT(pResource.get() == test.pDummy);
+
+    // loading the same resource again while it is in flight gives the same handle
+    TestResourceLoader sameLoader("./data/other/../async.test", 20, &gate);
+    auto pSame = test.manager.loadResourceAsync<TestResource>(sameLoader);
+    GEP_ASSERT(pSame.getWeakRefIndex() == pResource.getWeakRefIndex(), "the resource is loaded twice");
+
+    // the real resource is swapped into every handle once the load completed
+    gate.open();
+    GEP_ASSERT(test.manager.waitForBatch(batch) == SUCCESS);
+    GEP_ASSERT(batch.isDone() && batch.getNumFinished() == 1 && batch.getNumFailed() == 0 && batch.getProgress() == 1.0f);
+    GEP_ASSERT(pResource.get() != test.pDummy && pResource->value == 10, "the loaded resource was not swapped in");
+    GEP_ASSERT(pSame.get() == pResource.get());
+    GEP_ASSERT(gate.numLoads == 1);
+
+    // reloading uses the loader which loaded the resource, every handle sees the result
+    test.manager.reloadResource(pResource);
+    GEP_ASSERT(gate.numLoads == 2 && pSame->value == 11, "the resource was not reloaded", pSame->value);
+}
+
+GEP_UNITTEST_TEST(ResourceManager, WaitForBatch)
+{
+    LoadGate gate;
+    ResourceLoadBatch batch;
+    TestResourceManager test;
+    SCOPE_EXIT{ gate.open(); });
+    const int numResources = 20;
+    ResourcePtr<TestResource> resources[numResources];
+    for (int i = 0; i < numResources; i++)
+    {
+        TestResourceLoader loader(format("data/batch%d.test", i).c_str(), 100 * i, &gate);
+        resources[i] = test.manager.loadResourceAsync<TestResource>(loader, &batch);
+    }
+    GEP_ASSERT(batch.getNumQueued() == numResources && batch.getProgress() == 0.0f);
+
+    gate.open();
+    GEP_ASSERT(test.manager.waitForBatch(batch) == SUCCESS);
+    // waitForBatch only returns once every load of the batch finished and was swapped in
+    GEP_ASSERT(gate.numLoads == numResources && batch.getNumFinished() == numResources, "returned too early", batch.getNumFinished());
+    for (int i = 0; i < numResources; i++)
+    {
+        GEP_ASSERT(resources[i].get() != test.pDummy, "a load of the batch was not swapped in", i);
+        GEP_ASSERT(resources[i]->value >= 100 * i && resources[i]->value < 100 * i + numResources, "wrong resource", i);
+    }
+}
+
+GEP_UNITTEST_TEST(ResourceManager, FailedLoad)
+{
+    uint32 numEntries = IResource::getNumWeakTableEntries();
+    {
+        TestResourceManager test;
+        FailingResourceLoader loader("data/missing.test");
+        auto pResource = test.manager.loadResource<TestResource>(loader);
+        GEP_ASSERT(pResource.get() == test.pDummy, "a failed load has to return the dummy");
+        GEP_ASSERT(pResource.getWeakRefIndex() != test.pDummy->getWeakRefIndex(), "the handle of a failed load needs its own slot");
+    }
+    // the slot of the handle which was never replaced has to be given back with the dummy
+    GEP_ASSERT(IResource::getNumWeakTableEntries() == numEntries, "weak table slots leaked", IResource::getNumWeakTableEntries(), numEntries);
+}
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "gep/samplingprofiler.h"
+#include "gep/timer.h"
+#include "gep/file.h"
+#include <string>
+
+using namespace gep;
+
+namespace
+{
+    volatile double g_sink;
+
+    void burnCpu(float seconds)
+    {
+        Timer timer;
+        double value = 1.0;
+        while (timer.getTimeAsFloat() < seconds)
+        {
+            for (int i = 0; i < 1000; i++)
+                value = value * 1.0000001 + 0.5;
+        }
+        g_sink = value;
+    }
+}
+
+GEP_UNITTEST_GROUP(SamplingProfiler)
+GEP_UNITTEST_TEST(SamplingProfiler, FoldedStacks)
+{
+    if (SamplingProfiler::start(1000) != SUCCESS)
+    {
+        // not supported on this platform
+        GEP_ASSERT(!SamplingProfiler::isRunning());
+        return;
+    }
+    GEP_ASSERT(SamplingProfiler::isRunning());
+
+    // called through a volatile pointer so that it shows up as its own frame
+    void (*volatile pBurn)(float) = &burnCpu;
+    pBurn(0.3f);
+    SamplingProfiler::stop();
+    GEP_ASSERT(!SamplingProfiler::isRunning());
+
+    size_t numSamples = SamplingProfiler::getNumSamples();
+    // 300 expected, the timer only counts the cpu time this process actually got
+    GEP_ASSERT(numSamples > 30, "too few samples", numSamples);
+    GEP_ASSERT(SamplingProfiler::getNumDroppedSamples() == 0);
+
+    GEP_ASSERT(SamplingProfiler::writeFoldedStacks("sampling_test.folded") == SUCCESS);
+    {
+        RawFile file("sampling_test.folded", "rb");
+        GEP_ASSERT(file.isOpen());
+        std::string folded(file.getSize(), '\0');
+        file.readArray(&folded[0], folded.size());
+        GEP_ASSERT(!folded.empty() && folded.back() == '\n');
+
+        size_t samplesInBurn = 0, samplesTotal = 0;
+        for (size_t lineStart = 0; lineStart < folded.size(); )
+        {
+            size_t lineEnd = folded.find('\n', lineStart);
+            std::string line = folded.substr(lineStart, lineEnd - lineStart);
+            size_t space = line.rfind(' ');
+            GEP_ASSERT(space != std::string::npos, "line without a count", line.c_str());
+            size_t count = strtoul(line.c_str() + space + 1, nullptr, 10);
+            samplesTotal += count;
+            if (line.find("burnCpu") != std::string::npos)
+                samplesInBurn += count;
+            lineStart = lineEnd + 1;
+        }
+        GEP_ASSERT(samplesTotal == numSamples, "samples got lost", samplesTotal, numSamples);
+        GEP_ASSERT(samplesInBurn * 2 > samplesTotal, "the busy function is not where the time went", samplesInBurn, samplesTotal);
+    }
+    remove("sampling_test.folded");
+
+    // a small buffer drops what does not fit
+    GEP_ASSERT(SamplingProfiler::start(1000, SamplingProfiler::MAX_FRAMES + 1) == SUCCESS);
+    // long enough to overflow even if every sample is a single frame
+    pBurn(0.2f);
+    SamplingProfiler::stop();
+    GEP_ASSERT(SamplingProfiler::getNumDroppedSamples() > 0, "nothing dropped");
+    // every sample takes at least two entries, its count and the interrupted function
+    GEP_ASSERT(SamplingProfiler::getNumSamples() <= (SamplingProfiler::MAX_FRAMES + 1) / 2, "more samples than fit into the buffer");
+}
@@ -0,0 +1,54 @@
+#include "stdafx.h"
+#include "gep/stackwalker.h"
+#include <string>
+
+using namespace gep;
+
+namespace
+{
+    volatile size_t g_numCaptured;
+
+    size_t captureHere(ArrayPtr<StackWalker::address_t> addresses)
+    {
+        // skips getCallstack itself
+        g_numCaptured = StackWalker::getCallstack(1, addresses);
+        return g_numCaptured;
+    }
+}
+
+GEP_UNITTEST_GROUP(StackWalker)
+GEP_UNITTEST_TEST(StackWalker, StackWalker)
+{
+    StackWalker::address_t addresses[16];
+
+    // called through a volatile pointer so that it can not be inlined
+    size_t (*volatile pCapture)(ArrayPtr<StackWalker::address_t>) = &captureHere;
+    size_t numFound = pCapture(ArrayPtr<StackWalker::address_t>(addresses));
+
+    GEP_ASSERT(numFound > 1 && numFound <= 16, "stack walker did not find any stack frames");
+
+    //Test a way too small buffer
+    {
+        StackWalker::address_t addresses2[3];
+        size_t numFound2 = StackWalker::getCallstack(0, ArrayPtr<StackWalker::address_t>(addresses2));
+
+        GEP_ASSERT(numFound2 == GEP_ARRAY_SIZE(addresses2), "stack walker did not respect the array size");
+    }
+
+    //Test resolving the stack frames
+    char results[GEP_ARRAY_SIZE(addresses)][256];
+    memset(results, 0, sizeof(results));
+    StackWalker::resolveCallstack(ArrayPtr<StackWalker::address_t>(addresses, numFound), (char*)results, 256);
+
+    GEP_ASSERT(results[0][0] != 0, "nothing has been written to the pFunctionNames argument");
+    //make sure the StackWalker sticks to the visual studio error formatting: file(line): function
+    const char* separator = strstr(results[0], "): ");
+    GEP_ASSERT(separator != nullptr, "no file and line number in the result", results[0]);
+    GEP_ASSERT(strstr(separator, "captureHere") != nullptr, "the function name is not correct", results[0]);
+    GEP_ASSERT(strstr(results[0], "test_stackwalker.cpp(") != nullptr, "the file name is not correct", results[0]);
+
+    char names[GEP_ARRAY_SIZE(addresses)][256];
+    StackWalker::resolveFunctionNames(ArrayPtr<StackWalker::address_t>(addresses, numFound), (char*)names, 256);
+    std::string name = names[0];
+    GEP_ASSERT(name.size() >= 11 && name.compare(name.size() - 11, 11, "captureHere") == 0, "the function name is not correct", names[0]);
+}
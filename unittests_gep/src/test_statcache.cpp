@@ -0,0 +1,126 @@
+#include "stdafx.h"
+#include "gep/statcache.h"
+#include "gep/file.h"
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+using namespace gep;
+
+namespace
+{
+    const char* cachedDirectory = "statcache_test";
+    const uint32 numFiles = 200;
+
+    std::string testFilename(uint32 i)
+    {
+        return std::string(cachedDirectory) + "/models/model" + std::to_string(i) + ".fbx";
+    }
+
+    void writeSize(const std::string& filename, size_t size)
+    {
+        RawFile file(filename.c_str(), "wb");
+        GEP_ASSERT(file.isOpen());
+        std::string data(size, 'x');
+        file.writeArray(data.c_str(), size);
+    }
+
+    void createTestFiles()
+    {
+        createDirectory(cachedDirectory);
+        createDirectory((std::string(cachedDirectory) + "/models").c_str());
+        for(uint32 i = 0; i < numFiles; i++)
+            writeSize(testFilename(i), i);
+    }
+
+    void removeTestFiles()
+    {
+        for(uint32 i = 0; i < numFiles; i++)
+            remove(testFilename(i).c_str());
+        rmdir((std::string(cachedDirectory) + "/models").c_str());
+        rmdir(cachedDirectory);
+    }
+}
+
+GEP_UNITTEST_GROUP(StatCache)
+GEP_UNITTEST_TEST(StatCache, Lookups)
+{
+    createTestFiles();
+    StatCache cache;
+    cache.addDirectory(cachedDirectory);
+    for(uint32 i = 0; i < numFiles; i++)
+    {
+        GEP_ASSERT(cache.fileExists(testFilename(i).c_str()), "a file is missing", i);
+        GEP_ASSERT(cache.getFileSize(testFilename(i).c_str()) == i, "wrong size", i);
+    }
+    GEP_ASSERT(cache.directoryExists("statcache_test\\models\\") && !cache.fileExists("./statcache_test/models"));
+    GEP_ASSERT(cache.directoryExists(cachedDirectory));
+    GEP_ASSERT(!cache.fileExists("statcache_test/models/missing.fbx") && cache.getFileSize("statcache_test/models/missing.fbx") == 0);
+    GEP_ASSERT(!cache.fileExists("statcache_test/missing/model0.fbx"));
+    GEP_ASSERT(cache.getType("statcache_test/models/model0.fbx/sub") == StatCache::Type::None);
+
+    // changes are only seen after they were reported
+    std::string newFile = std::string(cachedDirectory) + "/models/new.fbx";
+    writeSize(newFile, 10);
+    writeSize(testFilename(5), 50);
+    GEP_ASSERT(!cache.fileExists(newFile.c_str()), "the directory was listed again without being invalidated");
+    GEP_ASSERT(cache.getFileSize(testFilename(5).c_str()) == 5);
+    cache.invalidate(newFile.c_str());
+    cache.invalidate(testFilename(5).c_str());
+    GEP_ASSERT(cache.fileExists(newFile.c_str()) && cache.getFileSize(newFile.c_str()) == 10);
+    GEP_ASSERT(cache.getFileSize(testFilename(5).c_str()) == 50);
+    GEP_ASSERT(cache.getFileSize(testFilename(6).c_str()) == 6);
+
+    // invalidating a directory forgets everything in it
+    remove(newFile.c_str());
+    removeTestFiles();
+    GEP_ASSERT(cache.fileExists(testFilename(1).c_str()));
+    cache.invalidate(cachedDirectory);
+    GEP_ASSERT(!cache.directoryExists(cachedDirectory) && !cache.fileExists(testFilename(1).c_str()));
+
+    // paths outside of the cached directories go to the file system
+    writeSize("statcache_test_uncached.bin", 3);
+    GEP_ASSERT(cache.fileExists("statcache_test_uncached.bin") && cache.getFileSize("statcache_test_uncached.bin") == 3);
+    remove("statcache_test_uncached.bin");
+    GEP_ASSERT(!cache.fileExists("statcache_test_uncached.bin"));
+}
+
+namespace
+{
+    void benchmarkFileExists(BenchmarkState& state, bool cached)
+    {
+        createTestFiles();
+        StatCache cache;
+        if(cached)
+            cache.addDirectory(cachedDirectory);
+        std::vector<std::string> filenames;
+        for(uint32 i = 0; i < numFiles; i++)
+        {
+            filenames.push_back(testFilename(i));
+            // the model loader also looks for files which do not exist yet
+            filenames.push_back(testFilename(i) + ".info");
+        }
+        size_t next = 0;
+        while(state.keepRunning())
+        {
+            doNotOptimize(cache.fileExists(filenames[next].c_str()));
+            next = (next + 1) % filenames.size();
+        }
+        removeTestFiles();
+    }
+}
+
+GEP_BENCHMARK(StatCache, FileExists)
+{
+    benchmarkFileExists(state, true);
+}
+
+GEP_BENCHMARK(StatCache, FileExistsUncached)
+{
+    benchmarkFileExists(state, false);
+}
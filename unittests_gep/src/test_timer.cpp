@@ -76,3 +76,32 @@ GEP_UNITTEST_TEST(Timer, PointInTime)
     GEP_ASSERT(t1 <= t1);
     GEP_ASSERT(t2 <= t2);
 }
+
+GEP_UNITTEST_TEST(Timer, Clock)
+{
+    GEP_ASSERT(Timer::getTicksPerSecond() >= 1000000, "the clock should at least have microsecond resolution", Timer::getClockName());
+    GEP_ASSERT(Timer::getSecondsPerTick() * Timer::getTicksPerSecond() > 0.999 && Timer::getSecondsPerTick() * Timer::getTicksPerSecond() < 1.001);
+
+    // compare against the performance counter the test uses everywhere else
+    uint64 frequency, start, end;
+    QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&frequency));
+    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&start));
+    uint64 ticksStart = Timer::getCurrentTicks();
+    Sleep(50);
+    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&end));
+    uint64 ticksEnd = Timer::getCurrentTicks();
+    double expected = static_cast<double>(end - start) / frequency;
+    double measured = (ticksEnd - ticksStart) * Timer::getSecondsPerTick();
+    GEP_ASSERT(measured > expected * 0.98 && measured < expected * 1.02, "clock is not calibrated correctly", measured, expected);
+
+    uint64 last = Timer::getCurrentTicks();
+    for (int i = 0; i < 10000; i++)
+    {
+        uint64 now = Timer::getCurrentTicks();
+        GEP_ASSERT(now >= last, "clock is not monotonic");
+        last = now;
+    }
+
+    PointInTime start0;
+    GEP_ASSERT(start0.getTicks() == 0);
+}
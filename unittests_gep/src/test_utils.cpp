@@ -243,3 +243,85 @@ GEP_UNITTEST_TEST(Utils, normalizePath)
         GEP_ASSERT(path == "Weapons/Some Sound");
     }
 }
+
+GEP_UNITTEST_TEST(Utils, normalizeAndHashPath)
+{
+    // into a separate buffer, the source stays as it is
+    {
+        const char source[] = "./data\\\\models//barbarian/../knight/./knight_with_a_long_name.fbx";
+        char destination[sizeof(source)];
+        auto normalized = normalizeAndHashPath(source, sizeof(source) - 1, destination);
+        std::string result(destination, normalized.length);
+        GEP_ASSERT(result == "data/models/knight/knight_with_a_long_name.fbx", "wrong path", result.c_str());
+        GEP_ASSERT(normalized.hash == hashPath(result.c_str(), result.length()), "the hash does not match the path");
+        GEP_ASSERT(source[0] == '.' && source[6] == '\\');
+    }
+
+    // the hash only depends on the normalized path, also after going up with ../
+    {
+        std::string lh = "\\Sounds\\Weapons\\Some Sound";
+        std::string rh = "/Sounds//Music/Very/../../Weapons/./Some Sound";
+        uint64 lhHash = normalizeAndHashPath(lh, NormalizationOptions::PreserveLeadingSlash);
+        uint64 rhHash = normalizeAndHashPath(rh, NormalizationOptions::PreserveLeadingSlash);
+        GEP_ASSERT(lh == "/Sounds/Weapons/Some Sound" && rh == lh);
+        GEP_ASSERT(lhHash == rhHash && lhHash != hashPath("Sounds/Weapons/Some Sound", 25));
+    }
+
+    // separators at any position of the 16 chars which are searched at once
+    for (size_t length = 1; length < 40; length++)
+    {
+        std::string segment(length, 'a');
+        std::string path = segment + "\\\\" + segment + "/../" + segment + "/";
+        uint64 hash = normalizeAndHashPath(path);
+        GEP_ASSERT(path == segment + "/" + segment + "/", "wrong path", length);
+        GEP_ASSERT(hash == hashPath(path.c_str(), path.length()));
+    }
+
+    // leading ../ can not be removed by the ones which follow
+    {
+        std::string path = "../../a";
+        uint64 hash = normalizeAndHashPath(path);
+        GEP_ASSERT(path == "../../a", "wrong path", path.c_str());
+        GEP_ASSERT(hash == hashPath(path.c_str(), path.length()));
+
+        path = "./../b/../../a/c/../";
+        normalizeAndHashPath(path);
+        GEP_ASSERT(path == "../../a/", "wrong path", path.c_str());
+
+        path = "/../a";
+        normalizeAndHashPath(path, NormalizationOptions::PreserveLeadingSlash);
+        GEP_ASSERT(path == "/a", "wrong path", path.c_str());
+    }
+
+    // deeper than the fixed stack of segments, ../ still goes up
+    {
+        std::string deep;
+        for (int i = 0; i < 200; i++)
+            deep += "d" + std::to_string(i) + "/";
+        std::string path = deep + "../x";
+        uint64 hash = normalizeAndHashPath(path);
+        GEP_ASSERT(path == deep.substr(0, deep.length() - 5) + "x", "wrong path", path.c_str());
+        GEP_ASSERT(hash == hashPath(path.c_str(), path.length()));
+
+        path = deep;
+        for (int i = 0; i < 199; i++)
+            path += "../";
+        path += "x";
+        normalizeAndHashPath(path);
+        GEP_ASSERT(path == "d0/x", "wrong path", path.c_str());
+    }
+
+    std::string empty;
+    GEP_ASSERT(normalizeAndHashPath(empty) == hashPath("", 0) && empty.empty());
+}
+
+GEP_BENCHMARK(Utils, NormalizeAndHashPath)
+{
+    const char source[] = "./data\\models\\barbarian\\textures/../Barbarian_Belt_Low_d.dds";
+    char destination[sizeof(source)];
+    while (state.keepRunning())
+    {
+        auto normalized = normalizeAndHashPath(source, sizeof(source) - 1, destination, NormalizationOptions::PreserveLeadingSlash);
+        doNotOptimize(normalized.hash);
+    }
+}
@@ -0,0 +1,316 @@
+#include "stdafx.h"
+#include "gep/vfs.h"
+#include "gep/chunkfile.h"
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#define rmdir _rmdir
+#else
+#include <unistd.h>
+#endif
+
+using namespace gep;
+
+namespace
+{
+    const char* pakFilename = "vfs_test.pak";
+    const char* overlayDirectory = "vfs_test_overlay";
+
+    std::vector<uint8> makeData(size_t size, uint8 seed)
+    {
+        std::vector<uint8> data(size);
+        for(size_t i = 0; i < size; i++)
+            data[i] = static_cast<uint8>(i * 13 + seed);
+        return data;
+    }
+
+    void writeFile(const char* filename, const std::vector<uint8>& data)
+    {
+        RawFile file(filename, "wb");
+        GEP_ASSERT(file.isOpen());
+        file.writeArray(data.data(), data.size());
+    }
+
+    std::vector<uint8> readVfsFile(VirtualFileSystem& vfs, const char* path)
+    {
+        VfsFile file;
+        if(vfs.open(path, file) != SUCCESS)
+            return std::vector<uint8>();
+        return std::vector<uint8>(file.getData().getPtr(), file.getData().getPtr() + file.getSize());
+    }
+
+    void writeTestPak()
+    {
+        auto textures = makeData(1000, 1);
+        auto sounds = makeData(33, 2);
+        writeFile("vfs_test_source.bin", makeData(70000, 3));
+        PakWriter writer;
+        writer.addFile("data/textures/wall.dds", ArrayPtr<const uint8>(textures.data(), textures.size()));
+        writer.addFile("data\\sounds\\.\\step.wav", ArrayPtr<const uint8>(sounds.data(), sounds.size()));
+        writer.addFile("data/empty.txt", ArrayPtr<const uint8>());
+        writer.addFileFromDisk("data/models/big.bin", "vfs_test_source.bin");
+        GEP_ASSERT(writer.write(pakFilename) == SUCCESS, "the archive could not be written");
+        remove("vfs_test_source.bin");
+    }
+}
+
+GEP_UNITTEST_GROUP(Vfs)
+GEP_UNITTEST_TEST(Vfs, PakArchive)
+{
+    writeTestPak();
+    {
+        PakArchive archive;
+        GEP_ASSERT(archive.open(pakFilename) == SUCCESS);
+        auto entries = archive.getEntries();
+        GEP_ASSERT(entries.length() == 4, "wrong number of files", entries.length());
+        for(size_t i = 0; i < entries.length(); i++)
+        {
+            GEP_ASSERT(i == 0 || entries[i - 1].hash <= entries[i].hash, "the table is not sorted");
+            GEP_ASSERT(entries[i].offset % PakArchive::DATA_ALIGNMENT == 0, "the data is not aligned");
+        }
+
+        // the paths are normalized when they are added and when they are looked up
+        auto pSound = archive.find("./data/sounds/step.wav");
+        GEP_ASSERT(pSound != nullptr && archive.getPath(*pSound) == "data/sounds/step.wav");
+        GEP_ASSERT(archive.getData(*pSound).length() == 33 && archive.getData(*pSound)[32] == makeData(33, 2)[32]);
+        auto pBig = archive.find("data/models/big.bin");
+        GEP_ASSERT(pBig != nullptr && pBig->size == 70000, "the file from the disk is missing");
+        GEP_ASSERT(memcmp(archive.getData(*pBig).getPtr(), makeData(70000, 3).data(), 70000) == 0, "the file from the disk is wrong");
+        auto pEmpty = archive.find("data/empty.txt");
+        GEP_ASSERT(pEmpty != nullptr && pEmpty->size == 0);
+        GEP_ASSERT(archive.find("data/models/small.bin") == nullptr);
+        GEP_ASSERT(archive.find("data/textures") == nullptr);
+    }
+
+    // a path can only be in the archive once
+    {
+        PakWriter writer;
+        uint8 value = 1;
+        writer.addFile("a.txt", ArrayPtr<const uint8>(&value, 1));
+        writer.addFile("./a.txt", ArrayPtr<const uint8>(&value, 1));
+        GEP_ASSERT(writer.write("vfs_test_duplicate.pak") == FAILURE, "a duplicate path was written");
+        GEP_ASSERT(!fileExists("vfs_test_duplicate.pak"), "the failed archive was left behind");
+    }
+
+    // damaged archives are not mounted
+    std::vector<uint8> original;
+    {
+        MappedFile file;
+        GEP_ASSERT(file.open(pakFilename) == SUCCESS);
+        original.assign(file.getData().getPtr(), file.getData().getPtr() + file.getData().length());
+    }
+    auto checkDamaged = [&](size_t offset, uint8 value, size_t size, const char* what)
+    {
+        std::vector<uint8> damaged(original.begin(), original.begin() + size);
+        if(offset < size)
+            damaged[offset] = value;
+        writeFile("vfs_test_damaged.pak", damaged);
+        PakArchive archive;
+        GEP_ASSERT(archive.open("vfs_test_damaged.pak") == FAILURE, what);
+        GEP_ASSERT(!archive.isOpen());
+    };
+    checkDamaged(0, 'X', original.size(), "wrong magic");
+    checkDamaged(0, 'G', 50, "cut off table");
+    checkDamaged(sizeof(PakArchive::Header) + 15, 0xFF, original.size(), "file behind the end");
+    checkDamaged(sizeof(PakArchive::Header) + 4 * sizeof(PakArchive::Entry), 'x', original.size(), "changed path");
+    checkDamaged(0, 'G', original.size() - 10, "cut off data");
+    remove("vfs_test_damaged.pak");
+    remove(pakFilename);
+}
+
+GEP_UNITTEST_TEST(Vfs, Mounts)
+{
+    writeTestPak();
+    VirtualFileSystem vfs;
+    // without mounts the files are opened by their path
+    writeFile("vfs_test_loose.bin", makeData(10, 4));
+    GEP_ASSERT(vfs.exists("vfs_test_loose.bin") && !vfs.exists("data/textures/wall.dds"));
+    GEP_ASSERT(readVfsFile(vfs, "./vfs_test_loose.bin") == makeData(10, 4));
+    {
+        // they are opened with the path as it was given, not the normalized one
+        VfsPath path(".\\vfs_test_loose.bin");
+        GEP_ASSERT(path.path == "vfs_test_loose.bin" && path.original == ".\\vfs_test_loose.bin");
+        RawFile file;
+        std::string diskPath;
+        GEP_ASSERT(vfs.openLoose("./vfs_test_loose.bin", file, "rb", diskPath) == SUCCESS && diskPath == "./vfs_test_loose.bin");
+    }
+
+    GEP_ASSERT(vfs.mountArchive("vfs_test_missing.pak") == FAILURE);
+    GEP_ASSERT(vfs.mountArchive(pakFilename) == SUCCESS);
+    GEP_ASSERT(vfs.exists("data/textures/wall.dds") && vfs.exists("data//textures/../textures/wall.dds"));
+    {
+        VfsFile file;
+        VfsPath path("data/textures/wall.dds");
+        GEP_ASSERT(vfs.open(path, file) == SUCCESS && file.isInArchive());
+        std::string diskPath;
+        GEP_ASSERT(!vfs.findLooseFile(path, diskPath), "a file in an archive has no path on the disk");
+
+        // read like a RawFile
+        uint32 first = 0;
+        GEP_ASSERT(file.read(first) == sizeof(first) && file.position() == sizeof(first));
+        GEP_ASSERT(memcmp(&first, makeData(4, 1).data(), sizeof(first)) == 0);
+        file.seek(996);
+        uint32 values[2];
+        GEP_ASSERT(file.readArray(values, 2) == sizeof(uint32), "read over the end of the file");
+        file.skip(100);
+        GEP_ASSERT(file.position() == file.getSize());
+        GEP_ASSERT(file.read(first) == 0);
+    }
+    {
+        // the file keeps the archive alive
+        VfsFile file;
+        GEP_ASSERT(vfs.open("data/models/big.bin", file) == SUCCESS);
+        vfs.unmountAll();
+        GEP_ASSERT(!vfs.exists("data/models/big.bin"));
+        GEP_ASSERT(file.getSize() == 70000 && file.getData()[69999] == makeData(70000, 3)[69999]);
+    }
+
+    // directories mounted later override archives and the other way round
+    createDirectory(overlayDirectory);
+    std::string overlayFile = std::string(overlayDirectory) + "/data/sounds";
+    createDirectory((std::string(overlayDirectory) + "/data").c_str());
+    createDirectory(overlayFile.c_str());
+    overlayFile += "/step.wav";
+    writeFile(overlayFile.c_str(), makeData(5, 5));
+    GEP_ASSERT(vfs.mountDirectory("vfs_test_missing_directory") == FAILURE);
+    GEP_ASSERT(vfs.mountArchive(pakFilename) == SUCCESS);
+    GEP_ASSERT(vfs.mountDirectory(overlayDirectory) == SUCCESS);
+    GEP_ASSERT(readVfsFile(vfs, "data/sounds/step.wav") == makeData(5, 5), "the directory does not override the archive");
+    GEP_ASSERT(readVfsFile(vfs, "data/textures/wall.dds") == makeData(1000, 1), "files which are not in the directory come from the archive");
+    {
+        RawFile file;
+        std::string diskPath;
+        GEP_ASSERT(vfs.openLoose("data/sounds/step.wav", file, "rb", diskPath) == SUCCESS, "the file in the directory was not opened");
+        GEP_ASSERT(diskPath == overlayFile && file.isOpen());
+        RawFile archived;
+        GEP_ASSERT(vfs.openLoose("data/textures/wall.dds", archived, "rb", diskPath) == FAILURE && !archived.isOpen(), "a file in an archive has no path on the disk");
+    }
+    GEP_ASSERT(vfs.mountArchive(pakFilename) == SUCCESS);
+    GEP_ASSERT(readVfsFile(vfs, "data/sounds/step.wav") == makeData(33, 2), "the archive does not override the directory");
+
+    vfs.unmountAll();
+    remove(overlayFile.c_str());
+    rmdir((std::string(overlayDirectory) + "/data/sounds").c_str());
+    rmdir((std::string(overlayDirectory) + "/data").c_str());
+    rmdir(overlayDirectory);
+    remove("vfs_test_loose.bin");
+    remove(pakFilename);
+}
+
+GEP_UNITTEST_TEST(Vfs, Chunkfile)
+{
+    // a chunkfile which only exists in an archive
+    {
+        Chunkfile file("vfs_test.thTest", Chunkfile::Operation::write);
+        file.startWriting("thTest", 1);
+        file.startWriteChunk("Values");
+        for(uint32 i = 0; i < 100; i++)
+            file.write(i);
+        file.endWriteChunk();
+        file.endWriting();
+    }
+    {
+        PakWriter writer;
+        writer.addFileFromDisk("data/test.thTest", "vfs_test.thTest");
+        GEP_ASSERT(writer.write(pakFilename) == SUCCESS);
+        remove("vfs_test.thTest");
+    }
+    GEP_ASSERT(g_vfs.mountArchive(pakFilename) == SUCCESS);
+    for(auto operation : { Chunkfile::Operation::read, Chunkfile::Operation::mapped })
+    {
+        Chunkfile file("data/test.thTest", operation);
+        GEP_ASSERT(file.isOpen(), "the chunkfile was not found in the archive");
+        GEP_ASSERT(file.verifyChecksums() == SUCCESS);
+        GEP_ASSERT(file.startReading("thTest") == SUCCESS);
+        GEP_ASSERT(file.startReadChunk() == SUCCESS && file.getCurrentChunkName() == "Values");
+        std::vector<uint32> values(100);
+        GEP_ASSERT(file.readArray(ArrayPtr<uint32>(values.data(), values.size())) == 100 * sizeof(uint32));
+        GEP_ASSERT(values[99] == 99, "wrong data", values[99]);
+        file.endReadChunk();
+        file.endReading();
+    }
+    g_vfs.unmountAll();
+    {
+        Chunkfile file("data/test.thTest", Chunkfile::Operation::read);
+        GEP_ASSERT(!file.isOpen(), "the chunkfile is still found after unmounting");
+    }
+    remove(pakFilename);
+}
+
+GEP_BENCHMARK(Vfs, OpenFromArchive)
+{
+    const uint32 numFiles = 10000;
+    {
+        PakWriter writer;
+        uint32 value = 0;
+        for(uint32 i = 0; i < numFiles; i++)
+        {
+            std::string path = "data/textures/texture" + std::to_string(i) + ".dds";
+            writer.addFile(path.c_str(), ArrayPtr<const uint8>(reinterpret_cast<const uint8*>(&value), sizeof(value)));
+        }
+        GEP_ASSERT(writer.write(pakFilename) == SUCCESS);
+    }
+    VirtualFileSystem vfs;
+    GEP_ASSERT(vfs.mountArchive(pakFilename) == SUCCESS);
+    std::vector<VfsPath> paths;
+    for(uint32 i = 0; i < numFiles; i += 97)
+        paths.push_back(VfsPath("data/textures/texture" + std::to_string(i) + ".dds"));
+    VfsFile file;
+    size_t next = 0;
+    while(state.keepRunning())
+    {
+        doNotOptimize(vfs.open(paths[next], file));
+        doNotOptimize(file.getData().getPtr());
+        next = (next + 1) % paths.size();
+    }
+    file.close();
+    vfs.unmountAll();
+    remove(pakFilename);
+}
+
+GEP_UNITTEST_TEST(Vfs, Prefetch)
+{
+    const char* filename = "vfs_test_prefetch.bin";
+    auto original = makeData(5000, 4);
+    writeFile(filename, original);
+    SCOPE_EXIT{ remove(filename); });
+
+    VirtualFileSystem vfs;
+    AsyncIo io;
+    std::vector<std::string> prefetched;
+    bool isDone = false;
+    vfs.prefetch(io, { "vfs_test_missing.bin", filename }, IoPriority::Normal, [&](const std::vector<std::string>& files)
+    {
+        prefetched = files;
+        isDone = true;
+    });
+    io.waitUntilIdle();
+    GEP_ASSERT(isDone, "the prefetch did not finish");
+    GEP_ASSERT(prefetched.size() == 1 && prefetched[0] == filename, "a missing file can not be prefetched");
+
+    // the second prefetch only takes another reference
+    uint32 numReads = io.getNumReadsIssued();
+    isDone = false;
+    vfs.prefetch(io, { filename }, IoPriority::Normal, [&](const std::vector<std::string>& files)
+    {
+        prefetched = files;
+        isDone = true;
+    });
+    io.waitUntilIdle();
+    GEP_ASSERT(isDone && prefetched.size() == 1);
+    GEP_ASSERT(io.getNumReadsIssued() == numReads, "a prefetched file was read again");
+
+    // opening the file now reads it from memory, changes on the disk do not show up anymore
+    writeFile(filename, makeData(5000, 5));
+    GEP_ASSERT(readVfsFile(vfs, filename) == original, "the file was not read from memory");
+    std::string diskPath;
+    GEP_ASSERT(!vfs.findLooseFile(filename, diskPath), "a prefetched file should not be streamed from the disk");
+
+    // the memory stays until every prefetch was released
+    vfs.releasePrefetched(filename);
+    GEP_ASSERT(readVfsFile(vfs, filename) == original);
+    vfs.releasePrefetched(filename);
+    GEP_ASSERT(readVfsFile(vfs, filename) == makeData(5000, 5), "the prefetched file was not released");
+    GEP_ASSERT(vfs.findLooseFile(filename, diskPath));
+}
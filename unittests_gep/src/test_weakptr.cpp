@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "gep/weakPtr.h"
 #include "gep/memory/allocators.h"
+#include <thread>
+#include <vector>
 
 using namespace gep;
 
@@ -71,3 +73,120 @@ GEP_UNITTEST_TEST(WeakPtr, WeakPtr)
     GEP_ASSERT(ptr2.get() == nullptr);
     GEP_ASSERT(ptr3.get() == nullptr);
 }
+
+GEP_UNITTEST_TEST(WeakPtr, GrowingTable)
+{
+    const size_t numObjects = 1000;
+    WeakRefTest* objects[numObjects];
+    WeakPtr<WeakRefTest> ptrs[numObjects];
+    for(size_t i = 0; i < numObjects; i++)
+    {
+        objects[i] = new WeakRefTest();
+        ptrs[i] = objects[i];
+    }
+
+    // growing the table must not move existing entries
+    for(size_t i = 0; i < numObjects; i++)
+    {
+        GEP_ASSERT(ptrs[i].get() == objects[i], "weak reference does not survive growing of the table", i);
+    }
+
+    for(size_t i = 0; i < numObjects; i += 2)
+    {
+        delete objects[i];
+    }
+
+    // reused slots must not make old references valid again
+    WeakRefTest* reused[numObjects / 2];
+    for(size_t i = 0; i < numObjects / 2; i++)
+    {
+        reused[i] = new WeakRefTest();
+    }
+    for(size_t i = 0; i < numObjects; i++)
+    {
+        if(i % 2 == 0)
+        {
+            GEP_ASSERT(ptrs[i].get() == nullptr, "reference to a deleted object became valid again", i);
+        }
+        else
+        {
+            GEP_ASSERT(ptrs[i].get() == objects[i], "reference to a alive object got invalid", i);
+        }
+    }
+
+    for(size_t i = 0; i < numObjects / 2; i++)
+    {
+        delete reused[i];
+        delete objects[i * 2 + 1];
+    }
+}
+
+GEP_UNITTEST_TEST(WeakPtr, SwapAndReplace)
+{
+    auto pA = new WeakRefTest();
+    auto pB = new WeakRefTest();
+    WeakPtr<WeakRefTest> refA(pA);
+    WeakPtr<WeakRefTest> refB(pB);
+
+    pA->swapPlaces(*pB);
+    GEP_ASSERT(refA.get() == pB, "swapPlaces did not redirect the reference");
+    GEP_ASSERT(refB.get() == pA, "swapPlaces did not redirect the reference");
+
+    // a handle with its own slot, initially pointing to a stand-in object
+    WeakPtr<WeakRefTest> handle;
+    handle.setWithNewIndex(pA);
+    GEP_ASSERT(handle.get() == pA);
+    GEP_ASSERT(handle.getWeakRefIndex() != refB.getWeakRefIndex(), "setWithNewIndex has to create a new slot");
+
+    auto pC = new WeakRefTest();
+    WeakPtr<WeakRefTest> refC(pC);
+    handle.invalidateAndReplace(pC);
+    GEP_ASSERT(handle.get() == pC, "invalidateAndReplace did not replace the object");
+    GEP_ASSERT(refC.get() == nullptr, "references to the old slot of the replacing object have to be invalidated");
+    GEP_ASSERT(refB.get() == pA, "the stand-in object must not be affected");
+
+    // a handle which is never replaced gives its slot back
+    uint32 numEntries = WeakRefTest::getNumWeakTableEntries();
+    WeakPtr<WeakRefTest> unreplaced;
+    unreplaced.setWithNewIndex(pB);
+    WeakPtr<WeakRefTest> unreplacedCopy = unreplaced;
+    GEP_ASSERT(WeakRefTest::getNumWeakTableEntries() == numEntries + 1);
+    unreplaced.releaseNewIndex();
+    GEP_ASSERT(WeakRefTest::getNumWeakTableEntries() == numEntries, "the slot was not released");
+    GEP_ASSERT(unreplaced.get() == nullptr && unreplacedCopy.get() == nullptr, "copies of a released reference have to be invalid");
+    GEP_ASSERT(refA.get() == pB, "the stand-in object must not be affected");
+
+    delete pC;
+    GEP_ASSERT(handle.get() == nullptr);
+    delete pA;
+    delete pB;
+    GEP_ASSERT(refA.get() == nullptr);
+    GEP_ASSERT(refB.get() == nullptr);
+}
+
+GEP_UNITTEST_TEST(WeakPtr, Multithreaded)
+{
+    const int numThreads = 4;
+    const int numIterations = 10000;
+    std::atomic<int> numErrors(0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < numThreads; t++)
+    {
+        threads.emplace_back([&]()
+        {
+            for(int i = 0; i < numIterations; i++)
+            {
+                auto pObject = new WeakRefTest();
+                WeakPtr<WeakRefTest> ref(pObject);
+                if(ref.get() != pObject)
+                    numErrors++;
+                delete pObject;
+                if(ref.get() != nullptr)
+                    numErrors++;
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    GEP_ASSERT(numErrors == 0, "weak references got mixed up between threads", numErrors.load());
+}
@@ -3,20 +3,90 @@
 
 #include "stdafx.h"
 #include "gep/unittest/unittestmanager.h"
+#include "gep/samplingprofiler.h"
+#include "gep/memory/allocationtrace.h"
+#include "gep/modelloader.h"
+#include "gep/exception.h"
 
 // implement new/delete
 #include "gep/memory/newdelete.inl"
 
+namespace
+{
+    /// \brief records the allocations of loading a model, for -allocreplay
+    ///
+    /// The extraction needs a renderer, traces of whole frames are recorded by the game with IUpdateFramework::recordAllocationTrace.
+    int recordAllocationTrace(const char* modelFile, const char* traceFile)
+    {
+        gep::AllocationTrace trace;
+        gep::ModelLoader loader;
+        g_stdAllocator.setTrace(&trace);
+        try
+        {
+            SCOPE_EXIT{ g_stdAllocator.setTrace(nullptr); });
+            loader.loadFile(modelFile, gep::ModelLoader::Load::Everything);
+        }
+        catch(gep::LoadingError& ex)
+        {
+            printf("Could not load the model %s: %s\n", modelFile, ex.what());
+            return -1;
+        }
+        if(trace.saveToFile(traceFile) != gep::SUCCESS)
+        {
+            printf("Could not save the allocation trace %s\n", traceFile);
+            return -1;
+        }
+        printf("Recorded %u allocation events of %s into %s\n", (unsigned int)trace.getEvents().size(), modelFile, traceFile);
+        return 0;
+    }
+}
+
 int main(int argc, const char* argv[])
 {
     bool doDebugBreaks = false;
     bool pause = false;
+    const char* sampleProfileFile = nullptr;
+    int sampleRate = 997;
+    bool runBenchmarks = false;
+    gep::BenchmarkSettings benchmarkSettings;
+    int numWorkers = 1;
+    float testTimeout = 60.0f;
+    const char* allocationTraceFile = nullptr;
+    int allocationThreads = 4;
+    const char* recordTraceFile = nullptr;
+    const char* recordTraceModel = "data/models/ball.thModel";
     for(int i=1; i<argc; i++)
     {
         if(!strcmp(argv[i], "-debugbreak"))
             doDebugBreaks = true;
         else if(!strcmp(argv[i], "-nopause"))
             pause = false;
+        else if(!strcmp(argv[i], "-sampleprofile") && i + 1 < argc)
+            sampleProfileFile = argv[++i];
+        else if(!strcmp(argv[i], "-samplerate") && i + 1 < argc)
+            sampleRate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+            numWorkers = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-timeout") && i + 1 < argc)
+            testTimeout = (float)atof(argv[++i]);
+        else if(!strcmp(argv[i], "-allocreplay") && i + 1 < argc)
+            allocationTraceFile = argv[++i];
+        else if(!strcmp(argv[i], "-allocthreads") && i + 1 < argc)
+            allocationThreads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-alloctrace") && i + 1 < argc)
+            recordTraceFile = argv[++i];
+        else if(!strcmp(argv[i], "-alloctracemodel") && i + 1 < argc)
+            recordTraceModel = argv[++i];
+        else if(!strcmp(argv[i], "-bench"))
+            runBenchmarks = true;
+        else if(!strcmp(argv[i], "-benchfilter") && i + 1 < argc)
+            benchmarkSettings.filter = argv[++i];
+        else if(!strcmp(argv[i], "-benchjson") && i + 1 < argc)
+            benchmarkSettings.jsonOutput = argv[++i];
+        else if(!strcmp(argv[i], "-benchbaseline") && i + 1 < argc)
+            benchmarkSettings.baseline = argv[++i];
+        else if(!strcmp(argv[i], "-benchthreshold") && i + 1 < argc)
+            benchmarkSettings.regressionThreshold = (float)atof(argv[++i]) / 100.0f;
         else
         {
             printf("Unkown command line option %s\n", argv[i]);
@@ -27,14 +97,44 @@ int main(int argc, const char* argv[])
     {
         doDebugBreaks = true;
     }
-    gep::UnittestManager::instance().setDoDebugBreaks(doDebugBreaks);
-    int numFailedTests = gep::UnittestManager::instance().runAllTests();
-    gep::UnittestManager::instance().destoryGlobalInstance();
+    if(sampleProfileFile != nullptr)
+    {
+        // the folded stacks are written by gep::destroy
+        if(sampleRate <= 0 || gep::SamplingProfiler::startUntilExit(sampleProfileFile, sampleRate) != gep::SUCCESS)
+            printf("Could not start the sampling profiler\n");
+    }
+    int result = 0;
+    if(recordTraceFile != nullptr)
+        result = recordAllocationTrace(recordTraceModel, recordTraceFile);
+    else if(allocationTraceFile != nullptr)
+    {
+        // compares the allocators on a trace recorded with gep::StdAllocator::setTrace instead of running the tests
+        gep::AllocationTrace trace;
+        if(allocationThreads <= 0 || trace.loadFromFile(allocationTraceFile) != gep::SUCCESS)
+        {
+            printf("Could not load the allocation trace %s\n", allocationTraceFile);
+            result = -1;
+        }
+        else
+            gep::AllocationReplay::compareAllocators(trace, allocationThreads);
+    }
+    else
+    {
+        gep::UnittestManager::instance().setDoDebugBreaks(doDebugBreaks);
+        if(runBenchmarks)
+            result = gep::UnittestManager::instance().runAllBenchmarks(benchmarkSettings);
+        else if(numWorkers > 1)
+            result = gep::UnittestManager::instance().runAllTestsParallel(numWorkers, testTimeout);
+        else
+            result = gep::UnittestManager::instance().runAllTests();
+        gep::UnittestManager::instance().destoryGlobalInstance();
+    }
 
+    // also writes the -sampleprofile output, whichever of the above ran
 	gep::destroy(); //Shutdown gep
 
     if(pause)
         system("pause");
-    return numFailedTests;
+    return result;
 }
 